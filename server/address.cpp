@@ -0,0 +1,318 @@
+#include "address.h"
+#include "future.h"
+#include "log.h"
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace ZnetServer {
+
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen) {
+    if(!addr) {
+        return nullptr;
+    }
+    switch(addr->sa_family) {
+    case AF_INET:
+        return std::make_shared<IPv4Address>(*(const sockaddr_in*)addr);
+    case AF_INET6:
+        return std::make_shared<IPv6Address>(*(const sockaddr_in6*)addr);
+    case AF_UNIX: {
+        UnixAddress::ptr ua = std::make_shared<UnixAddress>();
+        socklen_t len = std::min<socklen_t>(addrlen, sizeof(sockaddr_un));
+        memcpy(ua->getAddr(), addr, len);
+        ua->setAddrLen(len);
+        return ua;
+    }
+    default:
+        return std::make_shared<UnknownAddress>(addr, addrlen);
+    }
+}
+
+// 拆出主机和端口: "[v6]:port"、"host:port"，多个冒号的是不带端口的IPv6
+static void SplitHost(const std::string& host, std::string& node, std::string& service) {
+    if(!host.empty() && host[0] == '[') {
+        size_t end = host.find(']');
+        if(end != std::string::npos) {
+            node = host.substr(1, end - 1);
+            if(end + 1 < host.size() && host[end + 1] == ':') {
+                service = host.substr(end + 2);
+            }
+            return;
+        }
+    }
+    size_t colon = host.find(':');
+    if(colon != std::string::npos && host.find(':', colon + 1) == std::string::npos) {
+        node = host.substr(0, colon);
+        service = host.substr(colon + 1);
+        return;
+    }
+    node = host;
+}
+
+std::vector<Address::ptr> Address::Lookup(const std::string& host, int family,
+                                          int type, int protocol) {
+    std::vector<Address::ptr> result;
+    std::string node, service;
+    SplitHost(host, node, service);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = type;
+    hints.ai_protocol = protocol;
+    addrinfo* results = nullptr;
+    int error = Scheduler::Offload([&](){
+        return getaddrinfo(node.empty() ? nullptr : node.c_str(),
+                           service.empty() ? nullptr : service.c_str(), &hints, &results);
+    });
+    if(error) {
+        ZNS_LOG_ERROR(g_logger) << "Address::Lookup getaddrinfo(" << host << ", " << family << ", "
+            << type << ") error=" << error << " errstr=" << gai_strerror(error);
+        return result;
+    }
+    for(addrinfo* next = results; next; next = next->ai_next) {
+        result.push_back(Create(next->ai_addr, next->ai_addrlen));
+    }
+    freeaddrinfo(results);
+    return result;
+}
+
+Address::ptr Address::LookupAny(const std::string& host, int family, int type, int protocol) {
+    std::vector<Address::ptr> result = Lookup(host, family, type, protocol);
+    return result.empty() ? nullptr : result.front();
+}
+
+IPAddress::ptr Address::LookupAnyIPAddress(const std::string& host, int family,
+                                           int type, int protocol) {
+    for(auto& addr : Lookup(host, family, type, protocol)) {
+        IPAddress::ptr ip = std::dynamic_pointer_cast<IPAddress>(addr);
+        if(ip) {
+            return ip;
+        }
+    }
+    return nullptr;
+}
+
+int Address::getFamily() const {
+    return getAddr()->sa_family;
+}
+
+std::string Address::toString() const {
+    std::stringstream ss;
+    insert(ss);
+    return ss.str();
+}
+
+bool Address::operator<(const Address& rhs) const {
+    socklen_t minlen = std::min(getAddrLen(), rhs.getAddrLen());
+    int result = memcmp(getAddr(), rhs.getAddr(), minlen);
+    if(result) {
+        return result < 0;
+    }
+    return getAddrLen() < rhs.getAddrLen();
+}
+
+bool Address::operator==(const Address& rhs) const {
+    return getAddrLen() == rhs.getAddrLen()
+        && memcmp(getAddr(), rhs.getAddr(), getAddrLen()) == 0;
+}
+
+bool Address::operator!=(const Address& rhs) const {
+    return !(*this == rhs);
+}
+
+IPAddress::ptr IPAddress::Create(const char* address, uint16_t port) {
+    IPAddress::ptr ip = IPv4Address::Create(address, port);
+    if(!ip) {
+        ip = IPv6Address::Create(address, port);
+    }
+    return ip;
+}
+
+IPv4Address::ptr IPv4Address::Create(const char* address, uint16_t port) {
+    IPv4Address::ptr rt = std::make_shared<IPv4Address>(INADDR_ANY, port);
+    if(!address || inet_pton(AF_INET, address, &rt->m_addr.sin_addr) != 1) {
+        return nullptr;
+    }
+    return rt;
+}
+
+IPv4Address::IPv4Address(const sockaddr_in& address)
+    : m_addr(address) {
+}
+
+IPv4Address::IPv4Address(uint32_t address, uint16_t port) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin_family = AF_INET;
+    m_addr.sin_port = htons(port);
+    m_addr.sin_addr.s_addr = htonl(address);
+}
+
+const sockaddr* IPv4Address::getAddr() const {
+    return (const sockaddr*)&m_addr;
+}
+
+sockaddr* IPv4Address::getAddr() {
+    return (sockaddr*)&m_addr;
+}
+
+socklen_t IPv4Address::getAddrLen() const {
+    return sizeof(m_addr);
+}
+
+std::ostream& IPv4Address::insert(std::ostream& os) const {
+    char buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &m_addr.sin_addr, buf, sizeof(buf));
+    return os << buf << ":" << ntohs(m_addr.sin_port);
+}
+
+uint16_t IPv4Address::getPort() const {
+    return ntohs(m_addr.sin_port);
+}
+
+void IPv4Address::setPort(uint16_t port) {
+    m_addr.sin_port = htons(port);
+}
+
+IPv6Address::ptr IPv6Address::Create(const char* address, uint16_t port) {
+    IPv6Address::ptr rt = std::make_shared<IPv6Address>();
+    if(!address || inet_pton(AF_INET6, address, &rt->m_addr.sin6_addr) != 1) {
+        return nullptr;
+    }
+    rt->setPort(port);
+    return rt;
+}
+
+IPv6Address::IPv6Address() {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin6_family = AF_INET6;
+}
+
+IPv6Address::IPv6Address(const sockaddr_in6& address)
+    : m_addr(address) {
+}
+
+IPv6Address::IPv6Address(const uint8_t address[16], uint16_t port) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin6_family = AF_INET6;
+    m_addr.sin6_port = htons(port);
+    memcpy(&m_addr.sin6_addr.s6_addr, address, 16);
+}
+
+const sockaddr* IPv6Address::getAddr() const {
+    return (const sockaddr*)&m_addr;
+}
+
+sockaddr* IPv6Address::getAddr() {
+    return (sockaddr*)&m_addr;
+}
+
+socklen_t IPv6Address::getAddrLen() const {
+    return sizeof(m_addr);
+}
+
+std::ostream& IPv6Address::insert(std::ostream& os) const {
+    char buf[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, &m_addr.sin6_addr, buf, sizeof(buf));
+    return os << "[" << buf << "]:" << ntohs(m_addr.sin6_port);
+}
+
+uint16_t IPv6Address::getPort() const {
+    return ntohs(m_addr.sin6_port);
+}
+
+void IPv6Address::setPort(uint16_t port) {
+    m_addr.sin6_port = htons(port);
+}
+
+static const size_t MAX_PATH_LEN = sizeof(((sockaddr_un*)0)->sun_path) - 1;
+
+UnixAddress::UnixAddress() {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sun_family = AF_UNIX;
+    m_length = offsetof(sockaddr_un, sun_path) + MAX_PATH_LEN;
+}
+
+UnixAddress::UnixAddress(const std::string& path) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sun_family = AF_UNIX;
+    // 普通路径带上结尾的'\0'，抽象地址的长度就是名字本身
+    m_length = path.size() + (path.empty() || path[0] != '\0');
+    if(m_length > sizeof(m_addr.sun_path)) {
+        throw std::invalid_argument("UnixAddress path too long: " + path);
+    }
+    memcpy(m_addr.sun_path, path.c_str(), path.size());
+    m_length += offsetof(sockaddr_un, sun_path);
+}
+
+const sockaddr* UnixAddress::getAddr() const {
+    return (const sockaddr*)&m_addr;
+}
+
+sockaddr* UnixAddress::getAddr() {
+    return (sockaddr*)&m_addr;
+}
+
+socklen_t UnixAddress::getAddrLen() const {
+    return m_length;
+}
+
+std::string UnixAddress::getPath() const {
+    size_t offset = offsetof(sockaddr_un, sun_path);
+    if(m_length <= offset) {
+        return "";
+    }
+    size_t len = m_length - offset;
+    if(m_addr.sun_path[0] == '\0') {
+        return std::string(m_addr.sun_path, len);
+    }
+    return std::string(m_addr.sun_path, strnlen(m_addr.sun_path, len));
+}
+
+std::ostream& UnixAddress::insert(std::ostream& os) const {
+    std::string path = getPath();
+    if(!path.empty() && path[0] == '\0') {
+        return os << "\\0" << path.substr(1);
+    }
+    return os << path;
+}
+
+UnknownAddress::UnknownAddress(int family) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.ss_family = family;
+    m_length = sizeof(m_addr);
+}
+
+UnknownAddress::UnknownAddress(const sockaddr* addr, socklen_t addrlen) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_length = std::min<socklen_t>(addrlen, sizeof(m_addr));
+    memcpy(&m_addr, addr, m_length);
+}
+
+const sockaddr* UnknownAddress::getAddr() const {
+    return (const sockaddr*)&m_addr;
+}
+
+sockaddr* UnknownAddress::getAddr() {
+    return (sockaddr*)&m_addr;
+}
+
+socklen_t UnknownAddress::getAddrLen() const {
+    return m_length;
+}
+
+std::ostream& UnknownAddress::insert(std::ostream& os) const {
+    return os << "[UnknownAddress family=" << m_addr.ss_family << "]";
+}
+
+std::ostream& operator<<(std::ostream& os, const Address& addr) {
+    return addr.insert(os);
+}
+
+}
@@ -0,0 +1,193 @@
+#ifndef __ZNS_ADDRESS_H__
+#define __ZNS_ADDRESS_H__
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+namespace ZnetServer {
+
+class IPAddress;
+
+/**
+ * @brief socket地址的基类
+ * @details 子类IPv4Address、IPv6Address、UnixAddress包装对应的sockaddr，
+ *          不认识的地址族用UnknownAddress保存原样
+ */
+class Address {
+public:
+    typedef std::shared_ptr<Address> ptr;
+
+    /**
+     * @brief 按sockaddr的地址族创建对应的子类
+     * @return addr为空时返回nullptr
+     */
+    static Address::ptr Create(const sockaddr* addr, socklen_t addrlen);
+
+    /**
+     * @brief 解析主机名
+     * @param[in] host "www.example.com"、"www.example.com:80"、"1.2.3.4:80"、"[::1]:80"或"::1"，
+     *            不带端口时端口为0，端口也可以是服务名("http")
+     * @param[in] family AF_INET、AF_INET6或AF_UNSPEC
+     * @param[in] type SOCK_STREAM、SOCK_DGRAM，0表示不限
+     * @return 所有结果，失败时为空(错误记日志)
+     * @details getaddrinfo会阻塞，在调度器的工作协程里通过Scheduler::Offload放到阻塞线程池执行
+     */
+    static std::vector<Address::ptr> Lookup(const std::string& host, int family = AF_INET,
+                                            int type = 0, int protocol = 0);
+
+    /**
+     * @brief 解析主机名，返回第一个结果，失败时返回nullptr
+     */
+    static Address::ptr LookupAny(const std::string& host, int family = AF_INET,
+                                  int type = 0, int protocol = 0);
+
+    /**
+     * @brief 解析主机名，返回第一个IP地址，失败时返回nullptr
+     */
+    static std::shared_ptr<IPAddress> LookupAnyIPAddress(const std::string& host,
+                                                         int family = AF_INET,
+                                                         int type = 0, int protocol = 0);
+
+    virtual ~Address() {}
+
+    int getFamily() const;
+    virtual const sockaddr* getAddr() const = 0;
+    virtual sockaddr* getAddr() = 0;
+    virtual socklen_t getAddrLen() const = 0;
+
+    virtual std::ostream& insert(std::ostream& os) const = 0;
+    std::string toString() const;
+
+    bool operator<(const Address& rhs) const;
+    bool operator==(const Address& rhs) const;
+    bool operator!=(const Address& rhs) const;
+};
+
+/**
+ * @brief IP地址
+ */
+class IPAddress : public Address {
+public:
+    typedef std::shared_ptr<IPAddress> ptr;
+
+    /**
+     * @brief 由数字形式的IPv4或IPv6地址创建，不做域名解析
+     * @return 格式不对时返回nullptr
+     */
+    static IPAddress::ptr Create(const char* address, uint16_t port = 0);
+
+    virtual uint16_t getPort() const = 0;
+    virtual void setPort(uint16_t port) = 0;
+};
+
+class IPv4Address : public IPAddress {
+public:
+    typedef std::shared_ptr<IPv4Address> ptr;
+
+    /**
+     * @brief 由点分十进制地址创建，格式不对时返回nullptr
+     */
+    static IPv4Address::ptr Create(const char* address, uint16_t port = 0);
+
+    explicit IPv4Address(const sockaddr_in& address);
+    /**
+     * @param[in] address 主机字节序
+     */
+    explicit IPv4Address(uint32_t address = INADDR_ANY, uint16_t port = 0);
+
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    std::ostream& insert(std::ostream& os) const override;
+
+    uint16_t getPort() const override;
+    void setPort(uint16_t port) override;
+private:
+    sockaddr_in m_addr;
+};
+
+class IPv6Address : public IPAddress {
+public:
+    typedef std::shared_ptr<IPv6Address> ptr;
+
+    /**
+     * @brief 由冒号十六进制地址创建，格式不对时返回nullptr
+     */
+    static IPv6Address::ptr Create(const char* address, uint16_t port = 0);
+
+    IPv6Address();
+    explicit IPv6Address(const sockaddr_in6& address);
+    /**
+     * @param[in] address 16字节，网络字节序
+     */
+    IPv6Address(const uint8_t address[16], uint16_t port = 0);
+
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    std::ostream& insert(std::ostream& os) const override;
+
+    uint16_t getPort() const override;
+    void setPort(uint16_t port) override;
+private:
+    sockaddr_in6 m_addr;
+};
+
+/**
+ * @brief Unix域socket地址
+ * @details 路径以'\0'开头时是抽象命名空间的地址，不在文件系统里创建文件
+ */
+class UnixAddress : public Address {
+public:
+    typedef std::shared_ptr<UnixAddress> ptr;
+
+    /**
+     * @brief 空地址，用作accept/recvfrom的输出
+     */
+    UnixAddress();
+    /**
+     * @details 路径超过sun_path的长度时抛出std::invalid_argument
+     */
+    explicit UnixAddress(const std::string& path);
+
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    void setAddrLen(socklen_t len) { m_length = len; }
+    std::string getPath() const;
+    std::ostream& insert(std::ostream& os) const override;
+private:
+    sockaddr_un m_addr;
+    socklen_t m_length;
+};
+
+/**
+ * @brief 不认识的地址族
+ */
+class UnknownAddress : public Address {
+public:
+    typedef std::shared_ptr<UnknownAddress> ptr;
+
+    explicit UnknownAddress(int family);
+    UnknownAddress(const sockaddr* addr, socklen_t addrlen);
+
+    const sockaddr* getAddr() const override;
+    sockaddr* getAddr() override;
+    socklen_t getAddrLen() const override;
+    std::ostream& insert(std::ostream& os) const override;
+private:
+    sockaddr_storage m_addr;
+    socklen_t m_length;
+};
+
+std::ostream& operator<<(std::ostream& os, const Address& addr);
+
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include "blocking_pool.h"
+#include "fiber_event.h"
+#include "config.h"
+#include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace ZnetServer {
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_min_threads =
+    Config::Create<uint32_t>("blocking_pool.min_threads", 0, "blocking pool threads kept alive when idle");
+
+static ConfigVar<uint32_t>::ptr g_max_threads =
+    Config::Create<uint32_t>("blocking_pool.max_threads", 64, "upper bound of blocking pool threads");
+
+static ConfigVar<uint32_t>::ptr g_queue_size =
+    Config::Create<uint32_t>("blocking_pool.queue_size", 1024,
+        "queued blocking tasks before submitters have to wait");
+
+static ConfigVar<uint32_t>::ptr g_keepalive_ms =
+    Config::Create<uint32_t>("blocking_pool.keepalive_ms", 10000,
+        "idle time before a blocking pool thread above min_threads exits");
+
+BlockingPool::BlockingPool(const std::string& name, uint32_t min_threads, uint32_t max_threads,
+                           uint32_t queue_size, uint32_t keepalive_ms)
+    : m_name(name)
+    , m_minThreads(min_threads)
+    , m_maxThreads(max_threads)
+    , m_queueSize(queue_size)
+    , m_keepaliveMs(keepalive_ms) {
+    if(!max_threads || min_threads > max_threads || !queue_size) {
+        throw std::logic_error("BlockingPool invalid thread or queue limits");
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    try {
+        for(uint32_t i = 0; i < m_minThreads; ++i) {
+            spawn();
+        }
+    } catch(...) {
+        // 已经起来的线程引用着this，等它们退出再抛出
+        m_stopping = true;
+        m_cond.notify_all();
+        m_exitCond.wait(lock, [this](){ return m_threads == 0; });
+        throw;
+    }
+}
+
+BlockingPool::~BlockingPool() {
+    std::deque<FiberEvent*> full;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    full.swap(m_full);
+    m_cond.notify_all();
+    m_exitCond.wait(lock, [this](){ return m_threads == 0; });
+    lock.unlock();
+    // 等位置的提交方醒来后看到m_stopping抛异常
+    for(FiberEvent* e : full) {
+        e->set();
+    }
+    // 它们醒来后还要拿m_mutex，全部离开submit之后才能析构
+    lock.lock();
+    m_exitCond.wait(lock, [this](){ return m_fullWaiters == 0; });
+}
+
+BlockingPool* BlockingPool::GetInstance() {
+    static BlockingPool* s_instance = [](){
+        uint32_t max_threads = std::max<uint32_t>(1, g_max_threads->getValue());
+        uint32_t min_threads = std::min(g_min_threads->getValue(), max_threads);
+        return new BlockingPool("blocking", min_threads, max_threads,
+                                std::max<uint32_t>(1, g_queue_size->getValue()),
+                                g_keepalive_ms->getValue());
+    }();
+    return s_instance;
+}
+
+void BlockingPool::spawn() {
+    // 持有m_mutex调用，新线程拿到锁时已经登记好
+    uint32_t id = m_serial++;
+    ++m_threads;
+    try {
+        m_threadObjs[id].reset(new Thread(m_name + "_" + std::to_string(id), [this, id](){ run(id); }));
+    } catch(...) {
+        m_threadObjs.erase(id);
+        --m_threads;
+        throw;
+    }
+}
+
+void BlockingPool::submit(Callable cb) {
+    if(!cb) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(m_queue.size() >= m_queueSize && !m_stopping) {
+        // 共享栈协程挂起后栈内存归别的协程使用，取任务的线程不能再写，事件放到堆上
+        std::unique_ptr<FiberEvent> full(new FiberEvent);
+        m_full.push_back(full.get());
+        ++m_fullWaits;
+        ++m_fullWaiters;
+        lock.unlock();
+        full->wait();
+        lock.lock();
+        if(--m_fullWaiters == 0 && m_stopping) {
+            // 析构在等最后一个提交方，要等这里抛出异常放开锁之后才能继续
+            m_exitCond.notify_all();
+        }
+    }
+    if(m_stopping) {
+        throw std::logic_error("BlockingPool::submit on a stopping pool");
+    }
+    m_queue.push_back(std::move(cb));
+    // 每个排队的任务都有一个空闲线程对应时只唤醒，否则加线程
+    if(m_queue.size() <= m_idle || m_threads >= m_maxThreads) {
+        m_cond.notify_one();
+        return;
+    }
+    try {
+        spawn();
+    } catch(const std::exception& e) {
+        // 任务留在队列里，由现有的线程执行
+        ZNS_LOG_ERROR(g_logger) << "BlockingPool " << m_name << " spawn thread failed: " << e.what();
+        if(!m_threads) {
+            m_queue.pop_back();
+            throw;
+        }
+    }
+}
+
+void BlockingPool::run(uint32_t id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true) {
+        if(m_queue.empty()) {
+            if(m_stopping) {
+                break;
+            }
+            ++m_idle;
+            bool timeout = false;
+            if(m_threads <= m_minThreads) {
+                m_cond.wait(lock);
+            } else {
+                timeout = m_cond.wait_for(lock, std::chrono::milliseconds(m_keepaliveMs))
+                    == std::cv_status::timeout;
+            }
+            --m_idle;
+            if(timeout && m_queue.empty() && m_threads > m_minThreads) {
+                break;
+            }
+            continue;
+        }
+        Callable cb = std::move(m_queue.front());
+        m_queue.pop_front();
+        FiberEvent* full = nullptr;
+        if(!m_full.empty()) {
+            full = m_full.front();
+            m_full.pop_front();
+        }
+        lock.unlock();
+        if(full) {
+            full->set();
+        }
+        try {
+            cb();
+        } catch(const std::exception& e) {
+            ZNS_LOG_ERROR(g_logger) << "BlockingPool " << m_name << " task exception: " << e.what();
+        } catch(...) {
+            ZNS_LOG_ERROR(g_logger) << "BlockingPool " << m_name << " task exception";
+        }
+        // 回调捕获的对象在锁外析构
+        cb.reset();
+        lock.lock();
+    }
+    // 退出的线程自己释放线程对象(detach)，之后不再访问this
+    Thread::ptr self = std::move(m_threadObjs[id]);
+    m_threadObjs.erase(id);
+    --m_threads;
+    m_exitCond.notify_all();
+    lock.unlock();
+}
+
+size_t BlockingPool::getThreadCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_threads;
+}
+
+size_t BlockingPool::getIdleCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle;
+}
+
+size_t BlockingPool::getQueueSize() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+uint64_t BlockingPool::getFullWaits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_fullWaits;
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef __ZNS_BLOCKING_POOL_H__
+#define __ZNS_BLOCKING_POOL_H__
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+#include "callable.h"
+#include "thread.h"
+
+namespace ZnetServer {
+
+class FiberEvent;
+
+/**
+ * @brief 执行阻塞调用的弹性线程池，通常通过Scheduler::Offload使用
+ * @details 常驻min_threads个线程。提交时空闲线程不够就新建，最多max_threads个；
+ *          多出来的线程空闲keepalive_ms之后退出。
+ *          排队的任务最多queue_size个，满了之后提交方等到有任务被取走:
+ *          在调度器的工作协程里只Park当前协程，在普通线程上阻塞
+ */
+class BlockingPool {
+public:
+    BlockingPool(const std::string& name, uint32_t min_threads, uint32_t max_threads,
+                 uint32_t queue_size, uint32_t keepalive_ms);
+    /**
+     * @brief 执行完已经排队的任务，等所有线程退出
+     */
+    ~BlockingPool();
+
+    /**
+     * @brief 全局实例，第一次使用时按blocking_pool.*配置创建，从不析构
+     */
+    static BlockingPool* GetInstance();
+
+    /**
+     * @brief 提交一个回调，队列满时等待
+     * @details 回调抛出的异常记日志后忽略，需要结果时用Scheduler::Offload
+     */
+    void submit(Callable cb);
+
+    size_t getThreadCount() const;
+    size_t getIdleCount() const;
+    size_t getQueueSize() const;
+    /**
+     * @brief 提交时因为队列满而等待的次数
+     */
+    uint64_t getFullWaits() const;
+private:
+    void spawn();
+    void run(uint32_t id);
+private:
+    std::string m_name;
+    uint32_t m_minThreads;
+    uint32_t m_maxThreads;
+    uint32_t m_queueSize;
+    uint32_t m_keepaliveMs;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;     // 线程等任务
+    std::condition_variable m_exitCond; // 析构等线程和等位置的提交方退出
+    std::deque<Callable> m_queue;
+    std::deque<FiberEvent*> m_full;     // 等队列腾出位置的提交方，先来先醒
+    std::unordered_map<uint32_t, Thread::ptr> m_threadObjs;
+    uint32_t m_threads = 0;
+    uint32_t m_idle = 0;                // 在等任务的线程数，包括已经被唤醒还没拿到锁的
+    uint32_t m_serial = 0;              // 线程名的编号
+    uint64_t m_fullWaits = 0;
+    uint32_t m_fullWaiters = 0;         // 正在等位置的提交方，包括已经被唤醒还没拿到锁的
+    bool m_stopping = false;
+};
+
+}
+
+#endif
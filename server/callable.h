@@ -0,0 +1,185 @@
+#ifndef __ZNS_CALLABLE_H__
+#define __ZNS_CALLABLE_H__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <typeinfo>
+
+namespace ZnetServer {
+
+/**
+ * @brief 只可移动的 void() 可调用对象，带小缓冲区优化
+ * @details 不超过INLINE_SIZE字节、移动不抛异常的可调用对象直接存放在对象内部，
+ *          不分配堆内存；更大的退回到堆上。和std::function不同，
+ *          可以装只可移动的lambda(例如捕获了unique_ptr)。
+ *          可以从std::function隐式构造，空的std::function得到空的Callable。
+ */
+class Callable {
+public:
+    static const size_t INLINE_SIZE = 6 * sizeof(void*);
+
+    Callable() {}
+    Callable(std::nullptr_t) {}
+
+    template<class F,
+             class D = typename std::decay<F>::type,
+             class = typename std::enable_if<!std::is_same<D, Callable>::value>::type,
+             class = decltype(std::declval<D&>()())>
+    Callable(F&& f) {
+        if(IsNull(f)) {
+            return;
+        }
+        construct<D>(std::forward<F>(f), std::integral_constant<bool, FitsInline<D>::value>());
+    }
+
+    Callable(Callable&& other) {
+        moveFrom(other);
+    }
+
+    Callable& operator=(Callable&& other) {
+        if(this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Callable& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    ~Callable() {
+        reset();
+    }
+
+    Callable(const Callable&) = delete;
+    Callable& operator=(const Callable&) = delete;
+
+    void operator()() {
+        if(!m_ops) {
+            throw std::bad_function_call();
+        }
+        m_ops->invoke(&m_storage);
+    }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    /**
+     * @brief 装着的可调用对象的类型，std::function取其内部目标的类型，空时为void
+     */
+    const std::type_info& targetType() const {
+        return m_ops ? m_ops->type(&m_storage) : typeid(void);
+    }
+
+    void reset() {
+        if(m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+private:
+    typedef typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type Storage;
+
+    struct Ops {
+        void (*invoke)(Storage* s);
+        // 从src移动构造到dst，并析构src
+        void (*relocate)(Storage* dst, Storage* src);
+        void (*destroy)(Storage* s);
+        const std::type_info& (*type)(const Storage* s);
+    };
+
+    template<class D>
+    struct FitsInline {
+        static const bool value = sizeof(D) <= INLINE_SIZE
+            && alignof(D) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<D>::value;
+    };
+
+    template<class D>
+    struct InlineOps {
+        static D* get(Storage* s) { return reinterpret_cast<D*>(s); }
+        static void invoke(Storage* s) { (*get(s))(); }
+        static void relocate(Storage* dst, Storage* src) {
+            ::new (dst) D(std::move(*get(src)));
+            get(src)->~D();
+        }
+        static void destroy(Storage* s) { get(s)->~D(); }
+        static const std::type_info& type(const Storage* s) {
+            return TargetType(*reinterpret_cast<const D*>(s));
+        }
+        static const Ops ops;
+    };
+
+    template<class D>
+    struct HeapOps {
+        static D*& get(Storage* s) { return *reinterpret_cast<D**>(s); }
+        static void invoke(Storage* s) { (*get(s))(); }
+        static void relocate(Storage* dst, Storage* src) {
+            *reinterpret_cast<D**>(dst) = get(src);
+        }
+        static void destroy(Storage* s) { delete get(s); }
+        static const std::type_info& type(const Storage* s) {
+            return TargetType(**reinterpret_cast<D* const*>(s));
+        }
+        static const Ops ops;
+    };
+
+    template<class D, class F>
+    void construct(F&& f, std::true_type) {
+        ::new (&m_storage) D(std::forward<F>(f));
+        m_ops = &InlineOps<D>::ops;
+    }
+
+    template<class D, class F>
+    void construct(F&& f, std::false_type) {
+        *reinterpret_cast<D**>(&m_storage) = new D(std::forward<F>(f));
+        m_ops = &HeapOps<D>::ops;
+    }
+
+    void moveFrom(Callable& other) {
+        if(other.m_ops) {
+            other.m_ops->relocate(&m_storage, &other.m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    template<class F>
+    static bool IsNull(const F&) { return false; }
+    template<class R, class... Args>
+    static bool IsNull(const std::function<R(Args...)>& f) { return !f; }
+    template<class R, class... Args>
+    static bool IsNull(R (* const& f)(Args...)) { return f == nullptr; }
+
+    template<class F>
+    static const std::type_info& TargetType(const F&) { return typeid(F); }
+    template<class R, class... Args>
+    static const std::type_info& TargetType(const std::function<R(Args...)>& f) { return f.target_type(); }
+private:
+    const Ops* m_ops = nullptr;
+    Storage m_storage;
+};
+
+template<class D>
+const Callable::Ops Callable::InlineOps<D>::ops = {
+    &Callable::InlineOps<D>::invoke,
+    &Callable::InlineOps<D>::relocate,
+    &Callable::InlineOps<D>::destroy,
+    &Callable::InlineOps<D>::type
+};
+
+template<class D>
+const Callable::Ops Callable::HeapOps<D>::ops = {
+    &Callable::HeapOps<D>::invoke,
+    &Callable::HeapOps<D>::relocate,
+    &Callable::HeapOps<D>::destroy,
+    &Callable::HeapOps<D>::type
+};
+
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include "channel.h"
+#include "fiber.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace ZnetServer {
+namespace detail {
+
+void ChannelBase::enqueue(ChannelWaiter* w, bool send) {
+    WaitQueue& q = send ? m_senders : m_receivers;
+    w->prev = q.tail;
+    w->next = nullptr;
+    if(q.tail) {
+        q.tail->next = w;
+    } else {
+        q.head = w;
+    }
+    q.tail = w;
+    w->linked = true;
+    q.count.fetch_add(1);
+}
+
+void ChannelBase::dequeue(ChannelWaiter* w, bool send) {
+    WaitQueue& q = send ? m_senders : m_receivers;
+    if(w->prev) {
+        w->prev->next = w->next;
+    } else {
+        q.head = w->next;
+    }
+    if(w->next) {
+        w->next->prev = w->prev;
+    } else {
+        q.tail = w->prev;
+    }
+    w->prev = w->next = nullptr;
+    w->linked = false;
+    q.count.fetch_sub(1);
+}
+
+ChannelWaiter* ChannelBase::popWaiter(bool senders) {
+    WaitQueue& q = senders ? m_senders : m_receivers;
+    while(q.head) {
+        ChannelWaiter* w = q.head;
+        dequeue(w, senders);
+        int expected = -1;
+        if(w->sel->fired.compare_exchange_strong(expected, w->index)) {
+            return w;
+        }
+        // 它所在的select已经由别的分支完成，醒来后自己清理其余节点
+    }
+    return nullptr;
+}
+
+void ChannelBase::notify(bool senders) {
+    WaitQueue& q = senders ? m_senders : m_receivers;
+    // 和SelectWait登记之后的复查配对: 要么这里看到等待者，要么对方复查时看到这次收发的结果
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!q.count.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ChannelWaiter* w;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        w = popWaiter(senders);
+    }
+    if(w) {
+        w->sel->event.set();
+    }
+}
+
+void ChannelBase::close() {
+    std::vector<ChannelWaiter*> woken;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_closed.load(std::memory_order_relaxed)) {
+            throw std::logic_error("close of closed channel");
+        }
+        m_closed.store(true, std::memory_order_release);
+        markClosed();
+        for(int senders = 0; senders < 2; ++senders) {
+            while(ChannelWaiter* w = popWaiter(senders)) {
+                w->sel->ok = false;
+                woken.push_back(w);
+            }
+        }
+    }
+    for(ChannelWaiter* w : woken) {
+        w->sel->event.set();
+    }
+}
+
+bool ChannelBase::blockOp(void* value, bool send) {
+    ChannelCase c = {this, value, send};
+    bool ok = false;
+    SelectWait(&c, 1, true, ok);
+    return ok;
+}
+
+ChannelBase::Status ChannelBase::tryOp(void* value, bool send) {
+    ChannelCase c = {this, value, send};
+    bool ok = false;
+    if(SelectWait(&c, 1, false, ok) < 0) {
+        return WOULD_BLOCK;
+    }
+    return ok ? OK : CLOSED;
+}
+
+// 常见的分支数用栈上的数组，多了再分配
+template<class T, size_t N>
+class SmallArray {
+public:
+    explicit SmallArray(size_t n) {
+        if(n > N) {
+            m_heap.resize(n);
+            m_data = m_heap.data();
+        }
+    }
+    T& operator[](size_t i) { return m_data[i]; }
+    T* data() { return m_data; }
+private:
+    T m_local[N];
+    std::vector<T> m_heap;
+    T* m_data = m_local;
+};
+
+static thread_local uint32_t t_selectRotate = 0;
+
+int SelectWait(ChannelCase* cases, size_t n, bool block, bool& ok) {
+    if(!n) {
+        if(!block) {
+            return -1;
+        }
+        throw std::logic_error("select without cases would block forever");
+    }
+    // 按地址排序去重，所有select以同样的顺序加锁
+    SmallArray<ChannelBase*, 4> chans(n);
+    for(size_t i = 0; i < n; ++i) {
+        chans[i] = cases[i].ch;
+    }
+    std::sort(chans.data(), chans.data() + n);
+    size_t nchans = std::unique(chans.data(), chans.data() + n) - chans.data();
+    auto lock_all = [&](){
+        for(size_t i = 0; i < nchans; ++i) {
+            chans[i]->m_mutex.lock();
+        }
+    };
+    auto unlock_all = [&](){
+        for(size_t i = nchans; i > 0; --i) {
+            chans[i - 1]->m_mutex.unlock();
+        }
+    };
+
+    size_t start = t_selectRotate++ % n;
+    int hint = -1; // 被缓冲通道唤醒的分支，重试时先试它
+    lock_all();
+    while(true) {
+        int done = -1;
+        ChannelBase::Status status = ChannelBase::WOULD_BLOCK;
+        ChannelWaiter* peer = nullptr;
+        for(size_t k = 0; k <= n && done < 0; ++k) {
+            int i;
+            if(k == 0) {
+                if(hint < 0) {
+                    continue;
+                }
+                i = hint;
+            } else {
+                i = (int)((start + k - 1) % n);
+                if(i == hint) {
+                    continue;
+                }
+            }
+            status = cases[i].ch->poll(cases[i].value, cases[i].send, &peer);
+            if(status != ChannelBase::WOULD_BLOCK) {
+                done = i;
+            }
+        }
+        if(done >= 0) {
+            unlock_all();
+            ChannelCase& c = cases[done];
+            if(peer) {
+                peer->sel->event.set();
+            } else if(status == ChannelBase::OK) {
+                c.ch->notify(!c.send);
+            }
+            if(hint >= 0 && hint != done) {
+                // 唤醒是给hint分支的，没用上就让给同一队列的下一个等待者
+                cases[hint].ch->notify(cases[hint].send);
+            }
+            ok = status == ChannelBase::OK;
+            return done;
+        }
+        if(!block) {
+            unlock_all();
+            return -1;
+        }
+        // 对方直接读写挂起方栈上的sel、waiters和收发的值，共享栈协程挂起后这些地址归别的协程使用
+        if(Fiber::GetThis()->isSharedStack()) {
+            unlock_all();
+            throw std::logic_error("channel operation would block in a shared stack fiber");
+        }
+
+        ChannelSelect sel;
+        SmallArray<ChannelWaiter, 4> waiters(n);
+        for(size_t i = 0; i < n; ++i) {
+            waiters[i].sel = &sel;
+            waiters[i].index = (int)i;
+            waiters[i].value = cases[i].value;
+            cases[i].ch->enqueue(&waiters[i], cases[i].send);
+        }
+        // 缓冲通道的收发不加锁，登记之后复查一次，和notify里的屏障配对
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ready = false;
+        for(size_t i = 0; i < n && !ready; ++i) {
+            ChannelBase* ch = cases[i].ch;
+            ready = ch->m_capacity && ch->ready(cases[i].send);
+        }
+        if(!ready) {
+            unlock_all();
+            sel.event.wait();
+            lock_all();
+        }
+        for(size_t i = 0; i < n; ++i) {
+            if(waiters[i].linked) {
+                cases[i].ch->dequeue(&waiters[i], cases[i].send);
+            }
+        }
+        if(ready) {
+            // 持有所有锁，没有人能抢到sel，直接重试
+            continue;
+        }
+        int fired = sel.fired.load();
+        if(!cases[fired].ch->m_capacity) {
+            // 不带缓冲的交接已经由对方完成，或者通道关闭
+            unlock_all();
+            ok = sel.ok;
+            return fired;
+        }
+        hint = fired;
+    }
+}
+
+}
+}
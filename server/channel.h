@@ -0,0 +1,445 @@
+#ifndef __ZNS_CHANNEL_H__
+#define __ZNS_CHANNEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <type_traits>
+#include <utility>
+
+#include "fiber_event.h"
+
+namespace ZnetServer {
+
+template<class T> class Channel;
+class Select;
+
+namespace detail {
+
+// 一次阻塞的收发或select，各个通道上的等待者共享
+struct ChannelSelect {
+    std::atomic<int> fired {-1}; // 抢到它的分支下标，只能被抢一次
+    bool ok = false;             // 不带缓冲的交接完成为true，通道关闭为false
+    FiberEvent event;
+};
+
+// 挂在通道等待队列上的节点，在等待方的栈上
+struct ChannelWaiter {
+    ChannelWaiter* prev = nullptr;
+    ChannelWaiter* next = nullptr;
+    ChannelSelect* sel = nullptr;
+    int index = 0;
+    void* value = nullptr; // 发送方是源对象，接收方是目标对象
+    bool linked = false;
+};
+
+class ChannelBase;
+
+struct ChannelCase {
+    ChannelBase* ch;
+    void* value;
+    bool send;
+};
+
+/**
+ * @brief select的实现，单个通道的阻塞收发也走这里
+ * @details 按地址顺序锁住涉及的通道，先找能立即完成的分支；
+ *          block为false时没有就返回-1，否则在每个通道上登记等待者后挂起
+ */
+int SelectWait(ChannelCase* cases, size_t n, bool block, bool& ok);
+
+/**
+ * @brief Channel中与元素类型无关的部分: 等待队列、唤醒和关闭
+ */
+class ChannelBase {
+public:
+    enum Status {
+        OK = 0,
+        WOULD_BLOCK,
+        CLOSED
+    };
+
+    explicit ChannelBase(size_t capacity) : m_capacity(capacity) {}
+    virtual ~ChannelBase() {}
+    ChannelBase(const ChannelBase&) = delete;
+    ChannelBase& operator=(const ChannelBase&) = delete;
+
+    size_t capacity() const { return m_capacity; }
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 关闭通道，唤醒所有等待的收发方
+     * @details 之后send返回false；recv取完已缓冲的元素后返回false。
+     *          重复关闭抛出std::logic_error
+     */
+    void close();
+protected:
+    struct WaitQueue {
+        ChannelWaiter* head = nullptr;
+        ChannelWaiter* tail = nullptr;
+        std::atomic<size_t> count {0};
+    };
+
+    // 以下三个持有m_mutex调用
+    // 尝试完成一次收发。不带缓冲时和对侧的一个等待者交接，交接的等待者放在peer里，解锁后唤醒
+    virtual Status poll(void* value, bool send, ChannelWaiter** peer) = 0;
+    // 缓冲通道登记等待者之后复查是否已经可以收发
+    virtual bool ready(bool send) = 0;
+    virtual void markClosed() {}
+
+    void enqueue(ChannelWaiter* w, bool send);
+    void dequeue(ChannelWaiter* w, bool send);
+    // 从队头取出一个等待者并抢占它所属的select，已经被别的分支抢走的直接丢掉
+    ChannelWaiter* popWaiter(bool senders);
+    // 缓冲通道的无锁收发成功之后，唤醒对侧队列里的一个等待者
+    void notify(bool senders);
+
+    bool blockOp(void* value, bool send);
+    Status tryOp(void* value, bool send);
+protected:
+    size_t m_capacity;
+    std::mutex m_mutex;
+    std::atomic<bool> m_closed {false};
+    WaitQueue m_senders;
+    WaitQueue m_receivers;
+
+    friend int SelectWait(ChannelCase* cases, size_t n, bool block, bool& ok);
+};
+
+/**
+ * @brief 有界多生产者多消费者无锁环形队列
+ * @details 按 Vyukov 的 bounded MPMC queue，每个槽位带序号:
+ *          2*pos表示位置pos可以写入，2*pos+1表示已经写入，
+ *          这样容量为1时"已写入"和"下一圈可写入"也不会混淆。
+ *          关闭时在tail上打标记，之后的push失败，已经放进去的元素照常取出
+ */
+template<class T>
+class ChannelRing {
+public:
+    explicit ChannelRing(size_t capacity)
+        : m_capacity(capacity)
+        , m_slots(new Slot[capacity])
+        , m_head(0)
+        , m_tail(0) {
+        for(size_t i = 0; i < capacity; ++i) {
+            m_slots[i].seq.store(2 * i, std::memory_order_relaxed);
+        }
+    }
+
+    ~ChannelRing() {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t tail = m_tail.load(std::memory_order_relaxed) & ~CLOSED_BIT;
+        for(; head != tail; ++head) {
+            at(head).value()->~T();
+        }
+        delete[] m_slots;
+    }
+
+    ChannelRing(const ChannelRing&) = delete;
+    ChannelRing& operator=(const ChannelRing&) = delete;
+
+    // 成功时v被移走
+    ChannelBase::Status push(T& v) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        int spins = 0;
+        while(true) {
+            if(tail & CLOSED_BIT) {
+                return ChannelBase::CLOSED;
+            }
+            Slot& s = at(tail);
+            uint64_t seq = s.seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)(seq - 2 * tail);
+            if(diff == 0) {
+                if(m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    ::new (&s.storage) T(std::move(v));
+                    s.seq.store(2 * tail + 1, std::memory_order_release);
+                    return ChannelBase::OK;
+                }
+                continue;
+            }
+            if(diff < 0) {
+                // 上一圈的元素还在: 满了，或者取它的线程还没读完
+                if(m_head.load(std::memory_order_acquire) + m_capacity == tail) {
+                    return ChannelBase::WOULD_BLOCK;
+                }
+                Backoff(spins);
+            }
+            tail = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    ChannelBase::Status pop(T& out) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        int spins = 0;
+        while(true) {
+            Slot& s = at(head);
+            uint64_t seq = s.seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)(seq - (2 * head + 1));
+            if(diff == 0) {
+                if(m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                    T* p = s.value();
+                    out = std::move(*p);
+                    p->~T();
+                    s.seq.store(2 * (head + m_capacity), std::memory_order_release);
+                    return ChannelBase::OK;
+                }
+                continue;
+            }
+            if(diff < 0) {
+                // 这一圈还没写入: 空了，或者放它的线程还没写完
+                uint64_t tail = m_tail.load(std::memory_order_acquire);
+                if((tail & ~CLOSED_BIT) == head) {
+                    return (tail & CLOSED_BIT) ? ChannelBase::CLOSED : ChannelBase::WOULD_BLOCK;
+                }
+                Backoff(spins);
+            }
+            head = m_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    // 先读head再读tail，两者的差不会是负数
+    bool canPush() const {
+        uint64_t head = m_head.load();
+        uint64_t tail = m_tail.load();
+        return (tail & CLOSED_BIT) || (tail & ~CLOSED_BIT) - head < m_capacity;
+    }
+
+    bool canPop() const {
+        uint64_t head = m_head.load();
+        uint64_t tail = m_tail.load();
+        return (tail & CLOSED_BIT) || (tail & ~CLOSED_BIT) != head;
+    }
+
+    size_t size() const {
+        uint64_t head = m_head.load();
+        uint64_t tail = m_tail.load() & ~CLOSED_BIT;
+        return tail - head;
+    }
+
+    void close() {
+        m_tail.fetch_or(CLOSED_BIT);
+    }
+private:
+    static const uint64_t CLOSED_BIT = 1ull << 63;
+
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        T* value() { return reinterpret_cast<T*>(&storage); }
+    };
+
+    Slot& at(uint64_t pos) { return m_slots[pos % m_capacity]; }
+
+    // 对方在两次原子操作之间，很快就好；等太久让出CPU，对方可能被换下去了
+    static void Backoff(int& spins) {
+        if(++spins > 16) {
+            std::this_thread::yield();
+        }
+    }
+private:
+    size_t m_capacity;
+    Slot* m_slots;
+    // head和tail分开在不同缓存行，用填充而不是alignas
+    std::atomic<uint64_t> m_head;
+    char m_pad1[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> m_tail;
+    char m_pad2[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+} // namespace detail
+
+/**
+ * @brief 有界通道，用于不同线程上的协程之间传递消息
+ * @details capacity为0时不带缓冲，send要等到有recv接手(交接)才返回；
+ *          否则是无锁环形队列，满了send等、空了recv等。
+ *          等待在调度器的工作协程里只Park当前协程，在普通线程上阻塞。
+ *          元素的移动构造和移动赋值不能抛异常。
+ *          对方直接读写等待方栈上的元素和等待节点，共享栈协程挂起后这些地址归别的协程使用，
+ *          所以共享栈协程里需要等待的send/recv/Select::wait抛出std::logic_error，
+ *          可以立即完成的和trySend/tryRecv不受影响。
+ *
+ *          Channel<Request>::ptr ch = std::make_shared<Channel<Request> >(1024);
+ *          // 生产者
+ *          ch->send(req);
+ *          ch->close();
+ *          // 消费者
+ *          Request r;
+ *          while(ch->recv(r)) { handle(r); }
+ */
+template<class T>
+class Channel : public detail::ChannelBase {
+    static_assert(std::is_nothrow_move_constructible<T>::value
+                  && std::is_nothrow_move_assignable<T>::value,
+                  "Channel element must be nothrow movable");
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    explicit Channel(size_t capacity = 0)
+        : ChannelBase(capacity) {
+        if(capacity) {
+            m_ring.reset(new detail::ChannelRing<T>(capacity));
+        }
+    }
+
+    /**
+     * @brief 发送，缓冲满或没有接收方时等待
+     * @return 通道已关闭返回false
+     */
+    bool send(T value) {
+        if(m_ring) {
+            Status s = m_ring->push(value);
+            if(s == OK) {
+                notify(false);
+                return true;
+            }
+            if(s == CLOSED) {
+                return false;
+            }
+        }
+        return blockOp(&value, true);
+    }
+
+    /**
+     * @brief 接收，没有元素时等待
+     * @return 通道已关闭并且取空时返回false
+     */
+    bool recv(T& out) {
+        if(m_ring) {
+            Status s = m_ring->pop(out);
+            if(s == OK) {
+                notify(true);
+                return true;
+            }
+            if(s == CLOSED) {
+                return false;
+            }
+        }
+        return blockOp(&out, false);
+    }
+
+    /**
+     * @brief 不等待的发送，成功时value被移走
+     */
+    Status trySend(T& value) {
+        if(!m_ring) {
+            return tryOp(&value, true);
+        }
+        Status s = m_ring->push(value);
+        if(s == OK) {
+            notify(false);
+        }
+        return s;
+    }
+
+    Status tryRecv(T& out) {
+        if(!m_ring) {
+            return tryOp(&out, false);
+        }
+        Status s = m_ring->pop(out);
+        if(s == OK) {
+            notify(true);
+        }
+        return s;
+    }
+
+    /**
+     * @brief 缓冲的元素个数，不带缓冲时为0
+     */
+    size_t size() const { return m_ring ? m_ring->size() : 0; }
+protected:
+    Status poll(void* value, bool send, detail::ChannelWaiter** peer) override {
+        T* v = static_cast<T*>(value);
+        if(m_ring) {
+            return send ? m_ring->push(*v) : m_ring->pop(*v);
+        }
+        if(m_closed.load(std::memory_order_relaxed)) {
+            return CLOSED;
+        }
+        detail::ChannelWaiter* w = popWaiter(!send);
+        if(!w) {
+            return WOULD_BLOCK;
+        }
+        T* other = static_cast<T*>(w->value);
+        if(send) {
+            *other = std::move(*v);
+        } else {
+            *v = std::move(*other);
+        }
+        w->sel->ok = true;
+        *peer = w;
+        return OK;
+    }
+
+    bool ready(bool send) override {
+        return send ? m_ring->canPush() : m_ring->canPop();
+    }
+
+    void markClosed() override {
+        if(m_ring) {
+            m_ring->close();
+        }
+    }
+private:
+    std::unique_ptr<detail::ChannelRing<T> > m_ring;
+};
+
+/**
+ * @brief 在多个通道的收发中等第一个能完成的，类似Go的select
+ * @details 同时有多个分支可以完成时轮流选择，避免总是偏向前面的分支。
+ *          接收分支遇到通道关闭并取空、发送分支遇到通道关闭也算完成，ok()为false
+ *
+ *          Select sel;
+ *          int a = sel.addRecv(*requests, req);
+ *          int b = sel.addRecv(*quit, dummy);
+ *          int i = sel.wait();
+ *          if(i == a && sel.ok()) { handle(req); }
+ */
+class Select {
+public:
+    template<class T>
+    int addRecv(Channel<T>& ch, T& out) {
+        m_cases.push_back(detail::ChannelCase{&ch, &out, false});
+        return (int)m_cases.size() - 1;
+    }
+
+    /**
+     * @brief 这个分支被选中并且成功时value被移走
+     */
+    template<class T>
+    int addSend(Channel<T>& ch, T& value) {
+        m_cases.push_back(detail::ChannelCase{&ch, &value, true});
+        return (int)m_cases.size() - 1;
+    }
+
+    /**
+     * @brief 等到有一个分支完成，返回它的下标
+     * @details 没有分支时、在共享栈协程里需要等待时抛出std::logic_error
+     */
+    int wait() {
+        return detail::SelectWait(m_cases.data(), m_cases.size(), true, m_ok);
+    }
+
+    /**
+     * @brief 不等待，没有能立即完成的分支时返回-1
+     */
+    int tryWait() {
+        return detail::SelectWait(m_cases.data(), m_cases.size(), false, m_ok);
+    }
+
+    /**
+     * @brief 最近完成的分支是否真的收发了元素，false表示通道已关闭
+     */
+    bool ok() const { return m_ok; }
+private:
+    std::vector<detail::ChannelCase> m_cases;
+    bool m_ok = false;
+};
+
+}
+
+#endif
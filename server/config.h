@@ -42,6 +42,22 @@ public:
     }
 };
 
+// string -> bool，lexical_cast只认0/1，YAML里写的是true/false
+template<>
+class LexicalCast<std::string, bool> {
+public:
+    bool operator()(const std::string& v) {
+        std::string s = to_lower(v);
+        if (s == "true" || s == "yes" || s == "on") {
+            return true;
+        }
+        if (s == "false" || s == "no" || s == "off") {
+            return false;
+        }
+        return boost::lexical_cast<bool>(v);
+    }
+};
+
 //vector<T>, list<T>, set<T>, unordered_set<T> -> string
 #define CAST_TO_STRING(mytype) \
     template<class T> \
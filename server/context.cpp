@@ -0,0 +1,87 @@
+#include <stdexcept>
+
+#include "context.h"
+
+#ifndef ZNS_CONTEXT_UCONTEXT
+extern "C" {
+// 新上下文的第一个返回地址，从寄存器中取出fn和arg并调用
+void zns_context_entry();
+}
+#endif
+
+namespace ZnetServer {
+
+#ifdef ZNS_CONTEXT_UCONTEXT
+
+// makecontext只能传int参数，指针拆成高低两半
+static void UcontextTrampoline(uint32_t fn_hi, uint32_t fn_lo, uint32_t arg_hi, uint32_t arg_lo) {
+    uintptr_t fn = ((uintptr_t)fn_hi << 32) | fn_lo;
+    uintptr_t arg = ((uintptr_t)arg_hi << 32) | arg_lo;
+    ((Context::EntryFunc)fn)((void*)arg);
+}
+
+void Context::make(void* stack, size_t size, EntryFunc fn, void* arg) {
+    if(getcontext(&m_ctx) == -1) {
+        throw std::logic_error("getcontext");
+    }
+    m_ctx.uc_link = nullptr;
+    m_ctx.uc_stack.ss_sp = stack;
+    m_ctx.uc_stack.ss_size = size;
+    uintptr_t f = (uintptr_t)fn;
+    uintptr_t a = (uintptr_t)arg;
+    makecontext(&m_ctx, (void(*)())&UcontextTrampoline, 4,
+                (uint32_t)((uint64_t)f >> 32), (uint32_t)f,
+                (uint32_t)((uint64_t)a >> 32), (uint32_t)a);
+}
+
+void Context::SwapUcontext(Context& from, Context& to) {
+    if(swapcontext(&from.m_ctx, &to.m_ctx) == -1) {
+        throw std::runtime_error("swapcontext error");
+    }
+}
+
+const char* Context::BackendName() {
+    return "ucontext";
+}
+
+#else
+
+void Context::make(void* stack, size_t size, EntryFunc fn, void* arg) {
+    // 栈顶按16字节对齐，在栈顶伪造一帧zns_context_swap保存的现场，
+    // 第一次切入时恢复出的返回地址就是zns_context_entry
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+#if defined(__x86_64__)
+    // 布局(低->高): fpu控制字 r12 r13 r14 r15 rbx rbp ret
+    void** sp = (void**)(top - 8 * sizeof(void*));
+    sp[0] = (void*)(((uintptr_t)0x037F << 32) | 0x1F80); // x87控制字 | MXCSR，均为默认值
+    sp[1] = (void*)fn;   // r12
+    sp[2] = arg;         // r13
+    sp[3] = nullptr;     // r14
+    sp[4] = nullptr;     // r15
+    sp[5] = nullptr;     // rbx
+    sp[6] = nullptr;     // rbp，置0让回溯在这里结束
+    sp[7] = (void*)&zns_context_entry;
+#elif defined(__aarch64__)
+    // 布局(低->高): d8-d15 x19-x28 x29 x30，共0xb0字节
+    void** sp = (void**)(top - 0xb0);
+    for(int i = 0; i < 0xb0 / (int)sizeof(void*); ++i) {
+        sp[i] = nullptr;
+    }
+    sp[8] = (void*)fn;   // x19
+    sp[9] = arg;         // x20
+    sp[19] = (void*)&zns_context_entry; // x30(lr)
+#endif
+    m_sp = sp;
+}
+
+const char* Context::BackendName() {
+#if defined(__x86_64__)
+    return "fcontext(x86_64)";
+#else
+    return "fcontext(aarch64)";
+#endif
+}
+
+#endif
+
+}
@@ -0,0 +1,77 @@
+#ifndef __ZNS_CONTEXT_H__
+#define __ZNS_CONTEXT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 上下文切换后端：
+//   fcontext - 手写汇编(x86_64 / aarch64)，只保存被调用者保存寄存器，不做系统调用
+//   ucontext - glibc的swapcontext，每次切换都有一次rt_sigprocmask系统调用
+// 由CMake的ZNS_CONTEXT_BACKEND选择，不支持的架构自动退回ucontext
+#if !defined(ZNS_CONTEXT_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#define ZNS_CONTEXT_UCONTEXT 1
+#endif
+
+#ifdef ZNS_CONTEXT_UCONTEXT
+#include <ucontext.h>
+#else
+extern "C" {
+/**
+ * @brief 保存当前被调用者保存寄存器到当前栈上，栈顶写入*from_sp，再从to_sp恢复
+ * @details 实现见 context_x86_64.S / context_aarch64.S
+ */
+void zns_context_swap(void** from_sp, void* to_sp);
+}
+#endif
+
+namespace ZnetServer {
+
+/**
+ * @brief 协程执行上下文
+ * @details 主协程不需要make，第一次Swap出去时自动保存现场
+ */
+class Context {
+public:
+    typedef void (*EntryFunc)(void* arg);
+
+    /**
+     * @brief 在[stack, stack + size)上构造上下文，首次切入时执行fn(arg)
+     * @attention fn不能返回
+     */
+    void make(void* stack, size_t size, EntryFunc fn, void* arg);
+
+    /**
+     * @brief 保存当前现场到from，切换到to
+     */
+    static void Swap(Context& from, Context& to) {
+#ifdef ZNS_CONTEXT_UCONTEXT
+        SwapUcontext(from, to);
+#else
+        zns_context_swap(&from.m_sp, to.m_sp);
+#endif
+    }
+
+#ifndef ZNS_CONTEXT_UCONTEXT
+    /**
+     * @brief 挂起时保存的栈顶，栈上[sp, 栈底)就是恢复这个上下文需要的全部内容
+     */
+    void* getStackPointer() const { return m_sp; }
+#endif
+
+    /**
+     * @brief 编译期选择的后端名称
+     */
+    static const char* BackendName();
+private:
+#ifdef ZNS_CONTEXT_UCONTEXT
+    static void SwapUcontext(Context& from, Context& to);
+    ucontext_t m_ctx;
+#else
+    // 挂起时的栈顶，寄存器都保存在栈上
+    void* m_sp = nullptr;
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include "fd_manager.h"
+#include "hook.h"
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <algorithm>
+
+namespace ZnetServer {
+
+FdCtx::FdCtx(int fd) {
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        m_isSocket = true;
+    }
+    if(m_isSocket) {
+        // 用原函数取标志，用户在hook之前自己设的O_NONBLOCK要保留下来
+        int flags = fcntl_f(fd, F_GETFL, 0);
+        if(flags >= 0) {
+            m_userNonblock = (flags & O_NONBLOCK) != 0;
+            m_sysNonblock = (flags & O_NONBLOCK) || fcntl_f(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+        }
+    }
+}
+
+uint64_t FdCtx::getTimeout(int type) const {
+    return type == SO_RCVTIMEO ? m_recvTimeout.load(std::memory_order_relaxed)
+                               : m_sendTimeout.load(std::memory_order_relaxed);
+}
+
+void FdCtx::setTimeout(int type, uint64_t ms) {
+    if(type == SO_RCVTIMEO) {
+        m_recvTimeout.store(ms, std::memory_order_relaxed);
+    } else {
+        m_sendTimeout.store(ms, std::memory_order_relaxed);
+    }
+}
+
+FdManager* FdManager::GetInstance() {
+    static FdManager* s_instance = new FdManager;
+    return s_instance;
+}
+
+FdManager::FdManager() {
+    m_datas.resize(64);
+}
+
+FdCtx::ptr FdManager::get(int fd, bool auto_create) {
+    if(fd < 0) {
+        return nullptr;
+    }
+    {
+        ReadScopedLockImpl<RWMutex> lock(m_mutex);
+        if((size_t)fd < m_datas.size()) {
+            if(m_datas[fd] || !auto_create) {
+                return m_datas[fd];
+            }
+        } else if(!auto_create) {
+            return nullptr;
+        }
+    }
+    WriteScopedLockImpl<RWMutex> lock(m_mutex);
+    if((size_t)fd >= m_datas.size()) {
+        m_datas.resize(std::max((size_t)fd + 1, m_datas.size() * 3 / 2));
+    }
+    if(!m_datas[fd]) {
+        m_datas[fd] = std::make_shared<FdCtx>(fd);
+    }
+    return m_datas[fd];
+}
+
+void FdManager::del(int fd) {
+    if(fd < 0) {
+        return;
+    }
+    FdCtx::ptr old;
+    WriteScopedLockImpl<RWMutex> lock(m_mutex);
+    if((size_t)fd < m_datas.size()) {
+        old.swap(m_datas[fd]);
+    }
+}
+
+}
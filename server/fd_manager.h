@@ -0,0 +1,83 @@
+#ifndef __ZNS_FD_MANAGER_H__
+#define __ZNS_FD_MANAGER_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "mutex.h"
+
+namespace ZnetServer {
+
+/**
+ * @brief hook用的文件句柄上下文
+ * @details 只有hook开启的线程上创建的socket才有上下文。创建时把socket设成非阻塞(系统层)，
+ *          用户看到的阻塞与否单独记录: 用户自己设了O_NONBLOCK的socket，hook直接调用原函数。
+ */
+class FdCtx {
+public:
+    typedef std::shared_ptr<FdCtx> ptr;
+
+    FdCtx(int fd);
+
+    bool isSocket() const { return m_isSocket; }
+    bool isClosed() const { return m_isClosed.load(std::memory_order_relaxed); }
+    void setClosed() { m_isClosed.store(true, std::memory_order_relaxed); }
+
+    /**
+     * @brief 用户是否设置了非阻塞
+     */
+    bool getUserNonblock() const { return m_userNonblock.load(std::memory_order_relaxed); }
+    void setUserNonblock(bool v) { m_userNonblock.store(v, std::memory_order_relaxed); }
+
+    /**
+     * @brief 系统层是否已经是非阻塞
+     */
+    bool getSysNonblock() const { return m_sysNonblock; }
+
+    /**
+     * @brief 超时毫秒数，~0ull表示不超时
+     * @param[in] type SO_RCVTIMEO或SO_SNDTIMEO
+     */
+    uint64_t getTimeout(int type) const;
+    void setTimeout(int type, uint64_t ms);
+private:
+    bool m_isSocket = false;
+    bool m_sysNonblock = false;
+    std::atomic<bool> m_userNonblock {false};
+    std::atomic<bool> m_isClosed {false};
+    std::atomic<uint64_t> m_recvTimeout {~0ull};
+    std::atomic<uint64_t> m_sendTimeout {~0ull};
+};
+
+/**
+ * @brief 按fd下标管理FdCtx
+ */
+class FdManager {
+public:
+    /**
+     * @brief 全局实例，从不析构: 进程退出时其他静态对象的析构函数还会调用close
+     */
+    static FdManager* GetInstance();
+
+    /**
+     * @brief 取fd的上下文
+     * @param[in] auto_create 不存在时创建
+     * @return 不存在并且不创建时返回nullptr
+     */
+    FdCtx::ptr get(int fd, bool auto_create = false);
+
+    /**
+     * @brief 删除fd的上下文，fd关闭时调用
+     */
+    void del(int fd);
+private:
+    FdManager();
+private:
+    RWMutex m_mutex;
+    std::vector<FdCtx::ptr> m_datas;
+};
+
+}
+
+#endif
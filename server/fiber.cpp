@@ -1,51 +1,213 @@
 #include <stdlib.h>
+#include <string.h>
 #include <stdexcept>
 #include <atomic>
+#include <mutex>
+#include <vector>
 
 #include "fiber.h"
 #include "log.h"
+#include "config.h"
 #include "scheduler.h"
+#include "stack_allocator.h"
+#include "stack_usage.h"
 
 namespace ZnetServer{
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
+    Config::Create<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
+static ConfigVar<uint32_t>::ptr g_shared_stack_size =
+    Config::Create<uint32_t>("fiber.shared_stack_size", 1024 * 1024, "shared fiber stack size");
+static ConfigVar<uint32_t>::ptr g_shared_stack_count =
+    Config::Create<uint32_t>("fiber.shared_stack_count", 4, "shared fiber stacks per thread");
+
 static thread_local Fiber* t_fiber = nullptr;
 static thread_local Fiber::ptr t_thread_main_fiber = nullptr;
 static std::atomic<uint64_t> s_fiber_id {0};
 static std::atomic<uint64_t> s_fiber_count {0};
 
+// 共享栈，同一时刻只有occupant的栈内容真正在上面
+struct SharedStack {
+    void* stack = nullptr;
+    size_t size = 0;
+    const void* owner = nullptr; // 所属线程的SharedStackSet
+    std::atomic<Fiber*> occupant {nullptr};
+    std::mutex mutex; // 保护换出occupant和析构之间的竞争
+
+    ~SharedStack() {
+        StackAllocator::Dealloc(stack, size);
+    }
+};
+
+// 每个线程的一组共享栈，新协程轮流分配
+struct SharedStackSet {
+    std::vector<std::shared_ptr<SharedStack> > stacks;
+    size_t next = 0;
+};
+static thread_local SharedStackSet t_shared_stacks;
+
+// 协程局部变量槽位的析构函数表，槽位注册后不回收
+static std::atomic<uint32_t> s_local_count {0};
+static Fiber::LocalDestructor s_local_dtors[Fiber::LOCAL_MAX_SLOTS];
+
 Fiber::Fiber() {
-    ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Fiber::Fiber main";
+    ZNS_LOG_DEBUG(g_logger) << "Fiber::Fiber main";
     m_state = EXEC;
     m_id = s_fiber_id ++;
-
-    if(getcontext(&m_ctx) == -1) { // 获取当前上下文
-        throw std::logic_error("getcontext");
-    }
+    // 主协程运行在线程栈上，第一次切出时由Context::Swap保存现场
     t_fiber = this; // 主协程
 }
 
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller)
-    : m_cb(std::move(cb)), m_id(s_fiber_id ++) {
+Fiber::Fiber(Callable cb, size_t stacksize, bool use_caller, bool shared_stack)
+    : m_id(s_fiber_id ++), m_cb(std::move(cb)) {
     s_fiber_count ++;
-    m_stack = new char[stacksize]; // 分配栈内存
-    if(getcontext(&m_ctx) == -1) { // 获取当前上下文
-        throw std::logic_error("getcontext");
+#ifdef ZNS_CONTEXT_UCONTEXT
+    if(shared_stack) {
+        // ucontext拿不到挂起时的栈顶，无法只保存用到的部分
+        static std::atomic<bool> s_warned {false};
+        if(!s_warned.exchange(true)) {
+            ZNS_LOG_WARN(g_logger) << "Fiber shared stack requires fcontext backend, use private stack";
+        }
+        shared_stack = false;
+    }
+#endif
+    if(shared_stack) {
+        SharedStackSet& set = t_shared_stacks;
+        size_t count = std::max<uint32_t>(1, g_shared_stack_count->getValue());
+        if(set.stacks.size() < count) {
+            std::shared_ptr<SharedStack> st(new SharedStack);
+            st->size = g_shared_stack_size->getValue();
+            st->stack = StackAllocator::Alloc(st->size);
+            st->owner = &set;
+            set.stacks.push_back(st);
+        }
+        m_sharedStack = set.stacks[set.next++ % set.stacks.size()];
+        m_stack = m_sharedStack->stack;
+        m_stacksize = m_sharedStack->size;
+        m_needMake = true; // 共享栈可能正被别的协程占用，切入时再构造
+        m_affinity = Scheduler::GetWorkerIndex(); // 只能在本线程切入
+    } else {
+        size_t size = stacksize ? stacksize : g_fiber_stack_size->getValue();
+        m_stack = StackAllocator::Alloc(size); // 分配栈内存，size取整到档位
+        m_stacksize = size;
+        if(StackUsage::IsEnabled()) {
+            StackUsage::Paint(m_stack, m_stacksize);
+            m_painted = true;
+        }
+        m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc, this); // 设置上下文函数
     }
-    m_stacksize = stacksize;
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack; // 设置栈指针
-    m_ctx.uc_stack.ss_size = stacksize; // 设置栈大小
-    
-    makecontext(&m_ctx, &Fiber::MainFunc, 0); // 设置上下文函数
-    ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Fiber::Fiber id=" << m_id << " has created";
+    ZNS_LOG_DEBUG(g_logger) << "Fiber::Fiber id=" << m_id << " has created";
 }
 
 Fiber::~Fiber() {
     -- s_fiber_count;
-    if (m_stack) {
-        delete[] static_cast<char*>(m_stack);
+    destroyLocals();
+    if (m_sharedStack) {
+        std::lock_guard<std::mutex> lock(m_sharedStack->mutex);
+        if (m_sharedStack->occupant == this) {
+            m_sharedStack->occupant = nullptr;
+        }
+        free(m_saveBuf);
+    } else if (m_stack) {
+        StackAllocator::Dealloc(m_stack, m_stacksize);
+    }
+}
+
+uint32_t Fiber::AllocLocalSlot(LocalDestructor dtor) {
+    uint32_t index = s_local_count++;
+    if (index >= LOCAL_MAX_SLOTS) {
+        throw std::logic_error("Fiber::AllocLocalSlot too many fiber local slots");
+    }
+    s_local_dtors[index] = dtor;
+    return index;
+}
+
+void*& Fiber::GetLocalSlot(uint32_t index) {
+    Fiber* cur = t_fiber;
+    if (!cur) {
+        cur = GetThis().get();
+    }
+    if (index < LOCAL_INLINE_SLOTS) {
+        return cur->m_locals[index];
+    }
+    index -= LOCAL_INLINE_SLOTS;
+    if (index >= cur->m_localsExt.size()) {
+        cur->m_localsExt.resize(index + 1, nullptr);
+    }
+    return cur->m_localsExt[index];
+}
+
+void* Fiber::PeekLocalSlot(uint32_t index) {
+    Fiber* cur = t_fiber;
+    if (!cur) {
+        return nullptr;
+    }
+    if (index < LOCAL_INLINE_SLOTS) {
+        return cur->m_locals[index];
+    }
+    index -= LOCAL_INLINE_SLOTS;
+    return index < cur->m_localsExt.size() ? cur->m_localsExt[index] : nullptr;
+}
+
+void Fiber::destroyLocals() {
+    for (uint32_t i = 0; i < LOCAL_INLINE_SLOTS; ++i) {
+        if (m_locals[i]) {
+            void* v = m_locals[i];
+            m_locals[i] = nullptr;
+            s_local_dtors[i](v);
+        }
+    }
+    for (size_t i = 0; i < m_localsExt.size(); ++i) {
+        if (m_localsExt[i]) {
+            void* v = m_localsExt[i];
+            m_localsExt[i] = nullptr;
+            s_local_dtors[i + LOCAL_INLINE_SLOTS](v);
+        }
     }
 }
 
+void Fiber::saveStack() {
+#ifndef ZNS_CONTEXT_UCONTEXT
+    char* top = (char*)m_sharedStack->stack + m_sharedStack->size;
+    char* sp = (char*)m_ctx.getStackPointer();
+    size_t used = top - sp;
+    // 缓冲区按实际用量分配，用量明显变小时也缩回去
+    if (used > m_saveCap || used < m_saveCap / 2) {
+        char* buf = (char*)realloc(m_saveBuf, used);
+        if (!buf) {
+            throw std::bad_alloc();
+        }
+        m_saveBuf = buf;
+        m_saveCap = used;
+    }
+    memcpy(m_saveBuf, sp, used);
+    m_saveSize = used;
+#endif
+}
+
+void Fiber::acquireStack() {
+    SharedStack* st = m_sharedStack.get();
+    if (st->occupant.load(std::memory_order_relaxed) == this) {
+        return;
+    }
+    if (st->owner != &t_shared_stacks) {
+        throw std::logic_error("Fiber::swapIn shared stack fiber on foreign thread");
+    }
+    std::lock_guard<std::mutex> lock(st->mutex);
+    Fiber* occ = st->occupant;
+    if (occ && occ->m_state != TERM && occ->m_state != EXCEPT) {
+        occ->saveStack();
+    }
+    if (m_needMake) {
+        m_ctx.make(st->stack, st->size, &Fiber::MainFunc, this);
+        m_needMake = false;
+    } else {
+        memcpy((char*)st->stack + st->size - m_saveSize, m_saveBuf, m_saveSize);
+    }
+    st->occupant = this;
+}
+
 uint64_t Fiber::GetFiberId() {
     if(t_fiber) {
         return t_fiber->getId();
@@ -68,77 +230,116 @@ Fiber::ptr Fiber::GetThis() {
 }
 
 void Fiber::Yield() {
-    Fiber::ptr cur = GetThis();
-    ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Fiber::Yield" << " id=" << cur->getId();
+    // 用裸指针，挂起期间栈上不留自己的引用
+    Fiber* cur = t_fiber;
+    if(!cur) {
+        return;
+    }
+    ZNS_LOG_DEBUG(g_logger) << "Fiber::Yield" << " id=" << cur->getId();
+    if(cur->m_state == EXEC) {
+        cur->m_state = HOLD;
+    }
     cur->swapOut();
 }
 
-void Fiber::reset(std::function<void()> cb) {
+void Fiber::reset(Callable cb) {
     // 重置回调函数，保留栈空间，以便重用
     if (!m_stack) {
         throw std::logic_error("Fiber::reset m_stack == nullptr");
     }
+    if (m_state != INIT && m_state != TERM && m_state != EXCEPT) {
+        throw std::logic_error("Fiber::reset fiber is still running");
+    }
     m_cb = std::move(cb);
-    if(getcontext(&m_ctx) == -1) { // 获取当前上下文
-        throw std::logic_error("getcontext");
+    destroyLocals();
+    if (m_sharedStack) {
+        std::lock_guard<std::mutex> lock(m_sharedStack->mutex);
+        m_needMake = true;
+        m_saveSize = 0;
+        if (m_sharedStack->occupant == this) {
+            m_sharedStack->occupant = nullptr;
+        }
+    } else {
+        if(!StackUsage::IsEnabled()) {
+            m_painted = false;
+        } else if(m_painted) {
+            // 测量之后还要切出，多涂一点余量盖住那几层调用
+            StackUsage::Repaint(m_stack, m_stacksize, m_stackUsed + 16 * 1024);
+        } else {
+            StackUsage::Paint(m_stack, m_stacksize);
+            m_painted = true;
+        }
+        m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc, this); // 设置上下文函数
     }
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack; // 设置栈指针
-    m_ctx.uc_stack.ss_size = m_stacksize; // 设置栈大小
-    
-    makecontext(&m_ctx, &Fiber::MainFunc, 0); // 设置上下文函数
-    
+    m_state = INIT;
 }
 
 void Fiber::call() {
-    t_fiber = this;
-    if(swapcontext(&t_thread_main_fiber->m_ctx, &m_ctx) == -1) {
-        throw std::runtime_error("swapcontext error");
+    if(m_sharedStack) {
+        acquireStack();
     }
+    t_fiber = this;
+    Context::Swap(t_thread_main_fiber->m_ctx, m_ctx);
 }
 
 void Fiber::back() {
     t_fiber = t_thread_main_fiber.get();
-    if(swapcontext(&m_ctx, &t_thread_main_fiber->m_ctx) == -1) {
-        throw std::runtime_error("swapcontext error");
-    }
+    Context::Swap(m_ctx, t_thread_main_fiber->m_ctx);
+}
+
+// 没有调度器时(单独使用Fiber)，和线程主协程之间切换
+static Fiber* GetSwapTarget() {
+    Fiber* main = Scheduler::GetMainFiber();
+    return main ? main : t_thread_main_fiber.get();
 }
 
 void Fiber::swapIn() {
-    t_fiber = this;
-    if(swapcontext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx) == -1) {
-        throw std::runtime_error("swapcontext error");
+    Fiber* main = GetSwapTarget();
+    if(m_sharedStack) {
+        acquireStack();
     }
+    t_fiber = this;
+    m_state = EXEC;
+    Context::Swap(main->m_ctx, m_ctx);
 }
 
 void Fiber::swapOut() {
-    t_fiber = Scheduler::GetMainFiber();
-    ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Fiber::swapOut id=" << t_fiber->getId();
-    if(swapcontext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx) == -1) {
-        throw std::runtime_error("swapcontext error");
-    }
+    Fiber* main = GetSwapTarget();
+    t_fiber = main;
+    ZNS_LOG_DEBUG(g_logger) << "Fiber::swapOut id=" << t_fiber->getId();
+    Context::Swap(m_ctx, main->m_ctx);
 }
 
-void Fiber::MainFunc() {
-    ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Fiber::MainFunc";
+void Fiber::MainFunc(void*) {
+    ZNS_LOG_DEBUG(g_logger) << "Fiber::MainFunc";
     Fiber::ptr cur = GetThis();
     if(!cur) {
         throw std::logic_error("cannot get current fiber");
     }
+    const std::type_info& entry = cur->m_cb.targetType();
     try {
         cur->m_cb();
         cur->m_cb = nullptr;
         cur->setState(TERM);
     } catch(const std::exception& e) {
-        ZNS_LOG_ERROR(ZNS_LOG_ROOT()) << "Fiber Except: " << e.what()
+        ZNS_LOG_ERROR(g_logger) << "Fiber Except: " << e.what()
             << " fiber_id=" << cur->m_id;
         cur->setState(EXCEPT);
     } catch(...) {
-        ZNS_LOG_ERROR(ZNS_LOG_ROOT()) << "Fiber Except"
+        ZNS_LOG_ERROR(g_logger) << "Fiber Except"
             << " fiber_id=" << cur->m_id;
         cur->setState(EXCEPT);
     }
-    cur->swapOut();
+    // 局部变量的析构还在本协程上执行
+    cur->destroyLocals();
+    if(cur->m_painted) {
+        cur->m_stackUsed = StackUsage::Measure(cur->m_stack, cur->m_stacksize);
+        StackUsage::Record(entry, cur->m_stackUsed, cur->m_stacksize);
+    }
+    // swapOut之后不会再回来，先释放引用，否则协程对象永远不会析构
+    Fiber* raw = cur.get();
+    cur.reset();
+    raw->swapOut();
 }
 
 }
\ No newline at end of file
@@ -1,12 +1,21 @@
 #pragma once 
-#include <ucontext.h>
 #include <memory>
 #include <functional>
+#include <vector>
+#include <atomic>
 #include "noncopyable.h"
 #include "mutex.h"
+#include "context.h"
+#include "callable.h"
+#include "sched_node.h"
 
 namespace ZnetServer{
+struct SharedStack;
+
+class Scheduler;
+
 class Fiber : public std::enable_shared_from_this<Fiber>{
+friend class Scheduler;
 public:
     typedef std::shared_ptr<Fiber> ptr;
     enum State {
@@ -16,29 +25,94 @@ public:
         TERM, // 结束态
         EXCEPT, // 异常态
     };
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool use_caller = false);
+    // cb可以是任意void()可调用对象(包括std::function)，stacksize为0时取fiber.stack_size
+    // shared_stack为true时运行在本线程的共享栈上，切走时只保存用到的那部分栈，
+    // 适合大量长期挂起的协程。共享栈协程只能在创建它的线程上切入，
+    // 挂起期间其他协程不能持有指向它栈上变量的指针
+    Fiber(Callable cb, size_t stacksize = 0, bool use_caller = false, bool shared_stack = false);
     ~Fiber();
     static uint64_t GetFiberId();
     static Fiber::ptr GetThis();
     static void Yield();
     uint32_t getId() const { return m_id;}
-    void reset(std::function<void()> cb);
+    // 复用已结束协程的栈和对象，换一个回调重新开始
+    void reset(Callable cb);
     void call();
     void back();    
     void swapIn();
     void swapOut();
     State getState() const { return m_state; }
     void setState(State s) { m_state = s; }
+    // 由调度器池化的回调协程，结束后回收复用
+    bool isPooled() const { return m_pooled; }
+    void setPooled(bool v) { m_pooled = v; }
+    bool isSharedStack() const { return m_sharedStack != nullptr; }
+    // 固定运行的工作线程下标，-1表示不固定。Scheduler重新调度(例如Unpark)时会送回这个线程，
+    // 共享栈协程在工作线程上创建时自动固定在该线程
+    int getAffinity() const { return m_affinity; }
+    void setAffinity(int thread) { m_affinity = thread; }
+    // 调度优先级(Scheduler::Priority)，Unpark等重新调度时沿用，回调协程随提交时的优先级
+    int getPriority() const { return m_priority; }
+    void setPriority(int priority) { m_priority = priority; }
+    // 共享栈协程当前保存的栈数据大小
+    size_t getSavedStackSize() const { return m_saveSize; }
+    // 上一次运行结束时测得的栈用量，没开fiber.stack_watermark时为0，见stack_usage.h
+    size_t getStackHighWatermark() const { return m_stackUsed; }
+
+    // 协程局部存储，见fiber_local.h
+    static const uint32_t LOCAL_INLINE_SLOTS = 8;
+    static const uint32_t LOCAL_MAX_SLOTS = 64;
+    typedef void (*LocalDestructor)(void* value);
+    /**
+     * @brief 注册一个协程局部变量槽位，返回下标
+     * @param[in] dtor 协程结束、reset或析构时用来销毁该槽位的值
+     */
+    static uint32_t AllocLocalSlot(LocalDestructor dtor);
+    /**
+     * @brief 当前协程的槽位引用，未创建过值时为nullptr
+     */
+    static void*& GetLocalSlot(uint32_t index);
+    /**
+     * @brief 当前协程槽位里的值，不扩展槽位数组，也不创建主协程，没有时返回nullptr
+     */
+    static void* PeekLocalSlot(uint32_t index);
 private:
     Fiber(); // 主协程
-    static void MainFunc();
+    static void MainFunc(void* arg);
+    // 共享栈模式：切入前把占用共享栈的协程换出，再把自己的栈换进来
+    void acquireStack();
+    void saveStack();
+    // 销毁本协程所有已创建的局部变量
+    void destroyLocals();
 private:
     uint32_t m_id; // 协程id
-    std::function<void()> m_cb;
-    ucontext_t m_ctx;
+    Callable m_cb;
+    Context m_ctx;
     void* m_stack = nullptr;
-    uint32_t m_stacksize = 0;
+    size_t m_stacksize = 0;
     Semaphore m_semaphore;
     State m_state = INIT;
+    bool m_pooled = false;
+    int m_affinity = -1;
+    int m_priority = 1; // Scheduler::NORMAL
+
+    std::shared_ptr<SharedStack> m_sharedStack;
+    char* m_saveBuf = nullptr; // 换出时保存的栈内容
+    size_t m_saveSize = 0;
+    size_t m_saveCap = 0;
+    bool m_needMake = false; // 共享栈上还没有构造初始上下文
+
+    bool m_painted = false; // 栈已涂标记，结束时测量高水位
+    size_t m_stackUsed = 0;
+
+    void* m_locals[LOCAL_INLINE_SLOTS] = {}; // 前几个槽位直接放在对象里
+    std::vector<void*> m_localsExt;          // 其余槽位按需分配
+
+    // Scheduler::Park/Unpark的状态，见scheduler.cpp
+    std::atomic<int> m_parkState {0};
+    Scheduler* m_parkScheduler = nullptr;
+    // 在Scheduler运行队列里时的节点，以及排队期间调度器持有的自身引用
+    SchedNode m_schedNode;
+    Fiber::ptr m_schedRef;
 };
 }
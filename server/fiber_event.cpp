@@ -0,0 +1,54 @@
+#include "fiber_event.h"
+#include "scheduler.h"
+
+namespace ZnetServer {
+
+void FiberEvent::wait() {
+    bool in_fiber = Scheduler::GetThis() && Fiber::GetThis().get() != Scheduler::GetMainFiber();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_set) {
+            return;
+        }
+        if(in_fiber) {
+            m_fiber = Fiber::GetThis();
+        } else {
+            m_threadWaiting = true;
+        }
+    }
+    if(!in_fiber) {
+        m_sem.wait();
+        return;
+    }
+    // Park可能虚假返回
+    while(true) {
+        Scheduler::Park();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_set) {
+            return;
+        }
+    }
+}
+
+void FiberEvent::set() {
+    Fiber::ptr f;
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_set = true;
+        f = std::move(m_fiber);
+        notify = m_threadWaiting;
+    }
+    if(f) {
+        Scheduler::Unpark(f);
+    } else if(notify) {
+        m_sem.notify();
+    }
+}
+
+bool FiberEvent::isSet() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_set;
+}
+
+}
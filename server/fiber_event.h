@@ -0,0 +1,37 @@
+#ifndef __ZNS_FIBER_EVENT_H__
+#define __ZNS_FIBER_EVENT_H__
+
+#include <mutex>
+
+#include "fiber.h"
+#include "mutex.h"
+
+namespace ZnetServer {
+
+/**
+ * @brief 一次性事件，只允许一个等待方
+ * @details 在调度器的工作协程里wait()只Park当前协程，不阻塞线程；
+ *          在普通线程上wait()用信号量阻塞。
+ *          set()解锁之后不再访问成员(唤醒阻塞中的线程除外)，
+ *          所以等待方醒来后可以立即销毁它，适合放在等待方的栈上。
+ */
+class FiberEvent {
+public:
+    FiberEvent() {}
+    FiberEvent(const FiberEvent&) = delete;
+    FiberEvent& operator=(const FiberEvent&) = delete;
+
+    void wait();
+    void set();
+    bool isSet();
+private:
+    std::mutex m_mutex;
+    bool m_set = false;
+    bool m_threadWaiting = false;
+    Fiber::ptr m_fiber;
+    Semaphore m_sem;
+};
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __ZNS_FIBER_LOCAL_H__
+#define __ZNS_FIBER_LOCAL_H__
+
+#include "fiber.h"
+
+namespace ZnetServer {
+
+/**
+ * @brief 协程局部变量
+ * @details 和thread_local不同，值跟着协程走，协程在调度器线程之间迁移后仍然可见。
+ *          构造时分配槽位下标，访问就是对当前协程槽位数组的一次下标读取；
+ *          值在第一次访问时默认构造，协程结束、reset或析构时销毁。
+ *          槽位不回收，FiberLocal一般定义为全局或静态变量。
+ *
+ *          static FiberLocal<std::string> s_trace_id;
+ *          *s_trace_id = "abc";
+ */
+template<class T>
+class FiberLocal {
+public:
+    FiberLocal()
+        : m_index(Fiber::AllocLocalSlot(&FiberLocal::Destroy)) {}
+
+    FiberLocal(const FiberLocal&) = delete;
+    FiberLocal& operator=(const FiberLocal&) = delete;
+
+    T& get() {
+        void*& slot = Fiber::GetLocalSlot(m_index);
+        if (!slot) {
+            slot = new T();
+        }
+        return *static_cast<T*>(slot);
+    }
+
+    void set(const T& v) { get() = v; }
+
+    /**
+     * @brief 当前协程是否已经创建过这个值
+     */
+    bool has() const { return Fiber::PeekLocalSlot(m_index) != nullptr; }
+
+    /**
+     * @brief 提前销毁当前协程的值，下次访问重新构造
+     */
+    void reset() {
+        if (!Fiber::PeekLocalSlot(m_index)) {
+            return;
+        }
+        void*& slot = Fiber::GetLocalSlot(m_index);
+        void* v = slot;
+        slot = nullptr;
+        Destroy(v);
+    }
+
+    T& operator*() { return get(); }
+    T* operator->() { return &get(); }
+    uint32_t getIndex() const { return m_index; }
+private:
+    static void Destroy(void* v) {
+        delete static_cast<T*>(v);
+    }
+private:
+    uint32_t m_index;
+};
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "future.h"
+
+namespace ZnetServer {
+namespace detail {
+
+bool FutureStateBase::addWaiter(Waiter* w) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_ready) {
+        return false;
+    }
+    w->prev = nullptr;
+    w->next = m_waiters;
+    if(m_waiters) {
+        m_waiters->prev = w;
+    }
+    m_waiters = w;
+    return true;
+}
+
+bool FutureStateBase::removeWaiter(Waiter* w) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_ready) {
+        return false;
+    }
+    if(w->prev) {
+        w->prev->next = w->next;
+    } else if(m_waiters == w) {
+        m_waiters = w->next;
+    } else {
+        return false; // 不在链表里
+    }
+    if(w->next) {
+        w->next->prev = w->prev;
+    }
+    w->prev = w->next = nullptr;
+    return true;
+}
+
+namespace {
+// 等待方提供的节点
+struct EventWaiter : public FutureStateBase::Waiter {
+    FiberEvent event;
+    void onReady() override { event.set(); }
+};
+}
+
+void FutureStateBase::wait() {
+    if(ready()) {
+        return;
+    }
+    // 共享栈协程挂起后栈内存归别的协程使用，完成方不能再写，节点放到堆上
+    if(Scheduler::GetThis() && Fiber::GetThis()->isSharedStack()) {
+        std::unique_ptr<EventWaiter> w(new EventWaiter);
+        if(addWaiter(w.get())) {
+            w->event.wait();
+        }
+        return;
+    }
+    EventWaiter w;
+    if(!addWaiter(&w)) {
+        return;
+    }
+    w.event.wait();
+}
+
+void FutureStateBase::setException(std::exception_ptr e) {
+    beginSet();
+    m_exception = e;
+    markReady();
+}
+
+void FutureStateBase::beginSet() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_setting) {
+        throw std::logic_error("Future already satisfied");
+    }
+    m_setting = true;
+}
+
+void FutureStateBase::markReady() {
+    Waiter* w = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready.store(true, std::memory_order_release);
+        w = m_waiters;
+        m_waiters = nullptr;
+    }
+    // onReady之后节点可能已经被释放，先取next
+    while(w) {
+        Waiter* next = w->next;
+        w->onReady();
+        w = next;
+    }
+}
+
+void WhenState::attach(std::shared_ptr<WhenState> self,
+                       std::vector<std::shared_ptr<FutureStateBase> > inputs) {
+    m_self = std::move(self);
+    m_inputs = std::move(inputs);
+    m_nodes.resize(m_inputs.size());
+    for(size_t i = 0; i < m_nodes.size(); ++i) {
+        m_nodes[i].owner = this;
+        m_nodes[i].index = i;
+    }
+    for(size_t i = 0; i < m_inputs.size() && !m_stop; ++i) {
+        ++m_pending;
+        if(!m_inputs[i]->addWaiter(&m_nodes[i])) {
+            arrive(i);
+        }
+    }
+    // 放掉注册期间的保护计数，之后的release可能销毁自己
+    release();
+}
+
+void WhenState::arrive(size_t index) {
+    if(onArrive(index) && !m_stop.exchange(true)) {
+        for(size_t i = 0; i < m_nodes.size(); ++i) {
+            // 还没注册的节点返回false，注册后由完成回调释放
+            if(i != index && m_inputs[i]->removeWaiter(&m_nodes[i])) {
+                release();
+            }
+        }
+    }
+    release();
+}
+
+void WhenState::release() {
+    if(--m_pending == 0) {
+        std::shared_ptr<WhenState> self;
+        self.swap(m_self);
+    }
+}
+
+namespace {
+class WhenAllState : public WhenState {
+public:
+    WhenAllState(size_t n, std::shared_ptr<FutureState<void> > out)
+        : m_remaining(n), m_out(std::move(out)) {}
+protected:
+    bool onArrive(size_t) override {
+        if(--m_remaining == 0) {
+            m_out->setValue();
+        }
+        return false;
+    }
+private:
+    std::atomic<size_t> m_remaining;
+    std::shared_ptr<FutureState<void> > m_out;
+};
+
+class WhenAnyState : public WhenState {
+public:
+    explicit WhenAnyState(std::shared_ptr<FutureState<size_t> > out)
+        : m_out(std::move(out)) {}
+protected:
+    bool onArrive(size_t index) override {
+        if(m_decided.exchange(true)) {
+            return false;
+        }
+        m_out->setValue(index);
+        return true;
+    }
+private:
+    std::atomic<bool> m_decided {false};
+    std::shared_ptr<FutureState<size_t> > m_out;
+};
+}
+
+Future<void> MakeWhenAll(std::vector<std::shared_ptr<FutureStateBase> > inputs) {
+    std::shared_ptr<FutureState<void> > out = std::make_shared<FutureState<void> >();
+    if(inputs.empty()) {
+        out->setValue();
+        return Future<void>(out);
+    }
+    std::shared_ptr<WhenState> st = std::make_shared<WhenAllState>(inputs.size(), out);
+    WhenState* raw = st.get();
+    raw->attach(std::move(st), std::move(inputs));
+    return Future<void>(out);
+}
+
+Future<size_t> MakeWhenAny(std::vector<std::shared_ptr<FutureStateBase> > inputs) {
+    std::shared_ptr<FutureState<size_t> > out = std::make_shared<FutureState<size_t> >();
+    if(inputs.empty()) {
+        out->setException(std::make_exception_ptr(std::invalid_argument("WhenAny with no futures")));
+        return Future<size_t>(out);
+    }
+    std::shared_ptr<WhenState> st = std::make_shared<WhenAnyState>(out);
+    WhenState* raw = st.get();
+    raw->attach(std::move(st), std::move(inputs));
+    return Future<size_t>(out);
+}
+
+}
+}
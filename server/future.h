@@ -0,0 +1,323 @@
+#ifndef __ZNS_FUTURE_H__
+#define __ZNS_FUTURE_H__
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "scheduler.h"
+#include "fiber_event.h"
+#include "blocking_pool.h"
+
+namespace ZnetServer {
+
+template<class T> class Future;
+template<class T> class Promise;
+
+namespace detail {
+
+/**
+ * @brief Future共享状态中与结果类型无关的部分
+ * @details 等待者是侵入式链表节点，由等待方自己提供(通常在它的栈上)，
+ *          注册和唤醒都不分配内存。完成时在完成方线程上依次回调onReady。
+ */
+class FutureStateBase {
+public:
+    struct Waiter {
+        Waiter* prev = nullptr;
+        Waiter* next = nullptr;
+        virtual ~Waiter() {}
+        // 完成时调用一次，调用之后状态不再访问这个节点
+        virtual void onReady() = 0;
+    };
+
+    FutureStateBase() {}
+    FutureStateBase(const FutureStateBase&) = delete;
+    FutureStateBase& operator=(const FutureStateBase&) = delete;
+    virtual ~FutureStateBase() {}
+
+    bool ready() const { return m_ready.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 注册等待者
+     * @return 已经完成时返回false，不会回调w
+     */
+    bool addWaiter(Waiter* w);
+
+    /**
+     * @brief 取消注册
+     * @return 已经完成(onReady正在或即将被调用)时返回false
+     */
+    bool removeWaiter(Waiter* w);
+
+    /**
+     * @brief 等待完成，协程里只Park当前协程
+     * @details 节点通常放在等待方栈上，共享栈协程的节点分配在堆上
+     */
+    void wait();
+
+    void setException(std::exception_ptr e);
+protected:
+    // 结果已经写好之后调用，唤醒所有等待者
+    void markReady();
+    void beginSet();
+    void rethrowIfException() const {
+        if(m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+protected:
+    std::mutex m_mutex;
+    std::atomic<bool> m_ready {false};
+    bool m_setting = false;
+    Waiter* m_waiters = nullptr;
+    std::exception_ptr m_exception;
+};
+
+// 结果直接放在状态对象内部，和shared_ptr控制块一起只分配一次
+template<class T>
+class FutureState : public FutureStateBase {
+public:
+    ~FutureState() {
+        if(m_hasValue) {
+            reinterpret_cast<T*>(&m_storage)->~T();
+        }
+    }
+
+    template<class U>
+    void setValue(U&& v) {
+        beginSet();
+        ::new (&m_storage) T(std::forward<U>(v));
+        m_hasValue = true;
+        markReady();
+    }
+
+    // 等待并把结果移出，只能调用一次
+    T take() {
+        wait();
+        rethrowIfException();
+        return std::move(*reinterpret_cast<T*>(&m_storage));
+    }
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+    bool m_hasValue = false;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase {
+public:
+    void setValue() {
+        beginSet();
+        markReady();
+    }
+
+    void take() {
+        wait();
+        rethrowIfException();
+    }
+};
+
+// 执行回调并把结果或异常写进状态
+template<class R>
+struct FutureSetter {
+    template<class F>
+    static void Run(F& f, FutureState<R>& st) { st.setValue(f()); }
+};
+
+template<>
+struct FutureSetter<void> {
+    template<class F>
+    static void Run(F& f, FutureState<void>& st) {
+        f();
+        st.setValue();
+    }
+};
+
+template<class F, class R>
+struct AsyncTask {
+    F func;
+    std::shared_ptr<FutureState<R> > state;
+
+    void operator()() {
+        try {
+            FutureSetter<R>::Run(func, *state);
+        } catch(...) {
+            state->setException(std::current_exception());
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief 异步结果
+ * @details get()在调度器协程里只Park当前协程，不阻塞工作线程；
+ *          在普通线程上阻塞等待。结果只能取一次。
+ *          可以复制，多个Future共享同一个结果。
+ *
+ *          Future<int> a = sc.async([]{ return callBackendA(); });
+ *          Future<int> b = sc.async([]{ return callBackendB(); });
+ *          int r = a.get() + b.get();
+ */
+template<class T>
+class Future {
+public:
+    typedef std::shared_ptr<detail::FutureState<T> > StatePtr;
+
+    Future() {}
+    explicit Future(StatePtr st) : m_state(std::move(st)) {}
+
+    bool valid() const { return (bool)m_state; }
+    bool ready() const { return m_state && m_state->ready(); }
+
+    void wait() const {
+        checkValid();
+        m_state->wait();
+    }
+
+    /**
+     * @brief 等待并取出结果，回调抛出的异常在这里重新抛出
+     */
+    T get() {
+        checkValid();
+        return m_state->take();
+    }
+
+    // 组合器(WhenAll/WhenAny)使用
+    const StatePtr& getState() const { return m_state; }
+private:
+    void checkValid() const {
+        if(!m_state) {
+            throw std::logic_error("Future has no state");
+        }
+    }
+private:
+    StatePtr m_state;
+};
+
+/**
+ * @brief 手动完成的Future，用于把回调式接口接到Future上
+ * @details 没有设置结果就析构时，Future得到std::runtime_error("broken promise")
+ */
+template<class T>
+class Promise {
+public:
+    Promise() : m_state(std::make_shared<detail::FutureState<T> >()) {}
+    Promise(Promise&&) = default;
+    Promise& operator=(Promise&&) = default;
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise() {
+        if(m_state && !m_done) {
+            m_state->setException(std::make_exception_ptr(std::runtime_error("broken promise")));
+        }
+    }
+
+    Future<T> getFuture() { return Future<T>(m_state); }
+
+    template<class... Args>
+    void setValue(Args&&... args) {
+        m_done = true;
+        m_state->setValue(std::forward<Args>(args)...);
+    }
+
+    void setException(std::exception_ptr e) {
+        m_done = true;
+        m_state->setException(e);
+    }
+private:
+    std::shared_ptr<detail::FutureState<T> > m_state;
+    bool m_done = false;
+};
+
+template<class F>
+Future<typename std::result_of<F()>::type> Scheduler::async(F&& f) {
+    typedef typename std::result_of<F()>::type R;
+    typedef typename std::decay<F>::type D;
+    std::shared_ptr<detail::FutureState<R> > st = std::make_shared<detail::FutureState<R> >();
+    schedule(detail::AsyncTask<D, R>{std::forward<F>(f), st});
+    return Future<R>(std::move(st));
+}
+
+template<class F>
+typename std::result_of<F()>::type Scheduler::Offload(F&& f) {
+    typedef typename std::result_of<F()>::type R;
+    typedef typename std::decay<F>::type D;
+    // 普通线程和调度协程本来就可以阻塞，也没法Park；
+    // 共享栈协程Park之后，池里的线程写它栈上的变量会写到别的协程的栈里
+    if(!GetThis() || Fiber::GetThis().get() == GetMainFiber() || Fiber::GetThis()->isSharedStack()) {
+        return f();
+    }
+    std::shared_ptr<detail::FutureState<R> > st = std::make_shared<detail::FutureState<R> >();
+    BlockingPool::GetInstance()->submit(detail::AsyncTask<D, R>{std::forward<F>(f), st});
+    return st->take();
+}
+
+namespace detail {
+
+// 组合器: 给每个输入注册一个节点，自身引用保持到所有节点都回调或取消为止
+class WhenState {
+public:
+    struct Node : public FutureStateBase::Waiter {
+        WhenState* owner = nullptr;
+        size_t index = 0;
+        void onReady() override { owner->arrive(index); }
+    };
+
+    virtual ~WhenState() {}
+    void attach(std::shared_ptr<WhenState> self,
+                std::vector<std::shared_ptr<FutureStateBase> > inputs);
+    void arrive(size_t index);
+protected:
+    // 第index个输入完成，返回true表示结果已定，取消其余输入上的节点
+    virtual bool onArrive(size_t index) = 0;
+    void release();
+protected:
+    std::vector<std::shared_ptr<FutureStateBase> > m_inputs;
+    std::vector<Node> m_nodes;
+    std::atomic<size_t> m_pending {1};
+    std::atomic<bool> m_stop {false};
+    std::shared_ptr<WhenState> m_self;
+};
+
+Future<void> MakeWhenAll(std::vector<std::shared_ptr<FutureStateBase> > inputs);
+Future<size_t> MakeWhenAny(std::vector<std::shared_ptr<FutureStateBase> > inputs);
+
+} // namespace detail
+
+/**
+ * @brief 所有输入都完成(包括以异常结束)时完成，之后逐个get()取结果不会再等待
+ */
+template<class T>
+Future<void> WhenAll(const std::vector<Future<T> >& futures) {
+    std::vector<std::shared_ptr<detail::FutureStateBase> > inputs;
+    inputs.reserve(futures.size());
+    for(auto& f : futures) {
+        inputs.push_back(f.getState());
+    }
+    return detail::MakeWhenAll(std::move(inputs));
+}
+
+/**
+ * @brief 任意一个输入完成时完成，结果是它在futures中的下标
+ * @details futures为空时结果抛std::invalid_argument
+ */
+template<class T>
+Future<size_t> WhenAny(const std::vector<Future<T> >& futures) {
+    std::vector<std::shared_ptr<detail::FutureStateBase> > inputs;
+    inputs.reserve(futures.size());
+    for(auto& f : futures) {
+        inputs.push_back(f.getState());
+    }
+    return detail::MakeWhenAny(std::move(inputs));
+}
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include "histogram.h"
+#include <algorithm>
+
+namespace ZnetServer {
+
+Histogram::Histogram() {
+    for(int i = 0; i < BUCKETS; ++i) {
+        m_counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Histogram::BucketMax(int index) {
+    if(index < SUB_COUNT) {
+        return index;
+    }
+    int e = index / SUB_COUNT + SUB_BITS - 1;
+    uint64_t sub = index % SUB_COUNT;
+    uint64_t low = (1ull << e) | (sub << (e - SUB_BITS));
+    return low + ((1ull << (e - SUB_BITS)) - 1);
+}
+
+HistogramStats Histogram::Summarize(const std::vector<const Histogram*>& hists) {
+    HistogramStats st;
+    std::vector<uint64_t> counts(BUCKETS, 0);
+    uint64_t sum = 0;
+    uint64_t min = ~0ull;
+    for(const Histogram* h : hists) {
+        for(int i = 0; i < BUCKETS; ++i) {
+            counts[i] += h->m_counts[i].load(std::memory_order_relaxed);
+        }
+        sum += h->m_sum.load(std::memory_order_relaxed);
+        st.max = std::max(st.max, h->m_max.load(std::memory_order_relaxed));
+        min = std::min(min, h->m_min.load(std::memory_order_relaxed));
+    }
+    for(uint64_t c : counts) {
+        st.count += c;
+    }
+    if(!st.count) {
+        return st;
+    }
+    st.min = min;
+    st.mean = (double)sum / st.count;
+    // 分位数对应的名次，从1开始
+    const double pcts[] = {0.5, 0.9, 0.99, 0.999};
+    uint64_t* outs[] = {&st.p50, &st.p90, &st.p99, &st.p999};
+    uint64_t seen = 0;
+    int k = 0;
+    for(int i = 0; i < BUCKETS && k < 4; ++i) {
+        seen += counts[i];
+        while(k < 4 && seen >= (uint64_t)(pcts[k] * st.count + 0.999999)) {
+            // 桶上界可能超过实际出现过的最大值
+            *outs[k] = std::min(BucketMax(i), st.max);
+            ++k;
+        }
+    }
+    return st;
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef __ZNS_HISTOGRAM_H__
+#define __ZNS_HISTOGRAM_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace ZnetServer {
+
+/**
+ * @brief 直方图的汇总结果
+ */
+struct HistogramStats {
+    uint64_t count = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+    double mean = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+};
+
+/**
+ * @brief HDR风格的直方图
+ * @details 每个2的幂区间再线性分成16个桶，相对误差不超过1/16，覆盖整个uint64_t范围。
+ *          只允许一个线程写(各工作线程各自一份)，用relaxed的读改写代替原子加，
+ *          其他线程随时可以读，读到的是某个时刻附近的近似值
+ */
+class Histogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    Histogram();
+
+    /**
+     * @brief 记录一个值，只能由所属线程调用
+     */
+    void record(uint64_t value) {
+        int i = BucketIndex(value);
+        m_counts[i].store(m_counts[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sum.store(m_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if(value > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(value, std::memory_order_relaxed);
+        }
+        if(value < m_min.load(std::memory_order_relaxed)) {
+            m_min.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 合并多个直方图并计算分位数，分位数取所在桶的上界
+     */
+    static HistogramStats Summarize(const std::vector<const Histogram*>& hists);
+
+    static int BucketIndex(uint64_t value) {
+        if(value < (uint64_t)SUB_COUNT) {
+            return (int)value;
+        }
+        int e = 63 - __builtin_clzll(value);
+        return (e - SUB_BITS + 1) * SUB_COUNT + (int)((value >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    /**
+     * @brief 第index个桶能放的最大值
+     */
+    static uint64_t BucketMax(int index);
+private:
+    std::atomic<uint64_t> m_counts[BUCKETS];
+    std::atomic<uint64_t> m_sum {0};
+    std::atomic<uint64_t> m_max {0};
+    std::atomic<uint64_t> m_min {~0ull};
+};
+
+}
+
+#endif
@@ -0,0 +1,407 @@
+#include "hook.h"
+#include "fd_manager.h"
+#include "iomanager.h"
+#include "fiber.h"
+#include "util.h"
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <atomic>
+#include <memory>
+
+#define ZNS_HOOK_FUN(XX) \
+    XX(sleep) \
+    XX(usleep) \
+    XX(nanosleep) \
+    XX(socket) \
+    XX(connect) \
+    XX(accept) \
+    XX(read) \
+    XX(readv) \
+    XX(recv) \
+    XX(recvfrom) \
+    XX(recvmsg) \
+    XX(write) \
+    XX(writev) \
+    XX(send) \
+    XX(sendto) \
+    XX(sendmsg) \
+    XX(close) \
+    XX(fcntl) \
+    XX(ioctl) \
+    XX(setsockopt)
+
+extern "C" {
+#define XX(name) name ## _fun name ## _f = nullptr;
+    ZNS_HOOK_FUN(XX)
+#undef XX
+}
+
+// 先于所有全局对象的构造取得原函数，它们的构造函数里也可能调到被覆盖的函数
+__attribute__((constructor(101))) static void HookInit() {
+#define XX(name) name ## _f = (name ## _fun)dlsym(RTLD_NEXT, #name);
+    ZNS_HOOK_FUN(XX)
+#undef XX
+}
+
+namespace ZnetServer {
+
+static thread_local bool t_hook_enable = false;
+
+bool IsHookEnable() {
+    return t_hook_enable;
+}
+
+void SetHookEnable(bool flag) {
+    t_hook_enable = flag;
+}
+
+// 可以挂起当前协程时返回所在的IOManager，否则调用方直接调用原函数
+static IOManager* HookIOManager() {
+    if(!t_hook_enable) {
+        return nullptr;
+    }
+    IOManager* iom = IOManager::GetThis();
+    if(!iom || Fiber::GetThis().get() == Scheduler::GetMainFiber()) {
+        return nullptr;
+    }
+    return iom;
+}
+
+static void FiberSleep(IOManager* iom, uint64_t ms) {
+    std::shared_ptr<std::atomic<bool> > done = std::make_shared<std::atomic<bool> >(false);
+    Fiber::ptr fiber = Fiber::GetThis();
+    iom->addTimer(ms, [done, fiber]() {
+        done->store(true, std::memory_order_release);
+        Scheduler::Unpark(fiber);
+    });
+    // Park的虚假返回不算
+    do {
+        Scheduler::Park();
+    } while(!done->load(std::memory_order_acquire));
+}
+
+// 把等待的结果转成errno，恢复后可能换了线程，errno经过SetErrno写
+static int WaitFailed(const FdCtx::ptr& ctx, int rt, int timeout_errno) {
+    if(rt == -ETIMEDOUT) {
+        SetErrno(timeout_errno);
+    } else {
+        // close从别的协程关掉了fd
+        SetErrno(ctx->isClosed() ? EBADF : -rt);
+    }
+    return -1;
+}
+
+// hook住的socket按阻塞语义执行f: EAGAIN时挂起协程等fd就绪再重试，
+// timeout_so(SO_RCVTIMEO/SO_SNDTIMEO)是整个调用的超时，超时和内核一样以EAGAIN返回
+template<class F>
+static ssize_t DoIO(int fd, F f, IOManager::Event event, int timeout_so) {
+    IOManager* iom = HookIOManager();
+    if(!iom) {
+        return f();
+    }
+    FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+    if(!ctx) {
+        return f();
+    }
+    if(ctx->isClosed()) {
+        errno = EBADF;
+        return -1;
+    }
+    if(!ctx->isSocket() || ctx->getUserNonblock()) {
+        return f();
+    }
+    uint64_t timeout = ctx->getTimeout(timeout_so);
+    uint64_t deadline = timeout == ~0ull ? ~0ull : GetCurrentMS() + timeout;
+    while(true) {
+        ssize_t n = f();
+        if(n >= 0) {
+            return n;
+        }
+        int err = GetErrno();
+        if(err == EINTR) {
+            continue;
+        }
+        if(err != EAGAIN && err != EWOULDBLOCK) {
+            return n;
+        }
+        uint64_t wait = ~0ull;
+        if(deadline != ~0ull) {
+            uint64_t now = GetCurrentMS();
+            if(now >= deadline) {
+                SetErrno(EAGAIN);
+                return -1;
+            }
+            wait = deadline - now;
+        }
+        int rt = iom->waitEvent(fd, event, wait);
+        if(rt) {
+            return WaitFailed(ctx, rt, EAGAIN);
+        }
+    }
+}
+
+}
+
+using ZnetServer::FdCtx;
+using ZnetServer::FdManager;
+using ZnetServer::IOManager;
+
+extern "C" {
+
+unsigned int sleep(unsigned int seconds) {
+    IOManager* iom = ZnetServer::HookIOManager();
+    if(!iom) {
+        return sleep_f(seconds);
+    }
+    ZnetServer::FiberSleep(iom, seconds * 1000ull);
+    return 0;
+}
+
+int usleep(useconds_t usec) {
+    IOManager* iom = ZnetServer::HookIOManager();
+    if(!iom) {
+        return usleep_f(usec);
+    }
+    ZnetServer::FiberSleep(iom, (usec + 999) / 1000);
+    return 0;
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+    IOManager* iom = ZnetServer::HookIOManager();
+    // 非法参数交给原函数报错
+    if(!iom || !req || req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+        return nanosleep_f(req, rem);
+    }
+    ZnetServer::FiberSleep(iom, req->tv_sec * 1000ull + (req->tv_nsec + 999999) / 1000000);
+    return 0;
+}
+
+int socket(int domain, int type, int protocol) {
+    int fd = socket_f(domain, type, protocol);
+    if(fd >= 0 && ZnetServer::IsHookEnable()) {
+        FdManager::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+    IOManager* iom = ZnetServer::HookIOManager();
+    if(!iom) {
+        return connect_f(sockfd, addr, addrlen);
+    }
+    FdCtx::ptr ctx = FdManager::GetInstance()->get(sockfd);
+    if(!ctx || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return connect_f(sockfd, addr, addrlen);
+    }
+    if(ctx->isClosed()) {
+        errno = EBADF;
+        return -1;
+    }
+    int n = connect_f(sockfd, addr, addrlen);
+    if(n == 0 || errno != EINPROGRESS) {
+        return n;
+    }
+    // 阻塞socket的connect受SO_SNDTIMEO限制，超时返回EINPROGRESS
+    int rt = iom->waitEvent(sockfd, IOManager::WRITE, ctx->getTimeout(SO_SNDTIMEO));
+    if(rt) {
+        return ZnetServer::WaitFailed(ctx, rt, EINPROGRESS);
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if(getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len)) {
+        return -1;
+    }
+    if(err) {
+        ZnetServer::SetErrno(err);
+        return -1;
+    }
+    return 0;
+}
+
+int accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
+    int fd = (int)ZnetServer::DoIO(s, [=]() {
+        return accept_f(s, addr, addrlen);
+    }, IOManager::READ, SO_RCVTIMEO);
+    if(fd >= 0 && ZnetServer::IsHookEnable()) {
+        FdManager::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+    return ZnetServer::DoIO(fd, [=]() {
+        return read_f(fd, buf, count);
+    }, IOManager::READ, SO_RCVTIMEO);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+    return ZnetServer::DoIO(fd, [=]() {
+        return readv_f(fd, iov, iovcnt);
+    }, IOManager::READ, SO_RCVTIMEO);
+}
+
+ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
+    return ZnetServer::DoIO(sockfd, [=]() {
+        return recv_f(sockfd, buf, len, flags);
+    }, IOManager::READ, SO_RCVTIMEO);
+}
+
+ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags,
+                 struct sockaddr* src_addr, socklen_t* addrlen) {
+    return ZnetServer::DoIO(sockfd, [=]() {
+        return recvfrom_f(sockfd, buf, len, flags, src_addr, addrlen);
+    }, IOManager::READ, SO_RCVTIMEO);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+    return ZnetServer::DoIO(sockfd, [=]() {
+        return recvmsg_f(sockfd, msg, flags);
+    }, IOManager::READ, SO_RCVTIMEO);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+    return ZnetServer::DoIO(fd, [=]() {
+        return write_f(fd, buf, count);
+    }, IOManager::WRITE, SO_SNDTIMEO);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+    return ZnetServer::DoIO(fd, [=]() {
+        return writev_f(fd, iov, iovcnt);
+    }, IOManager::WRITE, SO_SNDTIMEO);
+}
+
+ssize_t send(int s, const void* msg, size_t len, int flags) {
+    return ZnetServer::DoIO(s, [=]() {
+        return send_f(s, msg, len, flags);
+    }, IOManager::WRITE, SO_SNDTIMEO);
+}
+
+ssize_t sendto(int s, const void* msg, size_t len, int flags,
+               const struct sockaddr* to, socklen_t tolen) {
+    return ZnetServer::DoIO(s, [=]() {
+        return sendto_f(s, msg, len, flags, to, tolen);
+    }, IOManager::WRITE, SO_SNDTIMEO);
+}
+
+ssize_t sendmsg(int s, const struct msghdr* msg, int flags) {
+    return ZnetServer::DoIO(s, [=]() {
+        return sendmsg_f(s, msg, flags);
+    }, IOManager::WRITE, SO_SNDTIMEO);
+}
+
+int close(int fd) {
+    // 不管哪个线程关闭都要删掉上下文，fd复用之后不能沿用
+    FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+    if(ctx) {
+        ctx->setClosed();
+        if(ZnetServer::IsHookEnable()) {
+            IOManager* iom = IOManager::GetThis();
+            if(iom) {
+                iom->cancelAll(fd);
+            }
+        }
+        FdManager::GetInstance()->del(fd);
+    }
+    return close_f(fd);
+}
+
+int fcntl(int fd, int cmd, ... /* arg */ ) {
+    va_list va;
+    va_start(va, cmd);
+    switch(cmd) {
+    case F_SETFL: {
+        int arg = va_arg(va, int);
+        va_end(va);
+        FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+        if(!ctx || ctx->isClosed() || !ctx->isSocket()) {
+            return fcntl_f(fd, cmd, arg);
+        }
+        // 记下用户要的阻塞方式，系统层保持非阻塞
+        ctx->setUserNonblock(arg & O_NONBLOCK);
+        if(ctx->getSysNonblock()) {
+            arg |= O_NONBLOCK;
+        } else {
+            arg &= ~O_NONBLOCK;
+        }
+        return fcntl_f(fd, cmd, arg);
+    }
+    case F_GETFL: {
+        va_end(va);
+        int arg = fcntl_f(fd, cmd);
+        FdCtx::ptr ctx = FdManager::GetInstance()->get(fd);
+        if(arg < 0 || !ctx || ctx->isClosed() || !ctx->isSocket()) {
+            return arg;
+        }
+        return ctx->getUserNonblock() ? arg | O_NONBLOCK : arg & ~O_NONBLOCK;
+    }
+    case F_DUPFD:
+    case F_DUPFD_CLOEXEC:
+    case F_SETFD:
+    case F_SETOWN:
+    case F_SETSIG:
+    case F_SETLEASE:
+    case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+    case F_SETPIPE_SZ:
+#endif
+    {
+        int arg = va_arg(va, int);
+        va_end(va);
+        return fcntl_f(fd, cmd, arg);
+    }
+    case F_GETFD:
+    case F_GETOWN:
+    case F_GETSIG:
+    case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+    case F_GETPIPE_SZ:
+#endif
+        va_end(va);
+        return fcntl_f(fd, cmd);
+    default: {
+        // 其余命令的参数都是指针(struct flock*、struct f_owner_ex*等)
+        void* arg = va_arg(va, void*);
+        va_end(va);
+        return fcntl_f(fd, cmd, arg);
+    }
+    }
+}
+
+int ioctl(int d, unsigned long int request, ...) {
+    va_list va;
+    va_start(va, request);
+    void* arg = va_arg(va, void*);
+    va_end(va);
+    if(request == FIONBIO && arg) {
+        FdCtx::ptr ctx = FdManager::GetInstance()->get(d);
+        if(ctx && !ctx->isClosed() && ctx->isSocket()) {
+            ctx->setUserNonblock(*(int*)arg != 0);
+            if(ctx->getSysNonblock()) {
+                int on = 1;
+                return ioctl_f(d, request, &on);
+            }
+        }
+    }
+    return ioctl_f(d, request, arg);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t optlen) {
+    int rt = setsockopt_f(sockfd, level, optname, optval, optlen);
+    if(rt == 0 && level == SOL_SOCKET && (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)
+            && optval && optlen >= sizeof(struct timeval)) {
+        FdCtx::ptr ctx = FdManager::GetInstance()->get(sockfd);
+        if(ctx) {
+            const struct timeval* tv = (const struct timeval*)optval;
+            uint64_t ms = tv->tv_sec * 1000ull + (tv->tv_usec + 999) / 1000;
+            // 和内核一样，0表示不超时
+            ctx->setTimeout(optname, ms ? ms : ~0ull);
+        }
+    }
+    return rt;
+}
+
+}
@@ -0,0 +1,101 @@
+#ifndef __ZNS_HOOK_H__
+#define __ZNS_HOOK_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace ZnetServer {
+
+/**
+ * @brief 当前线程是否开启hook
+ * @details 本库用同名函数覆盖libc的阻塞调用，原函数用dlsym(RTLD_NEXT)取得。
+ *          开启hook的线程上，IOManager的工作协程调用这些函数时:
+ *            sleep/usleep/nanosleep  用定时器挂起协程，不阻塞线程
+ *            socket上的读写/accept/connect  在hook之内把socket设成非阻塞，
+ *                EAGAIN时挂起协程等fd就绪再重试，遵守SO_RCVTIMEO/SO_SNDTIMEO
+ *          超时的返回同内核: 读写以EAGAIN失败，connect以EINPROGRESS失败。
+ *          只处理hook开启时由socket/accept创建的socket，用户自己设了非阻塞的照原样调用。
+ *          没开启hook的线程、调度协程和非IOManager的线程上一律直接调用原函数。
+ *          IOManager的工作线程在配置iomanager.hook为true时开启。
+ */
+bool IsHookEnable();
+
+/**
+ * @brief 开启或关闭当前线程的hook
+ */
+void SetHookEnable(bool flag);
+
+}
+
+extern "C" {
+
+typedef unsigned int (*sleep_fun)(unsigned int seconds);
+extern sleep_fun sleep_f;
+
+typedef int (*usleep_fun)(useconds_t usec);
+extern usleep_fun usleep_f;
+
+typedef int (*nanosleep_fun)(const struct timespec* req, struct timespec* rem);
+extern nanosleep_fun nanosleep_f;
+
+typedef int (*socket_fun)(int domain, int type, int protocol);
+extern socket_fun socket_f;
+
+typedef int (*connect_fun)(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+extern connect_fun connect_f;
+
+typedef int (*accept_fun)(int s, struct sockaddr* addr, socklen_t* addrlen);
+extern accept_fun accept_f;
+
+typedef ssize_t (*read_fun)(int fd, void* buf, size_t count);
+extern read_fun read_f;
+
+typedef ssize_t (*readv_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern readv_fun readv_f;
+
+typedef ssize_t (*recv_fun)(int sockfd, void* buf, size_t len, int flags);
+extern recv_fun recv_f;
+
+typedef ssize_t (*recvfrom_fun)(int sockfd, void* buf, size_t len, int flags,
+                                struct sockaddr* src_addr, socklen_t* addrlen);
+extern recvfrom_fun recvfrom_f;
+
+typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr* msg, int flags);
+extern recvmsg_fun recvmsg_f;
+
+typedef ssize_t (*write_fun)(int fd, const void* buf, size_t count);
+extern write_fun write_f;
+
+typedef ssize_t (*writev_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern writev_fun writev_f;
+
+typedef ssize_t (*send_fun)(int s, const void* msg, size_t len, int flags);
+extern send_fun send_f;
+
+typedef ssize_t (*sendto_fun)(int s, const void* msg, size_t len, int flags,
+                              const struct sockaddr* to, socklen_t tolen);
+extern sendto_fun sendto_f;
+
+typedef ssize_t (*sendmsg_fun)(int s, const struct msghdr* msg, int flags);
+extern sendmsg_fun sendmsg_f;
+
+typedef int (*close_fun)(int fd);
+extern close_fun close_f;
+
+typedef int (*fcntl_fun)(int fd, int cmd, ... /* arg */ );
+extern fcntl_fun fcntl_f;
+
+typedef int (*ioctl_fun)(int d, unsigned long int request, ...);
+extern ioctl_fun ioctl_f;
+
+typedef int (*setsockopt_fun)(int sockfd, int level, int optname,
+                              const void* optval, socklen_t optlen);
+extern setsockopt_fun setsockopt_f;
+
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include "io_uring.h"
+
+#if ZNS_HAS_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+namespace ZnetServer {
+
+static int SysSetup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int SysEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int SysRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IoUring::ptr IoUring::Create(unsigned entries, unsigned cq_entries, const uint8_t* ops, size_t n_ops) {
+    ptr ring(new IoUring);
+    if(!ring->init(entries, cq_entries) || !ring->probe(ops, n_ops)) {
+        return nullptr;
+    }
+    return ring;
+}
+
+bool IoUring::init(unsigned entries, unsigned cq_entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    p.cq_entries = cq_entries;
+    m_fd = SysSetup(entries, &p);
+    if(m_fd < 0) {
+        return false;
+    }
+    // 没有NODROP时CQ满了会丢完成项，等待它的协程永远醒不过来
+    if(!(p.features & IORING_FEAT_NODROP)) {
+        return false;
+    }
+    m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single && m_cqRingSize > m_sqRingSize) {
+        m_sqRingSize = m_cqRingSize;
+    }
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        return false;
+    }
+    if(single) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if(m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            return false;
+        }
+    }
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = (io_uring_sqe*)sqes;
+
+    char* sq = (char*)m_sqRing;
+    m_sqHead = (unsigned*)(sq + p.sq_off.head);
+    m_sqTail = (unsigned*)(sq + p.sq_off.tail);
+    m_sqFlags = (unsigned*)(sq + p.sq_off.flags);
+    m_sqArray = (unsigned*)(sq + p.sq_off.array);
+    m_sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    m_sqEntries = p.sq_entries;
+    m_sqeTail = m_submitted = *m_sqTail;
+
+    char* cq = (char*)m_cqRing;
+    m_cqHead = (unsigned*)(cq + p.cq_off.head);
+    m_cqTail = (unsigned*)(cq + p.cq_off.tail);
+    m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    m_cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    return true;
+}
+
+bool IoUring::probe(const uint8_t* ops, size_t n_ops) {
+    const unsigned n = 256;
+    size_t size = sizeof(io_uring_probe) + n * sizeof(io_uring_probe_op);
+    io_uring_probe* pr = (io_uring_probe*)calloc(1, size);
+    if(!pr) {
+        return false;
+    }
+    bool ok = SysRegister(m_fd, IORING_REGISTER_PROBE, pr, n) == 0;
+    for(size_t i = 0; ok && i < n_ops; ++i) {
+        ok = ops[i] <= pr->last_op && (pr->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(pr);
+    return ok;
+}
+
+IoUring::~IoUring() {
+    if(m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if(m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    // 内核只在io_uring_enter里消费SQE，head不会越过已提交的部分
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(m_sqeTail - head >= m_sqEntries) {
+        return nullptr;
+    }
+    unsigned idx = m_sqeTail & m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[idx] = idx;
+    ++m_sqeTail;
+    return sqe;
+}
+
+int IoUring::submit() {
+    unsigned n = m_sqeTail - m_submitted;
+    if(n == 0) {
+        return 0;
+    }
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+    int rt = 0;
+    do {
+        rt = SysEnter(m_fd, n, 0, 0);
+    } while(rt < 0 && errno == EINTR);
+    if(rt < 0) {
+        return -errno;
+    }
+    m_submitted += rt;
+    return rt;
+}
+
+bool IoUring::flushOverflow() {
+    int rt = 0;
+    do {
+        rt = SysEnter(m_fd, 0, 0, IORING_ENTER_GETEVENTS);
+    } while(rt < 0 && errno == EINTR);
+    return rt >= 0;
+}
+
+}
+
+#endif
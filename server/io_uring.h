@@ -0,0 +1,110 @@
+#ifndef __ZNS_IO_URING_H__
+#define __ZNS_IO_URING_H__
+
+#if ZNS_HAS_IO_URING
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <linux/io_uring.h>
+
+namespace ZnetServer {
+
+/**
+ * @brief io_uring环形队列的最小封装
+ * @details 直接用io_uring_setup/io_uring_enter/io_uring_register系统调用，不依赖liburing。
+ *          不加锁: 同一时刻只能有一个线程准备和提交SQE，也只能有一个线程收割完成项，
+ *          两端可以是不同的线程
+ */
+class IoUring {
+public:
+    typedef std::unique_ptr<IoUring> ptr;
+
+    /**
+     * @brief 创建
+     * @param[in] entries SQ大小
+     * @param[in] cq_entries CQ大小，在途请求可以比它多，溢出的完成项由内核暂存(NODROP)
+     * @param[in] ops 需要支持的操作码
+     * @return 内核不支持io_uring、不支持NODROP或者缺少某个操作码时返回nullptr
+     */
+    static ptr Create(unsigned entries, unsigned cq_entries, const uint8_t* ops, size_t n_ops);
+    ~IoUring();
+
+    /**
+     * @brief ring的fd，CQ里有完成项时可读，可以加进epoll
+     */
+    int getFd() const { return m_fd; }
+
+    /**
+     * @brief 取一个清零的SQE，SQ满时返回nullptr
+     * @details 填好之后由下一次submit批量交给内核
+     */
+    io_uring_sqe* getSqe();
+
+    /**
+     * @brief 准备好还没交给内核的SQE数
+     */
+    unsigned getUnsubmitted() const { return m_sqeTail - m_submitted; }
+
+    /**
+     * @brief 一次系统调用提交所有准备好的SQE，返回提交数，失败返回-errno
+     */
+    int submit();
+
+    /**
+     * @brief 取出所有完成项，对每一项调用cb(user_data, res)，返回处理的个数
+     */
+    template<class F>
+    unsigned reap(F cb) {
+        unsigned n = 0;
+        while(true) {
+            unsigned head = *m_cqHead;
+            unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            while(head != tail) {
+                const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+                cb(cqe.user_data, cqe.res);
+                ++head;
+                ++n;
+            }
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            // CQ满过，内核暂存的完成项要进入一次内核才会搬进CQ
+            if(!(__atomic_load_n(m_sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+                    || !flushOverflow()) {
+                return n;
+            }
+        }
+    }
+private:
+    IoUring() {}
+    bool init(unsigned entries, unsigned cq_entries);
+    bool probe(const uint8_t* ops, size_t n_ops);
+    bool flushOverflow();
+private:
+    int m_fd = -1;
+    void* m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    void* m_cqRing = nullptr;  // 内核支持SINGLE_MMAP时和m_sqRing是同一块
+    size_t m_cqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqFlags = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned m_sqeTail = 0;   // 已经准备的SQE
+    unsigned m_submitted = 0; // 其中已经交给内核的
+
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+    unsigned m_cqMask = 0;
+};
+
+}
+
+#endif
+
+#endif
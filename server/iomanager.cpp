@@ -0,0 +1,744 @@
+#include "iomanager.h"
+#include "io_uring.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "hook.h"
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace ZnetServer {
+
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+static ConfigVar<std::string>::ptr g_iomanager_backend =
+    Config::Create<std::string>("iomanager.backend", "epoll", "iomanager io backend: epoll or io_uring");
+static ConfigVar<bool>::ptr g_iomanager_hook =
+    Config::Create<bool>("iomanager.hook", false, "hook blocking libc calls on iomanager worker threads");
+
+#if ZNS_HAS_IO_URING
+struct IOManager::UringContext {
+    IoUring::ptr ring;    // 只有所属的工作线程准备和提交请求
+    std::mutex cq_mutex;  // 所属线程和poller都可能收割
+};
+
+static const uint8_t s_uringOps[] = {
+    IORING_OP_READ, IORING_OP_WRITE, IORING_OP_ACCEPT, IORING_OP_CONNECT,
+    IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL,
+};
+#else
+struct IOManager::UringContext {
+};
+#endif
+
+// epoll的data里ring的指针最低位置1，和FdContext区分
+static const uint64_t URING_TAG = 1;
+
+// 协程版IO的一次等待，放在等待协程的栈上: epoll事件的waiter或者io_uring请求的user_data
+struct IOWaiter {
+    Fiber::ptr fiber;
+    int res = 0; // epoll: 0就绪，-ECANCELED被取消，-ETIMEDOUT超时；io_uring: 完成项的res
+    std::atomic<bool> done {false};
+};
+
+// 写入结果并唤醒等待的协程
+static void Complete(IOWaiter* w, int res) {
+    Fiber::ptr fiber;
+    fiber.swap(w->fiber);
+    w->res = res;
+    // 之后协程随时可能返回，w所在的栈不能再碰
+    w->done.store(true, std::memory_order_release);
+    Scheduler::Unpark(fiber);
+}
+
+// 挂起直到Complete，Park的虚假返回不算
+static int WaitComplete(IOWaiter* w) {
+    do {
+        Scheduler::Park();
+    } while(!w->done.load(std::memory_order_acquire));
+    return w->res;
+}
+
+static ssize_t ToResult(int res) {
+    if(res < 0) {
+        SetErrno(-res);
+        return -1;
+    }
+    return res;
+}
+
+
+IOManager::IOManager(int threads, bool use_caller, const std::string& name)
+    : Scheduler(threads, use_caller, name) {
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(m_epfd < 0) {
+        throw std::runtime_error("IOManager epoll_create error");
+    }
+    // poller的eventfd，data.ptr为空以区分fd事件
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, getPollerFd(), &ev)) {
+        close(m_epfd);
+        throw std::runtime_error("IOManager epoll_ctl error");
+    }
+    m_fdContexts.resize(64, nullptr);
+
+    m_hook = g_iomanager_hook->getValue();
+    const std::string& backend = g_iomanager_backend->getValue();
+    if(backend == "io_uring") {
+        if(initUring()) {
+            m_backend = IO_URING;
+        } else {
+            ZNS_LOG_WARN(g_logger) << "IOManager io_uring not supported, fall back to epoll";
+        }
+    } else if(backend != "epoll") {
+        ZNS_LOG_WARN(g_logger) << "IOManager unknown backend " << backend << ", use epoll";
+    }
+}
+
+IOManager::~IOManager() {
+    close(m_epfd);
+    for(FdContext* ctx : m_fdContexts) {
+        delete ctx;
+    }
+    for(UringContext* ctx : m_urings) {
+        delete ctx;
+    }
+}
+
+bool IOManager::initUring() {
+#if ZNS_HAS_IO_URING
+    std::vector<UringContext*> urings;
+    for(int i = 0; i < getWorkerCount(); ++i) {
+        UringContext* ctx = new UringContext;
+        urings.push_back(ctx);
+        ctx->ring = IoUring::Create(256, 4096, s_uringOps, sizeof(s_uringOps));
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = (uint64_t)(uintptr_t)ctx | URING_TAG;
+        if(!ctx->ring || epoll_ctl(m_epfd, EPOLL_CTL_ADD, ctx->ring->getFd(), &ev)) {
+            for(UringContext* c : urings) {
+                delete c;
+            }
+            return false;
+        }
+    }
+    m_urings.swap(urings);
+    return true;
+#else
+    return false;
+#endif
+}
+
+IOManager* IOManager::GetThis() {
+    return dynamic_cast<IOManager*>(Scheduler::GetThis());
+}
+
+IOManager::FdContext* IOManager::getFdContext(int fd, bool create) {
+    if(fd < 0) {
+        return nullptr;
+    }
+    {
+        ReadScopedLockImpl<RWMutex> lock(m_mutex);
+        if((size_t)fd < m_fdContexts.size()) {
+            FdContext* ctx = m_fdContexts[fd];
+            if(ctx || !create) {
+                return ctx;
+            }
+        } else if(!create) {
+            return nullptr;
+        }
+    }
+    WriteScopedLockImpl<RWMutex> lock(m_mutex);
+    if((size_t)fd >= m_fdContexts.size()) {
+        m_fdContexts.resize(std::max((size_t)fd + 1, m_fdContexts.size() * 3 / 2), nullptr);
+    }
+    if(!m_fdContexts[fd]) {
+        m_fdContexts[fd] = new FdContext;
+        m_fdContexts[fd]->fd = fd;
+    }
+    return m_fdContexts[fd];
+}
+
+int IOManager::addEvent(int fd, Event event, Callable cb) {
+    return registerEvent(fd, event, std::move(cb), nullptr);
+}
+
+int IOManager::registerEvent(int fd, Event event, Callable cb, IOWaiter* waiter) {
+    if(!cb && (Scheduler::GetThis() == nullptr
+               || Fiber::GetThis().get() == Scheduler::GetMainFiber())) {
+        throw std::logic_error("IOManager::addEvent without callback must be called in a scheduler fiber");
+    }
+    FdContext* ctx = getFdContext(fd, true);
+    if(!ctx) {
+        errno = EBADF;
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if(ctx->events & event) {
+            ZNS_LOG_ERROR(g_logger) << "addEvent fd=" << fd << " event=" << event
+                << " already registered, events=" << ctx->events;
+            errno = EEXIST;
+            return -1;
+        }
+        int op = ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLET | ctx->events | event;
+        ev.data.ptr = ctx;
+        int rt = epoll_ctl(m_epfd, op, fd, &ev);
+        if(rt && op == EPOLL_CTL_MOD && errno == ENOENT) {
+            // fd关闭后被复用，epoll已经自动删除了旧的注册
+            op = EPOLL_CTL_ADD;
+            rt = epoll_ctl(m_epfd, op, fd, &ev);
+        }
+        if(rt) {
+            ZNS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << op << ", " << fd
+                << ", " << ev.events << "): " << errno << " (" << strerror(errno) << ")";
+            return -1;
+        }
+        ctx->events |= event;
+        FdContext::EventContext& ec = ctx->getContext(event);
+        if(cb) {
+            ec.cb = std::move(cb);
+        } else if(waiter) {
+            ec.waiter = waiter;
+        } else {
+            ec.fiber = Fiber::GetThis();
+        }
+    }
+    addPending();
+    return 0;
+}
+
+int IOManager::waitEvent(int fd, Event event, uint64_t timeout_ms) {
+    // 共享栈协程挂起后栈上的地址归别的协程使用，Complete不能写到它的栈上，等待放在堆上
+    if(timeout_ms == ~0ull && !Fiber::GetThis()->isSharedStack()) {
+        IOWaiter waiter;
+        waiter.fiber = Fiber::GetThis();
+        if(registerEvent(fd, event, nullptr, &waiter)) {
+            return -errno;
+        }
+        return WaitComplete(&waiter);
+    }
+    // 超时回调可能在协程返回之后才执行，等待放在堆上，回调持有它时地址不会被复用
+    std::shared_ptr<IOWaiter> waiter = std::make_shared<IOWaiter>();
+    waiter->fiber = Fiber::GetThis();
+    if(registerEvent(fd, event, nullptr, waiter.get())) {
+        return -errno;
+    }
+    if(timeout_ms == ~0ull) {
+        return WaitComplete(waiter.get());
+    }
+    std::weak_ptr<IOWaiter> weak(waiter);
+    Timer::ptr timer = addTimer(timeout_ms, [this, fd, event, weak]() {
+        std::shared_ptr<IOWaiter> w = weak.lock();
+        if(w) {
+            abortEvent(fd, event, -ETIMEDOUT, w.get());
+        }
+    });
+    int rt = WaitComplete(waiter.get());
+    timer->cancel();
+    return rt;
+}
+
+template<class F>
+ssize_t IOManager::waitIO(int fd, Event event, F f) {
+    while(true) {
+        ssize_t n = f();
+        if(n >= 0) {
+            return n;
+        }
+        int err = GetErrno();
+        if(err == EINTR) {
+            continue;
+        }
+        if(err != EAGAIN && err != EWOULDBLOCK) {
+            return n;
+        }
+        int rt = waitEvent(fd, event);
+        if(rt) {
+            SetErrno(-rt);
+            return -1;
+        }
+    }
+}
+
+void IOManager::addPending() {
+    ++m_pendingEventCount;
+    // 所有空闲线程都是在没有事件时睡下的，叫醒一个来当poller。
+    // 和park里的登记配对，先增加计数再检查
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!hasPoller()) {
+        tickle();
+    }
+}
+
+bool IOManager::delEvent(int fd, Event event) {
+    FdContext* ctx = getFdContext(fd, false);
+    if(!ctx) {
+        return false;
+    }
+    // 回调和协程出锁后再释放
+    FdContext::EventContext old;
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if(!(ctx->events & event)) {
+            return false;
+        }
+        int left = ctx->events & ~event;
+        int op = left ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLET | left;
+        ev.data.ptr = ctx;
+        if(epoll_ctl(m_epfd, op, fd, &ev) && errno != ENOENT && errno != EBADF) {
+            ZNS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << op << ", " << fd
+                << ", " << ev.events << "): " << errno << " (" << strerror(errno) << ")";
+            return false;
+        }
+        ctx->events = left;
+        FdContext::EventContext& ec = ctx->getContext(event);
+        old.fiber.swap(ec.fiber);
+        old.cb = std::move(ec.cb);
+        // 协程版IO的等待不能丢下不管
+        if(ec.waiter) {
+            Complete(ec.waiter, -ECANCELED);
+            ec.waiter = nullptr;
+        }
+    }
+    finishEvents(1);
+    return true;
+}
+
+bool IOManager::cancelEvent(int fd, Event event) {
+    return abortEvent(fd, event, -ECANCELED, nullptr);
+}
+
+bool IOManager::abortEvent(int fd, Event event, int res, IOWaiter* waiter) {
+    FdContext* ctx = getFdContext(fd, false);
+    if(!ctx) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if(!(ctx->events & event)) {
+            return false;
+        }
+        if(waiter && ctx->getContext(event).waiter != waiter) {
+            return false;
+        }
+        int left = ctx->events & ~event;
+        int op = left ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLET | left;
+        ev.data.ptr = ctx;
+        if(epoll_ctl(m_epfd, op, fd, &ev) && errno != ENOENT && errno != EBADF) {
+            ZNS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << op << ", " << fd
+                << ", " << ev.events << "): " << errno << " (" << strerror(errno) << ")";
+            return false;
+        }
+        triggerEvent(ctx, event, res);
+    }
+    finishEvents(1);
+    return true;
+}
+
+bool IOManager::cancelAll(int fd) {
+    bool cancelled = false;
+#if ZNS_HAS_IO_URING && defined(IORING_ASYNC_CANCEL_FD)
+    // 取消请求必须提交到发起请求的那个ring，交给每个工作线程自己提交
+    for(int i = 0; i < (int)m_urings.size(); ++i) {
+        schedule([this, i, fd]() {
+            IoUring* ring = m_urings[i]->ring.get();
+            io_uring_sqe* sqe = ring->getSqe();
+            if(!sqe) {
+                ring->submit();
+                sqe = ring->getSqe();
+            }
+            if(sqe) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = fd;
+                sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+                sqe->user_data = 0;
+                ring->submit();
+            }
+        }, i);
+        cancelled = true;
+    }
+#endif
+    FdContext* ctx = getFdContext(fd, false);
+    if(!ctx) {
+        return cancelled;
+    }
+    size_t n = 0;
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if(!ctx->events) {
+            return cancelled;
+        }
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        if(epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, &ev) && errno != ENOENT && errno != EBADF) {
+            ZNS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << EPOLL_CTL_DEL << ", " << fd
+                << "): " << errno << " (" << strerror(errno) << ")";
+            return false;
+        }
+        if(ctx->events & READ) {
+            triggerEvent(ctx, READ, -ECANCELED);
+            ++n;
+        }
+        if(ctx->events & WRITE) {
+            triggerEvent(ctx, WRITE, -ECANCELED);
+            ++n;
+        }
+    }
+    finishEvents(n);
+    return true;
+}
+
+void IOManager::triggerEvent(FdContext* ctx, Event event, int res) {
+    ctx->events &= ~event;
+    FdContext::EventContext& ec = ctx->getContext(event);
+    if(ec.cb) {
+        schedule(std::move(ec.cb));
+    } else if(ec.waiter) {
+        IOWaiter* waiter = ec.waiter;
+        ec.waiter = nullptr;
+        Complete(waiter, res);
+    } else if(ec.fiber) {
+        Fiber::ptr fiber;
+        fiber.swap(ec.fiber);
+        Scheduler::Unpark(fiber);
+    }
+}
+
+void IOManager::finishEvents(size_t n) {
+    if(n == 0) {
+        return;
+    }
+    // stop在等最后一个事件，叫醒所有线程退出
+    if(m_pendingEventCount.fetch_sub(n) == n && Scheduler::stopping()) {
+        wakeAll();
+    }
+}
+
+bool IOManager::processEvents(int timeout_ms) {
+    static const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    // 被信号或者io_uring的task_work打断时直接返回，由调用方重新计算超时
+    int n = epoll_wait(m_epfd, events, MAX_EVENTS, timeout_ms);
+    bool scheduled = false;
+    size_t done = 0;
+    for(int i = 0; i < n; ++i) {
+        epoll_event& ev = events[i];
+        if(ev.data.u64 & URING_TAG) {
+            UringContext* uctx = (UringContext*)(uintptr_t)(ev.data.u64 & ~URING_TAG);
+            if(reapUring(uctx, true)) {
+                scheduled = true;
+            }
+            continue;
+        }
+        FdContext* ctx = (FdContext*)ev.data.ptr;
+        if(!ctx) {
+            uint64_t v = 0;
+            ssize_t rt = ::read(getPollerFd(), &v, sizeof(v));
+            (void)rt;
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        uint32_t real = ev.events;
+        // 出错或者对端关闭时唤醒所有等待方，由它们的读写调用拿到具体错误
+        if(real & (EPOLLERR | EPOLLHUP)) {
+            real |= (EPOLLIN | EPOLLOUT) & ctx->events;
+        }
+        // 另一个线程可能已经处理或者取消了
+        int fired = real & ctx->events & (READ | WRITE);
+        if(!fired) {
+            continue;
+        }
+        int left = ctx->events & ~fired;
+        int op = left ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event nev;
+        memset(&nev, 0, sizeof(nev));
+        nev.events = EPOLLET | left;
+        nev.data.ptr = ctx;
+        if(epoll_ctl(m_epfd, op, ctx->fd, &nev)) {
+            // 照样触发，不让等待方永远挂着
+            ZNS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << op << ", " << ctx->fd
+                << ", " << nev.events << "): " << errno << " (" << strerror(errno) << ")";
+        }
+        if(fired & READ) {
+            triggerEvent(ctx, READ);
+            ++done;
+        }
+        if(fired & WRITE) {
+            triggerEvent(ctx, WRITE);
+            ++done;
+        }
+        scheduled = true;
+    }
+    finishEvents(done);
+    return scheduled;
+}
+
+bool IOManager::stopping() {
+    return Scheduler::stopping() && m_pendingEventCount == 0;
+}
+
+bool IOManager::needPoller() {
+    return m_pendingEventCount > 0 || Scheduler::needPoller();
+}
+
+void IOManager::pollerWait(int timeout_ms) {
+    // 睡下之前把自己攒下的请求交出去
+    flushPending();
+    processEvents(timeout_ms);
+}
+
+bool IOManager::pollNonBlocking() {
+    bool got = false;
+    UringContext* ctx = currentUring();
+    if(ctx) {
+        // 先提交再收割自己的ring，不用进epoll
+        flushPending();
+        got = reapUring(ctx, false) > 0;
+    }
+    // 已经有线程阻塞在epoll_wait里时由它收取
+    if(m_pendingEventCount == 0 || hasPoller()) {
+        return got;
+    }
+    return processEvents(0) || got;
+}
+
+void IOManager::flushPending() {
+#if ZNS_HAS_IO_URING
+    UringContext* ctx = currentUring();
+    if(ctx && ctx->ring->getUnsubmitted()) {
+        int rt = ctx->ring->submit();
+        if(rt < 0 && rt != -EAGAIN && rt != -EBUSY) {
+            ZNS_LOG_ERROR(g_logger) << "io_uring_enter: " << -rt << " (" << strerror(-rt) << ")";
+        }
+    }
+#endif
+}
+
+void IOManager::onWorkerStart() {
+    SetHookEnable(m_hook);
+}
+
+void IOManager::onWorkerStop() {
+    SetHookEnable(false);
+}
+
+IOManager::UringContext* IOManager::currentUring() {
+    if(m_urings.empty() || Scheduler::GetThis() != this) {
+        return nullptr;
+    }
+    int i = GetWorkerIndex();
+    return i >= 0 ? m_urings[i] : nullptr;
+}
+
+IOManager::UringContext* IOManager::fiberUring() {
+    UringContext* ctx = currentUring();
+    if(ctx && Fiber::GetThis()->isSharedStack()) {
+        return nullptr;
+    }
+    return ctx;
+}
+
+size_t IOManager::reapUring(UringContext* ctx, bool wait) {
+    size_t n = 0;
+#if ZNS_HAS_IO_URING
+    {
+        std::unique_lock<std::mutex> lock(ctx->cq_mutex, std::defer_lock);
+        if(wait) {
+            lock.lock();
+        } else if(!lock.try_lock()) {
+            return 0;
+        }
+        ctx->ring->reap([&n](uint64_t data, int res) {
+            // 取消请求自己的完成项
+            if(!data) {
+                return;
+            }
+            Complete((IOWaiter*)(uintptr_t)data, res);
+            ++n;
+        });
+    }
+    finishEvents(n);
+#else
+    (void)ctx;
+#endif
+    return n;
+}
+
+template<class Prep>
+int IOManager::uringCall(Prep prep) {
+#if ZNS_HAS_IO_URING
+    if(Fiber::GetThis().get() == Scheduler::GetMainFiber()) {
+        throw std::logic_error("IOManager io must be called in a scheduler fiber");
+    }
+    if(Fiber::GetThis()->isSharedStack()) {
+        throw std::logic_error("IOManager io_uring request from a shared stack fiber");
+    }
+    IoUring* ring = currentUring()->ring.get();
+    io_uring_sqe* sqe = ring->getSqe();
+    if(!sqe) {
+        // SQ满了，先把攒下的交给内核
+        ring->submit();
+        sqe = ring->getSqe();
+        if(!sqe) {
+            return -EBUSY;
+        }
+    }
+    IOWaiter waiter;
+    prep(sqe);
+    sqe->user_data = (uint64_t)(uintptr_t)&waiter;
+    waiter.fiber = Fiber::GetThis();
+    addPending();
+    // 所在线程下一次没有任务或者每61次调度时提交
+    return WaitComplete(&waiter);
+#else
+    (void)prep;
+    return -ENOSYS;
+#endif
+}
+
+template<class Prep>
+int IOManager::uringRetry(int fd, short poll_events, Prep prep) {
+#if ZNS_HAS_IO_URING
+    while(true) {
+        int res = uringCall(prep);
+        if(res != -EAGAIN) {
+            return res;
+        }
+        // 协程恢复后可能换了工作线程，每次重新取当前线程的ring
+        res = uringCall([fd, poll_events](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = poll_events;
+        });
+        if(res < 0) {
+            return res;
+        }
+    }
+#else
+    (void)fd;
+    (void)poll_events;
+    (void)prep;
+    return -ENOSYS;
+#endif
+}
+
+ssize_t IOManager::read(int fd, void* buf, size_t count) {
+#if ZNS_HAS_IO_URING
+    if(fiberUring()) {
+        return ToResult(uringRetry(fd, POLLIN, [=](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = (uintptr_t)buf;
+            sqe->len = (unsigned)std::min<size_t>(count, UINT_MAX);
+            sqe->off = (uint64_t)-1; // 当前文件位置，socket没有位置
+        }));
+    }
+#endif
+    return waitIO(fd, READ, [=]() { return ::read(fd, buf, count); });
+}
+
+ssize_t IOManager::write(int fd, const void* buf, size_t count) {
+#if ZNS_HAS_IO_URING
+    if(fiberUring()) {
+        return ToResult(uringRetry(fd, POLLOUT, [=](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = (uintptr_t)buf;
+            sqe->len = (unsigned)std::min<size_t>(count, UINT_MAX);
+            sqe->off = (uint64_t)-1;
+        }));
+    }
+#endif
+    return waitIO(fd, WRITE, [=]() { return ::write(fd, buf, count); });
+}
+
+int IOManager::accept(int fd, sockaddr* addr, socklen_t* addrlen) {
+#if ZNS_HAS_IO_URING
+    if(fiberUring()) {
+        // 完成项要等工作线程空下来才收割，连接积压时每轮只能取一个。
+        // 先直接取，没有待接受的连接时再交给io_uring等
+        int rt = ::accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(rt >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return rt;
+        }
+        return ToResult(uringRetry(fd, POLLIN, [=](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = fd;
+            sqe->addr = (uintptr_t)addr;
+            sqe->addr2 = (uintptr_t)addrlen;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        }));
+    }
+#endif
+    return waitIO(fd, READ, [=]() {
+        return ::accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    });
+}
+
+int IOManager::connect(int fd, const sockaddr* addr, socklen_t addrlen) {
+    int rt = 0;
+#if ZNS_HAS_IO_URING
+    if(fiberUring()) {
+        rt = uringRetry(fd, POLLOUT, [=](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->fd = fd;
+            sqe->addr = (uintptr_t)addr;
+            sqe->off = addrlen;
+        });
+        if(rt != -EINPROGRESS) {
+            return ToResult(rt);
+        }
+        // 老内核对非阻塞socket返回EINPROGRESS，等可写后取结果
+        rt = uringCall([fd](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = POLLOUT;
+        });
+        if(rt < 0) {
+            return ToResult(rt);
+        }
+    } else
+#endif
+    {
+        rt = ::connect(fd, addr, addrlen);
+        if(rt == 0 || errno != EINPROGRESS) {
+            return rt;
+        }
+        rt = waitEvent(fd, WRITE);
+        if(rt) {
+            SetErrno(-rt);
+            return -1;
+        }
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len)) {
+        return -1;
+    }
+    if(err) {
+        SetErrno(err);
+        return -1;
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,188 @@
+#ifndef __ZNS_IOMANAGER_H__
+#define __ZNS_IOMANAGER_H__
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+#include "scheduler.h"
+#include "mutex.h"
+
+namespace ZnetServer {
+struct IOWaiter;
+
+/**
+ * @brief 基于epoll的IO调度器
+ * @details 事件用边缘触发注册，触发一次后自动注销，需要继续等待时重新addEvent。
+ *          没有任务时，空闲线程中的poller阻塞在epoll_wait里，超时时间是最近的定时器，
+ *          新任务或更早的定时器通过eventfd打断它；其余空闲线程各自睡眠。
+ *          所有线程都忙时，由找不到任务的工作线程非阻塞地收取一次。
+ *          不在每61次调度时收取: 就绪的协程会压在本地队列(后进先出)的顶上，持续有IO时压在下面的会饿死。
+ *          stop会等到所有已注册的事件都触发或取消之后才返回。
+ *
+ *          read/write/accept/connect是协程版的IO: 配置iomanager.backend为io_uring并且内核支持时，
+ *          请求提交到当前工作线程自己的io_uring，协程挂起直到完成；同一线程上的协程攒下的请求
+ *          在线程没有任务时或者每61次调度时一次系统调用批量提交。完成项由线程自己收割，
+ *          睡眠时ring的fd也在epoll里，由poller收割。内核不支持时退回epoll。
+ *
+ *          配置iomanager.hook为true时工作线程开启hook(见hook.h)，协程里直接调用阻塞的
+ *          read/write/connect/sleep等只挂起协程。
+ *
+ *          协程中等待可读:
+ *              iom->addEvent(fd, IOManager::READ);
+ *              Scheduler::Park();
+ */
+class IOManager : public Scheduler {
+public:
+    typedef std::shared_ptr<IOManager> ptr;
+
+    enum Event {
+        NONE  = 0x0,
+        READ  = EPOLLIN,
+        WRITE = EPOLLOUT,
+    };
+
+    enum Backend {
+        EPOLL,
+        IO_URING,
+    };
+
+    IOManager(int threads = 1, bool use_caller = true, const std::string& name = "");
+    ~IOManager();
+
+    /**
+     * @brief 注册事件
+     * @param[in] cb 触发时调度的回调；为空时触发时Unpark当前协程，
+     *            这时只能在调度器的工作协程里调用，调用方随后Park
+     * @return 成功返回0，事件已经注册过或者epoll_ctl失败返回-1
+     */
+    int addEvent(int fd, Event event, Callable cb = nullptr);
+
+    /**
+     * @brief 注销事件，不触发
+     */
+    bool delEvent(int fd, Event event);
+
+    /**
+     * @brief 注销事件并立即触发一次(回调或者Unpark等待的协程)
+     */
+    bool cancelEvent(int fd, Event event);
+
+    /**
+     * @brief 注销并触发fd上的所有事件
+     * @details io_uring后端还会异步取消fd上在途的请求，等待的协程以ECANCELED返回
+     */
+    bool cancelAll(int fd);
+
+    /**
+     * @brief 挂起当前协程直到fd上的事件就绪，只能在调度器的工作协程里调用
+     * @param[in] timeout_ms 超时毫秒数，~0ull表示不超时
+     * @return 就绪返回0，超时返回-ETIMEDOUT，被cancelEvent/cancelAll取消返回-ECANCELED，
+     *         注册失败返回-errno
+     */
+    int waitEvent(int fd, Event event, uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @name 协程版IO
+     * @details 语义同对应的系统调用，失败返回-1并设置errno。只能在调度器的协程里调用，
+     *          fd应该是非阻塞的。io_uring后端下只有本IOManager的协程走io_uring，
+     *          其他调度器的协程、共享栈协程和epoll后端一样在EAGAIN时等待就绪后重试
+     * @{
+     */
+    ssize_t read(int fd, void* buf, size_t count);
+    ssize_t write(int fd, const void* buf, size_t count);
+    /**
+     * @brief 返回的fd是非阻塞、close-on-exec的
+     */
+    int accept(int fd, sockaddr* addr, socklen_t* addrlen);
+    int connect(int fd, const sockaddr* addr, socklen_t addrlen);
+    /** @} */
+
+    /**
+     * @brief 实际使用的后端
+     */
+    Backend getBackend() const { return m_backend; }
+
+    /**
+     * @brief 已注册还没触发的事件数
+     */
+    size_t getPendingEventCount() const { return m_pendingEventCount; }
+
+    /**
+     * @brief 当前线程所属的IOManager，不在IOManager的线程上时为nullptr
+     */
+    static IOManager* GetThis();
+protected:
+    bool stopping() override;
+    bool needPoller() override;
+    void pollerWait(int timeout_ms) override;
+    bool pollNonBlocking() override;
+    void flushPending() override;
+    void onWorkerStart() override;
+    void onWorkerStop() override;
+private:
+    // 每个fd一个，按fd下标放在m_fdContexts里，创建后直到IOManager析构才释放
+    struct FdContext {
+        struct EventContext {
+            Fiber::ptr fiber; // 等待事件的协程
+            Callable cb;      // 或者回调
+            IOWaiter* waiter = nullptr; // 或者协程版IO的等待
+        };
+
+        EventContext& getContext(Event event) { return event == READ ? read : write; }
+
+        EventContext read;
+        EventContext write;
+        int fd = -1;
+        int events = NONE; // 已注册的事件
+        std::mutex mutex;
+    };
+
+    FdContext* getFdContext(int fd, bool create);
+    // addEvent的实现，waiter不为空时触发后写入结果再唤醒它
+    int registerEvent(int fd, Event event, Callable cb, IOWaiter* waiter);
+    // 执行非阻塞的IO，EAGAIN时waitEvent后重试
+    template<class F>
+    ssize_t waitIO(int fd, Event event, F f);
+    // 注销事件并以res触发。waiter不为空时只在登记的还是它时才触发，用于超时
+    bool abortEvent(int fd, Event event, int res, IOWaiter* waiter);
+    // 需要持有ctx->mutex，事件从ctx上摘掉并调度出去。res是协程版IO等待的结果
+    void triggerEvent(FdContext* ctx, Event event, int res = 0);
+    // 事件触发或取消之后调用
+    void finishEvents(size_t n);
+    // 收取epoll事件并调度，返回是否调度了任务
+    bool processEvents(int timeout_ms);
+    // 事件计数加一，没有poller时叫醒一个空闲线程来等
+    void addPending();
+
+    // 每个工作线程一个io_uring
+    struct UringContext;
+    bool initUring();
+    // 当前线程是本IOManager的工作线程并且用io_uring时返回它的ring
+    UringContext* currentUring();
+    // 协程版IO用的ring。共享栈协程挂起后栈被换出，内核不能在这期间读写它栈上的缓冲区，
+    // 也不能写栈上的等待，返回nullptr退回epoll
+    UringContext* fiberUring();
+    // 在当前线程的ring上准备一个请求，挂起协程直到完成，返回完成项的res
+    template<class Prep>
+    int uringCall(Prep prep);
+    // 同uringCall，老内核对非阻塞fd返回EAGAIN时等就绪再重试
+    template<class Prep>
+    int uringRetry(int fd, short poll_events, Prep prep);
+    // 收割完成项并唤醒对应的协程，返回个数
+    size_t reapUring(UringContext* ctx, bool wait);
+private:
+    Backend m_backend = EPOLL;
+    bool m_hook = false; // 工作线程是否开启hook
+    int m_epfd = -1;
+    std::atomic<size_t> m_pendingEventCount {0};
+    RWMutex m_mutex; // 保护m_fdContexts的扩容
+    std::vector<FdContext*> m_fdContexts;
+    std::vector<UringContext*> m_urings; // 按工作线程下标
+};
+
+}
+
+#endif
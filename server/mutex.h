@@ -79,6 +79,70 @@ private:
 
 using ScopedLock = ScopedLockImpl<Mutex>;
 
+// 读写锁，读多写少的场景(如按fd索引的表，只在扩容时写)
+class RWMutex {
+public:
+    RWMutex() {
+        pthread_rwlock_init(&m_lock, nullptr);
+    }
+    ~RWMutex() {
+        pthread_rwlock_destroy(&m_lock);
+    }
+    void rdlock() {
+        pthread_rwlock_rdlock(&m_lock);
+    }
+    void wrlock() {
+        pthread_rwlock_wrlock(&m_lock);
+    }
+    void unlock() {
+        pthread_rwlock_unlock(&m_lock);
+    }
+private:
+    pthread_rwlock_t m_lock;
+};
+
+template<class T>
+class ReadScopedLockImpl {
+public:
+    ReadScopedLockImpl(T& mutex) : m_mutex(mutex) {
+        m_mutex.rdlock();
+        m_locked = true;
+    }
+    ~ReadScopedLockImpl() {
+        unlock();
+    }
+    void unlock() {
+        if (m_locked) {
+            m_mutex.unlock();
+            m_locked = false;
+        }
+    }
+private:
+    T& m_mutex;
+    bool m_locked;
+};
+
+template<class T>
+class WriteScopedLockImpl {
+public:
+    WriteScopedLockImpl(T& mutex) : m_mutex(mutex) {
+        m_mutex.wrlock();
+        m_locked = true;
+    }
+    ~WriteScopedLockImpl() {
+        unlock();
+    }
+    void unlock() {
+        if (m_locked) {
+            m_mutex.unlock();
+            m_locked = false;
+        }
+    }
+private:
+    T& m_mutex;
+    bool m_locked;
+};
+
 class NullMutex {
 public:
     NullMutex() {}
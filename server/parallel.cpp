@@ -0,0 +1,184 @@
+#include "parallel.h"
+#include "scheduler.h"
+#include "fiber_event.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+namespace ZnetServer {
+
+// 共享栈协程挂起后栈内存归别的协程使用，
+// 任务按引用捕获的局部变量和wait()等待的事件在别的线程上都会失效
+static void CheckSharedStack(const char* op) {
+    if(Scheduler::GetThis() && Fiber::GetThis()->isSharedStack()) {
+        throw std::logic_error(std::string(op) + " in a shared stack fiber");
+    }
+}
+
+class TaskGroup::State {
+public:
+    // 帮手回调: 从队头取任务执行到队列为空
+    void help();
+    // 执行一个已经取出的任务，不持锁调用，返回时持有lock
+    void execute(Callable& cb, std::unique_lock<std::mutex>& lock);
+public:
+    Scheduler* sc = nullptr;
+    size_t maxHelpers = 0;
+    std::mutex mutex;
+    std::deque<Callable> tasks;
+    size_t pending = 0;          // 提交了还没结束的任务，包括排队的
+    size_t helpers = 0;          // 已投递还没退出的帮手
+    FiberEvent* waiter = nullptr; // 队列空了之后等pending归零的wait()
+    bool waiting = false;
+    std::exception_ptr error;
+    std::atomic<bool> canceled {false};
+};
+
+void TaskGroup::State::help() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!tasks.empty()) {
+        Callable cb = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        execute(cb, lock);
+    }
+    // 和run()在同一把锁下判断，队列非空时总有帮手或wait()会取走
+    --helpers;
+}
+
+void TaskGroup::State::execute(Callable& cb, std::unique_lock<std::mutex>& lock) {
+    std::exception_ptr err;
+    if(!canceled.load(std::memory_order_relaxed)) {
+        try {
+            cb();
+        } catch(...) {
+            err = std::current_exception();
+        }
+    }
+    // 捕获的对象在锁外析构
+    cb.reset();
+    lock.lock();
+    if(err) {
+        if(!error) {
+            error = err;
+        }
+        canceled.store(true, std::memory_order_relaxed);
+    }
+    if(--pending == 0 && waiter) {
+        FiberEvent* ev = waiter;
+        waiter = nullptr;
+        lock.unlock();
+        ev->set();
+        lock.lock();
+    }
+}
+
+TaskGroup::TaskGroup(Scheduler* sc)
+    : m_state(std::make_shared<State>()) {
+    m_state->sc = sc ? sc : Scheduler::GetThis();
+    if(m_state->sc) {
+        m_state->maxHelpers = m_state->sc->getWorkerCount();
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if(!m_state->pending) {
+            return;
+        }
+        m_state->canceled.store(true, std::memory_order_relaxed);
+    }
+    try {
+        wait();
+    } catch(...) {
+    }
+}
+
+Scheduler* TaskGroup::getScheduler() const {
+    return m_state->sc;
+}
+
+void TaskGroup::run(Callable cb) {
+    if(!cb) {
+        return;
+    }
+    CheckSharedStack("TaskGroup::run");
+    State* st = m_state.get();
+    bool spawn = false;
+    {
+        std::lock_guard<std::mutex> lock(st->mutex);
+        st->tasks.push_back(std::move(cb));
+        ++st->pending;
+        if(st->helpers < st->maxHelpers) {
+            ++st->helpers;
+            spawn = true;
+        }
+    }
+    if(!spawn) {
+        return;
+    }
+    // 帮手可能在任务组析构之后才轮到执行，持有状态的引用
+    std::shared_ptr<State> self = m_state;
+    try {
+        st->sc->schedule([self](){ self->help(); });
+    } catch(...) {
+        // 任务留在队列里，由其他帮手或wait()执行
+        std::lock_guard<std::mutex> lock(st->mutex);
+        --st->helpers;
+    }
+}
+
+void TaskGroup::wait() {
+    CheckSharedStack("TaskGroup::wait");
+    State* st = m_state.get();
+    std::unique_lock<std::mutex> lock(st->mutex);
+    if(st->waiting) {
+        throw std::logic_error("TaskGroup::wait called concurrently");
+    }
+    st->waiting = true;
+    while(st->pending) {
+        if(!st->tasks.empty()) {
+            // 从队尾取最近切出来的小段，大段留给帮手
+            Callable cb = std::move(st->tasks.back());
+            st->tasks.pop_back();
+            lock.unlock();
+            st->execute(cb, lock);
+            continue;
+        }
+        // 剩下的任务都在别的线程上执行，它们run的新任务由帮手接手
+        FiberEvent ev;
+        st->waiter = &ev;
+        lock.unlock();
+        ev.wait();
+        lock.lock();
+    }
+    st->waiting = false;
+    std::exception_ptr err = st->error;
+    st->error = nullptr;
+    st->canceled.store(false, std::memory_order_relaxed);
+    lock.unlock();
+    if(err) {
+        std::rethrow_exception(err);
+    }
+}
+
+namespace detail {
+
+size_t ParallelGrain(Scheduler* sc, size_t n, size_t grain) {
+    if(grain) {
+        return grain;
+    }
+    if(!sc) {
+        sc = Scheduler::GetThis();
+    }
+    size_t workers = sc ? sc->getWorkerCount() : 1;
+    return std::max<size_t>(1, n / (workers * 8));
+}
+
+}
+
+}
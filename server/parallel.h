@@ -0,0 +1,145 @@
+#ifndef __ZNS_PARALLEL_H__
+#define __ZNS_PARALLEL_H__
+
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+#include "callable.h"
+
+namespace ZnetServer {
+
+class Scheduler;
+
+/**
+ * @brief fork-join任务组
+ * @details run()把任务放进组自己的队列，再往调度器投递帮手回调(同时最多工作线程数个)，
+ *          帮手从队头取任务执行到队列为空，空闲的工作线程偷到帮手就一起干活。
+ *          wait()不干等: 先从队尾取本组的任务在当前协程里执行，
+ *          队列空了才等在别处执行的任务结束，协程里只Park当前协程。
+ *          任务抛出的第一个异常在wait()里重新抛出，之后还没开始的任务不再执行。
+ *          任务里可以继续run()，同一时刻只能有一个wait()。
+ *          共享栈协程里run()和wait()抛出std::logic_error: 它挂起期间栈内存归别的协程使用，
+ *          别的线程上的任务访问不了它栈上的变量。ParallelFor/ParallelReduce同样如此。
+ *
+ *          TaskGroup g;
+ *          g.run([&]{ a = encode(x); });
+ *          g.run([&]{ b = encode(y); });
+ *          g.wait();
+ */
+class TaskGroup {
+public:
+    /**
+     * @param sc 执行任务的调度器，nullptr表示当前线程所在的调度器；
+     *           都没有时任务全部在wait()里依次执行
+     */
+    explicit TaskGroup(Scheduler* sc = nullptr);
+    /**
+     * @brief 还有任务没结束时取消没开始的任务并等待，忽略异常
+     */
+    ~TaskGroup();
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(Callable cb);
+
+    /**
+     * @brief 等到所有任务(包括任务里run的)结束
+     */
+    void wait();
+
+    Scheduler* getScheduler() const;
+private:
+    class State;
+    std::shared_ptr<State> m_state;
+};
+
+namespace detail {
+
+// grain为0时按工作线程数自动选择，每个线程大约分到8段
+size_t ParallelGrain(Scheduler* sc, size_t n, size_t grain);
+
+// 对半切分: 右半放进任务组让别的线程取，自己接着切左半，切到grain以内执行
+template<class F>
+struct ParallelRange {
+    TaskGroup* group;
+    F* fn;
+    size_t begin;
+    size_t end;
+    size_t grain;
+
+    void operator()() const {
+        size_t b = begin;
+        size_t e = end;
+        while(e - b > grain) {
+            size_t mid = b + (e - b) / 2;
+            group->run(ParallelRange{group, fn, mid, e, grain});
+            e = mid;
+        }
+        (*fn)(b, e);
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief 把[begin, end)切成不超过grain的子区间并行执行fn(b, e)
+ * @details 调用方也执行子区间，所有子区间结束后返回，fn抛出的第一个异常在这里重新抛出。
+ *          grain为0时自动选择
+ */
+template<class F>
+void ParallelFor(Scheduler* sc, size_t begin, size_t end, size_t grain, F&& fn) {
+    if(begin >= end) {
+        return;
+    }
+    typedef typename std::remove_reference<F>::type D;
+    TaskGroup group(sc);
+    grain = detail::ParallelGrain(group.getScheduler(), end - begin, grain);
+    group.run(detail::ParallelRange<D>{&group, &fn, begin, end, grain});
+    group.wait();
+}
+
+template<class F>
+void ParallelFor(size_t begin, size_t end, size_t grain, F&& fn) {
+    ParallelFor(nullptr, begin, end, grain, std::forward<F>(fn));
+}
+
+/**
+ * @brief 并行归约
+ * @details 按grain切成固定的段，每段map(b, e)得到一个T，再按段的顺序用reduce(T, T)合并，
+ *          所以reduce只需要满足结合律，结果和切分、调度无关。identity是reduce的单位元
+ */
+template<class T, class Map, class Reduce>
+T ParallelReduce(Scheduler* sc, size_t begin, size_t end, size_t grain, T identity,
+                 Map&& map, Reduce&& reduce) {
+    if(begin >= end) {
+        return identity;
+    }
+    grain = detail::ParallelGrain(sc, end - begin, grain);
+    size_t segments = (end - begin - 1) / grain + 1;
+    std::vector<T> partial(segments, identity);
+    ParallelFor(sc, 0, segments, 1, [&](size_t sb, size_t se){
+        for(size_t i = sb; i < se; ++i) {
+            size_t b = begin + i * grain;
+            partial[i] = map(b, std::min(end, b + grain));
+        }
+    });
+    T result = std::move(identity);
+    for(auto& p : partial) {
+        result = reduce(std::move(result), std::move(p));
+    }
+    return result;
+}
+
+template<class T, class Map, class Reduce>
+T ParallelReduce(size_t begin, size_t end, size_t grain, T identity, Map&& map, Reduce&& reduce) {
+    return ParallelReduce(nullptr, begin, end, grain, std::move(identity),
+                          std::forward<Map>(map), std::forward<Reduce>(reduce));
+}
+
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __ZNS_SCHED_NODE_H__
+#define __ZNS_SCHED_NODE_H__
+
+#include <stdint.h>
+
+namespace ZnetServer {
+
+class Fiber;
+
+/**
+ * @brief Scheduler运行队列的侵入式节点
+ * @details 本地队列、注入栈、固定任务链表和类队列里放的都是它。
+ *          协程的节点嵌在Fiber里，排队期间调度器通过Fiber持有协程的一个引用，
+ *          入队出队都是移动这个引用，不分配内存也不改引用计数；
+ *          回调的节点由Scheduler从线程缓存分配
+ */
+struct SchedNode {
+    SchedNode* next = nullptr; // 注入栈、固定任务链表和空闲链表的链接
+    Fiber* fiber = nullptr;    // 协程的节点指向所属协程，回调的节点为nullptr
+    int thread = -1;           // 固定的工作线程
+    int priority = 1;          // Scheduler::Priority
+    uint64_t deadline = ~0ull; // 截止时间(us)，~0ull表示没有
+    uint64_t key = 0;          // 类队列的排序键: 截止时间和饥饿保护时限中较早的一个
+    uint64_t seq = 0;          // 同一个key按提交顺序
+    uint64_t enqueue = 0;      // 进入类队列的时间(us)
+    uint64_t stamp = 0;        // 抽中计时的任务提交时的时间(ns)，0表示不计时
+};
+
+}
+
+#endif
@@ -1,8 +1,198 @@
 #include "scheduler.h"
+#include "config.h"
+#include "util.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <sstream>
 #include <thread>
 
 namespace ZnetServer {
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+static thread_local Scheduler* t_scheduler = nullptr;
+static thread_local void* t_worker = nullptr; // 当前线程在t_scheduler中的Worker
+
+// Park状态机
+//   RUNNING  --Park-->   PARKING --切回调度协程--> PARKED --Unpark--> RUNNING(重新调度)
+//   RUNNING --Unpark--> NOTIFIED，下一次Park直接返回
+//   PARKING --Unpark--> WAKING，切回后立即重新调度
+enum ParkState {
+    PARK_RUNNING = 0,
+    PARK_PARKING = 1,
+    PARK_PARKED = 2,
+    PARK_NOTIFIED = 3,
+    PARK_WAKING = 4,
+};
+
+
+static ConfigVar<uint32_t>::ptr g_fiber_pool_size =
+    Config::Create<uint32_t>("scheduler.fiber_pool_size", 64, "per thread pooled callback fibers");
+
+static ConfigVar<std::string>::ptr g_priority_policy =
+    Config::Create<std::string>("scheduler.priority_policy", "strict", "strict or weighted between priority classes");
+
+static ConfigVar<std::vector<uint32_t> >::ptr g_priority_weights =
+    Config::Create<std::vector<uint32_t> >("scheduler.priority_weights", {16, 4, 1},
+        "weighted policy: share of high, normal and low priority tasks");
+
+static ConfigVar<uint32_t>::ptr g_starvation_ms =
+    Config::Create<uint32_t>("scheduler.starvation_ms", 100,
+        "queued tasks waiting longer than this jump ahead of higher priorities, 0 disables");
+
+static ConfigVar<uint32_t>::ptr g_stats_sample =
+    Config::Create<uint32_t>("scheduler.stats_sample", 16,
+        "time queue wait and run time of one in this many tasks, 0 disables");
+
+static ConfigVar<uint32_t>::ptr g_stats_interval =
+    Config::Create<uint32_t>("scheduler.stats_interval_ms", 0,
+        "log scheduler stats at this interval, 0 disables");
+
+static ConfigVar<uint32_t>::ptr g_watchdog_slice =
+    Config::Create<uint32_t>("scheduler.watchdog_slice_ms", 0,
+        "warn about fibers running longer than this without switching out, 0 disables the watchdog");
+
+static ConfigVar<bool>::ptr g_preempt =
+    Config::Create<bool>("scheduler.preempt", false,
+        "ask fibers caught by the watchdog to yield at their next ZNS_PREEMPT_POINT");
+
+static ConfigVar<uint32_t>::ptr g_max_threads =
+    Config::Create<uint32_t>("scheduler.max_threads", 0,
+        "elastic mode upper bound of worker threads, 0 or not above the constructor count keeps it fixed");
+
+static ConfigVar<uint32_t>::ptr g_min_threads =
+    Config::Create<uint32_t>("scheduler.min_threads", 0,
+        "elastic mode lower bound of worker threads, 0 means the constructor count");
+
+static ConfigVar<uint32_t>::ptr g_scale_up_wait =
+    Config::Create<uint32_t>("scheduler.scale_up_wait_us", 1000,
+        "elastic mode adds a thread when sampled mean queue wait stays above this");
+
+static ConfigVar<uint32_t>::ptr g_scale_up_sustain =
+    Config::Create<uint32_t>("scheduler.scale_up_sustain_ms", 50,
+        "how long queue wait has to stay high before adding a thread");
+
+static ConfigVar<uint32_t>::ptr g_scale_down_idle =
+    Config::Create<uint32_t>("scheduler.scale_down_idle_ms", 10000,
+        "elastic mode retires threads above min_threads after sleeping this long");
+
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+// 提交任务的线程上距离下一次抽样还有几个任务
+static thread_local uint32_t t_stats_countdown = 0;
+
+// 抽中的任务返回当前时间，否则返回0
+static uint64_t SampleStamp() {
+    if(t_stats_countdown > 1) {
+        --t_stats_countdown;
+        return 0;
+    }
+    uint32_t n = g_stats_sample->getValue();
+    if(!n) {
+        return 0;
+    }
+    t_stats_countdown = n;
+    return GetCurrentNS();
+}
+
+// 只有所属线程写的计数器，不需要原子加
+static void Bump(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// 每个工作线程缓存已结束的回调协程，带着栈一起复用
+static thread_local std::vector<Fiber::ptr> t_fiber_pool;
+
+static Fiber::ptr AcquireFiber(Callable cb) {
+    if(!t_fiber_pool.empty()) {
+        Fiber::ptr f = std::move(t_fiber_pool.back());
+        t_fiber_pool.pop_back();
+        f->reset(std::move(cb));
+        return f;
+    }
+    Fiber::ptr f = std::make_shared<Fiber>(std::move(cb));
+    f->setPooled(true);
+    return f;
+}
+
+static void ReleaseFiber(Fiber::ptr& f) {
+    // 还有别人持有的协程不能拿去跑别的回调
+    if(f.use_count() == 1 && t_fiber_pool.size() < g_fiber_pool_size->getValue()) {
+        t_fiber_pool.push_back(std::move(f));
+    }
+    f.reset();
+}
+
+// 任务节点的线程缓存，稳态下提交任务不进malloc
+static const size_t TASK_CACHE_SIZE = 1024;
+
+static thread_local bool t_task_cache_dead = false;
+
+struct TaskCache {
+    void* head = nullptr;
+    size_t count = 0;
+
+    ~TaskCache() {
+        t_task_cache_dead = true;
+        while(head) {
+            void* next = *(void**)head;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+};
+static thread_local TaskCache t_task_cache;
+
+static void* AllocTaskMem(size_t size) {
+    if(t_task_cache_dead) {
+        return ::operator new(size);
+    }
+    TaskCache& c = t_task_cache;
+    if(c.head) {
+        void* p = c.head;
+        c.head = *(void**)p;
+        --c.count;
+        return p;
+    }
+    return ::operator new(size);
+}
+
+static void FreeTaskMem(void* p) {
+    if(t_task_cache_dead) {
+        ::operator delete(p);
+        return;
+    }
+    TaskCache& c = t_task_cache;
+    if(c.count < TASK_CACHE_SIZE) {
+        *(void**)p = c.head;
+        c.head = p;
+        ++c.count;
+        return;
+    }
+    ::operator delete(p);
+}
+
+void* Scheduler::ScheduleTask::operator new(size_t size) {
+    return AllocTaskMem(size);
+}
+
+void Scheduler::ScheduleTask::operator delete(void* p) {
+    FreeTaskMem(p);
+}
+
+bool Scheduler::TaskLater(const SchedNode* a, const SchedNode* b) {
+    return a->key > b->key || (a->key == b->key && a->seq > b->seq);
+}
+
+Scheduler::Worker::Worker() {
+    for(int p = 0; p < PRIORITY_COUNT; ++p) {
+        class_missed[p].store(0, std::memory_order_relaxed);
+    }
+}
 
 Scheduler::Scheduler(int threadCount, bool user_caller, const std::string& name)
         : m_name(name) {
@@ -10,7 +200,7 @@ Scheduler::Scheduler(int threadCount, bool user_caller, const std::string& name)
     if(user_caller) {
         Fiber::GetThis(); // 激活主协程
         -- threadCount;
-        m_rootFiber = std::make_shared<Fiber>([this](){ run(); }, 1024*128);
+        m_rootFiber = std::make_shared<Fiber>([this](){ run(m_threadCount); });
         t_scheduler_fiber = m_rootFiber.get();
         m_rootThreadId = GetThreadId();
         
@@ -18,29 +208,193 @@ Scheduler::Scheduler(int threadCount, bool user_caller, const std::string& name)
         m_rootThreadId = -1;
     }
     m_threadCount = threadCount;
+    // 工作线程在前，use_caller时调用线程排在它们之后，再后面是弹性模式增加线程用的槽位
+    int workers = threadCount + (m_rootFiber ? 1 : 0);
+    m_elastic = (int)g_max_threads->getValue() > workers;
+    if(m_elastic) {
+        workers = g_max_threads->getValue();
+    }
+    for(int i = 0; i < workers; ++i) {
+        std::unique_ptr<Worker> w(new Worker);
+        w->index = i;
+        w->seed = i * 2654435761u + 1;
+        w->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if(w->event_fd < 0) {
+            for(auto& o : m_workers) {
+                close(o->event_fd);
+            }
+            throw std::runtime_error("Scheduler eventfd error");
+        }
+        m_workers.push_back(std::move(w));
+    }
+    m_pollerFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(m_pollerFd < 0) {
+        for(auto& o : m_workers) {
+            close(o->event_fd);
+        }
+        throw std::runtime_error("Scheduler eventfd error");
+    }
+
+    const std::string& policy = g_priority_policy->getValue();
+    m_weighted = policy == "weighted";
+    if(!m_weighted && policy != "strict") {
+        ZNS_LOG_WARN(ZNS_LOG_ROOT()) << "Scheduler unknown priority policy " << policy << ", use strict";
+    }
+    // 权重越大虚拟时间走得越慢，被选中的次数越多
+    std::vector<uint32_t> weights = g_priority_weights->getValue();
+    for(int p = 0; p < PRIORITY_COUNT; ++p) {
+        uint32_t weight = p < (int)weights.size() && weights[p] ? weights[p] : 1;
+        m_strides[p] = (1ull << 20) / weight;
+    }
+    m_starvationUs = g_starvation_ms->getValue() * 1000ull;
+    m_watchdogSlice = g_watchdog_slice->getValue();
+    m_preempt = g_preempt->getValue();
+    m_minThreads = threadCount + (m_rootFiber ? 1 : 0);
+    m_retireMs = g_scale_down_idle->getValue();
+    if(m_rootFiber) {
+        // 调用线程的槽位不会退出，也不会另起线程
+        m_workers[m_threadCount]->running.store(true, std::memory_order_relaxed);
+    }
     ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "INIT F";
 }
 Scheduler::~Scheduler() {
-
+    // 没跑完的任务直接释放
+    for(auto& w : m_workers) {
+        while(SchedNode* t = w->deque.pop()) {
+            FreeTask(t);
+        }
+        SchedNode* lists[] = {w->pinned_head, w->inbox.exchange(nullptr)};
+        for(SchedNode* t : lists) {
+            while(t) {
+                SchedNode* next = t->next;
+                FreeTask(t);
+                t = next;
+            }
+        }
+        close(w->event_fd);
+    }
+    close(m_pollerFd);
+    for(auto& q : m_classes) {
+        for(SchedNode* t : q.heap) {
+            FreeTask(t);
+        }
+    }
+    SchedNode* t = m_inject.exchange(nullptr);
+    while(t) {
+        SchedNode* next = t->next;
+        FreeTask(t);
+        t = next;
+    }
 }
 
 Fiber* Scheduler::GetMainFiber() {
     return t_scheduler_fiber;
 }
 
+Scheduler* Scheduler::GetThis() {
+    return t_scheduler;
+}
+
+int Scheduler::GetWorkerIndex() {
+    return t_worker ? ((Worker*)t_worker)->index : -1;
+}
+
+void Scheduler::Park() {
+    Scheduler* sc = t_scheduler;
+    Fiber::ptr cur = Fiber::GetThis();
+    if(!sc || cur.get() == t_scheduler_fiber) {
+        throw std::logic_error("Scheduler::Park must be called in a scheduler fiber");
+    }
+    int expect = PARK_RUNNING;
+    if(!cur->m_parkState.compare_exchange_strong(expect, PARK_PARKING)) {
+        // 已经被提前Unpark过，消耗掉这次通知
+        cur->m_parkState = PARK_RUNNING;
+        return;
+    }
+    cur->m_parkScheduler = sc;
+    cur.reset(); // 挂起期间不持有自己的引用
+    Fiber::Yield();
+}
+
+void Scheduler::Unpark(const Fiber::ptr& fiber) {
+    int s = fiber->m_parkState.load();
+    while(true) {
+        if(s == PARK_PARKED) {
+            if(fiber->m_parkState.compare_exchange_weak(s, PARK_RUNNING)) {
+                fiber->m_parkScheduler->schedule(fiber);
+                return;
+            }
+        } else if(s == PARK_NOTIFIED || s == PARK_WAKING) {
+            return;
+        } else if(fiber->m_parkState.compare_exchange_weak(s,
+                    s == PARK_PARKING ? PARK_WAKING : PARK_NOTIFIED)) {
+            return;
+        }
+    }
+}
+
+void Scheduler::finishPark(Fiber::ptr& fiber) {
+    int expect = PARK_PARKING;
+    if(fiber->m_parkState.compare_exchange_strong(expect, PARK_PARKED)) {
+        return; // 引用交给唤醒方
+    }
+    // 切出过程中已经被Unpark，直接重新调度，引用交给运行队列
+    fiber->m_parkState = PARK_RUNNING;
+    schedule(std::move(fiber));
+}
+
+void Scheduler::Yield() {
+    Worker* w = (Worker*)t_worker;
+    if(!w) {
+        return;
+    }
+    w->preempt.store(false, std::memory_order_relaxed);
+    if(Fiber::GetThis().get() == t_scheduler_fiber) {
+        return;
+    }
+    w->yielding = true;
+    Fiber::Yield();
+}
+
+bool Scheduler::PreemptRequested() {
+    Worker* w = (Worker*)t_worker;
+    return w && w->preempt.load(std::memory_order_relaxed);
+}
+
+void Scheduler::requeue(Fiber::ptr fiber) {
+    int thread = fiber->getAffinity();
+    SchedNode* task = NewTask(std::move(fiber));
+    if(thread >= 0) {
+        pushTasks(task, task, thread);
+    } else if(task->priority != NORMAL) {
+        pushClass(task);
+    } else {
+        // 不进本地队列，否则后进先出马上又轮到它
+        notifyPushed(pushInjected(task, task));
+    }
+}
+
 void Scheduler::start() {
     // std::unique_lock<std::mutex> lock(m_mutex);
     m_stopping = false;
+    uint32_t interval = g_stats_interval->getValue();
+    if(interval) {
+        m_statsTimer = addTimer(interval, [this](){
+            ZNS_LOG_INFO(g_logger) << getStats().toString();
+        }, true);
+    }
     // 创建线程 
-    m_threads.resize(m_threadCount);
-    for(int i = 0; i < m_threadCount; i ++) {
-        m_threads[i].reset(new Thread(
-            m_name + "_" + std::to_string(i), [this](){
-                ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::start() thread " << GetThreadId() << " start";
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                run();
-            }
-        ));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = false;
+        m_threads.resize(m_workers.size());
+        for(int i = 0; i < m_threadCount; i ++) {
+            startWorker(m_workers[i].get());
+        }
+    }
+    if(m_watchdogSlice || m_elastic) {
+        m_monitorStop = false;
+        m_monitor.reset(new Thread(m_name + "_monitor", [this](){ monitor(); }));
     }
     ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::start() end";
     // lock.unlock();
@@ -52,82 +406,1205 @@ void Scheduler::start() {
 }
 void Scheduler::stop() {
     ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::stop()";
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_stopping = true;
+    if(m_statsTimer) {
+        m_statsTimer->cancel();
+        m_statsTimer.reset();
     }
-    m_condition.notify_all();
-    std::vector<Thread::ptr> thrs;
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        thrs.swap(m_threads); // 使用swap技巧，避免在持有锁时析构线程对象
+    m_stopping = true;
+    // 先停monitor，之后不会再因为排队加线程
+    if(m_monitor) {
+        {
+            std::lock_guard<std::mutex> lock(m_monitorMutex);
+            m_monitorStop = true;
+        }
+        m_monitorCond.notify_one();
+        m_monitor->join();
+        m_monitor.reset();
     }
-    for (auto& thr : thrs) {
-        thr->join();
+    // 睡着的线程醒来后看到m_stopping，没有任务就退出
+    wakeAll();
+    // 收尾期间固定到已退出槽位的任务会重新拉起线程，直到取不到新线程为止
+    while(true) {
+        std::vector<Thread::ptr> thrs;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for(auto& thr : m_threads) {
+                if(thr) {
+                    thrs.push_back(std::move(thr)); // 避免在持有锁时析构线程对象
+                }
+            }
+            if(thrs.empty()) {
+                m_stopped = true;
+                break;
+            }
+        }
+        for (auto& thr : thrs) {
+            thr->join();
+        }
     }
     if(m_rootFiber) {
         m_rootFiber->call();
     }
 }
+
+int Scheduler::getRunningCount() const {
+    return m_running.load(std::memory_order_relaxed) + (m_rootFiber ? 1 : 0);
+}
+
+void Scheduler::startWorker(Worker* w) {
+    int i = w->index;
+    Thread::ptr& thr = m_threads[i];
+    if(thr) {
+        // 空闲退出的线程已经不再访问w，join只是回收
+        thr->join();
+        thr.reset();
+    }
+    w->running.store(true, std::memory_order_relaxed);
+    m_running.fetch_add(1);
+    try {
+        thr.reset(new Thread(
+            m_name + "_" + std::to_string(i), [this, i](){
+                ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::start() thread " << GetThreadId() << " start";
+                run(i);
+            }
+        ));
+    } catch(...) {
+        w->running.store(false, std::memory_order_relaxed);
+        m_running.fetch_sub(1);
+        throw;
+    }
+}
+
+void Scheduler::wakePinned(Worker* w) {
+    bool wake = false;
+    bool poller = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        poller = w == m_poller.load(std::memory_order_relaxed);
+        wake = removeIdle(w);
+        if(!wake && !w->running.load(std::memory_order_relaxed) && !m_stopped) {
+            try {
+                startWorker(w);
+            } catch(const std::exception& e) {
+                ZNS_LOG_ERROR(g_logger) << "Scheduler " << m_name << " restart worker " << w->index
+                    << " failed: " << e.what();
+            }
+        }
+    }
+    if(wake && poller) {
+        wakePoller();
+    } else if(wake) {
+        Wakeup(w);
+    }
+}
+
+bool Scheduler::leaveWorker(Worker* w) {
+    if(isRootWorker(w)) {
+        return true;
+    }
+    w->running.store(false, std::memory_order_relaxed);
+    // 和pushTasks里压进inbox之后的fence配对，要么这里看到固定任务，要么对方看到线程已经退出
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(w->inbox.load(std::memory_order_relaxed) || w->pinned_head || !w->deque.empty()) {
+        w->running.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    m_running.fetch_sub(1);
+    return true;
+}
+
+bool Scheduler::retireWorker(Worker* w) {
+    if(!m_elastic || isRootWorker(w) || stopping()
+            || getRunningCount() <= m_minThreads.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    if(!leaveWorker(w)) {
+        return false;
+    }
+    m_scaleDowns.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+struct Scheduler::MonitorState {
+    // watchdog: 每个槽位上次看到的run_tick、第一次看到它的时间、已经报过的run_tick
+    std::vector<uint64_t> last;
+    std::vector<uint64_t> since;
+    std::vector<uint64_t> reported;
+    // 弹性伸缩: 上次看到的抽样排队时间总和、任务数，排队时间开始持续超标的时间(0表示没有超标)
+    uint64_t wait_ns = 0;
+    uint64_t waited = 0;
+    uint64_t over_since = 0;
+};
+
+void Scheduler::monitor() {
+    MonitorState st;
+    size_t n = m_workers.size();
+    st.last.resize(n, 0);
+    st.since.resize(n, 0);
+    st.reported.resize(n, 0);
+    uint32_t period = 10; // 弹性伸缩的检查间隔
+    if(m_watchdogSlice) {
+        uint32_t half = std::max<uint32_t>(1, m_watchdogSlice / 2);
+        period = m_elastic ? std::min(period, half) : half;
+    }
+    std::unique_lock<std::mutex> lock(m_monitorMutex);
+    while(!m_monitorStop) {
+        m_monitorCond.wait_for(lock, std::chrono::milliseconds(period));
+        if(m_monitorStop) {
+            break;
+        }
+        uint64_t now = GetCurrentNS();
+        if(m_watchdogSlice) {
+            checkWatchdog(st, now);
+        }
+        if(m_elastic) {
+            checkScale(st, now);
+        }
+    }
+}
+
+void Scheduler::checkWatchdog(MonitorState& st, uint64_t now) {
+    // 和Go的sysmon一样不在工作线程上取时间，只看run_tick有没有变:
+    // 连续几次看到同一个奇数，说明同一个协程一直没有切出
+    uint64_t slice_ns = m_watchdogSlice * 1000000ull;
+    for(size_t i = 0; i < m_workers.size(); ++i) {
+        Worker* w = m_workers[i].get();
+        uint64_t tick = w->run_tick.load(std::memory_order_acquire);
+        if(tick != st.last[i]) {
+            st.last[i] = tick;
+            st.since[i] = now;
+            continue;
+        }
+        if(!(tick & 1) || st.reported[i] == tick || now - st.since[i] < slice_ns) {
+            continue;
+        }
+        uint32_t id = w->run_fiber.load(std::memory_order_relaxed);
+        const std::type_info* entry = w->run_entry.load(std::memory_order_relaxed);
+        // 读的过程中协程切出了，这两个值可能属于下一个协程
+        if(w->run_tick.load(std::memory_order_acquire) != tick) {
+            continue;
+        }
+        st.reported[i] = tick;
+        if(m_preempt) {
+            w->preempt.store(true, std::memory_order_relaxed);
+        }
+        ZNS_LOG_WARN(g_logger) << "Scheduler " << m_name << " worker " << w->index
+            << ": fiber_id=" << id << " entry=" << (entry ? Demangle(entry->name()) : "?")
+            << " has run for at least " << (now - st.since[i]) / 1000000 << "ms without switching out";
+    }
+}
+
+void Scheduler::checkScale(MonitorState& st, uint64_t now) {
+    // 上下限随热更新生效，上限不超过槽位数
+    int base = m_threadCount + (m_rootFiber ? 1 : 0);
+    int slots = (int)m_workers.size();
+    int max_threads = g_max_threads->getValue();
+    if(max_threads <= 0) {
+        max_threads = base;
+    }
+    max_threads = std::min(max_threads, slots);
+    int min_threads = g_min_threads->getValue();
+    if(min_threads <= 0) {
+        min_threads = base;
+    }
+    min_threads = std::max(1, std::min(min_threads, max_threads));
+    m_minThreads.store(min_threads, std::memory_order_relaxed);
+    m_retireMs.store(g_scale_down_idle->getValue(), std::memory_order_relaxed);
+
+    uint64_t wait_ns = 0;
+    uint64_t waited = 0;
+    for(auto& w : m_workers) {
+        wait_ns += w->wait_ns.load(std::memory_order_relaxed);
+        waited += w->waited.load(std::memory_order_relaxed);
+    }
+    uint64_t d_wait = wait_ns - st.wait_ns;
+    uint64_t d_count = waited - st.waited;
+    st.wait_ns = wait_ns;
+    st.waited = waited;
+    if(stopping()) {
+        return;
+    }
+
+    int running = getRunningCount();
+    int add = 0;
+    if(running < min_threads) {
+        add = min_threads - running;
+    } else {
+        // 有空闲线程时加线程没用，排队是因为唤醒不及时
+        bool over = d_count && d_wait / d_count > g_scale_up_wait->getValue() * 1000ull
+            && m_idleCount.load(std::memory_order_relaxed) == 0 && running < max_threads;
+        if(!over) {
+            st.over_since = 0;
+            return;
+        }
+        if(!st.over_since) {
+            st.over_since = now;
+        }
+        if(now - st.over_since < g_scale_up_sustain->getValue() * 1000000ull) {
+            return;
+        }
+        // 加了线程之后重新计时，等它的效果体现出来
+        st.over_since = 0;
+        add = 1;
+    }
+    bool scale_up = running >= min_threads;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto& w : m_workers) {
+        if(!add || m_stopped) {
+            break;
+        }
+        if(w->running.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        try {
+            startWorker(w.get());
+        } catch(const std::exception& e) {
+            ZNS_LOG_ERROR(g_logger) << "Scheduler " << m_name << " start worker " << w->index
+                << " failed: " << e.what();
+            break;
+        }
+        --add;
+        if(scale_up) {
+            m_scaleUps.fetch_add(1, std::memory_order_relaxed);
+        }
+        ZNS_LOG_INFO(g_logger) << "Scheduler " << m_name << " started worker " << w->index
+            << ", running " << getRunningCount() << " threads, mean queue wait "
+            << (d_count ? d_wait / d_count / 1000 : 0) << "us";
+    }
+}
+
 void Scheduler::tickle() {
-    ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::tickle()";
+    if(m_idleCount.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    // 已经有线程在自旋，它会拿到新任务
+    int expect = 0;
+    if(!m_spinning.compare_exchange_strong(expect, 1)) {
+        return;
+    }
+    Worker* self = t_scheduler == this ? (Worker*)t_worker : nullptr;
+    Worker* w = nullptr;
+    bool poller = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // 优先叫普通的空闲线程，都没有时才打断poller。
+        // poller自己分发IO事件时也算空闲，不叫醒自己
+        w = m_idle.empty() ? m_poller.load(std::memory_order_relaxed) : m_idle.back();
+        // poller可能已经被叫醒还没离开等待，不再重复叫它
+        if(w && (w == self || !w->idle.load(std::memory_order_relaxed))) {
+            w = nullptr;
+        }
+        if(w) {
+            poller = w == m_poller.load(std::memory_order_relaxed);
+            removeIdle(w);
+            w->wake_spinning = true;
+        }
+    }
+    if(!w) {
+        m_spinning.fetch_sub(1);
+        return;
+    }
+    if(poller) {
+        wakePoller();
+    } else {
+        Wakeup(w);
+    }
 }
-void Scheduler::schedule(Fiber::ptr fiber) {
-    // 加入协程队列
-    bool need_tickle = false;
+
+void Scheduler::wakePoller() {
+    uint64_t one = 1;
+    ssize_t rt = write(m_pollerFd, &one, sizeof(one));
+    (void)rt;
+}
+
+void Scheduler::wakeAll() {
+    for(auto& w : m_workers) {
+        Wakeup(w.get());
+    }
+    wakePoller();
+}
+
+void Scheduler::Wakeup(Worker* w) {
+    uint64_t one = 1;
+    ssize_t rt = write(w->event_fd, &one, sizeof(one));
+    (void)rt;
+}
+
+bool Scheduler::removeIdle(Worker* w) {
+    if(!w->idle.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    // poller离开等待之后才在park里让出位置，否则新poller可能抢走发给它的唤醒
+    if(w != m_poller.load(std::memory_order_relaxed)) {
+        m_idle.erase(std::find(m_idle.begin(), m_idle.end(), w));
+    }
+    w->idle.store(false, std::memory_order_relaxed);
+    m_idleCount.fetch_sub(1);
+    return true;
+}
+
+void Scheduler::pushTasks(SchedNode* head, SchedNode* tail, int thread) {
+    Worker* self = t_scheduler == this ? (Worker*)t_worker : nullptr;
+    if(thread >= (int)m_workers.size()) {
+        // 链表上的任务随之丢弃
+        while(head) {
+            SchedNode* next = head->next;
+            FreeTask(head);
+            head = next;
+        }
+        throw std::logic_error("Scheduler::schedule thread index out of range");
+    }
+    if(thread >= 0) {
+        for(SchedNode* t = head; t; t = t->next) {
+            t->thread = thread;
+        }
+        Worker* target = m_workers[thread].get();
+        if(target == self) {
+            appendPinned(self, head);
+            return;
+        }
+        SchedNode* old = target->inbox.load(std::memory_order_relaxed);
+        do {
+            tail->next = old;
+        } while(!target->inbox.compare_exchange_weak(old, head,
+                    std::memory_order_release, std::memory_order_relaxed));
+        if(!old) {
+            // 只有目标线程能执行，它睡着就直接叫醒它，不管有没有别的线程在自旋，
+            // 它已经空闲退出就重新启动。fence和park里的登记空闲、leaveWorker配对，
+            // 要么这里看到它空闲或者已经退出，要么它看到inbox
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(target->idle.load(std::memory_order_relaxed)
+                    || !target->running.load(std::memory_order_relaxed)) {
+                wakePinned(target);
+            }
+        }
+        return;
+    }
+
+    bool was_empty = false;
+    if(self) {
+        was_empty = self->deque.empty();
+        // 最新的先压，最早的在bottom，本线程先执行它
+        while(head) {
+            SchedNode* next = head->next;
+            head->next = nullptr;
+            self->deque.push(head);
+            head = next;
+        }
+    } else {
+        was_empty = pushInjected(head, tail);
+    }
+    notifyPushed(was_empty);
+}
+
+bool Scheduler::pushInjected(SchedNode* head, SchedNode* tail) {
+    SchedNode* old = m_inject.load(std::memory_order_relaxed);
+    do {
+        tail->next = old;
+    } while(!m_inject.compare_exchange_weak(old, head,
+                std::memory_order_release, std::memory_order_relaxed));
+    return old == nullptr;
+}
+
+void Scheduler::notifyPushed(bool was_empty) {
+    // 队列从空变成非空时，fence和park里的退出自旋、登记空闲配对: 要么这里看到空闲线程
+    // 并且没有自旋线程，要么它在睡下之前看到新任务。队列原本非空时之前的提交已经做过这一步，
+    // 这里只是顺便叫人来偷。有自旋线程时不唤醒，由它来取
+    if(was_empty) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    if(m_spinning.load(std::memory_order_relaxed) == 0
+            && m_idleCount.load(std::memory_order_relaxed) > 0) {
+        tickle();
+    }
+}
+
+SchedNode* Scheduler::NewTask(Fiber::ptr fiber) {
+    if(!fiber) {
+        return nullptr;
+    }
+    Fiber* f = fiber.get();
+    // 节点只有一个，同一个协程不能同时排两次
+    if(f->m_schedRef) {
+        throw std::logic_error("Scheduler::schedule fiber is already queued");
+    }
+    SchedNode* task = &f->m_schedNode;
+    *task = SchedNode();
+    task->fiber = f;
+    task->priority = f->getPriority();
+    task->stamp = SampleStamp();
+    f->m_schedRef = std::move(fiber);
+    return task;
+}
+
+SchedNode* Scheduler::NewTask(Callable cb) {
+    if(!cb) {
+        return nullptr;
+    }
+    ScheduleTask* task = new ScheduleTask;
+    task->cb = std::move(cb);
+    task->stamp = SampleStamp();
+    return task;
+}
+
+void Scheduler::FreeTask(SchedNode* task) {
+    if(task->fiber) {
+        task->fiber->m_schedRef.reset();
+    } else {
+        delete static_cast<ScheduleTask*>(task);
+    }
+}
+
+void Scheduler::schedule(Fiber::ptr fiber, int thread) {
+    if(!fiber) {
+        return;
+    }
+    if(IsMisplacedSharedStack(fiber.get(), thread)) {
+        throw std::logic_error("Scheduler::schedule shared stack fiber off its worker");
+    }
+    if(thread < 0) {
+        thread = fiber->getAffinity();
+    } else {
+        // 先检查下标，不能把协程固定到不存在的线程上
+        if(thread >= getWorkerCount()) {
+            throw std::logic_error("Scheduler::schedule thread index out of range");
+        }
+        fiber->setAffinity(thread);
+    }
+    SchedNode* task = NewTask(std::move(fiber));
+    if(!task) {
+        return;
+    }
+    if(thread < 0 && task->priority != NORMAL) {
+        pushClass(task);
+        return;
+    }
+    pushTasks(task, task, thread);
+}
+void Scheduler::schedule(Callable cb, int thread) {
+    SchedNode* task = NewTask(std::move(cb));
+    if(task) {
+        pushTasks(task, task, thread);
+    }
+}
+
+void Scheduler::schedule(Callable cb, Priority priority, uint64_t deadline_ms) {
+    if(priority < HIGH || priority > LOW) {
+        throw std::logic_error("Scheduler::schedule invalid priority");
+    }
+    SchedNode* task = NewTask(std::move(cb));
+    if(!task) {
+        return;
+    }
+    task->priority = priority;
+    if(priority == NORMAL && deadline_ms == ~0ull) {
+        pushTasks(task, task, -1);
+    } else {
+        pushClass(task, deadline_ms);
+    }
+}
+
+void Scheduler::schedule(Fiber::ptr fiber, Priority priority, uint64_t deadline_ms) {
+    if(priority < HIGH || priority > LOW) {
+        throw std::logic_error("Scheduler::schedule invalid priority");
+    }
+    if(!fiber) {
+        return;
+    }
+    if(IsMisplacedSharedStack(fiber.get(), -1)) {
+        throw std::logic_error("Scheduler::schedule shared stack fiber off its worker");
+    }
+    fiber->setPriority(priority);
+    int thread = fiber->getAffinity();
+    SchedNode* task = NewTask(std::move(fiber));
+    if(!task) {
+        return;
+    }
+    if(thread >= 0 || (priority == NORMAL && deadline_ms == ~0ull)) {
+        pushTasks(task, task, thread);
+    } else {
+        pushClass(task, deadline_ms);
+    }
+}
+
+void Scheduler::pushClass(SchedNode* task, uint64_t deadline_ms) {
+    ClassQueue& q = m_classes[task->priority];
+    uint64_t now = GetCurrentUS();
+    task->enqueue = now;
+    task->deadline = deadline_ms == ~0ull ? ~0ull : now + deadline_ms * 1000;
+    task->key = task->deadline;
+    if(m_starvationUs && now + m_starvationUs < task->key) {
+        task->key = now + m_starvationUs;
+    }
+    bool was_empty = false;
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        task->seq = q.seq++;
+        q.heap.push_back(task);
+        std::push_heap(q.heap.begin(), q.heap.end(), TaskLater);
+        was_empty = q.heap.size() == 1;
+        q.size.store(q.heap.size(), std::memory_order_relaxed);
+        q.top.store(q.heap.front()->key, std::memory_order_relaxed);
+    }
+    notifyPushed(was_empty);
+}
+
+SchedNode* Scheduler::takeClass(Worker* w, int priority) {
+    ClassQueue& q = m_classes[priority];
+    if(!q.size.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    SchedNode* t = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if(q.heap.empty()) {
+            return nullptr;
+        }
+        std::pop_heap(q.heap.begin(), q.heap.end(), TaskLater);
+        t = q.heap.back();
+        q.heap.pop_back();
+        q.size.store(q.heap.size(), std::memory_order_relaxed);
+        q.top.store(q.heap.empty() ? ~0ull : q.heap.front()->key, std::memory_order_relaxed);
+    }
+    uint64_t now = GetCurrentUS();
+    w->class_wait[priority].record(now > t->enqueue ? now - t->enqueue : 0);
+    if(now > t->deadline) {
+        Bump(w->class_missed[priority]);
+    }
+    return t;
+}
+
+SchedNode* Scheduler::takeStarving(Worker* w) {
+    // 等待超过时限或者已经到了截止时间，低优先级的等得最久，先看它
+    uint64_t now = 0;
+    for(int p = LOW; p > HIGH; --p) {
+        ClassQueue& q = m_classes[p];
+        if(!q.size.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        if(!now) {
+            now = GetCurrentUS();
+        }
+        if(q.top.load(std::memory_order_relaxed) <= now) {
+            SchedNode* t = takeClass(w, p);
+            if(t) {
+                return t;
+            }
+        }
+    }
+    return nullptr;
+}
+
+Scheduler::QueueWaitStats Scheduler::getQueueWaitStats(Priority priority) const {
+    if(priority < HIGH || priority > LOW) {
+        throw std::logic_error("Scheduler::getQueueWaitStats invalid priority");
+    }
+    std::vector<const Histogram*> hists;
+    QueueWaitStats st;
+    for(auto& w : m_workers) {
+        hists.push_back(&w->class_wait[priority]);
+        st.missed += w->class_missed[priority].load(std::memory_order_relaxed);
+    }
+    HistogramStats h = Histogram::Summarize(hists);
+    st.count = h.count;
+    st.p50_us = h.p50;
+    st.p99_us = h.p99;
+    st.max_us = h.max;
+    return st;
+}
+
+Scheduler::Stats Scheduler::getStats() const {
+    Stats st;
+    st.name = m_name;
+    uint64_t now = GetCurrentNS();
+    std::vector<const Histogram*> waits;
+    std::vector<const Histogram*> runs;
+    std::vector<const Histogram*> classes[PRIORITY_COUNT];
+    int started = 0;
+    for(auto& w : m_workers) {
+        WorkerStats ws;
+        ws.index = w->index;
+        ws.tasks = w->tasks.load(std::memory_order_relaxed);
+        ws.steals = w->steals.load(std::memory_order_relaxed);
+        ws.parks = w->parks.load(std::memory_order_relaxed);
+        ws.queue_depth = w->deque.size();
+        ws.running = w->running.load(std::memory_order_relaxed);
+        uint64_t start = w->start_ns.load(std::memory_order_relaxed);
+        if(start) {
+            ++started;
+            uint64_t stop = w->stop_ns.load(std::memory_order_relaxed);
+            uint64_t end = stop ? stop : now;
+            uint64_t idle = w->idle_ns.load(std::memory_order_relaxed);
+            // 正在睡眠的这一段还没有计入idle_ns
+            uint64_t park = w->park_begin.load(std::memory_order_relaxed);
+            if(!stop && park && now > park) {
+                idle += now - park;
+            }
+            uint64_t total = end > start ? end - start : 0;
+            idle = std::min(idle, total);
+            ws.idle_us = idle / 1000;
+            ws.busy_us = (total - idle) / 1000;
+            ws.utilization = total ? (double)(total - idle) / total : 0;
+        }
+        st.tasks += ws.tasks;
+        st.queue_depth += ws.queue_depth;
+        st.utilization += ws.utilization;
+        // 弹性模式下还没用过的槽位不列出来
+        if(start) {
+            st.workers.push_back(ws);
+        }
+        waits.push_back(&w->queue_wait);
+        runs.push_back(&w->run_time);
+        for(int p = 0; p < PRIORITY_COUNT; ++p) {
+            classes[p].push_back(&w->class_wait[p]);
+            st.class_missed[p] += w->class_missed[p].load(std::memory_order_relaxed);
+        }
+    }
+    if(started) {
+        st.utilization /= started;
+    }
+    st.running = getRunningCount();
+    st.scale_ups = m_scaleUps.load(std::memory_order_relaxed);
+    st.scale_downs = m_scaleDowns.load(std::memory_order_relaxed);
+    for(int p = 0; p < PRIORITY_COUNT; ++p) {
+        st.class_depth[p] = m_classes[p].size.load(std::memory_order_relaxed);
+        st.queue_depth += st.class_depth[p];
+        st.class_wait[p] = Histogram::Summarize(classes[p]);
+    }
+    st.queue_wait = Histogram::Summarize(waits);
+    st.run_time = Histogram::Summarize(runs);
+    return st;
+}
+
+static void FormatHistogram(std::ostream& os, const char* name, const HistogramStats& h) {
+    os << name << " n=" << h.count << " mean=" << (uint64_t)h.mean << " p50=" << h.p50
+       << " p90=" << h.p90 << " p99=" << h.p99 << " p999=" << h.p999 << " max=" << h.max;
+}
+
+std::string Scheduler::Stats::toString() const {
+    static const char* s_classNames[PRIORITY_COUNT] = {"high", "normal", "low"};
+    std::stringstream ss;
+    ss.precision(3);
+    ss << "scheduler " << name << ": tasks=" << tasks << " utilization=" << utilization
+       << " queue_depth=" << queue_depth << " running=" << running;
+    if(scale_ups || scale_downs) {
+        ss << " scale_ups=" << scale_ups << " scale_downs=" << scale_downs;
+    }
+    ss << "\n  ";
+    FormatHistogram(ss, "queue_wait(ns)", queue_wait);
+    ss << "\n  ";
+    FormatHistogram(ss, "run_time(ns)", run_time);
+    for(int p = 0; p < PRIORITY_COUNT; ++p) {
+        if(!class_wait[p].count && !class_depth[p]) {
+            continue;
+        }
+        ss << "\n  ";
+        std::string title = std::string(s_classNames[p]) + "_wait(us)";
+        FormatHistogram(ss, title.c_str(), class_wait[p]);
+        ss << " missed=" << class_missed[p] << " depth=" << class_depth[p];
+    }
+    for(auto& w : workers) {
+        ss << "\n  worker " << w.index << ": tasks=" << w.tasks << " steals=" << w.steals
+           << " parks=" << w.parks << " busy(us)=" << w.busy_us << " idle(us)=" << w.idle_us
+           << " utilization=" << w.utilization << " depth=" << w.queue_depth
+           << (w.running ? "" : " exited");
+    }
+    return ss.str();
+}
+void Scheduler::scheduleInline(InlineFunc fn, void* arg) {
+    ScheduleTask* task = new ScheduleTask;
+    task->inline_fn = fn;
+    task->inline_arg = arg;
+    pushTasks(task, task, -1);
+}
+
+void Scheduler::appendPinned(Worker* w, SchedNode* head) {
+    // head是最新的，反转成最早的在前再接到pinned链表尾部
+    SchedNode* first = nullptr;
+    SchedNode* last = head;
+    while(head) {
+        SchedNode* next = head->next;
+        head->next = first;
+        first = head;
+        head = next;
+    }
+    if(w->pinned_tail) {
+        w->pinned_tail->next = first;
+    } else {
+        w->pinned_head = first;
+    }
+    w->pinned_tail = last;
+}
+
+SchedNode* Scheduler::takePinned(Worker* w) {
+    if(!w->pinned_head) {
+        if(!w->inbox.load(std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        SchedNode* head = w->inbox.exchange(nullptr, std::memory_order_acquire);
+        if(!head) {
+            return nullptr;
+        }
+        appendPinned(w, head);
+    }
+    SchedNode* t = w->pinned_head;
+    w->pinned_head = t->next;
+    if(!w->pinned_head) {
+        w->pinned_tail = nullptr;
+    }
+    t->next = nullptr;
+    return t;
+}
+
+SchedNode* Scheduler::takeInjected(Worker* w) {
+    if(!m_inject.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    SchedNode* t = m_inject.exchange(nullptr, std::memory_order_acquire);
+    if(!t) {
+        return nullptr;
+    }
+    // 栈顶是最新提交的，依次压进本地队列，最早的那个直接返回执行，
+    // 之后本地pop的顺序仍然是先提交先执行
+    while(t->next) {
+        SchedNode* next = t->next;
+        t->next = nullptr;
+        w->deque.push(t);
+        t = next;
+    }
+    // 一次拿了一批，叫醒别的线程来偷
+    if(!w->deque.empty()) {
+        tickle();
+    }
+    return t;
+}
+
+SchedNode* Scheduler::stealTask(Worker* w) {
+    size_t n = m_workers.size();
+    if(n <= 1) {
+        return nullptr;
+    }
+    // xorshift选一个起点，避免所有空闲线程都盯着同一个受害者
+    w->seed ^= w->seed << 13;
+    w->seed ^= w->seed >> 17;
+    w->seed ^= w->seed << 5;
+    size_t start = w->seed % n;
+    for(size_t i = 0; i < n; ++i) {
+        Worker* victim = m_workers[(start + i) % n].get();
+        if(victim == w) {
+            continue;
+        }
+        SchedNode* t = victim->deque.steal();
+        if(t) {
+            Bump(w->steals);
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+SchedNode* Scheduler::nextTask(Worker* w) {
+    SchedNode* t = nullptr;
+    // 和Go一样每61次先看一眼定时器、饿着的类队列任务、固定任务和注入栈
+    if(++w->tick % 61 == 0) {
+        processTimers();
+        flushPending();
+        t = takeStarving(w);
+        if(!t) {
+            t = takePinned(w);
+        }
+        if(!t) {
+            t = takeInjected(w);
+        }
+        if(t) {
+            return t;
+        }
+    }
+    if(m_weighted) {
+        return nextWeighted(w);
+    }
+    t = takeClass(w, HIGH);
+    if(t) {
+        return t;
+    }
+    // 带截止时间的NORMAL任务排在没有截止时间的前面
+    t = takeClass(w, NORMAL);
+    if(t) {
+        return t;
+    }
+    t = nextNormal(w);
+    if(t) {
+        return t;
+    }
+    return takeClass(w, LOW);
+}
+
+SchedNode* Scheduler::nextWeighted(Worker* w) {
+    // 按虚拟时间从小到大试各优先级，相同时高优先级先
+    int order[PRIORITY_COUNT] = {HIGH, NORMAL, LOW};
+    for(int i = 1; i < PRIORITY_COUNT; ++i) {
+        for(int j = i; j > 0 && w->pass[order[j]] < w->pass[order[j - 1]]; --j) {
+            std::swap(order[j], order[j - 1]);
+        }
+    }
+    for(int i = 0; i < PRIORITY_COUNT; ++i) {
+        int p = order[i];
+        SchedNode* t = takeClass(w, p);
+        if(!t && p == NORMAL) {
+            t = nextNormal(w);
+        }
+        if(t) {
+            // 前面没有任务的优先级不攒额度，追到当前的虚拟时间
+            for(int j = 0; j < i; ++j) {
+                w->pass[order[j]] = w->pass[p];
+            }
+            w->pass[p] += m_strides[p];
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+SchedNode* Scheduler::nextNormal(Worker* w) {
+    SchedNode* t = w->deque.pop();
+    if(t) {
+        return t;
+    }
+    t = takePinned(w);
+    if(t) {
+        return t;
+    }
+    t = takeInjected(w);
+    if(t) {
+        return t;
+    }
+    return stealTask(w);
+}
+
+bool Scheduler::hasWork(Worker* w) const {
+    if(m_inject.load(std::memory_order_relaxed)
+            || w->pinned_head || w->inbox.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    for(auto& q : m_classes) {
+        if(q.size.load(std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    for(auto& w : m_workers) {
+        if(!w->deque.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SchedNode* Scheduler::spin(Worker* w) {
+    if(!w->spinning) {
+        // 自旋线程太多只是空耗CPU，不超过忙碌线程数的一半
+        int busy = getRunningCount() - m_idleCount.load(std::memory_order_relaxed);
+        if(2 * m_spinning.load(std::memory_order_relaxed) >= busy) {
+            return nullptr;
+        }
+        w->spinning = true;
+        m_spinning.fetch_add(1);
+    }
+    // 刚提交的任务常常马上就到
+    for(int i = 0; i < 4; ++i) {
+        std::this_thread::yield();
+        SchedNode* t = nextTask(w);
+        if(t) {
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::resetSpinning(Worker* w) {
+    w->spinning = false;
+    // 最后一个自旋线程找到了任务，可能还有更多任务，再叫醒一个来自旋
+    if(m_spinning.fetch_sub(1) == 1) {
+        tickle();
+    }
+}
+
+bool Scheduler::park(Worker* w) {
+    if(w->spinning) {
+        w->spinning = false;
+        m_spinning.fetch_sub(1);
+    }
+    bool poller = false;
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        need_tickle = m_fibers.empty();
-        m_fibers.push_back(fiber);
-        ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << m_fibers.size();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        w->idle.store(true, std::memory_order_relaxed);
+        m_idleCount.fetch_add(1);
+        // 还没有线程在等定时器或IO，由它来等。poller不进空闲栈
+        if(!m_poller.load(std::memory_order_relaxed) && needPoller()) {
+            m_poller.store(w, std::memory_order_relaxed);
+            poller = true;
+        } else {
+            m_idle.push_back(w);
+        }
+    }
+    // 和pushTasks里的fence配对，登记之后再检查一遍，不会漏掉登记之前提交的任务
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int timeout = -1;
+    if(poller) {
+        // 成为poller之后再取截止时间，之后更早的新定时器会通过onTimerInsertedAtFront叫醒它
+        uint64_t next = getNextTimer();
+        if(next != ~0ull) {
+            timeout = (int)std::min<uint64_t>(next, INT_MAX);
+        }
+    }
+    if(timeout == 0 || stopping() || hasWork(w)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(removeIdle(w)) {
+            if(poller) {
+                m_poller.store(nullptr, std::memory_order_relaxed);
+            }
+            return true;
+        }
+        // 已经被别人取走，对应的eventfd马上可读，下面的等待不会阻塞
+    }
+    uint64_t park_begin = GetCurrentNS();
+    w->park_begin.store(park_begin, std::memory_order_relaxed);
+    bool timed_out = false;
+    if(poller) {
+        pollerWait(timeout);
+    } else {
+        // 弹性模式下睡到空闲时限，超时的线程在下面决定是否退出
+        int idle_ms = -1;
+        if(m_elastic && !isRootWorker(w)) {
+            uint32_t ms = m_retireMs.load(std::memory_order_relaxed);
+            idle_ms = ms ? (int)std::min<uint32_t>(ms, INT_MAX) : -1;
+        }
+        struct pollfd pfd;
+        pfd.fd = w->event_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int rt = 0;
+        do {
+            rt = poll(&pfd, 1, idle_ms);
+        } while(rt < 0 && errno == EINTR);
+        timed_out = rt == 0;
+        if(!timed_out) {
+            uint64_t v = 0;
+            ssize_t n = read(w->event_fd, &v, sizeof(v));
+            (void)n;
+        }
+    }
+    w->park_begin.store(0, std::memory_order_relaxed);
+    Bump(w->idle_ns, GetCurrentNS() - park_begin);
+    Bump(w->parks);
+    Worker* handoff = nullptr;
+    bool retired = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // 被人取走说明是叫它去干活；stop、定时器提前、超时和IO事件都不会取走它
+        bool for_work = !w->idle.load(std::memory_order_relaxed);
+        removeIdle(w);
+        if(timed_out && !for_work) {
+            retired = retireWorker(w);
+        }
+        if(poller) {
+            m_poller.store(nullptr, std::memory_order_relaxed);
+            // 和IOManager登记事件之后检查poller配对，要么它看到没有poller，要么这里看到要等的事件
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        // poller去干活了，等定时器和IO的事交给另一个睡眠的线程
+        if(poller && for_work && !m_idle.empty() && needPoller()) {
+            handoff = m_idle.back();
+        }
+        if(w->wake_spinning) {
+            w->wake_spinning = false;
+            w->spinning = true;
+        }
+    }
+    if(handoff) {
+        Wakeup(handoff);
+    }
+    if(retired) {
+        ZNS_LOG_INFO(g_logger) << "Scheduler " << m_name << " worker " << w->index
+            << " idle for " << m_retireMs.load(std::memory_order_relaxed) << "ms, exit, running "
+            << getRunningCount() << " threads";
+    }
+    return !retired;
+}
+
+void Scheduler::pollerWait(int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = m_pollerFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rt = 0;
+    do {
+        rt = poll(&pfd, 1, timeout_ms);
+    } while(rt < 0 && errno == EINTR);
+    if(rt > 0) {
+        uint64_t v = 0;
+        ssize_t n = read(m_pollerFd, &v, sizeof(v));
+        (void)n;
     }
-    if(need_tickle) m_condition.notify_one();
 }
-void Scheduler::idle() {
-    ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::idle()";
-    while(!m_stopping){
-        sleep(1);
-        Fiber::Yield();
+
+void Scheduler::onTimerInsertedAtFront() {
+    // 有poller就让它重新算截止时间，没有就叫醒一个空闲线程，它再睡下时会成为poller
+    if(m_poller.load(std::memory_order_relaxed)) {
+        wakePoller();
+    } else {
+        tickle();
     }
 }
-void Scheduler::run() {
+
+bool Scheduler::processTimers() {
+    uint64_t earliest = getEarliest();
+    if(earliest == ~0ull || GetCurrentMS() < earliest) {
+        return false;
+    }
+    std::vector<std::function<void()> > cbs;
+    listExpiredCb(cbs);
+    if(cbs.empty()) {
+        return false;
+    }
+    schedule(std::make_move_iterator(cbs.begin()), std::make_move_iterator(cbs.end()));
+    return true;
+}
+
+void Scheduler::beginSlice(Worker* w, Fiber* fiber) {
+    if(!m_watchdogSlice) {
+        return;
+    }
+    w->preempt.store(false, std::memory_order_relaxed);
+    w->run_fiber.store(fiber->getId(), std::memory_order_relaxed);
+    w->run_entry.store(&fiber->m_cb.targetType(), std::memory_order_relaxed);
+    w->run_tick.store(w->run_tick.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Scheduler::endSlice(Worker* w) {
+    if(m_watchdogSlice) {
+        w->run_tick.store(w->run_tick.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+}
+
+void Scheduler::runTask(Worker* w, SchedNode* node, Fiber::ptr& cb_fiber) {
+    if(node->fiber) {
+        // 接过排队期间的引用，节点随即可以再次入队
+        Fiber::ptr fiber = std::move(node->fiber->m_schedRef);
+        if(fiber->getState() != Fiber::TERM && fiber->getState() != Fiber::EXCEPT) {
+            beginSlice(w, fiber.get());
+            fiber->swapIn();
+            endSlice(w);
+        }
+        // 切出途中可能已经被Unpark，WAKING也是通过Park切出来的
+        int park = fiber->m_parkState.load();
+        if(w->yielding) {
+            w->yielding = false;
+            requeue(std::move(fiber));
+        } else if(park == PARK_PARKING || park == PARK_WAKING) {
+            finishPark(fiber);
+        } else if(fiber->isPooled() && (fiber->getState() == Fiber::TERM
+                || fiber->getState() == Fiber::EXCEPT)) {
+            ReleaseFiber(fiber);
+        }
+        return;
+    }
+    ScheduleTask* task = static_cast<ScheduleTask*>(node);
+    if(task->cb) {
+        if(cb_fiber) {
+            cb_fiber->reset(std::move(task->cb));
+        } else {
+            cb_fiber = AcquireFiber(std::move(task->cb));
+        }
+        // 固定线程的回调在Park之后也要回到这个线程
+        cb_fiber->setAffinity(task->thread);
+        cb_fiber->setPriority(task->priority);
+        beginSlice(w, cb_fiber.get());
+        cb_fiber->swapIn();
+        endSlice(w);
+        int park = cb_fiber->m_parkState.load();
+        if(w->yielding) {
+            w->yielding = false;
+            requeue(std::move(cb_fiber));
+            cb_fiber.reset();
+        } else if(park == PARK_PARKING || park == PARK_WAKING) {
+            finishPark(cb_fiber);
+            cb_fiber.reset();
+        } else if(cb_fiber->getState() != Fiber::TERM && cb_fiber->getState() != Fiber::EXCEPT) {
+            // 回调中途挂起了，协程交给后续调度它的人，下个回调换一个协程
+            cb_fiber.reset();
+        }
+    } else if(task->inline_fn) {
+        task->inline_fn(task->inline_arg);
+    }
+    delete task;
+}
+
+void Scheduler::run(int index) {
+    t_scheduler = this;
+    Worker* w = m_workers[index].get();
+    t_worker = w;
     if(GetThreadId() != m_rootThreadId) {
         t_scheduler_fiber = Fiber::GetThis().get();
     }
     ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::run()" << m_name
     << " thread_id=" << GetThreadId() << " m_rootThreadId=" << m_rootThreadId 
     << " t_scheduler_fiber: "<< t_scheduler_fiber->getId();
-    Fiber::ptr idle_fiber = std::make_shared<Fiber>([this]() {idle();}, 1024*128);
-    while(1) {
-        Fiber::ptr fiber;
-        {
-            ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::run() before lock";
-            std::unique_lock<std::mutex> lock(m_mutex);
-            ZNS_LOG_DEBUG(ZNS_LOG_ROOT()) << "Scheduler::run() after lock";
-            m_condition.wait(lock, [this] {
-                    return !m_fibers.empty() || m_stopping;
-            });
-            if(!m_fibers.empty()) {
-                fiber = m_fibers.back();
-                m_fibers.pop_back();
+    w->stop_ns.store(0, std::memory_order_relaxed);
+    w->start_ns.store(GetCurrentNS(), std::memory_order_relaxed);
+    onWorkerStart();
+    Fiber::ptr cb_fiber; // 执行回调的池化协程
+    while(true) {
+        SchedNode* task = nextTask(w);
+        if(!task) {
+            // 到期的定时器和就绪的IO都会变成新任务
+            bool got = processTimers();
+            if(pollNonBlocking()) {
+                got = true;
+            }
+            if(got) {
+                continue;
             }
         }
-        
-        if(fiber) {
-            std::cout << "before swap" << std::endl;
-            fiber->swapIn();
-            std::cout << "after swap" << std::endl;
-            
-        } 
-        else {
-            if(m_stopping) break;
-            if(idle_fiber->getState() == Fiber::TERM) {
-                ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "idle fiber term";
+        if(!task) {
+            task = spin(w);
+        }
+        if(task) {
+            if(w->spinning) {
+                resetSpinning(w);
+            }
+            uint64_t stamp = task->stamp;
+            uint64_t begin = 0;
+            if(stamp) {
+                begin = GetCurrentNS();
+                uint64_t wait = begin > stamp ? begin - stamp : 0;
+                w->queue_wait.record(wait);
+                Bump(w->wait_ns, wait);
+                Bump(w->waited);
+            }
+            runTask(w, task, cb_fiber);
+            if(stamp) {
+                w->run_time.record(GetCurrentNS() - begin);
+            }
+            Bump(w->tasks);
+            continue;
+        }
+        if(stopping() && !hasWork(w)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(leaveWorker(w)) {
                 break;
             }
-            // idle_fiber->swapIn();
+            continue;
         }
-        
+        if(!park(w)) {
+            break;
+        }
+    }
+    if(w->spinning) {
+        w->spinning = false;
+        m_spinning.fetch_sub(1);
     }
+    onWorkerStop();
+    w->stop_ns.store(GetCurrentNS(), std::memory_order_relaxed);
+    t_worker = nullptr;
+}
 }
-}
\ No newline at end of file
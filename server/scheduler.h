@@ -1,36 +1,507 @@
 #pragma once
 #include <memory>
+#include <string>
 #include <vector>
 #include <list>
 #include <iostream>
+#include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <stdexcept>
 
 #include "fiber.h"
 #include "thread.h"
+#include "work_deque.h"
+#include "timer.h"
+#include "histogram.h"
+
+/**
+ * @brief 协作式抢占点，放在长时间占用CPU的循环里
+ * @details watchdog发现当前协程运行超过scheduler.watchdog_slice_ms并且scheduler.preempt开启时，
+ *          在这里让出线程，协程排到已有任务之后再继续。没有请求时只是读一个线程本地的标志
+ */
+#define ZNS_PREEMPT_POINT() \
+    do { \
+        if(ZnetServer::Scheduler::PreemptRequested()) { \
+            ZnetServer::Scheduler::Yield(); \
+        } \
+    } while(0)
 
 namespace ZnetServer {
-class Scheduler {
+template<class T> class Future;
+
+/**
+ * @brief 协程调度器
+ * @details 同时是定时器管理器: 到期的定时器回调作为任务调度到工作线程的池化协程上执行。
+ *          空闲线程中有一个负责睡到最近的定时器到期，其余的无限期睡眠；
+ *          stop之后还没到期的定时器不再触发。
+ *
+ *          构造时scheduler.max_threads大于线程数则开启弹性模式: 抽样的排队时间持续
+ *          scheduler.scale_up_sustain_ms超过scheduler.scale_up_wait_us并且没有空闲线程时加一个线程，
+ *          睡眠超过scheduler.scale_down_idle_ms的线程退出，线程数保持在
+ *          [scheduler.min_threads, scheduler.max_threads]之内。上下限可以热更新，
+ *          但上限不超过构造时的scheduler.max_threads(工作线程的槽位在构造时分配好)
+ */
+class Scheduler : public TimerManager {
 public:
+    /**
+     * @brief 任务的优先级
+     * @details NORMAL并且不带截止时间的任务走工作窃取的本地队列，其余的进按优先级分开的类队列，
+     *          类队列里按截止时间排序(最早截止优先，没有截止时间的按提交顺序)。
+     *          scheduler.priority_policy为strict时总是先取高优先级；weighted时按
+     *          scheduler.priority_weights的比例轮流取各优先级。
+     *          类队列里等待超过scheduler.starvation_ms的任务每61次调度插队一次，低优先级不会饿死
+     */
+    enum Priority {
+        HIGH = 0,
+        NORMAL = 1,
+        LOW = 2,
+    };
+    static const int PRIORITY_COUNT = 3;
+
+    /**
+     * @brief 一个优先级在类队列里的排队时间统计
+     * @details 只统计进了类队列的任务，分位数是所在直方图桶的上界
+     */
+    struct QueueWaitStats {
+        uint64_t count = 0;   // 出队的任务数
+        uint64_t missed = 0;  // 开始执行时已经过了截止时间的任务数
+        uint64_t p50_us = 0;
+        uint64_t p99_us = 0;
+        uint64_t max_us = 0;
+    };
+
+    /**
+     * @brief 一个工作线程的运行统计
+     */
+    struct WorkerStats {
+        int index = 0;
+        uint64_t tasks = 0;     // 执行过的任务数
+        uint64_t steals = 0;    // 从别的线程偷来的任务数
+        uint64_t parks = 0;     // 没有任务睡下的次数
+        uint64_t busy_us = 0;   // 不在睡眠的时间，包括自旋找任务
+        uint64_t idle_us = 0;   // 睡眠(包括当poller)的时间
+        double utilization = 0; // busy / (busy + idle)
+        size_t queue_depth = 0; // 本地队列里的任务数
+        bool running = false;   // 线程正在运行(弹性模式下可能已经退出)
+    };
+
+    /**
+     * @brief 调度器的运行统计，见getStats
+     */
+    struct Stats {
+        std::string name;
+        std::vector<WorkerStats> workers; // 只包括启动过的线程
+        int running = 0;                  // 正在运行的工作线程数
+        uint64_t scale_ups = 0;           // 弹性模式下加线程的次数
+        uint64_t scale_downs = 0;         // 弹性模式下线程空闲退出的次数
+        uint64_t tasks = 0;
+        double utilization = 0;  // 所有工作线程的平均
+        size_t queue_depth = 0;  // 所有本地队列加类队列里的任务数
+        size_t class_depth[PRIORITY_COUNT] = {};
+        HistogramStats queue_wait; // 抽样任务从入队到开始执行的时间(ns)
+        HistogramStats run_time;   // 抽样任务一次运行到切出(结束、Park或Yield)的时间(ns)
+        HistogramStats class_wait[PRIORITY_COUNT]; // 类队列的排队时间(us)
+        uint64_t class_missed[PRIORITY_COUNT] = {}; // 开始执行时已经过了截止时间的任务数
+
+        std::string toString() const;
+    };
+
     Scheduler(int n_threads = 1, bool user_caller = true, const std::string& name = "");
     virtual ~Scheduler(); 
     static Fiber* GetMainFiber();
+    /**
+     * @brief 当前线程所属的调度器，不在调度线程上时为nullptr
+     */
+    static Scheduler* GetThis();
     void start();
     void stop();
+    /**
+     * @brief 有睡眠中的工作线程、并且没有线程在自旋找任务时，唤醒一个
+     * @details 和Go runtime的spinning M一样: 已经有自旋线程时它会拿到新任务，
+     *          不再唤醒别的线程；被唤醒的线程带着自旋身份起来，找到任务后
+     *          如果它是最后一个自旋线程，再唤醒下一个
+     */
     void tickle();
-    void schedule(Fiber::ptr fiber);
+    /**
+     * @brief 当前线程在所属调度器中的工作线程下标，不是工作线程时为-1
+     */
+    static int GetWorkerIndex();
+    /**
+     * @brief 工作线程的槽位数，use_caller时包括调用线程(下标排在构造时的线程之后)
+     * @details 弹性模式下包括还没有启动和已经退出的线程，固定到这些下标的任务会把线程重新拉起来
+     */
+    int getWorkerCount() const { return (int)m_workers.size(); }
+    /**
+     * @brief 正在运行的工作线程数，use_caller时包括调用线程
+     */
+    int getRunningCount() const;
+
+    /**
+     * @brief 调度一个协程
+     * @param[in] thread 固定到哪个工作线程(0 ~ getWorkerCount()-1)，
+     *            -1时沿用协程自己的affinity。指定了线程时会记到协程上，
+     *            之后Park/Unpark等重新调度都回到这个线程
+     * @details 共享栈协程只能在创建它的工作线程上执行，不在工作线程上创建的
+     *          或者指定了别的线程时抛std::logic_error
+     */
+    void schedule(Fiber::ptr fiber, int thread = -1);
+    /**
+     * @brief 调度一个回调
+     * @details 在工作线程上调用时放进本线程的队列(后进先出，空闲线程会来偷)，
+     *          其他线程调用时放进注入栈。不为每个回调单独创建协程，工作线程在池化的协程上执行它，
+     *          回调结束后协程通过Fiber::reset复用。cb可以是std::function
+     *          或任意只可移动的可调用对象。
+     *          thread >= 0时只在该工作线程上执行(包括执行中Park之后的恢复)
+     */
+    void schedule(Callable cb, int thread = -1);
+
+    /**
+     * @brief 按优先级调度一个回调或协程
+     * @param[in] deadline_ms 从现在起多少毫秒内希望开始执行，~0ull表示没有截止时间。
+     *            截止时间只决定排队顺序，过了截止时间的任务照样执行并计入missed
+     * @details 协程记住这个优先级，之后Park/Unpark重新调度时沿用。
+     *          固定了线程的协程仍然进该线程的固定队列，不区分优先级
+     */
+    void schedule(Callable cb, Priority priority, uint64_t deadline_ms = ~0ull);
+    void schedule(Fiber::ptr fiber, Priority priority, uint64_t deadline_ms = ~0ull);
+
+    /**
+     * @brief 批量调度，元素可以是Fiber::ptr或可调用对象
+     * @details 整批一次挂到队列上，最多唤醒一次。协程的固定线程同schedule(Fiber::ptr, int):
+     *          thread >= 0时记到协程上，-1时固定了线程的协程单独进它的固定队列
+     */
+    template<class Iterator>
+    void schedule(Iterator begin, Iterator end, int thread = -1) {
+        // 先检查下标，不能把协程固定到不存在的线程上
+        if(thread >= getWorkerCount()) {
+            throw std::logic_error("Scheduler::schedule thread index out of range");
+        }
+        SchedNode* head = nullptr; // 最后一个(最新)
+        SchedNode* tail = nullptr; // 第一个(最早)
+        for(; begin != end; ++begin) {
+            SchedNode* t = NewTask(*begin);
+            if(!t) {
+                continue;
+            }
+            if(t->fiber) {
+                int affinity = t->fiber->getAffinity();
+                if(IsMisplacedSharedStack(t->fiber, thread)) {
+                    // 还没挂到队列上的节点都放掉
+                    FreeTask(t);
+                    while(head) {
+                        SchedNode* next = head->next;
+                        FreeTask(head);
+                        head = next;
+                    }
+                    throw std::logic_error("Scheduler::schedule shared stack fiber off its worker");
+                }
+                if(thread >= 0) {
+                    t->fiber->setAffinity(thread);
+                } else if(affinity >= 0) {
+                    // 不能进本地队列或注入栈被别的线程偷走(共享栈协程只能在自己的线程上恢复)
+                    pushTasks(t, t, affinity);
+                    continue;
+                } else if(t->priority != NORMAL) {
+                    // 带优先级的协程单独进类队列
+                    pushClass(t);
+                    continue;
+                }
+            }
+            t->next = head;
+            head = t;
+            if(!tail) {
+                tail = t;
+            }
+        }
+        if(head) {
+            pushTasks(head, tail, thread);
+        }
+    }
+
+    /**
+     * @brief 调度一个有返回值的回调，通过Future取结果
+     * @details 定义在future.h，使用时需要包含它。
+     *          结果直接存放在Future的共享状态里，不额外分配
+     */
+    template<class F>
+    Future<typename std::result_of<F()>::type> async(F&& f);
+
+    /**
+     * @brief 在BlockingPool::GetInstance()上执行会阻塞线程的回调(fsync、getaddrinfo、压缩等)，返回它的结果
+     * @details 在工作协程里调用时当前协程Park到回调完成，工作线程照常调度别的协程，
+     *          之后回到原来的调度器继续(沿用协程的固定线程和优先级)。池的队列满时也只Park当前协程。
+     *          回调抛出的异常在这里重新抛出。不在工作协程里时直接在当前线程执行。
+     *          共享栈协程也直接执行: 它挂起后栈内存归别的协程使用，回调按引用捕获的局部变量会失效。定义在future.h
+     */
+    template<class F>
+    static typename std::result_of<F()>::type Offload(F&& f);
+
+    typedef void (*InlineFunc)(void* arg);
+    /**
+     * @brief 在调度协程上直接执行fn(arg)，不切换到工作协程
+     * @details 只适合不会挂起当前协程的短回调，例如恢复一个无栈协程
+     */
+    void scheduleInline(InlineFunc fn, void* arg);
+
+    /**
+     * @brief 挂起当前协程，直到别人对它调用Unpark
+     * @details 语义同LockSupport.park: 先Unpark后Park时Park立即返回，
+     *          也可能虚假返回，调用方需要循环检查自己的条件。
+     *          调用方在Park之前要把Fiber::GetThis()交给唤醒方。
+     *          只能在调度器的工作协程中调用
+     */
+    static void Park();
+    /**
+     * @brief 唤醒Park中的协程，把它重新放回挂起时所在的调度器
+     * @details 可以在任意线程调用，和Park之间没有竞争:
+     *          协程还没完全切出时由调度线程在切回后负责重新调度
+     */
+    static void Unpark(const Fiber::ptr& fiber);
+
+    /**
+     * @brief 让出线程，当前协程重新排队
+     * @details 固定了线程的回到该线程的固定队列，带优先级的回到类队列，其余的进注入栈，
+     *          排在本线程已有的任务之后。在调度协程上或者调度器之外调用时直接返回
+     */
+    static void Yield();
+    /**
+     * @brief watchdog是否要求当前协程让出线程，见ZNS_PREEMPT_POINT
+     */
+    static bool PreemptRequested();
+
+    /**
+     * @brief 所有工作线程合计的某个优先级的排队时间
+     */
+    QueueWaitStats getQueueWaitStats(Priority priority) const;
+
+    /**
+     * @brief 运行统计
+     * @details 计数器和直方图由各工作线程写自己的一份，这里读的时候汇总，不影响调度。
+     *          排队和运行时间每scheduler.stats_sample个任务抽一个计时(0关闭)，
+     *          scheduler.stats_interval_ms大于0时start之后按这个间隔把统计打到system日志
+     */
+    Stats getStats() const;
+protected:
+    void onTimerInsertedAtFront() override;
+
+    /**
+     * @brief 是否已经stop并且可以退出，工作线程在没有任务时检查
+     */
+    virtual bool stopping() { return m_stopping; }
+
+    /**
+     * @brief 是否需要一个空闲线程当poller，在定时器或IO事件上等待
+     * @details 在持有调度器内部锁时调用
+     */
+    virtual bool needPoller() { return hasTimer(); }
+
+    /**
+     * @brief poller线程的等待: 最多timeout_ms毫秒(-1不限)，wakePoller或有事件时提前返回
+     * @details 默认等待getPollerFd()。IOManager在epoll_wait里等，并把就绪的IO调度出去
+     */
+    virtual void pollerWait(int timeout_ms);
+
+    /**
+     * @brief 没有空闲线程在等IO时，找不到任务的工作线程非阻塞地收取一次，返回是否调度了任务
+     */
+    virtual bool pollNonBlocking() { return false; }
+
+    /**
+     * @brief 工作线程每61次调度调用一次，IOManager在这里把协程们攒下的io_uring请求批量提交
+     */
+    virtual void flushPending() {}
+
+    /**
+     * @brief 工作线程开始和结束调度时在该线程上调用，use_caller时也包括调用线程
+     */
+    virtual void onWorkerStart() {}
+    virtual void onWorkerStop() {}
+
+    /**
+     * @brief poller等待的eventfd，需要加进poller自己的等待集合里
+     */
+    int getPollerFd() const { return m_pollerFd; }
+
+    /**
+     * @brief 是否有空闲线程正阻塞在pollerWait里
+     */
+    bool hasPoller() const { return m_poller.load(std::memory_order_relaxed) != nullptr; }
+
+    void wakePoller();
+    // 叫醒所有睡眠的线程重新检查stopping
+    void wakeAll();
 private:
-    void run();
-    void idle();
+    // 回调任务的节点，cb和inline_fn二选一
+    struct ScheduleTask : public SchedNode {
+        Callable cb;
+        InlineFunc inline_fn = nullptr;
+        void* inline_arg = nullptr;
+
+        // 节点从线程缓存分配
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
+    };
+    // 每个工作线程一个本地队列，只有自己push/pop，其他线程从另一端偷
+    struct Worker {
+        WorkStealingDeque<SchedNode> deque;
+        // 固定到本线程的任务: 其他线程压到inbox(无锁栈)，本线程取出后按提交顺序放进pinned链表，
+        // 都不会被偷走
+        std::atomic<SchedNode*> inbox {nullptr};
+        SchedNode* pinned_head = nullptr;
+        SchedNode* pinned_tail = nullptr;
+        uint32_t seed = 0; // 选择偷取对象的随机数
+        uint32_t tick = 0; // 定期先看固定任务和注入栈，避免本地队列一直有活时它们饿死
+        int index = 0;
+        int event_fd = -1; // 睡眠时阻塞在这个eventfd上
+        std::atomic<bool> idle {false}; // 在空闲栈里或者是poller，m_mutex保护写
+        bool wake_spinning = false; // 唤醒方替它计入了m_spinning，m_mutex保护
+        bool spinning = false; // 只有自己访问
+        uint64_t pass[PRIORITY_COUNT] = {}; // weighted策略下各优先级的虚拟时间，只有自己访问
+        // 以下统计只有自己写，getStats汇总
+        Histogram class_wait[PRIORITY_COUNT];
+        std::atomic<uint64_t> class_missed[PRIORITY_COUNT];
+        Histogram queue_wait;
+        Histogram run_time;
+        std::atomic<uint64_t> wait_ns {0};  // 抽样任务排队时间之和，弹性模式按它的增量判断是否加线程
+        std::atomic<uint64_t> waited {0};   // 抽样的任务数
+        std::atomic<uint64_t> tasks {0};
+        std::atomic<uint64_t> steals {0};
+        std::atomic<uint64_t> parks {0};
+        std::atomic<uint64_t> idle_ns {0};
+        std::atomic<uint64_t> park_begin {0}; // 正在睡眠时是开始的时间，否则为0
+        std::atomic<uint64_t> start_ns {0};   // 开始和结束调度的时间
+        std::atomic<uint64_t> stop_ns {0};
+        // 以下供watchdog观察，只在开启时更新。run_tick在切入协程前后各加一，奇数表示有协程在跑
+        std::atomic<uint64_t> run_tick {0};
+        std::atomic<uint32_t> run_fiber {0};                     // 正在跑的协程id
+        std::atomic<const std::type_info*> run_entry {nullptr};  // 它的入口函数类型
+        std::atomic<bool> preempt {false}; // watchdog要求正在跑的协程让出
+        bool yielding = false;             // 协程通过Yield切出，只有自己访问
+        std::atomic<bool> running {false}; // 有线程在这个槽位上调度，m_mutex保护写
+
+        Worker();
+    };
+    // 一个优先级的全局队列，按(key, seq)的小顶堆
+    struct ClassQueue {
+        std::mutex mutex;
+        std::vector<SchedNode*> heap;
+        uint64_t seq = 0;
+        std::atomic<size_t> size {0};
+        std::atomic<uint64_t> top {~0ull}; // 堆顶的key，检查饥饿时不用加锁
+    };
+
+    // 协程用自己的节点，把引用移进Fiber::m_schedRef；已经在排队时抛std::logic_error
+    static SchedNode* NewTask(Fiber::ptr fiber);
+    static SchedNode* NewTask(Callable cb);
+    // 释放没有执行的节点: 回调节点delete，协程节点放掉排队时持有的引用
+    static void FreeTask(SchedNode* task);
+    // 共享栈协程只能在创建它的工作线程(它的affinity)上恢复
+    static bool IsMisplacedSharedStack(const Fiber* fiber, int thread) {
+        return fiber->isSharedStack()
+            && (fiber->getAffinity() < 0 || (thread >= 0 && thread != fiber->getAffinity()));
+    }
+    // 类队列的小顶堆: key小的先出，同一个key先提交的先出
+    static bool TaskLater(const SchedNode* a, const SchedNode* b);
+
+    void run(int index);
+    // 取下一个任务: 按优先级策略在类队列和NORMAL的本地队列、注入栈、偷取之间选
+    SchedNode* nextTask(Worker* w);
+    // 不看类队列，取NORMAL的任务: 本地队列 -> 固定任务 -> 注入栈 -> 偷别的线程
+    SchedNode* nextNormal(Worker* w);
+    // weighted策略下按各优先级的虚拟时间轮流取
+    SchedNode* nextWeighted(Worker* w);
+    SchedNode* takeInjected(Worker* w);
+    SchedNode* takeClass(Worker* w, int priority);
+    // 类队列里等待超过饥饿保护时限的任务，低优先级先
+    SchedNode* takeStarving(Worker* w);
+    // 放进对应优先级的类队列，需要时唤醒一个线程
+    void pushClass(SchedNode* task, uint64_t deadline_ms = ~0ull);
+    SchedNode* takePinned(Worker* w);
+    // 把head(最新)开头的链按提交顺序接到w的pinned链表，只能由w自己调用
+    static void appendPinned(Worker* w, SchedNode* head);
+    SchedNode* stealTask(Worker* w);
+    // 有w能执行的任务: 注入栈、任何一个本地队列，或者w自己的固定任务
+    bool hasWork(Worker* w) const;
+    // 没找到任务时自旋几轮，自旋线程数不超过忙碌线程数的一半
+    SchedNode* spin(Worker* w);
+    // 自旋线程找到任务，不再自旋
+    void resetSpinning(Worker* w);
+    // 登记到空闲栈并阻塞在eventfd上，直到被唤醒或者stop。
+    // 弹性模式下空闲太久时退出，返回false
+    bool park(Worker* w);
+    // 在w的槽位上启动线程，之前退出的线程先join，需要持有m_mutex
+    void startWorker(Worker* w);
+    // 固定到w的任务到达时叫醒它，它已经退出时重新启动
+    void wakePinned(Worker* w);
+    // 空闲超时的w退出，需要持有m_mutex，返回是否退出
+    bool retireWorker(Worker* w);
+    // w的线程不再调度，需要持有m_mutex。有固定到它的任务时返回false，线程继续
+    bool leaveWorker(Worker* w);
+    bool isRootWorker(const Worker* w) const { return m_rootFiber && w->index == m_threadCount; }
+    // 把w从空闲栈或者poller的位置上拿掉，需要持有m_mutex，w没有在睡眠时返回false
+    bool removeIdle(Worker* w);
+    static void Wakeup(Worker* w);
+    // 有到期的定时器时把回调调度出去，返回是否调度了任务
+    bool processTimers();
+    void runTask(Worker* w, SchedNode* task, Fiber::ptr& cb_fiber);
+    // 切入协程前后更新给watchdog看的状态
+    void beginSlice(Worker* w, Fiber* fiber);
+    void endSlice(Worker* w);
+    // 通过Yield切出的协程重新排队
+    void requeue(Fiber::ptr fiber);
+    // watchdog和弹性伸缩的后台线程
+    struct MonitorState;
+    void monitor();
+    // 检查运行太久的协程
+    void checkWatchdog(MonitorState& st, uint64_t now);
+    // 按排队时间加线程，按热更新后的下限补线程
+    void checkScale(MonitorState& st, uint64_t now);
+    // 协程切回调度协程后，处理它在切出前发起的Park
+    void finishPark(Fiber::ptr& fiber);
+    // head到tail是一条按next串起来的链，head最新
+    void pushTasks(SchedNode* head, SchedNode* tail, int thread);
+    // 把链压进注入栈，返回注入栈原来是否为空
+    bool pushInjected(SchedNode* head, SchedNode* tail);
+    // 提交了不固定线程的任务之后，需要时唤醒一个线程
+    void notifyPushed(bool was_empty);
 private:
     std::string m_name;
     std::mutex m_mutex;
     int m_threadCount;
-    std::vector<Thread::ptr> m_threads;
-    std::list<Fiber::ptr> m_fibers;
-    bool m_stopping = true;
+    std::vector<Thread::ptr> m_threads; // 按槽位下标，m_mutex保护
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    // 调度器之外的线程提交的任务，无锁栈，工作线程一次取走全部
+    std::atomic<SchedNode*> m_inject {nullptr};
+    // 睡眠的工作线程，后进先出，最近睡下的缓存最热。m_mutex保护
+    std::vector<Worker*> m_idle;
+    std::atomic<int> m_idleCount {0};
+    std::atomic<int> m_spinning {0};
+    // 在pollerWait里睡到下一个定时器到期或者有IO事件的空闲线程，不在m_idle里。
+    // m_mutex保护写，计入m_idleCount
+    std::atomic<Worker*> m_poller {nullptr};
+    int m_pollerFd = -1;
+    ClassQueue m_classes[PRIORITY_COUNT];
+    bool m_weighted = false;                // scheduler.priority_policy为weighted
+    uint64_t m_strides[PRIORITY_COUNT] = {}; // weighted策略下取一个任务各优先级前进的虚拟时间
+    uint64_t m_starvationUs = 0;            // 0表示不做饥饿保护
+    Timer::ptr m_statsTimer;                // 定期打印统计
+    uint32_t m_watchdogSlice = 0;           // scheduler.watchdog_slice_ms，0表示不开watchdog
+    bool m_preempt = false;                 // scheduler.preempt
+    bool m_elastic = false;                 // 弹性模式
+    std::atomic<int> m_running {0};         // 正在运行的线程数，不包括调用线程
+    // 以下由monitor按热更新的配置刷新
+    std::atomic<int> m_minThreads {0};      // 线程数下限，use_caller时包括调用线程
+    std::atomic<uint32_t> m_retireMs {0};   // 空闲多久退出
+    std::atomic<uint64_t> m_scaleUps {0};
+    std::atomic<uint64_t> m_scaleDowns {0};
+    Thread::ptr m_monitor;
+    std::mutex m_monitorMutex;
+    std::condition_variable m_monitorCond;
+    bool m_monitorStop = false;             // m_monitorMutex保护
+    bool m_stopped = true;                  // stop已经回收了所有线程，不再启动线程。m_mutex保护
+    std::atomic<bool> m_stopping {true};
     Fiber::ptr m_rootFiber;
     pid_t m_rootThreadId;
-    Semaphore m_semaphore;
-    std::condition_variable m_condition;
 };
-}
\ No newline at end of file
+}
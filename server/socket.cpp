@@ -0,0 +1,490 @@
+#include "socket.h"
+#include "iomanager.h"
+#include "fiber.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include <sstream>
+
+namespace ZnetServer {
+
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+static ConfigVar<bool>::ptr g_tcp_nodelay =
+    Config::Create<bool>("socket.tcp_nodelay", true, "set TCP_NODELAY on tcp sockets");
+static ConfigVar<bool>::ptr g_reuseport =
+    Config::Create<bool>("socket.reuseport", false, "set SO_REUSEPORT on tcp sockets before bind");
+static ConfigVar<uint32_t>::ptr g_send_buffer =
+    Config::Create<uint32_t>("socket.send_buffer", 0, "SO_SNDBUF in bytes, 0 for system default");
+static ConfigVar<uint32_t>::ptr g_recv_buffer =
+    Config::Create<uint32_t>("socket.recv_buffer", 0, "SO_RCVBUF in bytes, 0 for system default");
+static ConfigVar<bool>::ptr g_keepalive =
+    Config::Create<bool>("socket.keepalive", false, "set SO_KEEPALIVE on tcp sockets");
+static ConfigVar<uint32_t>::ptr g_keepalive_idle =
+    Config::Create<uint32_t>("socket.keepalive_idle", 0,
+                             "TCP_KEEPIDLE in seconds, 0 for system default");
+static ConfigVar<uint32_t>::ptr g_keepalive_interval =
+    Config::Create<uint32_t>("socket.keepalive_interval", 0,
+                             "TCP_KEEPINTVL in seconds, 0 for system default");
+static ConfigVar<uint32_t>::ptr g_keepalive_count =
+    Config::Create<uint32_t>("socket.keepalive_count", 0,
+                             "TCP_KEEPCNT, 0 for system default");
+
+static const uint64_t NO_DEADLINE = ~0ull;
+
+static uint64_t Deadline(uint64_t timeout_ms) {
+    return timeout_ms == ~0ull ? NO_DEADLINE : GetCurrentMS() + timeout_ms;
+}
+
+// 等fd就绪，就绪返回0，超时返回-ETIMEDOUT，被信号打断返回-EINTR(调用方重试)，失败返回-errno
+static int WaitReady(int fd, IOManager::Event event, uint64_t deadline) {
+    uint64_t timeout = ~0ull;
+    if(deadline != NO_DEADLINE) {
+        uint64_t now = GetCurrentMS();
+        if(now >= deadline) {
+            return -ETIMEDOUT;
+        }
+        timeout = deadline - now;
+    }
+    IOManager* iom = IOManager::GetThis();
+    if(iom && Fiber::GetThis().get() != Scheduler::GetMainFiber()) {
+        return iom->waitEvent(fd, event, timeout);
+    }
+    // 调度协程和普通线程可以阻塞
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = event == IOManager::READ ? POLLIN : POLLOUT;
+    pfd.revents = 0;
+    int rt = ::poll(&pfd, 1, timeout == ~0ull ? -1 : (int)std::min<uint64_t>(timeout, INT_MAX));
+    if(rt < 0) {
+        return -errno;
+    }
+    return rt ? 0 : -ETIMEDOUT;
+}
+
+// 执行非阻塞的IO，EAGAIN时等就绪后重试，超时以EAGAIN失败
+template<class F>
+static ssize_t DoIO(int fd, IOManager::Event event, uint64_t timeout_ms, F f) {
+    uint64_t deadline = Deadline(timeout_ms);
+    while(true) {
+        ssize_t n = f();
+        if(n >= 0) {
+            return n;
+        }
+        int err = GetErrno();
+        if(err == EINTR) {
+            continue;
+        }
+        if(err != EAGAIN && err != EWOULDBLOCK) {
+            return n;
+        }
+        int rt = WaitReady(fd, event, deadline);
+        if(rt && rt != -EINTR) {
+            SetErrno(rt == -ETIMEDOUT ? EAGAIN : -rt);
+            return -1;
+        }
+    }
+}
+
+Socket::ptr Socket::CreateTCP(Address::ptr address) {
+    return std::make_shared<Socket>(address->getFamily(), TCP, 0);
+}
+
+Socket::ptr Socket::CreateUDP(Address::ptr address) {
+    return std::make_shared<Socket>(address->getFamily(), UDP, 0);
+}
+
+Socket::ptr Socket::CreateTCPSocket() {
+    return std::make_shared<Socket>(IPv4, TCP, 0);
+}
+
+Socket::ptr Socket::CreateUDPSocket() {
+    return std::make_shared<Socket>(IPv4, UDP, 0);
+}
+
+Socket::ptr Socket::CreateTCPSocket6() {
+    return std::make_shared<Socket>(IPv6, TCP, 0);
+}
+
+Socket::ptr Socket::CreateUDPSocket6() {
+    return std::make_shared<Socket>(IPv6, UDP, 0);
+}
+
+Socket::ptr Socket::CreateUnixTCPSocket() {
+    return std::make_shared<Socket>(UNIX, TCP, 0);
+}
+
+Socket::ptr Socket::CreateUnixUDPSocket() {
+    return std::make_shared<Socket>(UNIX, UDP, 0);
+}
+
+Socket::Socket(int family, int type, int protocol)
+    : m_family(family)
+    , m_type(type)
+    , m_protocol(protocol) {
+}
+
+Socket::~Socket() {
+    close();
+}
+
+bool Socket::getOption(int level, int option, void* result, socklen_t* len) {
+    if(!ensureSocket()) {
+        return false;
+    }
+    if(getsockopt(m_sock, level, option, result, len)) {
+        ZNS_LOG_DEBUG(g_logger) << "getOption sock=" << m_sock << " level=" << level
+            << " option=" << option << " errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setOption(int level, int option, const void* value, socklen_t len) {
+    if(!ensureSocket()) {
+        return false;
+    }
+    if(setsockopt(m_sock, level, option, value, len)) {
+        ZNS_LOG_DEBUG(g_logger) << "setOption sock=" << m_sock << " level=" << level
+            << " option=" << option << " errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::ensureSocket() {
+    if(m_sock != -1) {
+        return true;
+    }
+    m_sock = ::socket(m_family, m_type | SOCK_NONBLOCK | SOCK_CLOEXEC, m_protocol);
+    if(m_sock == -1) {
+        ZNS_LOG_ERROR(g_logger) << "socket(" << m_family << ", " << m_type << ", " << m_protocol
+            << ") errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    if(m_type == TCP && m_family != UNIX) {
+        int val = 1;
+        setOption(SOL_SOCKET, SO_REUSEADDR, val);
+        if(g_reuseport->getValue()) {
+            setOption(SOL_SOCKET, SO_REUSEPORT, val);
+        }
+    }
+    initSock();
+    return true;
+}
+
+bool Socket::init(int sock) {
+    m_sock = sock;
+    m_isConnected = true;
+    initSock();
+    getLocalAddress();
+    getRemoteAddress();
+    return true;
+}
+
+void Socket::initSock() {
+    // 先保存errno，设置选项失败不影响调用方看到的结果
+    int saved = errno;
+    uint32_t sndbuf = g_send_buffer->getValue();
+    if(sndbuf) {
+        setOption(SOL_SOCKET, SO_SNDBUF, (int)sndbuf);
+    }
+    uint32_t rcvbuf = g_recv_buffer->getValue();
+    if(rcvbuf) {
+        setOption(SOL_SOCKET, SO_RCVBUF, (int)rcvbuf);
+    }
+    if(m_type == TCP && m_family != UNIX) {
+        int val = 1;
+        if(g_tcp_nodelay->getValue()) {
+            setOption(IPPROTO_TCP, TCP_NODELAY, val);
+        }
+        if(g_keepalive->getValue()) {
+            setOption(SOL_SOCKET, SO_KEEPALIVE, val);
+            int idle = g_keepalive_idle->getValue();
+            if(idle) {
+                setOption(IPPROTO_TCP, TCP_KEEPIDLE, idle);
+            }
+            int interval = g_keepalive_interval->getValue();
+            if(interval) {
+                setOption(IPPROTO_TCP, TCP_KEEPINTVL, interval);
+            }
+            int count = g_keepalive_count->getValue();
+            if(count) {
+                setOption(IPPROTO_TCP, TCP_KEEPCNT, count);
+            }
+        }
+    }
+    errno = saved;
+}
+
+Address::ptr Socket::newAddress() const {
+    switch(m_family) {
+    case AF_INET:
+        return std::make_shared<IPv4Address>();
+    case AF_INET6:
+        return std::make_shared<IPv6Address>();
+    case AF_UNIX:
+        return std::make_shared<UnixAddress>();
+    default:
+        return std::make_shared<UnknownAddress>(m_family);
+    }
+}
+
+bool Socket::bind(const Address::ptr addr) {
+    if(!ensureSocket()) {
+        return false;
+    }
+    if(addr->getFamily() != m_family) {
+        ZNS_LOG_ERROR(g_logger) << "bind sock.family(" << m_family << ") addr.family("
+            << addr->getFamily() << ") not equal, addr=" << *addr;
+        errno = EAFNOSUPPORT;
+        return false;
+    }
+    if(::bind(m_sock, addr->getAddr(), addr->getAddrLen())) {
+        ZNS_LOG_ERROR(g_logger) << "bind " << *addr << " errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    m_localAddress.reset();
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::listen(int backlog) {
+    if(!isValid()) {
+        ZNS_LOG_ERROR(g_logger) << "listen error sock=-1";
+        errno = EBADF;
+        return false;
+    }
+    if(::listen(m_sock, backlog)) {
+        ZNS_LOG_ERROR(g_logger) << "listen errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+Socket::ptr Socket::accept() {
+    if(!isValid()) {
+        errno = EBADF;
+        return nullptr;
+    }
+    int sock = DoIO(m_sock, IOManager::READ, m_recvTimeout, [this](){
+        return ::accept4(m_sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    });
+    if(sock < 0) {
+        return nullptr;
+    }
+    Socket::ptr rt = std::make_shared<Socket>(m_family, m_type, m_protocol);
+    rt->init(sock);
+    return rt;
+}
+
+bool Socket::connect(const Address::ptr addr, uint64_t timeout_ms) {
+    if(!ensureSocket()) {
+        return false;
+    }
+    if(addr->getFamily() != m_family) {
+        ZNS_LOG_ERROR(g_logger) << "connect sock.family(" << m_family << ") addr.family("
+            << addr->getFamily() << ") not equal, addr=" << *addr;
+        errno = EAFNOSUPPORT;
+        return false;
+    }
+    uint64_t deadline = Deadline(timeout_ms);
+    if(::connect(m_sock, addr->getAddr(), addr->getAddrLen())) {
+        // Unix域socket的EAGAIN表示对方的backlog满了，不是连接中
+        if(errno != EINPROGRESS) {
+            return false;
+        }
+        int rt;
+        do {
+            rt = WaitReady(m_sock, IOManager::WRITE, deadline);
+        } while(rt == -EINTR);
+        if(rt) {
+            SetErrno(-rt);
+            return false;
+        }
+        int err = getError();
+        if(err) {
+            SetErrno(err);
+            return false;
+        }
+    }
+    m_isConnected = true;
+    m_remoteAddress = addr;
+    m_localAddress.reset();
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::close() {
+    if(m_sock == -1) {
+        m_isConnected = false;
+        return true;
+    }
+    // 先叫醒当前IOManager里还在等这个fd的协程，fd号关闭后可能马上被复用
+    IOManager* iom = IOManager::GetThis();
+    if(iom) {
+        iom->cancelAll(m_sock);
+    }
+    ::close(m_sock);
+    m_sock = -1;
+    m_isConnected = false;
+    return true;
+}
+
+ssize_t Socket::send(const void* buffer, size_t length, int flags) {
+    if(!isConnected()) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    return DoIO(m_sock, IOManager::WRITE, m_sendTimeout, [&](){
+        return ::send(m_sock, buffer, length, flags | MSG_NOSIGNAL);
+    });
+}
+
+ssize_t Socket::send(const iovec* buffers, size_t length, int flags) {
+    if(!isConnected()) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (iovec*)buffers;
+    msg.msg_iovlen = length;
+    return DoIO(m_sock, IOManager::WRITE, m_sendTimeout, [&](){
+        return ::sendmsg(m_sock, &msg, flags | MSG_NOSIGNAL);
+    });
+}
+
+ssize_t Socket::sendTo(const void* buffer, size_t length, const Address::ptr to, int flags) {
+    if(!ensureSocket()) {
+        return -1;
+    }
+    return DoIO(m_sock, IOManager::WRITE, m_sendTimeout, [&](){
+        return ::sendto(m_sock, buffer, length, flags | MSG_NOSIGNAL,
+                        to->getAddr(), to->getAddrLen());
+    });
+}
+
+ssize_t Socket::recv(void* buffer, size_t length, int flags) {
+    if(!isConnected()) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    return DoIO(m_sock, IOManager::READ, m_recvTimeout, [&](){
+        return ::recv(m_sock, buffer, length, flags);
+    });
+}
+
+ssize_t Socket::recv(iovec* buffers, size_t length, int flags) {
+    if(!isConnected()) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = length;
+    return DoIO(m_sock, IOManager::READ, m_recvTimeout, [&](){
+        return ::recvmsg(m_sock, &msg, flags);
+    });
+}
+
+ssize_t Socket::recvFrom(void* buffer, size_t length, Address::ptr from, int flags) {
+    if(!isValid()) {
+        errno = EBADF;
+        return -1;
+    }
+    socklen_t len = from->getAddrLen();
+    ssize_t n = DoIO(m_sock, IOManager::READ, m_recvTimeout, [&](){
+        len = from->getAddrLen();
+        return ::recvfrom(m_sock, buffer, length, flags, from->getAddr(), &len);
+    });
+    if(n >= 0 && m_family == AF_UNIX) {
+        std::static_pointer_cast<UnixAddress>(from)->setAddrLen(len);
+    }
+    return n;
+}
+
+Address::ptr Socket::getLocalAddress() {
+    if(m_localAddress) {
+        return m_localAddress;
+    }
+    if(!isValid()) {
+        return nullptr;
+    }
+    Address::ptr result = newAddress();
+    socklen_t addrlen = result->getAddrLen();
+    if(getsockname(m_sock, result->getAddr(), &addrlen)) {
+        ZNS_LOG_ERROR(g_logger) << "getsockname error sock=" << m_sock
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return std::make_shared<UnknownAddress>(m_family);
+    }
+    if(m_family == AF_UNIX) {
+        std::static_pointer_cast<UnixAddress>(result)->setAddrLen(addrlen);
+    }
+    m_localAddress = result;
+    return m_localAddress;
+}
+
+Address::ptr Socket::getRemoteAddress() {
+    if(m_remoteAddress) {
+        return m_remoteAddress;
+    }
+    if(!isValid()) {
+        return nullptr;
+    }
+    Address::ptr result = newAddress();
+    socklen_t addrlen = result->getAddrLen();
+    if(getpeername(m_sock, result->getAddr(), &addrlen)) {
+        return std::make_shared<UnknownAddress>(m_family);
+    }
+    if(m_family == AF_UNIX) {
+        std::static_pointer_cast<UnixAddress>(result)->setAddrLen(addrlen);
+    }
+    m_remoteAddress = result;
+    return m_remoteAddress;
+}
+
+int Socket::getError() {
+    int error = 0;
+    if(!getOption(SOL_SOCKET, SO_ERROR, error)) {
+        error = errno;
+    }
+    return error;
+}
+
+std::ostream& Socket::dump(std::ostream& os) const {
+    os << "[Socket sock=" << m_sock
+       << " is_connected=" << m_isConnected
+       << " family=" << m_family
+       << " type=" << m_type
+       << " protocol=" << m_protocol;
+    if(m_localAddress) {
+        os << " local_address=" << *m_localAddress;
+    }
+    if(m_remoteAddress) {
+        os << " remote_address=" << *m_remoteAddress;
+    }
+    return os << "]";
+}
+
+std::string Socket::toString() const {
+    std::stringstream ss;
+    dump(ss);
+    return ss.str();
+}
+
+std::ostream& operator<<(std::ostream& os, const Socket& sock) {
+    return sock.dump(os);
+}
+
+}
@@ -0,0 +1,161 @@
+#ifndef __ZNS_SOCKET_H__
+#define __ZNS_SOCKET_H__
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <memory>
+#include <string>
+#include <iosfwd>
+
+#include "address.h"
+
+namespace ZnetServer {
+
+/**
+ * @brief socket的RAII封装
+ * @details fd创建时就是非阻塞、close-on-exec的。accept/connect/send/recv/sendTo/recvFrom
+ *          遇到EAGAIN时:
+ *            在IOManager的工作协程里用IOManager::waitEvent挂起当前协程，就绪后重试
+ *            其他地方(普通线程、调度协程)用poll阻塞当前线程
+ *          失败返回-1(accept返回nullptr)并设置errno，收发超时以EAGAIN失败，connect超时以ETIMEDOUT失败。
+ *          不需要开启hook，开启了也不影响(用户设置了非阻塞的fd，hook照原样调用)。
+ *
+ *          新建的TCP socket按配置设置选项:
+ *            socket.tcp_nodelay      TCP_NODELAY
+ *            socket.reuseport        bind之前设置SO_REUSEPORT
+ *            socket.send_buffer/socket.recv_buffer  SO_SNDBUF/SO_RCVBUF，0表示系统默认
+ *            socket.keepalive及socket.keepalive_idle/interval/count  TCP保活
+ *          UDP只用缓冲区大小。accept出的连接同样按配置设置(SO_REUSEPORT除外)。
+ *
+ *          同一个Socket可以一个协程收、一个协程发，不能两个协程同时收或同时发。
+ *          close会取消当前IOManager里这个fd上的等待，在别的线程上等待的协程以ECANCELED返回。
+ */
+class Socket : public std::enable_shared_from_this<Socket> {
+public:
+    typedef std::shared_ptr<Socket> ptr;
+    typedef std::weak_ptr<Socket> weak_ptr;
+
+    enum Type {
+        TCP = SOCK_STREAM,
+        UDP = SOCK_DGRAM,
+    };
+
+    enum Family {
+        IPv4 = AF_INET,
+        IPv6 = AF_INET6,
+        UNIX = AF_UNIX,
+    };
+
+    /**
+     * @brief 创建和address同一地址族的socket
+     */
+    static Socket::ptr CreateTCP(Address::ptr address);
+    static Socket::ptr CreateUDP(Address::ptr address);
+
+    static Socket::ptr CreateTCPSocket();
+    static Socket::ptr CreateUDPSocket();
+    static Socket::ptr CreateTCPSocket6();
+    static Socket::ptr CreateUDPSocket6();
+    static Socket::ptr CreateUnixTCPSocket();
+    static Socket::ptr CreateUnixUDPSocket();
+
+    /**
+     * @details fd在第一次用到时(bind/connect/设置选项)才创建
+     */
+    Socket(int family, int type, int protocol = 0);
+    virtual ~Socket();
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    /**
+     * @brief 发送/接收超时毫秒数，~0ull表示不超时
+     */
+    uint64_t getSendTimeout() const { return m_sendTimeout; }
+    void setSendTimeout(uint64_t ms) { m_sendTimeout = ms; }
+    uint64_t getRecvTimeout() const { return m_recvTimeout; }
+    void setRecvTimeout(uint64_t ms) { m_recvTimeout = ms; }
+
+    bool getOption(int level, int option, void* result, socklen_t* len);
+    template<class T>
+    bool getOption(int level, int option, T& result) {
+        socklen_t len = sizeof(T);
+        return getOption(level, option, &result, &len);
+    }
+
+    bool setOption(int level, int option, const void* value, socklen_t len);
+    template<class T>
+    bool setOption(int level, int option, const T& value) {
+        return setOption(level, option, &value, sizeof(T));
+    }
+
+    bool bind(const Address::ptr addr);
+    bool listen(int backlog = SOMAXCONN);
+    /**
+     * @brief 接受一个连接，失败返回nullptr并设置errno
+     */
+    Socket::ptr accept();
+    /**
+     * @param[in] timeout_ms 超时毫秒数，~0ull表示不超时
+     */
+    bool connect(const Address::ptr addr, uint64_t timeout_ms = ~0ull);
+    bool close();
+
+    /**
+     * @name 收发
+     * @details 返回值同对应的系统调用，flags里自动带上MSG_NOSIGNAL，
+     *          对方关闭的连接上发送以EPIPE失败而不是收到SIGPIPE
+     * @{
+     */
+    ssize_t send(const void* buffer, size_t length, int flags = 0);
+    ssize_t send(const iovec* buffers, size_t length, int flags = 0);
+    ssize_t sendTo(const void* buffer, size_t length, const Address::ptr to, int flags = 0);
+    ssize_t recv(void* buffer, size_t length, int flags = 0);
+    ssize_t recv(iovec* buffers, size_t length, int flags = 0);
+    /**
+     * @param[out] from 对方地址，地址族要和socket一致
+     */
+    ssize_t recvFrom(void* buffer, size_t length, Address::ptr from, int flags = 0);
+    /** @} */
+
+    Address::ptr getLocalAddress();
+    Address::ptr getRemoteAddress();
+
+    int getFamily() const { return m_family; }
+    int getType() const { return m_type; }
+    int getProtocol() const { return m_protocol; }
+    bool isConnected() const { return m_isConnected; }
+    bool isValid() const { return m_sock != -1; }
+    /**
+     * @brief SO_ERROR
+     */
+    int getError();
+    int getSocket() const { return m_sock; }
+
+    std::ostream& dump(std::ostream& os) const;
+    std::string toString() const;
+private:
+    // 由accept得到的fd初始化
+    bool init(int sock);
+    // 按需创建fd并设置配置里的选项
+    bool ensureSocket();
+    void initSock();
+    Address::ptr newAddress() const;
+private:
+    int m_sock = -1;
+    int m_family;
+    int m_type;
+    int m_protocol;
+    bool m_isConnected = false;
+    uint64_t m_sendTimeout = ~0ull;
+    uint64_t m_recvTimeout = ~0ull;
+    Address::ptr m_localAddress;
+    Address::ptr m_remoteAddress;
+};
+
+std::ostream& operator<<(std::ostream& os, const Socket& sock);
+
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include <stdexcept>
+
+#include "stack_allocator.h"
+#include "config.h"
+#include "log.h"
+
+namespace ZnetServer {
+
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_stack_cache_size =
+    Config::Create<uint32_t>("fiber.stack_cache_size", 32, "per thread cached fiber stacks per size class");
+static ConfigVar<bool>::ptr g_stack_hugepage =
+    Config::Create<bool>("fiber.stack_hugepage", false, "madvise fiber stacks with MADV_HUGEPAGE");
+
+// 档位: 2^MIN_SHIFT ~ 2^MAX_SHIFT，更大的栈不缓存
+static const int MIN_SHIFT = 12;
+static const int MAX_SHIFT = 23;
+static const int CLASS_COUNT = MAX_SHIFT - MIN_SHIFT + 1;
+
+static std::atomic<uint64_t> s_mapped_count {0};
+
+static void* MapStack(size_t size) {
+    size_t page = StackAllocator::GetPageSize();
+    void* p = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(p == MAP_FAILED) {
+        ZNS_LOG_ERROR(g_logger) << "StackAllocator mmap size=" << size << " fail";
+        throw std::bad_alloc();
+    }
+    // 栈向低地址增长，保护页放在最低处
+    if(mprotect(p, page, PROT_NONE) != 0) {
+        munmap(p, size + page);
+        throw std::runtime_error("StackAllocator mprotect guard page fail");
+    }
+    if(g_stack_hugepage->getValue()) {
+        madvise((char*)p + page, size, MADV_HUGEPAGE);
+    }
+    ++s_mapped_count;
+    return (char*)p + page;
+}
+
+static void UnmapStack(void* stack, size_t size) {
+    size_t page = StackAllocator::GetPageSize();
+    munmap((char*)stack - page, size + page);
+    --s_mapped_count;
+}
+
+static int SizeClass(size_t size) {
+    int shift = MIN_SHIFT;
+    while(((size_t)1 << shift) < size) {
+        ++shift;
+    }
+    return shift - MIN_SHIFT;
+}
+
+// 缓存已析构。线程退出时其他thread_local(例如调度器的协程池)析构得更晚，
+// 还会释放栈，这时直接munmap
+static thread_local bool t_stack_cache_dead = false;
+
+// 线程退出时把缓存的栈还给系统
+struct StackCache {
+    std::vector<void*> lists[CLASS_COUNT];
+
+    ~StackCache() {
+        t_stack_cache_dead = true;
+        for(int i = 0; i < CLASS_COUNT; ++i) {
+            for(auto p : lists[i]) {
+                UnmapStack(p, (size_t)1 << (i + MIN_SHIFT));
+            }
+        }
+    }
+};
+
+static thread_local StackCache t_stack_cache;
+
+size_t StackAllocator::GetPageSize() {
+    static size_t s_page = sysconf(_SC_PAGESIZE);
+    return s_page;
+}
+
+size_t StackAllocator::RoundSize(size_t size) {
+    size_t page = GetPageSize();
+    if(size <= ((size_t)1 << MAX_SHIFT)) {
+        size_t r = (size_t)1 << (SizeClass(size) + MIN_SHIFT);
+        return r < page ? page : r;
+    }
+    return (size + page - 1) / page * page;
+}
+
+void* StackAllocator::Alloc(size_t& size) {
+    size = RoundSize(size);
+    if(size <= ((size_t)1 << MAX_SHIFT) && !t_stack_cache_dead) {
+        std::vector<void*>& list = t_stack_cache.lists[SizeClass(size)];
+        if(!list.empty()) {
+            void* p = list.back();
+            list.pop_back();
+            return p;
+        }
+    }
+    return MapStack(size);
+}
+
+void StackAllocator::Dealloc(void* stack, size_t size) {
+    if(!stack) {
+        return;
+    }
+    if(size <= ((size_t)1 << MAX_SHIFT) && !t_stack_cache_dead) {
+        std::vector<void*>& list = t_stack_cache.lists[SizeClass(size)];
+        if(list.size() < g_stack_cache_size->getValue()) {
+            list.push_back(stack);
+            return;
+        }
+    }
+    UnmapStack(stack, size);
+}
+
+size_t StackAllocator::GetCachedCount() {
+    size_t n = 0;
+    if(t_stack_cache_dead) {
+        return 0;
+    }
+    for(int i = 0; i < CLASS_COUNT; ++i) {
+        n += t_stack_cache.lists[i].size();
+    }
+    return n;
+}
+
+uint64_t StackAllocator::GetMappedCount() {
+    return s_mapped_count;
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef __ZNS_STACK_ALLOCATOR_H__
+#define __ZNS_STACK_ALLOCATOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ZnetServer {
+
+/**
+ * @brief 协程栈分配器
+ * @details 栈用mmap分配，最低地址一页设为PROT_NONE作为保护页，
+ *          栈溢出时直接触发SIGSEGV，而不是悄悄踩坏相邻内存。
+ *          释放的栈按尺寸档位(2的幂)放进当前线程的空闲链表，
+ *          稳态下创建协程不再有mmap/munmap。
+ *
+ *          相关配置:
+ *            fiber.stack_cache_size  每个线程每个档位最多缓存的栈数
+ *            fiber.stack_hugepage    是否对栈做MADV_HUGEPAGE
+ */
+class StackAllocator {
+public:
+    /**
+     * @brief 分配栈
+     * @param[in,out] size 期望的可用大小，返回时改为实际档位大小
+     * @return 可用区域的起始(低)地址，保护页在它之前
+     */
+    static void* Alloc(size_t& size);
+
+    /**
+     * @brief 归还栈，size必须是Alloc返回的档位大小
+     */
+    static void Dealloc(void* stack, size_t size);
+
+    /**
+     * @brief 把size向上取整到档位大小
+     */
+    static size_t RoundSize(size_t size);
+
+    static size_t GetPageSize();
+
+    /**
+     * @brief 当前线程空闲链表里缓存的栈数
+     */
+    static size_t GetCachedCount();
+
+    /**
+     * @brief 进程内通过mmap实际映射出去且尚未munmap的栈数
+     */
+    static uint64_t GetMappedCount();
+};
+
+}
+
+#endif
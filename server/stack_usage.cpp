@@ -0,0 +1,118 @@
+#include <string.h>
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <typeindex>
+
+#include "stack_usage.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+namespace ZnetServer {
+static Logger::ptr g_logger = ZNS_LOG_NAME("system");
+
+static ConfigVar<bool>::ptr g_stack_watermark =
+    Config::Create<bool>("fiber.stack_watermark", false, "measure fiber stack high-watermark");
+static ConfigVar<float>::ptr g_stack_warn_ratio =
+    Config::Create<float>("fiber.stack_warn_ratio", 0.75f, "warn when fiber stack usage exceeds this ratio");
+
+static const unsigned char CANARY_BYTE = 0xCD;
+static const uint64_t CANARY_WORD = 0xCDCDCDCDCDCDCDCDULL;
+
+static std::mutex s_mutex;
+static std::map<std::type_index, StackUsage::Stats> s_stats;
+
+bool StackUsage::IsEnabled() {
+    return g_stack_watermark->getValue();
+}
+
+void StackUsage::Paint(void* stack, size_t size) {
+    memset(stack, CANARY_BYTE, size);
+}
+
+void StackUsage::Repaint(void* stack, size_t size, size_t used) {
+    if(used > size) {
+        used = size;
+    }
+    memset((char*)stack + size - used, CANARY_BYTE, used);
+}
+
+size_t StackUsage::Measure(const void* stack, size_t size) {
+    const uint64_t* p = (const uint64_t*)stack;
+    const uint64_t* end = p + size / sizeof(uint64_t);
+    while(p < end && *p == CANARY_WORD) {
+        ++p;
+    }
+    return (const char*)stack + size - (const char*)p;
+}
+
+void StackUsage::Record(const std::type_info& entry, size_t used, size_t size) {
+    size_t bucket = 0;
+    while(bucket + 1 < BUCKET_COUNT && used > BucketLimit(bucket)) {
+        ++bucket;
+    }
+    bool first_over = false;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        Stats& st = s_stats[std::type_index(entry)];
+        if(st.count == 0) {
+            st.entry = Demangle(entry.name());
+        }
+        double limit = g_stack_warn_ratio->getValue() * size;
+        // 每个入口只在用量创新高时警告，避免刷屏
+        first_over = used > limit && used > st.max_used;
+        ++st.count;
+        st.total_used += used;
+        st.stack_size = size;
+        st.buckets[bucket]++;
+        if(used > st.max_used) {
+            st.max_used = used;
+        }
+    }
+    if(first_over) {
+        ZNS_LOG_WARN(g_logger) << "Fiber stack usage " << used << "/" << size
+            << " exceeds " << g_stack_warn_ratio->getValue()
+            << " entry=" << Demangle(entry.name());
+    }
+}
+
+std::vector<StackUsage::Stats> StackUsage::GetStats() {
+    std::vector<Stats> r;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    r.reserve(s_stats.size());
+    for(auto& i : s_stats) {
+        r.push_back(i.second);
+    }
+    return r;
+}
+
+void StackUsage::Reset() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_stats.clear();
+}
+
+std::string StackUsage::ToString() {
+    std::stringstream ss;
+    for(auto& st : GetStats()) {
+        uint64_t p99 = st.count - st.count / 100;
+        uint64_t seen = 0;
+        size_t p99_limit = 0;
+        for(size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += st.buckets[i];
+            if(seen >= p99) {
+                p99_limit = BucketLimit(i);
+                break;
+            }
+        }
+        ss << st.entry << " count=" << st.count
+           << " avg=" << st.total_used / st.count
+           << " max=" << st.max_used
+           << " p99<=" << p99_limit
+           << " stack=" << st.stack_size << std::endl;
+    }
+    return ss.str();
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef __ZNS_STACK_USAGE_H__
+#define __ZNS_STACK_USAGE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <typeinfo>
+
+namespace ZnetServer {
+
+/**
+ * @brief 协程栈用量(高水位)统计
+ * @details 打开fiber.stack_watermark后，私有栈协程创建时把整块栈涂成固定字节，
+ *          协程结束时从栈底往上找第一个被改写的字，得到这次运行用到的最深位置。
+ *          结果按入口(回调的类型)汇总成直方图，用来决定fiber.stack_size能缩到多小。
+ *          涂栈会把整块栈都提交成常驻内存，只在测量时打开。共享栈协程不统计。
+ *
+ *          相关配置:
+ *            fiber.stack_watermark   是否开启测量
+ *            fiber.stack_warn_ratio  用量超过栈大小的这个比例时打印警告
+ */
+class StackUsage {
+public:
+    // 第i档统计用量不超过(1KB << i)的次数，最后一档收其余所有
+    static const size_t BUCKET_COUNT = 16;
+
+    struct Stats {
+        std::string entry;      // 入口的类型名(demangle之后)
+        uint64_t count = 0;     // 测量次数
+        uint64_t total_used = 0;
+        size_t max_used = 0;
+        size_t stack_size = 0;  // 最近一次测量时的栈大小
+        uint64_t buckets[BUCKET_COUNT] = {};
+    };
+
+    static bool IsEnabled();
+
+    /**
+     * @brief 把[stack, stack + size)整块涂成标记字节
+     */
+    static void Paint(void* stack, size_t size);
+
+    /**
+     * @brief 栈顶往下used字节重新涂上，其余部分上次测量后没被碰过
+     */
+    static void Repaint(void* stack, size_t size, size_t used);
+
+    /**
+     * @brief 从栈底往上扫描，返回被用过的字节数(从栈顶算起)
+     */
+    static size_t Measure(const void* stack, size_t size);
+
+    /**
+     * @brief 记录一次测量，超过警告比例时打日志
+     */
+    static void Record(const std::type_info& entry, size_t used, size_t size);
+
+    /**
+     * @brief 第i档的上限字节数
+     */
+    static size_t BucketLimit(size_t i) { return (size_t)1024 << i; }
+
+    /**
+     * @brief 按入口返回到目前为止的统计
+     */
+    static std::vector<Stats> GetStats();
+
+    static void Reset();
+
+    /**
+     * @brief 每个入口一行: 次数、平均、最大、p99所在档位上限
+     */
+    static std::string ToString();
+};
+
+}
+
+#endif
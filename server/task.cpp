@@ -0,0 +1,59 @@
+#include <new>
+#include <vector>
+
+#include "task.h"
+
+namespace ZnetServer {
+
+// 64字节一档，最大4KB，更大的帧直接走operator new
+static const size_t FRAME_ALIGN = 64;
+static const size_t FRAME_CLASSES = 64;
+static const size_t FRAME_CACHE = 256;
+
+// 线程退出时缓存先于其他thread_local析构，之后的释放直接还给operator delete
+static thread_local bool t_frame_cache_dead = false;
+
+struct FrameCache {
+    std::vector<void*> lists[FRAME_CLASSES];
+
+    ~FrameCache() {
+        t_frame_cache_dead = true;
+        for(size_t i = 0; i < FRAME_CLASSES; ++i) {
+            for(auto p : lists[i]) {
+                ::operator delete(p);
+            }
+        }
+    }
+};
+
+static thread_local FrameCache t_frame_cache;
+
+void* CoroFrameAllocator::Alloc(size_t size) {
+    size_t cls = (size + FRAME_ALIGN - 1) / FRAME_ALIGN;
+    if(cls == 0 || cls > FRAME_CLASSES || t_frame_cache_dead) {
+        return ::operator new(size);
+    }
+    std::vector<void*>& list = t_frame_cache.lists[cls - 1];
+    if(!list.empty()) {
+        void* p = list.back();
+        list.pop_back();
+        return p;
+    }
+    return ::operator new(cls * FRAME_ALIGN);
+}
+
+void CoroFrameAllocator::Dealloc(void* p, size_t size) {
+    size_t cls = (size + FRAME_ALIGN - 1) / FRAME_ALIGN;
+    if(cls == 0 || cls > FRAME_CLASSES || t_frame_cache_dead) {
+        ::operator delete(p);
+        return;
+    }
+    std::vector<void*>& list = t_frame_cache.lists[cls - 1];
+    if(list.size() < FRAME_CACHE) {
+        list.push_back(p);
+        return;
+    }
+    ::operator delete(p);
+}
+
+}
@@ -0,0 +1,310 @@
+#ifndef __ZNS_TASK_H__
+#define __ZNS_TASK_H__
+
+#include <stddef.h>
+
+namespace ZnetServer {
+
+/**
+ * @brief 无栈协程帧分配器
+ * @details 按64字节分档，每个线程一组空闲链表，稳态下协程帧的分配和释放不进malloc
+ */
+class CoroFrameAllocator {
+public:
+    static void* Alloc(size_t size);
+    static void Dealloc(void* p, size_t size);
+};
+
+}
+
+// 以下需要C++20协程，用 -DZNS_ENABLE_COROUTINES=ON 构建
+#if defined(ZNS_HAS_COROUTINES) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <new>
+
+#include "scheduler.h"
+#include "fiber_event.h"
+
+namespace ZnetServer {
+
+template<class T> class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    static void* operator new(size_t size) { return CoroFrameAllocator::Alloc(size); }
+    static void operator delete(void* p, size_t size) { CoroFrameAllocator::Dealloc(p, size); }
+
+    // Task是惰性的，被co_await或Spawn时才开始执行
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            // 对称转移回等待者，不在栈上嵌套resume
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<class T>
+struct TaskPromise : TaskPromiseBase {
+    alignas(T) unsigned char storage[sizeof(T)];
+    bool has_value = false;
+
+    Task<T> get_return_object();
+
+    template<class U>
+    void return_value(U&& v) {
+        ::new (storage) T(std::forward<U>(v));
+        has_value = true;
+    }
+
+    T result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*reinterpret_cast<T*>(storage));
+    }
+
+    ~TaskPromise() {
+        if (has_value) {
+            reinterpret_cast<T*>(storage)->~T();
+        }
+    }
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+// 自动销毁的协程，用于Spawn和同步等待的包装
+struct DetachedTask {
+    struct promise_type {
+        static void* operator new(size_t size) { return CoroFrameAllocator::Alloc(size); }
+        static void operator delete(void* p, size_t size) { CoroFrameAllocator::Dealloc(p, size); }
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+inline void ResumeHandle(void* addr) {
+    std::coroutine_handle<>::from_address(addr).resume();
+}
+
+} // namespace detail
+
+/**
+ * @brief 运行在Scheduler上的无栈协程
+ * @details 惰性启动，co_await时在等待者所在线程开始执行，
+ *          遇到ScheduleOn/RunInFiber等挂起点后由调度线程恢复。
+ *          协程帧从CoroFrameAllocator分配。
+ *
+ *          Task<int> compute(Scheduler& sc) {
+ *              co_await ScheduleOn(sc);
+ *              co_return 42;
+ *          }
+ */
+template<class T = void>
+class [[nodiscard]] Task {
+public:
+    typedef detail::TaskPromise<T> promise_type;
+
+    Task() {}
+    explicit Task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool valid() const { return (bool)m_handle; }
+
+    struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+        bool await_ready() noexcept { return !handle || handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) noexcept {
+            handle.promise().continuation = waiter;
+            return handle;
+        }
+        T await_resume() { return handle.promise().result(); }
+    };
+
+    Awaiter operator co_await() && noexcept { return Awaiter{m_handle}; }
+    Awaiter operator co_await() & noexcept { return Awaiter{m_handle}; }
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail {
+template<class T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+}
+
+/**
+ * @brief 挂起当前Task，由sc的工作线程恢复
+ */
+struct ScheduleOn {
+    Scheduler& sc;
+    explicit ScheduleOn(Scheduler& s) : sc(s) {}
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        sc.scheduleInline(&detail::ResumeHandle, h.address());
+    }
+    void await_resume() noexcept {}
+};
+
+/**
+ * @brief Task等待Fiber: 在sc的池化协程上执行fn(可以阻塞式地Park/Yield)，完成后恢复Task
+ */
+template<class F>
+auto RunInFiber(Scheduler& sc, F fn) {
+    typedef decltype(fn()) R;
+    typedef std::conditional_t<std::is_void<R>::value, char, R> Slot;
+    struct Awaiter {
+        Scheduler& sc;
+        F fn;
+        std::exception_ptr exception;
+        alignas(Slot) unsigned char storage[sizeof(Slot)];
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            sc.schedule([this, h]() {
+                try {
+                    if constexpr (std::is_void<R>::value) {
+                        fn();
+                    } else {
+                        ::new (storage) R(fn());
+                    }
+                } catch (...) {
+                    exception = std::current_exception();
+                }
+                sc.scheduleInline(&detail::ResumeHandle, h.address());
+            });
+        }
+        R await_resume() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            if constexpr (!std::is_void<R>::value) {
+                R* p = reinterpret_cast<R*>(storage);
+                R r = std::move(*p);
+                p->~R();
+                return r;
+            }
+        }
+    };
+    return Awaiter{sc, std::move(fn), nullptr, {}};
+}
+
+namespace detail {
+template<class T>
+DetachedTask SpawnImpl(Scheduler& sc, Task<T> task) {
+    co_await ScheduleOn(sc);
+    try {
+        co_await std::move(task);
+    } catch (const std::exception& e) {
+        ZNS_LOG_ERROR(ZNS_LOG_NAME("system")) << "Spawned Task except: " << e.what();
+    } catch (...) {
+        ZNS_LOG_ERROR(ZNS_LOG_NAME("system")) << "Spawned Task except";
+    }
+}
+
+template<class T>
+DetachedTask AwaitImpl(Task<T>& task, FiberEvent& ev, std::exception_ptr& ex, T* out) {
+    try {
+        if constexpr (std::is_void<T>::value) {
+            co_await task;
+        } else {
+            // 先落到局部变量再placement new，gcc12对new表达式里的co_await会ICE
+            T v = co_await task;
+            ::new (out) T(std::move(v));
+        }
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    ev.set();
+}
+} // namespace detail
+
+/**
+ * @brief 在sc上启动一个Task，不等待结果
+ */
+template<class T>
+void Spawn(Scheduler& sc, Task<T> task) {
+    detail::SpawnImpl(sc, std::move(task));
+}
+
+/**
+ * @brief Fiber(或普通线程)等待Task完成并取得结果
+ * @details 在调度器协程中调用时只挂起当前协程，不阻塞线程
+ */
+template<class T>
+T Await(Task<T> task) {
+    FiberEvent ev;
+    std::exception_ptr ex;
+    if constexpr (std::is_void<T>::value) {
+        detail::AwaitImpl<T>(task, ev, ex, nullptr);
+        ev.wait();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+    } else {
+        alignas(T) unsigned char storage[sizeof(T)];
+        T* out = reinterpret_cast<T*>(storage);
+        detail::AwaitImpl<T>(task, ev, ex, out);
+        ev.wait();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+        T r = std::move(*out);
+        out->~T();
+        return r;
+    }
+}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,337 @@
+#include "timer.h"
+#include "util.h"
+#include <string.h>
+#include <algorithm>
+
+namespace ZnetServer {
+
+// 第level层(>=1)一槽对应的毫秒数的位数
+static inline int LevelShift(int level) {
+    return 8 + 6 * (level - 1);
+}
+
+// 在nbits位的循环位图里从from的下一位开始找置位的位，
+// 返回距离from的步数(1 ~ nbits)，没有时返回-1
+static int FindNext(const uint64_t* words, int nbits, int from) {
+    int pos = from + 1;
+    int end = from + 1 + nbits;
+    while(pos < end) {
+        int i = pos % nbits;
+        uint64_t w = words[i / 64] >> (i % 64);
+        if(w) {
+            int found = pos + __builtin_ctzll(w);
+            return found < end ? found - from : -1;
+        }
+        pos += 64 - i % 64;
+    }
+    return -1;
+}
+
+Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager)
+    : m_recurring(recurring)
+    , m_ms(ms)
+    , m_next(GetCurrentMS() + ms)
+    , m_cb(std::move(cb))
+    , m_manager(manager) {
+}
+
+bool Timer::cancel() {
+    TimerManager* mgr = m_manager;
+    if(!mgr) {
+        return false;
+    }
+    // 回调和自身引用出锁后再释放，它们的析构可能再调用定时器接口
+    ptr self;
+    std::function<void()> cb;
+    {
+        std::lock_guard<std::mutex> lock(mgr->m_mutex);
+        if(m_slot < 0) {
+            return false;
+        }
+        mgr->unlink(this);
+        cb.swap(m_cb);
+        self.swap(m_self);
+    }
+    return true;
+}
+
+bool Timer::refresh() {
+    TimerManager* mgr = m_manager;
+    if(!mgr) {
+        return false;
+    }
+    bool at_front = false;
+    {
+        std::lock_guard<std::mutex> lock(mgr->m_mutex);
+        if(m_slot < 0) {
+            return false;
+        }
+        mgr->unlink(this);
+        m_next = GetCurrentMS() + m_ms;
+        at_front = mgr->insert(this);
+    }
+    if(at_front) {
+        mgr->onTimerInsertedAtFront();
+    }
+    return true;
+}
+
+bool Timer::reset(uint64_t ms, bool from_now) {
+    if(ms == m_ms && !from_now) {
+        return true;
+    }
+    TimerManager* mgr = m_manager;
+    if(!mgr) {
+        return false;
+    }
+    bool at_front = false;
+    {
+        std::lock_guard<std::mutex> lock(mgr->m_mutex);
+        if(m_slot < 0) {
+            return false;
+        }
+        mgr->unlink(this);
+        uint64_t start = from_now ? GetCurrentMS() : m_next - m_ms;
+        m_ms = ms;
+        m_next = start + ms;
+        at_front = mgr->insert(this);
+    }
+    if(at_front) {
+        mgr->onTimerInsertedAtFront();
+    }
+    return true;
+}
+
+TimerManager::TimerManager()
+    : m_current(GetCurrentMS()) {
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_bitmap, 0, sizeof(m_bitmap));
+}
+
+TimerManager::~TimerManager() {
+    std::vector<Timer::ptr> all;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(int i = 0; i < SLOT_COUNT; ++i) {
+            Timer* t = m_slots[i];
+            while(t) {
+                Timer* succ = t->m_succ;
+                t->m_prev = t->m_succ = nullptr;
+                t->m_slot = -1;
+                t->m_manager = nullptr;
+                all.push_back(std::move(t->m_self));
+                t = succ;
+            }
+            m_slots[i] = nullptr;
+        }
+        m_count = 0;
+    }
+}
+
+Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
+    Timer::ptr timer(new Timer(ms, std::move(cb), recurring, this));
+    bool at_front = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        timer->m_self = timer;
+        at_front = insert(timer.get());
+    }
+    if(at_front) {
+        onTimerInsertedAtFront();
+    }
+    return timer;
+}
+
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb,
+                                           std::weak_ptr<void> cond, bool recurring) {
+    Timer::ptr timer(new Timer(ms, [cond, cb]() {
+        // 执行期间保持条件对象存活
+        std::shared_ptr<void> tmp = cond.lock();
+        if(tmp) {
+            cb();
+        }
+    }, recurring, this));
+    timer->m_cond = cond;
+    timer->m_hasCond = true;
+    bool at_front = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        timer->m_self = timer;
+        at_front = insert(timer.get());
+    }
+    if(at_front) {
+        onTimerInsertedAtFront();
+    }
+    return timer;
+}
+
+bool TimerManager::insert(Timer* timer) {
+    // 已经过期的定时器放到下一毫秒，当前毫秒的槽已经处理过了
+    link(timer, m_current + 1);
+    if(timer->m_next < m_earliest.load(std::memory_order_relaxed)) {
+        m_earliest.store(timer->m_next, std::memory_order_relaxed);
+    }
+    if(timer->m_next < m_sleepUntil) {
+        m_sleepUntil = timer->m_next;
+        return true;
+    }
+    return false;
+}
+
+void TimerManager::link(Timer* timer, uint64_t floor) {
+    uint64_t expires = std::max(timer->m_next, floor);
+    uint64_t delta = expires - m_current;
+    int slot;
+    if(delta < (1ull << LEVEL0_BITS)) {
+        slot = expires & ((1 << LEVEL0_BITS) - 1);
+    } else {
+        int level = 1;
+        while(level < LEVELS - 1 && delta >= (1ull << LevelShift(level + 1))) {
+            ++level;
+        }
+        if(delta >= (1ull << (LevelShift(LEVELS - 1) + LEVELN_BITS))) {
+            // 超出最高层的范围，先放在最远的槽，级联时再按实际时间重新分配
+            expires = m_current + (1ull << (LevelShift(LEVELS - 1) + LEVELN_BITS)) - 1;
+        }
+        slot = (1 << LEVEL0_BITS) + (level - 1) * (1 << LEVELN_BITS)
+             + ((expires >> LevelShift(level)) & ((1 << LEVELN_BITS) - 1));
+    }
+    timer->m_slot = slot;
+    timer->m_prev = nullptr;
+    timer->m_succ = m_slots[slot];
+    if(timer->m_succ) {
+        timer->m_succ->m_prev = timer;
+    }
+    m_slots[slot] = timer;
+    m_bitmap[slot / 64] |= 1ull << (slot % 64);
+    ++m_count;
+}
+
+void TimerManager::unlink(Timer* timer) {
+    int slot = timer->m_slot;
+    if(timer->m_prev) {
+        timer->m_prev->m_succ = timer->m_succ;
+    } else {
+        m_slots[slot] = timer->m_succ;
+        if(!m_slots[slot]) {
+            m_bitmap[slot / 64] &= ~(1ull << (slot % 64));
+        }
+    }
+    if(timer->m_succ) {
+        timer->m_succ->m_prev = timer->m_prev;
+    }
+    timer->m_prev = timer->m_succ = nullptr;
+    timer->m_slot = -1;
+    --m_count;
+}
+
+int TimerManager::cascade(int level) {
+    int idx = (m_current >> LevelShift(level)) & ((1 << LEVELN_BITS) - 1);
+    int slot = (1 << LEVEL0_BITS) + (level - 1) * (1 << LEVELN_BITS) + idx;
+    Timer* t = m_slots[slot];
+    m_slots[slot] = nullptr;
+    m_bitmap[slot / 64] &= ~(1ull << (slot % 64));
+    while(t) {
+        Timer* succ = t->m_succ;
+        --m_count;
+        // 槽的起点就是m_current，里面的定时器不会早于它
+        link(t, m_current);
+        t = succ;
+    }
+    return idx;
+}
+
+uint64_t TimerManager::nextEvent() const {
+    if(m_count == 0) {
+        return ~0ull;
+    }
+    uint64_t best = ~0ull;
+    int k = FindNext(m_bitmap, 1 << LEVEL0_BITS, m_current & ((1 << LEVEL0_BITS) - 1));
+    if(k > 0) {
+        best = m_current + k;
+    }
+    for(int level = 1; level < LEVELS; ++level) {
+        int shift = LevelShift(level);
+        const uint64_t* word = &m_bitmap[(1 << LEVEL0_BITS) / 64 + level - 1];
+        k = FindNext(word, 1 << LEVELN_BITS, (m_current >> shift) & ((1 << LEVELN_BITS) - 1));
+        if(k > 0) {
+            best = std::min(best, ((m_current >> shift) + k) << shift);
+        }
+    }
+    return best;
+}
+
+void TimerManager::updateEarliest() {
+    m_earliest.store(nextEvent(), std::memory_order_relaxed);
+}
+
+uint64_t TimerManager::getNextTimer() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t next = nextEvent();
+    m_sleepUntil = next;
+    if(next == ~0ull) {
+        return ~0ull;
+    }
+    uint64_t now = GetCurrentMS();
+    return next > now ? next - now : 0;
+}
+
+void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
+    uint64_t now = GetCurrentMS();
+    // 单次定时器的最后一个引用，出锁后释放
+    std::vector<Timer::ptr> done;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 处理的线程不一定是睡眠方，之后的新定时器都通知一次，让睡眠方重新计算
+    m_sleepUntil = ~0ull;
+    while(m_current < now) {
+        if(m_count == 0) {
+            m_current = now;
+            break;
+        }
+        // 直接跳到第0层下一个非空槽，或者下一圈的起点(要级联)
+        uint64_t boundary = (m_current | ((1 << LEVEL0_BITS) - 1)) + 1;
+        int k = FindNext(m_bitmap, 1 << LEVEL0_BITS, m_current & ((1 << LEVEL0_BITS) - 1));
+        uint64_t next = (k > 0 && m_current + k < boundary) ? m_current + k : boundary;
+        if(next > now) {
+            m_current = now;
+            break;
+        }
+        m_current = next;
+        if(next == boundary) {
+            for(int level = 1; level < LEVELS; ++level) {
+                if(cascade(level) != 0) {
+                    break;
+                }
+            }
+        }
+        int slot = next & ((1 << LEVEL0_BITS) - 1);
+        Timer* t = m_slots[slot];
+        while(t) {
+            Timer* succ = t->m_succ;
+            unlink(t);
+            if(t->m_hasCond && t->m_cond.expired()) {
+                // 条件对象已经释放，定时器自动取消
+                t->m_cb = nullptr;
+                done.push_back(std::move(t->m_self));
+            } else if(t->m_recurring) {
+                cbs.push_back(t->m_cb);
+                t->m_next = now + t->m_ms;
+                // 周期为0时也至少等到下一毫秒，不在这一轮里反复触发
+                link(t, now + 1);
+            } else {
+                cbs.push_back(std::move(t->m_cb));
+                t->m_cb = nullptr;
+                done.push_back(std::move(t->m_self));
+            }
+            t = succ;
+        }
+    }
+    updateEarliest();
+}
+
+bool TimerManager::hasTimer() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count > 0;
+}
+
+}
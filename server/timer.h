@@ -0,0 +1,142 @@
+#ifndef __ZNS_TIMER_H__
+#define __ZNS_TIMER_H__
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+namespace ZnetServer {
+
+class TimerManager;
+
+/**
+ * @brief 定时器
+ * @details 由TimerManager::addTimer创建，挂在时间轮上期间管理器持有它，
+ *          调用方可以不保存返回的指针
+ */
+class Timer : public std::enable_shared_from_this<Timer> {
+friend class TimerManager;
+public:
+    typedef std::shared_ptr<Timer> ptr;
+
+    /**
+     * @brief 取消定时器
+     * @return 已经触发(单次)或已经取消时返回false
+     */
+    bool cancel();
+
+    /**
+     * @brief 从现在起重新计时，周期不变
+     */
+    bool refresh();
+
+    /**
+     * @brief 修改周期
+     * @param[in] ms 新的周期(毫秒)
+     * @param[in] from_now true从现在起计时，false从上一次的起点计时
+     */
+    bool reset(uint64_t ms, bool from_now);
+private:
+    Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager);
+private:
+    bool m_recurring = false;
+    uint64_t m_ms = 0;       // 周期
+    uint64_t m_next = 0;     // 到期时间，GetCurrentMS的毫秒
+    std::function<void()> m_cb;
+    // 条件定时器: 条件对象释放后到期时不再执行，也不再循环
+    std::weak_ptr<void> m_cond;
+    bool m_hasCond = false;
+    TimerManager* m_manager = nullptr;
+    // 时间轮槽内的双向链表
+    Timer* m_prev = nullptr;
+    Timer* m_succ = nullptr;
+    int m_slot = -1;         // 所在的槽，-1表示不在时间轮上
+    ptr m_self;              // 在时间轮上时持有自己
+};
+
+/**
+ * @brief 分层时间轮定时器管理
+ * @details 精度1毫秒。第0层256个槽，每槽1ms；之上4层各64个槽，
+ *          每层一槽等于下一层转一圈(256ms、16s、17min、18h)，超过约49天的按49天算。
+ *          定时器按剩余时间放进对应层的槽里，槽内是侵入式双向链表，
+ *          添加和取消都是O(1)；时间走到高层槽的起点时把它的定时器重新分配到下面的层(级联)。
+ *          每个槽有一位占用标记，找下一个到期时间只扫位图。
+ */
+class TimerManager {
+friend class Timer;
+public:
+    TimerManager();
+    virtual ~TimerManager();
+
+    /**
+     * @brief 添加定时器
+     * @param[in] ms 多少毫秒后触发
+     * @param[in] recurring 是否循环，循环定时器每次触发后从触发时刻重新计时
+     */
+    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+
+    /**
+     * @brief 添加条件定时器，cond指向的对象释放后定时器自动失效
+     */
+    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb,
+                                 std::weak_ptr<void> cond, bool recurring = false);
+
+    /**
+     * @brief 距离下一次需要处理时间轮还有多少毫秒，没有定时器时返回~0ull
+     * @details 调用方通常随后睡眠这么久。之后新加的定时器更早到期时
+     *          会回调onTimerInsertedAtFront。高层槽只知道下界，
+     *          这时返回的是级联时刻，醒来后重新计算即可
+     */
+    uint64_t getNextTimer();
+
+    /**
+     * @brief 取出所有已到期定时器的回调，循环定时器重新计时
+     */
+    void listExpiredCb(std::vector<std::function<void()> >& cbs);
+
+    bool hasTimer();
+protected:
+    /**
+     * @brief 新定时器比getNextTimer给出的时间还早，睡眠方需要提前醒来
+     * @details 在不持锁的状态下调用
+     */
+    virtual void onTimerInsertedAtFront() = 0;
+
+    /**
+     * @brief 最早可能需要处理的时间，~0ull表示没有定时器
+     * @details 不加锁，供忙碌的线程廉价地判断要不要调用listExpiredCb
+     */
+    uint64_t getEarliest() const { return m_earliest.load(std::memory_order_relaxed); }
+private:
+    // 放上时间轮，需要持有m_mutex，返回是否要通知睡眠方
+    bool insert(Timer* timer);
+    // 按m_next放进对应的槽，到期时间不早于floor
+    void link(Timer* timer, uint64_t floor);
+    void unlink(Timer* timer);
+    // 把第level层当前下标的槽重新分配到下面的层，返回这个下标
+    int cascade(int level);
+    // 下一个要处理的时刻: 第0层最近的非空槽或者高层最近的级联时刻
+    uint64_t nextEvent() const;
+    void updateEarliest();
+private:
+    static const int LEVEL0_BITS = 8;
+    static const int LEVELN_BITS = 6;
+    static const int LEVELS = 5;
+    static const int SLOT_COUNT = (1 << LEVEL0_BITS) + (LEVELS - 1) * (1 << LEVELN_BITS);
+
+    std::mutex m_mutex;
+    Timer* m_slots[SLOT_COUNT];
+    uint64_t m_bitmap[SLOT_COUNT / 64];
+    uint64_t m_current;      // 时间轮已经处理到的时刻
+    size_t m_count = 0;
+    // 睡眠方睡到的时刻，比它早的新定时器需要唤醒睡眠方
+    uint64_t m_sleepUntil = ~0ull;
+    std::atomic<uint64_t> m_earliest {~0ull};
+};
+
+}
+
+#endif
@@ -1,5 +1,9 @@
 #include "util.h"
 #include "fiber.h"
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <cxxabi.h>
 namespace ZnetServer {
 
 // 由于GetThreadId已经在util.h中实现为内联函数，这里不需要再实现
@@ -9,4 +13,42 @@ uint32_t GetFiberId() {
     return 0;
 }
 
-} 
\ No newline at end of file
+uint64_t GetCurrentMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+uint64_t GetCurrentUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+uint64_t GetCurrentNS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 不内联，LTO之后也不会和调用方共用errno的地址
+__attribute__((noinline)) int GetErrno() {
+    return errno;
+}
+
+__attribute__((noinline)) void SetErrno(int err) {
+    errno = err;
+}
+
+std::string Demangle(const char* name) {
+    int status = 0;
+    char* p = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if(status != 0 || !p) {
+        return name;
+    }
+    std::string r(p);
+    free(p);
+    return r;
+}
+
+}
@@ -24,6 +24,35 @@ inline pid_t GetThreadId() {
  */
 uint32_t GetFiberId();
 
+/**
+ * @brief 获取单调时钟的毫秒数
+ * @details 不受系统时间调整影响，只用于计算间隔和定时器
+ */
+uint64_t GetCurrentMS();
+
+/**
+ * @brief 获取单调时钟的微秒数
+ */
+uint64_t GetCurrentUS();
+
+/**
+ * @brief 获取单调时钟的纳秒数
+ */
+uint64_t GetCurrentNS();
+
+/**
+ * @brief 读写errno
+ * @details errno是线程局部的，而编译器把它的地址(__errno_location)当作常量在函数内复用。
+ *          协程挂起后可能换到别的线程上恢复，恢复之后读写errno都要经过这两个函数
+ */
+int GetErrno();
+void SetErrno(int err);
+
+/**
+ * @brief 还原C++符号名，例如typeid(x).name()，失败时原样返回
+ */
+std::string Demangle(const char* name);
+
 /**
  * @brief 将字符串转换为小写
  * @param str 要转换的字符串
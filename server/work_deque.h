@@ -0,0 +1,143 @@
+#ifndef __ZNS_WORK_DEQUE_H__
+#define __ZNS_WORK_DEQUE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace ZnetServer {
+
+/**
+ * @brief Chase-Lev工作窃取双端队列
+ * @details 只有所属线程能push/pop(在bottom端，LIFO)，其他线程steal(在top端，FIFO)。
+ *          实现按 Lê et al. "Correct and Efficient Work-Stealing for Weak Memory Models"。
+ *          元素是指针，空间不够时加倍扩容，旧数组留到析构时再释放，
+ *          因为并发的steal可能还在读它。
+ */
+template<class T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 256)
+        : m_top(0), m_bottom(0) {
+        size_t cap = 1;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_array.store(new Array(cap), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque() {
+        delete m_array.load(std::memory_order_relaxed);
+        for(auto a : m_retired) {
+            delete a;
+        }
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /**
+     * @brief 所属线程放入一个元素
+     */
+    void push(T* x) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+        if(b - t > (int64_t)a->mask) {
+            a = grow(a, t, b);
+        }
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 所属线程取出最近放入的元素，空时返回nullptr
+     */
+    T* pop() {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        T* x = nullptr;
+        if(t <= b) {
+            x = a->get(b);
+            if(t == b) {
+                // 最后一个元素，和steal竞争
+                if(!m_top.compare_exchange_strong(t, t + 1,
+                        std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    x = nullptr;
+                }
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    /**
+     * @brief 其他线程从另一端偷一个最早放入的元素，空或竞争失败时返回nullptr
+     */
+    T* steal() {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return nullptr;
+        }
+        Array* a = m_array.load(std::memory_order_acquire);
+        T* x = a->get(t);
+        if(!m_top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return x;
+    }
+
+    /**
+     * @brief 元素个数的近似值，任何线程都可以调用
+     */
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+private:
+    struct Array {
+        size_t mask;
+        std::atomic<T*>* items;
+
+        explicit Array(size_t cap) : mask(cap - 1), items(new std::atomic<T*>[cap]) {}
+        ~Array() { delete[] items; }
+
+        T* get(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T* x) { items[i & mask].store(x, std::memory_order_relaxed); }
+    };
+
+    Array* grow(Array* a, int64_t t, int64_t b) {
+        Array* na = new Array((a->mask + 1) * 2);
+        for(int64_t i = t; i < b; ++i) {
+            na->put(i, a->get(i));
+        }
+        m_retired.push_back(a);
+        m_array.store(na, std::memory_order_release);
+        return na;
+    }
+private:
+    // top和bottom分开在不同缓存行，steal和本线程的push/pop互不干扰。
+    // 用填充而不是alignas，C++11的new不保证超过16字节的对齐
+    std::atomic<int64_t> m_top;
+    char m_pad1[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> m_bottom;
+    char m_pad2[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<Array*> m_array;
+    std::vector<Array*> m_retired; // 只有所属线程访问
+};
+
+}
+
+#endif
@@ -0,0 +1,219 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../server/scheduler.h"
+#include "../server/log.h"
+
+// 调度路径上每个任务的堆分配次数
+// 用法: bench_alloc [-t 线程数] [-n 每组调度次数] [-j 输出JSON的文件, -表示标准输出]
+//   yield        64个协程反复Scheduler::Yield，协程重新入队
+//   park_unpark  64个协程围成一圈传令牌，Park等令牌，Unpark下一个(跨线程唤醒)
+//   cb_local     工作线程上的回调一个接一个地调度下一个回调(本地队列)
+//   cb_external  主线程从调度器外部提交回调(注入栈)
+// 替换全局operator new计数，只统计测量期间的次数，包括调度器之外(例如日志)的分配
+
+static std::atomic<long> s_allocs {0};
+
+void* operator new(size_t size) {
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+struct Result {
+    std::string name;
+    int threads;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Result> s_results;
+static int s_threads = 4;
+static long s_count = 1000000;
+
+static double now_sec() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Add(const std::string& name, long n, double value, const char* unit) {
+    Result r = {name, s_threads, n, value, unit};
+    s_results.push_back(r);
+    printf("%-22s %8d %10ld %14.3f %s\n", name.c_str(), s_threads, n, value, unit);
+    fflush(stdout);
+}
+
+// 运行body，等到done达到n，记录每次调度的耗时和分配次数
+template<class F>
+static void Measure(const std::string& name, long n, std::atomic<long>& done, F body) {
+    long allocs = s_allocs.load();
+    double begin = now_sec();
+    body();
+    while(done.load() < n) {
+        usleep(100);
+    }
+    double seconds = now_sec() - begin;
+    allocs = s_allocs.load() - allocs;
+    Add(name + "_time", n, seconds * 1e9 / n, "ns/op");
+    Add(name + "_allocs", n, (double)allocs / n, "alloc/op");
+}
+
+static const int FIBERS = 64;
+
+static void bench_yield() {
+    ZnetServer::Scheduler sc(s_threads, false, "yield");
+    sc.start();
+    std::atomic<long> done {0};
+    long per = s_count / FIBERS;
+    std::vector<ZnetServer::Fiber::ptr> fibers;
+    for(int i = 0; i < FIBERS; ++i) {
+        fibers.push_back(std::make_shared<ZnetServer::Fiber>([&done, per](){
+            for(long k = 0; k < per; ++k) {
+                ZnetServer::Scheduler::Yield();
+                done.fetch_add(1, std::memory_order_relaxed);
+            }
+        }));
+    }
+    Measure("yield", per * FIBERS, done, [&](){
+        for(auto& f : fibers) {
+            sc.schedule(std::move(f));
+        }
+    });
+    sc.stop();
+}
+
+static void bench_park_unpark() {
+    ZnetServer::Scheduler sc(s_threads, false, "park");
+    sc.start();
+    std::atomic<long> done {0};
+    std::atomic<int> token {0};
+    long rounds = s_count / FIBERS;
+    std::vector<ZnetServer::Fiber::ptr> fibers(FIBERS);
+    for(int i = 0; i < FIBERS; ++i) {
+        fibers[i] = std::make_shared<ZnetServer::Fiber>([&, i, rounds](){
+            int next = (i + 1) % FIBERS;
+            for(long k = 0; k < rounds; ++k) {
+                while(token.load() != i) {
+                    ZnetServer::Scheduler::Park();
+                }
+                token = next;
+                done.fetch_add(1, std::memory_order_relaxed);
+                ZnetServer::Scheduler::Unpark(fibers[next]);
+            }
+        });
+    }
+    Measure("park_unpark", rounds * FIBERS, done, [&](){
+        for(auto& f : fibers) {
+            sc.schedule(f);
+        }
+    });
+    sc.stop();
+}
+
+static void bench_cb_local() {
+    ZnetServer::Scheduler sc(s_threads, false, "cb_local");
+    sc.start();
+    std::atomic<long> done {0};
+    long n = s_count;
+    // 每个线程一条链，回调捕获的内容放得进Callable的内联存储
+    struct Step {
+        ZnetServer::Scheduler* sc;
+        std::atomic<long>* done;
+        long left;
+        void operator()() {
+            done->fetch_add(1, std::memory_order_relaxed);
+            if(left > 1) {
+                sc->schedule(Step{sc, done, left - 1});
+            }
+        }
+    };
+    Measure("cb_local", n / s_threads * s_threads, done, [&](){
+        for(int i = 0; i < s_threads; ++i) {
+            sc.schedule(Step{&sc, &done, n / s_threads});
+        }
+    });
+    sc.stop();
+}
+
+static void bench_cb_external() {
+    ZnetServer::Scheduler sc(s_threads, false, "cb_external");
+    sc.start();
+    std::atomic<long> done {0};
+    long n = s_count;
+    Measure("cb_external", n, done, [&](){
+        for(long i = 0; i < n; ++i) {
+            sc.schedule([&done](){ done.fetch_add(1, std::memory_order_relaxed); });
+        }
+    });
+    sc.stop();
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %ld, "
+                "\"value\": %.3f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.threads, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "t:n:j:")) != -1) {
+        switch(opt) {
+        case 't': s_threads = atoi(optarg); break;
+        case 'n': s_count = atol(optarg); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n count] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("cpus: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-22s %8s %10s %14s\n", "bench", "threads", "iters", "result");
+    bench_yield();
+    bench_park_unpark();
+    bench_cb_local();
+    bench_cb_external();
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../server/channel.h"
+#include "../server/scheduler.h"
+#include "../server/log.h"
+
+// 协程间传递消息: Channel vs 互斥锁队列加轮询
+// 用法: bench_channel [-t 线程数] [-n 消息数] [-c 缓冲容量] [-j 输出JSON的文件, -表示标准输出]
+//   chan_1x1 / chan_4x4     缓冲通道，1个/4个生产者协程对1个/4个消费者协程
+//   chan_cap1_4x4           容量为1，几乎每次都要挂起和唤醒
+//   chan_unbuffered_4x4     不带缓冲，每条消息都是一次交接
+//   chan_select_2x1         消费者用Select同时收两个通道
+//   chan_pingpong           不带缓冲的通道来回一次的耗时
+//   mutex_queue_1x1 / 4x4   std::mutex+std::deque，消费者取不到就Scheduler::Yield再试
+// 每组都校验收到的消息总和，丢失或重复时报错
+
+struct Result {
+    std::string name;
+    int threads;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Result> s_results;
+static int s_threads = 4;
+static long s_count = 1000000;
+static size_t s_capacity = 1024;
+static int s_errors = 0;
+
+static double now_sec() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Add(const std::string& name, long n, double value, const char* unit) {
+    Result r = {name, s_threads, n, value, unit};
+    s_results.push_back(r);
+    printf("%-26s %8d %10ld %14.3f %s\n", name.c_str(), s_threads, n, value, unit);
+    fflush(stdout);
+}
+
+static void Check(const std::string& name, long n, long sum) {
+    long expect = n * (n - 1) / 2;
+    if(sum != expect) {
+        fprintf(stderr, "%s: sum %ld, expect %ld\n", name.c_str(), sum, expect);
+        ++s_errors;
+    }
+}
+
+// 生产者按下标分段发送0..n-1，消费者累加；全部发完后关闭通道
+static void RunChannel(const std::string& name, size_t capacity, int producers, int consumers) {
+    ZnetServer::Scheduler sc(s_threads, false, name);
+    sc.start();
+    ZnetServer::Channel<long> ch(capacity);
+    std::atomic<int> left {producers};
+    std::atomic<int> finished {0};
+    std::atomic<long> sum {0};
+    long n = s_count;
+    double begin = now_sec();
+    for(int c = 0; c < consumers; ++c) {
+        sc.schedule([&](){
+            long v, s = 0;
+            while(ch.recv(v)) {
+                s += v;
+            }
+            sum += s;
+            ++finished;
+        });
+    }
+    for(int p = 0; p < producers; ++p) {
+        sc.schedule([&, p](){
+            for(long i = p; i < n; i += producers) {
+                ch.send(i);
+            }
+            if(--left == 0) {
+                ch.close();
+            }
+        });
+    }
+    while(finished < consumers) {
+        usleep(1000);
+    }
+    double seconds = now_sec() - begin;
+    sc.stop();
+    Check(name, n, sum);
+    Add(name, n, seconds * 1e9 / n, "ns/msg");
+}
+
+static void RunSelect() {
+    ZnetServer::Scheduler sc(s_threads, false, "select");
+    sc.start();
+    ZnetServer::Channel<long> a(s_capacity), b(s_capacity);
+    std::atomic<int> left {2};
+    std::atomic<bool> finished {false};
+    long sum = 0;
+    long n = s_count;
+    double begin = now_sec();
+    sc.schedule([&](){
+        long va, vb;
+        bool open_a = true, open_b = true;
+        while(open_a || open_b) {
+            ZnetServer::Select sel;
+            int ia = open_a ? sel.addRecv(a, va) : -1;
+            int ib = open_b ? sel.addRecv(b, vb) : -1;
+            int i = sel.wait();
+            if(i == ia) {
+                if(sel.ok()) {
+                    sum += va;
+                } else {
+                    open_a = false;
+                }
+            } else if(i == ib) {
+                if(sel.ok()) {
+                    sum += vb;
+                } else {
+                    open_b = false;
+                }
+            }
+        }
+        finished = true;
+    });
+    for(int p = 0; p < 2; ++p) {
+        sc.schedule([&, p](){
+            ZnetServer::Channel<long>& ch = p ? b : a;
+            for(long i = p; i < n; i += 2) {
+                ch.send(i);
+            }
+            ch.close();
+            --left;
+        });
+    }
+    while(!finished) {
+        usleep(1000);
+    }
+    double seconds = now_sec() - begin;
+    sc.stop();
+    Check("chan_select_2x1", n, sum);
+    Add("chan_select_2x1", n, seconds * 1e9 / n, "ns/msg");
+}
+
+static void RunPingPong() {
+    ZnetServer::Scheduler sc(s_threads, false, "pingpong");
+    sc.start();
+    ZnetServer::Channel<long> ping, pong;
+    std::atomic<bool> finished {false};
+    long n = s_count / 10;
+    double begin = now_sec();
+    sc.schedule([&](){
+        long x;
+        while(ping.recv(x)) {
+            pong.send(x + 1);
+        }
+    });
+    sc.schedule([&](){
+        long x = 0;
+        for(long i = 0; i < n; ++i) {
+            ping.send(x);
+            pong.recv(x);
+        }
+        ping.close();
+        if(x != n) {
+            fprintf(stderr, "chan_pingpong: x %ld, expect %ld\n", x, n);
+            ++s_errors;
+        }
+        finished = true;
+    });
+    while(!finished) {
+        usleep(1000);
+    }
+    double seconds = now_sec() - begin;
+    sc.stop();
+    Add("chan_pingpong", n, seconds * 1e9 / n, "ns/round");
+}
+
+// 现在的做法: 加锁的队列，消费者轮询
+static void RunMutexQueue(const std::string& name, int producers, int consumers) {
+    ZnetServer::Scheduler sc(s_threads, false, name);
+    sc.start();
+    std::mutex mutex;
+    std::deque<long> queue;
+    std::atomic<int> left {producers};
+    std::atomic<int> finished {0};
+    std::atomic<long> sum {0};
+    long n = s_count;
+    double begin = now_sec();
+    for(int c = 0; c < consumers; ++c) {
+        sc.schedule([&](){
+            long s = 0;
+            while(true) {
+                long v;
+                bool got = false;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(!queue.empty()) {
+                        v = queue.front();
+                        queue.pop_front();
+                        got = true;
+                    }
+                }
+                if(got) {
+                    s += v;
+                } else if(left == 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(queue.empty()) {
+                        break;
+                    }
+                } else {
+                    ZnetServer::Scheduler::Yield();
+                }
+            }
+            sum += s;
+            ++finished;
+        });
+    }
+    for(int p = 0; p < producers; ++p) {
+        sc.schedule([&, p](){
+            for(long i = p; i < n; i += producers) {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(i);
+            }
+            --left;
+        });
+    }
+    while(finished < consumers) {
+        usleep(1000);
+    }
+    double seconds = now_sec() - begin;
+    sc.stop();
+    Check(name, n, sum);
+    Add(name, n, seconds * 1e9 / n, "ns/msg");
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %ld, "
+                "\"value\": %.3f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.threads, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "t:n:c:j:")) != -1) {
+        switch(opt) {
+        case 't': s_threads = atoi(optarg); break;
+        case 'n': s_count = atol(optarg); break;
+        case 'c': s_capacity = strtoul(optarg, nullptr, 10); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n count] [-c capacity] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("cpus: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-26s %8s %10s %14s\n", "bench", "threads", "messages", "result");
+    RunChannel("chan_1x1", s_capacity, 1, 1);
+    RunChannel("chan_4x4", s_capacity, 4, 4);
+    RunChannel("chan_cap1_4x4", 1, 4, 4);
+    RunChannel("chan_unbuffered_4x4", 0, 4, 4);
+    RunSelect();
+    RunPingPong();
+    RunMutexQueue("mutex_queue_1x1", 1, 1);
+    RunMutexQueue("mutex_queue_4x4", 4, 4);
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return s_errors ? 1 : 0;
+}
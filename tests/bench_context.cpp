@@ -0,0 +1,73 @@
+#include <ucontext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include "../server/context.h"
+
+// 上下文切换延迟: 主上下文和一个协程来回切换N次，
+// 对比当前编译的Context后端和glibc swapcontext
+
+static const long N = 2000000;
+static const size_t STACK_SIZE = 64 * 1024;
+
+static ZnetServer::Context s_main;
+static ZnetServer::Context s_co;
+
+static void CoEntry(void*) {
+    while(true) {
+        ZnetServer::Context::Swap(s_co, s_main);
+    }
+}
+
+static ucontext_t s_umain;
+static ucontext_t s_uco;
+
+static void UcoEntry() {
+    while(true) {
+        swapcontext(&s_uco, &s_umain);
+    }
+}
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double bench_context() {
+    std::vector<char> stack(STACK_SIZE);
+    s_co.make(&stack[0], stack.size(), &CoEntry, nullptr);
+    ZnetServer::Context::Swap(s_main, s_co); // 预热
+    double begin = now_ns();
+    for(long i = 0; i < N; ++i) {
+        ZnetServer::Context::Swap(s_main, s_co);
+    }
+    // 每轮切进切出共两次切换
+    return (now_ns() - begin) / (N * 2);
+}
+
+static double bench_ucontext() {
+    std::vector<char> stack(STACK_SIZE);
+    getcontext(&s_uco);
+    s_uco.uc_link = nullptr;
+    s_uco.uc_stack.ss_sp = &stack[0];
+    s_uco.uc_stack.ss_size = stack.size();
+    makecontext(&s_uco, &UcoEntry, 0);
+    swapcontext(&s_umain, &s_uco);
+    double begin = now_ns();
+    for(long i = 0; i < N; ++i) {
+        swapcontext(&s_umain, &s_uco);
+    }
+    return (now_ns() - begin) / (N * 2);
+}
+
+int main() {
+    double ctx = bench_context();
+    double uctx = bench_ucontext();
+    printf("%-24s %12s\n", "backend", "ns/switch");
+    printf("%-24s %12.2f\n", ZnetServer::Context::BackendName(), ctx);
+    printf("%-24s %12.2f\n", "swapcontext(glibc)", uctx);
+    printf("speedup: %.1fx\n", uctx / ctx);
+    return 0;
+}
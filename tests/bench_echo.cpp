@@ -0,0 +1,342 @@
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../server/iomanager.h"
+#include "../server/config.h"
+#include "../server/log.h"
+
+// IOManager上的echo服务器
+// 用法: bench_echo [-b epoll|io_uring] [-t 线程数] [-c 连接数] [-d 秒数] [-s 消息字节数]
+//                  [-j 输出JSON的文件, -表示标准输出]
+// 服务端用IOManager的协程版read/write/accept，-b选择后端(iomanager.backend)。
+// 客户端在fork出的子进程里用裸epoll驱动(两边各自占一份fd)，每个连接同时只有一个请求在路上，
+// 收到完整回显后立即发下一个。
+//   connect    建立所有连接的耗时
+//   rps        每秒完成的请求数
+//   lat        请求往返延迟
+//   server_cpu 服务进程平均每个请求消耗的CPU
+
+struct Result {
+    std::string name;
+    int threads;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+// 子进程通过管道交回的结果
+struct ClientReport {
+    int conns;
+    long requests;
+    double connect_ms;
+    double seconds;
+    double lat_avg;
+    double lat_p50;
+    double lat_p99;
+};
+
+static std::vector<Result> s_results;
+static std::string s_backend = "epoll";
+static int s_threads = 4;
+static int s_conns = 10000;
+static int s_seconds = 3;
+static int s_msgSize = 64;
+static std::atomic<bool> s_stop {false};
+static std::atomic<long> s_accepted {0};
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpu_us() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec
+         + ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+}
+
+static void Add(const std::string& name, long n, double value, const char* unit) {
+    std::string full = s_backend + "_" + name;
+    Result r = {full, s_threads, n, value, unit};
+    s_results.push_back(r);
+    printf("%-22s %8d %10ld %14.1f %s\n", full.c_str(), s_threads, n, value, unit);
+    fflush(stdout);
+}
+
+static void HandleConn(int fd) {
+    ZnetServer::IOManager* iom = ZnetServer::IOManager::GetThis();
+    std::vector<char> buf(4096);
+    while(true) {
+        ssize_t n = iom->read(fd, &buf[0], buf.size());
+        if(n <= 0) {
+            break;
+        }
+        ssize_t off = 0;
+        while(off < n) {
+            ssize_t w = iom->write(fd, &buf[off], n - off);
+            if(w <= 0) {
+                break;
+            }
+            off += w;
+        }
+        if(off < n) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+static void AcceptLoop(int lfd) {
+    ZnetServer::IOManager* iom = ZnetServer::IOManager::GetThis();
+    while(!s_stop) {
+        int fd = iom->accept(lfd, nullptr, nullptr);
+        if(fd >= 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            ++s_accepted;
+            iom->schedule([fd]() { HandleConn(fd); });
+        } else if(errno != EINTR && errno != ECONNABORTED && errno != ECANCELED) {
+            perror("accept");
+            break;
+        }
+    }
+}
+
+// 子进程: 建立连接后在一个线程里用epoll驱动所有连接
+static int RunClients(int port, int out) {
+    ClientReport rep;
+    memset(&rep, 0, sizeof(rep));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int epfd = epoll_create1(0);
+    std::vector<int> fds(s_conns, -1);
+    std::vector<int> got(s_conns, 0);
+    std::vector<double> sent(s_conns, 0);
+    double t0 = now_ns();
+    for(int i = 0; i < s_conns; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+            perror("client connect");
+            return 1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fds[i] = fd;
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    rep.connect_ms = (now_ns() - t0) / 1e6;
+
+    std::vector<char> msg(s_msgSize, 'x');
+    std::vector<char> buf(s_msgSize);
+    std::vector<double> lat;
+    lat.reserve(1 << 22);
+    double begin = now_ns();
+    double end = begin + s_seconds * 1e9;
+    for(int i = 0; i < s_conns; ++i) {
+        sent[i] = now_ns();
+        ssize_t rt = write(fds[i], &msg[0], s_msgSize);
+        (void)rt;
+    }
+    std::vector<epoll_event> events(1024);
+    int inflight = s_conns;
+    while(inflight > 0) {
+        int n = epoll_wait(epfd, &events[0], events.size(), 1000);
+        if(n <= 0) {
+            if(n == 0) {
+                fprintf(stderr, "client: no reply in 1s, inflight=%d\n", inflight);
+                break;
+            }
+            continue;
+        }
+        double now = now_ns();
+        for(int k = 0; k < n; ++k) {
+            int i = events[k].data.u32;
+            ssize_t r = read(fds[i], &buf[0], s_msgSize - got[i]);
+            if(r <= 0) {
+                continue;
+            }
+            got[i] += r;
+            if(got[i] < s_msgSize) {
+                continue;
+            }
+            got[i] = 0;
+            lat.push_back(now - sent[i]);
+            if(now < end) {
+                sent[i] = now_ns();
+                ssize_t rt = write(fds[i], &msg[0], s_msgSize);
+                (void)rt;
+            } else {
+                --inflight;
+            }
+        }
+    }
+    rep.seconds = (now_ns() - begin) / 1e9;
+    for(int fd : fds) {
+        close(fd);
+    }
+    close(epfd);
+
+    rep.conns = s_conns;
+    rep.requests = lat.size();
+    if(!lat.empty()) {
+        std::sort(lat.begin(), lat.end());
+        double sum = 0;
+        for(double v : lat) {
+            sum += v;
+        }
+        rep.lat_avg = sum / lat.size() / 1000;
+        rep.lat_p50 = lat[lat.size() / 2] / 1000;
+        rep.lat_p99 = lat[lat.size() * 99 / 100] / 1000;
+    }
+    ssize_t rt = write(out, &rep, sizeof(rep));
+    (void)rt;
+    return 0;
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %ld, "
+                "\"value\": %.2f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.threads, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "b:t:c:d:s:j:")) != -1) {
+        switch(opt) {
+        case 'b': s_backend = optarg; break;
+        case 't': s_threads = atoi(optarg); break;
+        case 'c': s_conns = atoi(optarg); break;
+        case 'd': s_seconds = atoi(optarg); break;
+        case 's': s_msgSize = std::max(1, atoi(optarg)); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-b epoll|io_uring] [-t threads] [-c conns] [-d seconds] "
+                    "[-s bytes] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 服务端和客户端各需要一个连接一个fd
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_cur != RLIM_INFINITY && (rlim_t)s_conns + 64 > rl.rlim_cur) {
+        s_conns = rl.rlim_cur - 64;
+        fprintf(stderr, "RLIMIT_NOFILE=%ld, connections reduced to %d\n", (long)rl.rlim_cur, s_conns);
+    }
+
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(bind(lfd, (sockaddr*)&addr, sizeof(addr)) || listen(lfd, 65535)
+            || getsockname(lfd, (sockaddr*)&addr, &len)) {
+        perror("listen");
+        return 1;
+    }
+
+    // 在创建任何线程之前fork
+    int pipefd[2];
+    if(pipe(pipefd)) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t pid = fork();
+    if(pid == 0) {
+        close(lfd);
+        close(pipefd[0]);
+        _exit(RunClients(ntohs(addr.sin_port), pipefd[1]));
+    }
+    close(pipefd[1]);
+
+    double cpu0 = cpu_us();
+    ZnetServer::Config::Lookup<std::string>("iomanager.backend")->setValue(s_backend);
+    ZnetServer::IOManager iom(s_threads, false, "echo");
+    if(iom.getBackend() != (s_backend == "io_uring" ? ZnetServer::IOManager::IO_URING
+                                                    : ZnetServer::IOManager::EPOLL)) {
+        s_backend = "epoll";
+    }
+    iom.start();
+    iom.schedule([lfd]() { AcceptLoop(lfd); });
+
+    ClientReport rep;
+    memset(&rep, 0, sizeof(rep));
+    ssize_t n = read(pipefd[0], &rep, sizeof(rep));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    double cpu = cpu_us() - cpu0;
+    close(pipefd[0]);
+
+    s_stop = true;
+    iom.cancelAll(lfd);
+    // 客户端退出后所有连接读到EOF，stop等它们的事件都结束
+    iom.stop();
+    close(lfd);
+    if(n != (ssize_t)sizeof(rep) || status != 0) {
+        fprintf(stderr, "client failed, accepted=%ld\n", s_accepted.load());
+        return 1;
+    }
+
+    printf("cpus: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-22s %8s %10s %14s\n", "bench", "threads", "iters", "result");
+    Add("conns", rep.conns, s_accepted, "conns");
+    Add("connect", rep.conns, rep.connect_ms, "ms");
+    Add("rps", rep.requests, rep.requests / rep.seconds, "req/s");
+    Add("lat_avg", rep.requests, rep.lat_avg, "us");
+    Add("lat_p50", rep.requests, rep.lat_p50, "us");
+    Add("lat_p99", rep.requests, rep.lat_p99, "us");
+    Add("server_cpu", rep.requests, cpu / std::max(1L, rep.requests), "cpu_us/req");
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
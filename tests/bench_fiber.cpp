@@ -0,0 +1,265 @@
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../server/fiber.h"
+#include "../server/scheduler.h"
+#include "../server/context.h"
+#include "../server/log.h"
+
+// Fiber微基准，用来评估上下文切换后端和栈分配器的改动
+// 用法: bench_fiber [-n 迭代次数] [-p 挂起协程数] [-j 输出JSON的文件, -表示标准输出]
+//   create_destroy  创建+析构一个(未运行的)协程
+//   create_run      创建、运行到结束、析构
+//   round_trip      swapIn + Yield 一次往返
+//   reset           已结束的协程reset后再跑一次
+//   parked_rss      大量挂起协程时每个协程的常驻内存，子进程里测
+//   pingpong_direct 同线程两个协程经主协程交替切换
+//   pingpong_sched  同一工作线程上两个协程用Park/Unpark互相唤醒
+
+struct Result {
+    std::string name;
+    size_t stack_size;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Result> s_results;
+static long s_iterations = 200000;
+static long s_parked = 10000;
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Add(const std::string& name, size_t stack_size, long n, double value, const char* unit) {
+    Result r = {name, stack_size, n, value, unit};
+    s_results.push_back(r);
+    printf("%-18s %10zu %10ld %14.1f %s\n", name.c_str(), stack_size, n, value, unit);
+    fflush(stdout);
+}
+
+static void Nop() {}
+
+static void Looper() {
+    while(true) {
+        ZnetServer::Fiber::Yield();
+    }
+}
+
+static void bench_create_destroy(size_t stack_size) {
+    long n = s_iterations;
+    double begin = now_ns();
+    for(long i = 0; i < n; ++i) {
+        ZnetServer::Fiber::ptr f(new ZnetServer::Fiber(&Nop, stack_size));
+    }
+    Add("create_destroy", stack_size, n, (now_ns() - begin) / n, "ns/op");
+}
+
+static void bench_create_run(size_t stack_size) {
+    long n = s_iterations;
+    double begin = now_ns();
+    for(long i = 0; i < n; ++i) {
+        ZnetServer::Fiber::ptr f(new ZnetServer::Fiber(&Nop, stack_size));
+        f->swapIn();
+    }
+    Add("create_run", stack_size, n, (now_ns() - begin) / n, "ns/op");
+}
+
+static void bench_round_trip(size_t stack_size) {
+    long n = s_iterations * 5;
+    ZnetServer::Fiber::ptr f(new ZnetServer::Fiber(&Looper, stack_size));
+    f->swapIn();
+    double begin = now_ns();
+    for(long i = 0; i < n; ++i) {
+        f->swapIn();
+    }
+    Add("round_trip", stack_size, n, (now_ns() - begin) / n, "ns/op");
+}
+
+static void bench_reset(size_t stack_size) {
+    long n = s_iterations;
+    ZnetServer::Fiber::ptr f(new ZnetServer::Fiber(&Nop, stack_size));
+    f->swapIn();
+    double begin = now_ns();
+    for(long i = 0; i < n; ++i) {
+        f->reset(&Nop);
+        f->swapIn();
+    }
+    Add("reset", stack_size, n, (now_ns() - begin) / n, "ns/op");
+}
+
+static size_t ReadRssKB() {
+    FILE* fp = fopen("/proc/self/status", "r");
+    if(!fp) {
+        return 0;
+    }
+    char line[256];
+    size_t val = 0;
+    while(fgets(line, sizeof(line), fp)) {
+        if(strncmp(line, "VmRSS:", 6) == 0) {
+            val = strtoul(line + 7, nullptr, 10);
+            break;
+        }
+    }
+    fclose(fp);
+    return val;
+}
+
+// 挂起前用掉一点栈，模拟真实的处理函数
+static void Parked() {
+    volatile char buf[512];
+    memset((char*)buf, 1, sizeof(buf));
+    ZnetServer::Fiber::Yield();
+}
+
+static void bench_parked_rss(size_t stack_size) {
+    int fds[2];
+    if(pipe(fds) != 0) {
+        return;
+    }
+    pid_t pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        ZnetServer::Fiber::GetThis();
+        std::vector<ZnetServer::Fiber::ptr> fibers;
+        fibers.reserve(s_parked);
+        size_t rss0 = ReadRssKB();
+        for(long i = 0; i < s_parked; ++i) {
+            ZnetServer::Fiber::ptr f(new ZnetServer::Fiber(&Parked, stack_size));
+            f->swapIn();
+            fibers.push_back(f);
+        }
+        double per = (ReadRssKB() - rss0) * 1024.0 / s_parked;
+        ssize_t rt = write(fds[1], &per, sizeof(per));
+        (void)rt;
+        _exit(0);
+    }
+    close(fds[1]);
+    double per = -1;
+    ssize_t rt = read(fds[0], &per, sizeof(per));
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+    if(rt != sizeof(per)) {
+        printf("%-18s %10zu  child failed\n", "parked_rss", stack_size);
+        return;
+    }
+    Add("parked_rss", stack_size, s_parked, per, "B/fiber");
+}
+
+static void bench_pingpong_direct() {
+    long n = s_iterations * 5;
+    long ball = 0;
+    ZnetServer::Fiber::ptr a(new ZnetServer::Fiber([&ball]() {
+        while(true) { ++ball; ZnetServer::Fiber::Yield(); }
+    }));
+    ZnetServer::Fiber::ptr b(new ZnetServer::Fiber([&ball]() {
+        while(true) { ++ball; ZnetServer::Fiber::Yield(); }
+    }));
+    double begin = now_ns();
+    for(long i = 0; i < n; ++i) {
+        a->swapIn();
+        b->swapIn();
+    }
+    // 一次来回是a、b各被切入一次
+    Add("pingpong_direct", 0, n, (now_ns() - begin) / n, "ns/round");
+}
+
+static void bench_pingpong_sched() {
+    long n = s_iterations;
+    ZnetServer::Scheduler sc(1, false, "pingpong");
+    std::atomic<bool> done {false};
+    ZnetServer::Fiber::ptr a;
+    ZnetServer::Fiber::ptr b;
+    double begin = 0;
+    double end = 0;
+    b.reset(new ZnetServer::Fiber([&]() {
+        for(long i = 0; i < n; ++i) {
+            ZnetServer::Scheduler::Park();
+            ZnetServer::Scheduler::Unpark(a);
+        }
+    }));
+    a.reset(new ZnetServer::Fiber([&]() {
+        begin = now_ns();
+        for(long i = 0; i < n; ++i) {
+            ZnetServer::Scheduler::Unpark(b);
+            ZnetServer::Scheduler::Park();
+        }
+        end = now_ns();
+        done = true;
+    }));
+    sc.start();
+    sc.schedule(b);
+    sc.schedule(a);
+    while(!done) {
+        usleep(1000);
+    }
+    sc.stop();
+    Add("pingpong_sched", 0, n, (end - begin) / n, "ns/round");
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"backend\": \"%s\",\n  \"results\": [\n", ZnetServer::Context::BackendName());
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"stack_size\": %zu, \"iterations\": %ld, "
+                "\"value\": %.2f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.stack_size, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "n:p:j:")) != -1) {
+        switch(opt) {
+        case 'n': s_iterations = atol(optarg); break;
+        case 'p': s_parked = atol(optarg); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-p parked] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ZnetServer::Fiber::GetThis();
+    printf("backend: %s\n", ZnetServer::Context::BackendName());
+    printf("%-18s %10s %10s %14s\n", "bench", "stack", "iters", "result");
+    const size_t sizes[] = {16 * 1024, 64 * 1024, 128 * 1024, 1024 * 1024};
+    for(size_t size : sizes) {
+        bench_create_destroy(size);
+        bench_create_run(size);
+        bench_round_trip(size);
+        bench_reset(size);
+        bench_parked_rss(size);
+    }
+    bench_pingpong_direct();
+    bench_pingpong_sched();
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../server/parallel.h"
+#include "../server/scheduler.h"
+#include "../server/log.h"
+
+// ParallelFor/ParallelReduce和单线程循环对比
+// 用法: bench_parallel [-t 线程数] [-n 元素个数] [-g grain, 0自动] [-r 重复次数] [-j 输出JSON的文件, -表示标准输出]
+//   transform  out[i] = f(in[i])，主要是内存带宽
+//   reduce     求和
+//   encode     每个元素格式化成定长十进制文本，模拟批量编码响应
+// 并行组从主线程发起，主线程在wait()里也执行子区间
+
+struct Result {
+    std::string name;
+    int threads;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Result> s_results;
+static int s_threads = 4;
+static long s_count = 1 << 24;
+static size_t s_grain = 0;
+static int s_repeat = 3;
+
+static double now_sec() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Add(const std::string& name, long n, double value, const char* unit) {
+    Result r = {name, s_threads, n, value, unit};
+    s_results.push_back(r);
+    printf("%-22s %8d %10ld %14.3f %s\n", name.c_str(), s_threads, n, value, unit);
+    fflush(stdout);
+}
+
+// 取s_repeat次中最快的一次，单位ms
+template<class F>
+static double Best(F fn) {
+    double best = 1e30;
+    for(int i = 0; i < s_repeat; ++i) {
+        double begin = now_sec();
+        fn();
+        double t = (now_sec() - begin) * 1e3;
+        if(t < best) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void Report(const char* name, double serial, double parallel, bool ok) {
+    Add(std::string(name) + "_serial", s_count, serial, "ms");
+    Add(std::string(name) + "_parallel", s_count, parallel, "ms");
+    Add(std::string(name) + "_speedup", s_count, serial / parallel, "x");
+    if(!ok) {
+        fprintf(stderr, "%s: parallel result differs from serial\n", name);
+    }
+}
+
+static inline double Transform(double x) {
+    return sqrt(x) * 1.5 + x * 0.25;
+}
+
+static void bench_transform(ZnetServer::Scheduler& sc, const std::vector<double>& in) {
+    std::vector<double> a(in.size()), b(in.size());
+    double serial = Best([&](){
+        for(size_t i = 0; i < in.size(); ++i) {
+            a[i] = Transform(in[i]);
+        }
+    });
+    double parallel = Best([&](){
+        ZnetServer::ParallelFor(&sc, 0, in.size(), s_grain, [&](size_t lo, size_t hi){
+            for(size_t i = lo; i < hi; ++i) {
+                b[i] = Transform(in[i]);
+            }
+        });
+    });
+    Report("transform", serial, parallel, a == b);
+}
+
+static void bench_reduce(ZnetServer::Scheduler& sc, const std::vector<double>& in) {
+    // 整数求和，结果和切分无关
+    std::vector<uint64_t> v(in.begin(), in.end());
+    uint64_t s1 = 0, s2 = 0;
+    double serial = Best([&](){
+        uint64_t s = 0;
+        for(size_t i = 0; i < v.size(); ++i) {
+            s += v[i];
+        }
+        s1 = s;
+    });
+    double parallel = Best([&](){
+        s2 = ZnetServer::ParallelReduce<uint64_t>(&sc, 0, v.size(), s_grain, 0,
+            [&](size_t lo, size_t hi){
+                uint64_t s = 0;
+                for(size_t i = lo; i < hi; ++i) {
+                    s += v[i];
+                }
+                return s;
+            },
+            [](uint64_t x, uint64_t y){ return x + y; });
+    });
+    Report("reduce", serial, parallel, s1 == s2);
+}
+
+static const size_t WIDTH = 12;
+
+static void Encode(const std::vector<double>& in, std::vector<char>& out, size_t lo, size_t hi) {
+    char buf[32];
+    for(size_t i = lo; i < hi; ++i) {
+        snprintf(buf, sizeof(buf), "%11.3f,", in[i]);
+        memcpy(&out[i * WIDTH], buf, WIDTH);
+    }
+}
+
+static void bench_encode(ZnetServer::Scheduler& sc, const std::vector<double>& in) {
+    std::vector<char> a(in.size() * WIDTH), b(in.size() * WIDTH);
+    double serial = Best([&](){
+        Encode(in, a, 0, in.size());
+    });
+    double parallel = Best([&](){
+        ZnetServer::ParallelFor(&sc, 0, in.size(), s_grain, [&](size_t lo, size_t hi){
+            Encode(in, b, lo, hi);
+        });
+    });
+    Report("encode", serial, parallel, a == b);
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %ld, "
+                "\"value\": %.3f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.threads, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "t:n:g:r:j:")) != -1) {
+        switch(opt) {
+        case 't': s_threads = atoi(optarg); break;
+        case 'n': s_count = atol(optarg); break;
+        case 'g': s_grain = strtoul(optarg, nullptr, 10); break;
+        case 'r': s_repeat = atoi(optarg); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n count] [-g grain] [-r repeat] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<double> in(s_count);
+    for(long i = 0; i < s_count; ++i) {
+        in[i] = (double)((i * 2654435761u) % 1000003);
+    }
+
+    ZnetServer::Scheduler sc(s_threads, false, "parallel");
+    sc.start();
+    printf("cpus: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-22s %8s %10s %14s\n", "bench", "threads", "elements", "result");
+    bench_transform(sc, in);
+    bench_reduce(sc, in);
+    bench_encode(sc, in);
+    sc.stop();
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../server/scheduler.h"
+#include "../server/config.h"
+#include "../server/log.h"
+
+// 后台任务占满线程池时前台请求的排队延迟
+// 用法: bench_priority [-t 线程数] [-n 请求数] [-w 后台任务微秒] [-j 输出JSON的文件, -表示标准输出]
+//   后台: 每个线程16条链，每个任务忙等-w微秒后再提交下一个，队列里始终积压着后台任务
+//   前台: 主线程每200us提交一个请求，记录提交到开始执行的时间
+//   alone        只有前台请求
+//   all_normal   前台和后台都是NORMAL(不区分优先级时的现状)
+//   strict       前台HIGH、后台LOW，scheduler.priority_policy=strict
+//   weighted     同上，scheduler.priority_policy=weighted(16:4:1)
+//   每组还给出后台吞吐，以及调度器统计的LOW排队时间(饥饿保护的效果)
+
+struct Result {
+    std::string name;
+    int threads;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Result> s_results;
+static int s_threads = 4;
+static long s_requests = 5000;
+static long s_workUs = 50;
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Add(const std::string& name, long n, double value, const char* unit) {
+    Result r = {name, s_threads, n, value, unit};
+    s_results.push_back(r);
+    printf("%-22s %8d %10ld %14.1f %s\n", name.c_str(), s_threads, n, value, unit);
+    fflush(stdout);
+}
+
+static void AddLatency(const std::string& name, std::vector<double>& lat) {
+    std::sort(lat.begin(), lat.end());
+    double sum = 0;
+    for(double v : lat) {
+        sum += v;
+    }
+    long n = lat.size();
+    Add(name + "_avg", n, sum / n / 1000, "us");
+    Add(name + "_p50", n, lat[n / 2] / 1000, "us");
+    Add(name + "_p99", n, lat[n * 99 / 100] / 1000, "us");
+}
+
+static void Spin(long us) {
+    double end = now_ns() + us * 1000.0;
+    while(now_ns() < end) {
+    }
+}
+
+static void bench_priority(const std::string& name, const char* policy, bool background,
+                           ZnetServer::Scheduler::Priority fg, ZnetServer::Scheduler::Priority bg) {
+    ZnetServer::Config::Lookup<std::string>("scheduler.priority_policy")->setValue(policy);
+    ZnetServer::Scheduler sc(s_threads, false, "priority");
+    sc.start();
+
+    std::atomic<bool> running {true};
+    std::atomic<int> chains {0};
+    std::atomic<long> bg_done {0};
+    std::function<void()> chain = [&](){
+        Spin(s_workUs);
+        ++bg_done;
+        if(running) {
+            sc.schedule(chain, bg);
+        } else {
+            --chains;
+        }
+    };
+    if(background) {
+        for(int i = 0; i < s_threads * 16; ++i) {
+            ++chains;
+            sc.schedule(chain, bg);
+        }
+        usleep(100 * 1000);
+    }
+
+    std::vector<double> lat(s_requests);
+    std::atomic<long> done {0};
+    long bg_begin = bg_done;
+    double begin = now_ns();
+    for(long i = 0; i < s_requests; ++i) {
+        double submit = now_ns();
+        sc.schedule([&lat, &done, i, submit](){
+            lat[i] = now_ns() - submit;
+            ++done;
+        }, fg);
+        usleep(200);
+    }
+    while(done < s_requests) {
+        usleep(1000);
+    }
+    double seconds = (now_ns() - begin) / 1e9;
+    long bg_count = bg_done - bg_begin;
+    running = false;
+    while(chains > 0) {
+        usleep(1000);
+    }
+    sc.stop();
+
+    AddLatency(name, lat);
+    if(background) {
+        Add(name + "_bg", bg_count, bg_count / seconds, "task/s");
+        ZnetServer::Scheduler::QueueWaitStats st = sc.getQueueWaitStats(bg);
+        if(st.count) {
+            Add(name + "_bg_wait_p99", st.count, st.p99_us, "us");
+        }
+    }
+    ZnetServer::Config::Lookup<std::string>("scheduler.priority_policy")->setValue("strict");
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %ld, "
+                "\"value\": %.2f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.threads, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "t:n:w:j:")) != -1) {
+        switch(opt) {
+        case 't': s_threads = atoi(optarg); break;
+        case 'n': s_requests = atol(optarg); break;
+        case 'w': s_workUs = atol(optarg); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n requests] [-w work_us] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("cpus: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-22s %8s %10s %14s\n", "bench", "threads", "iters", "result");
+    bench_priority("alone", "strict", false, ZnetServer::Scheduler::NORMAL, ZnetServer::Scheduler::NORMAL);
+    bench_priority("all_normal", "strict", true, ZnetServer::Scheduler::NORMAL, ZnetServer::Scheduler::NORMAL);
+    bench_priority("strict", "strict", true, ZnetServer::Scheduler::HIGH, ZnetServer::Scheduler::LOW);
+    bench_priority("weighted", "weighted", true, ZnetServer::Scheduler::HIGH, ZnetServer::Scheduler::LOW);
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../server/scheduler.h"
+#include "../server/log.h"
+
+// Scheduler吞吐随线程数的扩展性
+// 用法: bench_scheduler [-d 树深度] [-n 外部提交任务数] [-j 输出JSON的文件, -表示标准输出] [线程数...]
+//   fork_join  一个根任务递归地各调度两个子任务，任务都由工作线程提交(本地队列 + 窃取)
+//   external   主线程从调度器外部提交全部任务(注入队列)
+// 任务本身是空的，测的是调度开销。完成计数按线程分槽，避免计数本身成为瓶颈
+
+static const int SLOTS = 128;
+
+struct alignas(64) Counter {
+    std::atomic<long> value;
+    char pad[64 - sizeof(std::atomic<long>)];
+};
+static Counter s_done[SLOTS];
+static std::atomic<int> s_next_slot {0};
+static thread_local int t_slot = -1;
+
+static void Done() {
+    if(t_slot < 0) {
+        t_slot = s_next_slot++ % SLOTS;
+    }
+    s_done[t_slot].value.fetch_add(1, std::memory_order_relaxed);
+}
+
+static long TotalDone() {
+    long n = 0;
+    for(int i = 0; i < SLOTS; ++i) {
+        n += s_done[i].value.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+static void ResetDone() {
+    for(int i = 0; i < SLOTS; ++i) {
+        s_done[i].value = 0;
+    }
+}
+
+static double now_sec() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void WaitDone(long total) {
+    while(TotalDone() < total) {
+        usleep(100);
+    }
+}
+
+static void Spawn(ZnetServer::Scheduler* sc, int depth) {
+    if(depth > 0) {
+        sc->schedule([sc, depth]() { Spawn(sc, depth - 1); });
+        sc->schedule([sc, depth]() { Spawn(sc, depth - 1); });
+    }
+    Done();
+}
+
+static double bench_fork_join(int threads, int depth) {
+    long total = (1L << (depth + 1)) - 1;
+    ZnetServer::Scheduler sc(threads, false, "fj");
+    sc.start();
+    ResetDone();
+    double begin = now_sec();
+    sc.schedule([&sc, depth]() { Spawn(&sc, depth); });
+    WaitDone(total);
+    double sec = now_sec() - begin;
+    sc.stop();
+    return total / sec;
+}
+
+static double bench_external(int threads, long n) {
+    ZnetServer::Scheduler sc(threads, false, "ext");
+    sc.start();
+    ResetDone();
+    double begin = now_sec();
+    for(long i = 0; i < n; ++i) {
+        sc.schedule(&Done);
+    }
+    WaitDone(n);
+    double sec = now_sec() - begin;
+    sc.stop();
+    return n / sec;
+}
+
+struct Row {
+    int threads;
+    double fork_join;
+    double external;
+};
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    int depth = 19;
+    long external = 1000000;
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "d:n:j:")) != -1) {
+        switch(opt) {
+        case 'd': depth = atoi(optarg); break;
+        case 'n': external = atol(optarg); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-d depth] [-n tasks] [-j file|-] [threads...]\n", argv[0]);
+            return 1;
+        }
+    }
+    std::vector<int> counts;
+    for(int i = optind; i < argc; ++i) {
+        counts.push_back(atoi(argv[i]));
+    }
+    if(counts.empty()) {
+        int def[] = {1, 2, 4, 8, 16, 32, 64};
+        counts.assign(def, def + sizeof(def) / sizeof(def[0]));
+    }
+
+    printf("cpus: %ld, fork_join tasks: %ld, external tasks: %ld\n",
+           sysconf(_SC_NPROCESSORS_ONLN), (1L << (depth + 1)) - 1, external);
+    printf("%8s %16s %10s %16s %10s\n", "threads", "fork_join(/s)", "speedup", "external(/s)", "speedup");
+    std::vector<Row> rows;
+    for(int n : counts) {
+        Row r = {n, bench_fork_join(n, depth), bench_external(n, external)};
+        rows.push_back(r);
+        printf("%8d %16.0f %10.2f %16.0f %10.2f\n", n, r.fork_join, r.fork_join / rows[0].fork_join,
+               r.external, r.external / rows[0].external);
+        fflush(stdout);
+    }
+
+    if(json) {
+        FILE* fp = strcmp(json, "-") == 0 ? stdout : fopen(json, "w");
+        if(!fp) {
+            perror(json);
+            return 1;
+        }
+        fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+        for(size_t i = 0; i < rows.size(); ++i) {
+            fprintf(fp, "    {\"threads\": %d, \"fork_join_per_sec\": %.0f, \"external_per_sec\": %.0f}%s\n",
+                    rows[i].threads, rows[i].fork_join, rows[i].external, i + 1 < rows.size() ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+        if(fp != stdout) {
+            fclose(fp);
+        }
+    }
+    return 0;
+}
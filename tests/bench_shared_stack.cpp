@@ -0,0 +1,93 @@
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../server/fiber.h"
+#include "../server/log.h"
+
+// 大量挂起协程的内存占用: 私有栈 vs 共享栈
+// 用法: bench_shared_stack [N...]，默认 100000 1000000
+// 每组在单独的子进程里测，互不影响
+
+static size_t ReadStatusKB(const char* key) {
+    FILE* fp = fopen("/proc/self/status", "r");
+    if(!fp) {
+        return 0;
+    }
+    char line[256];
+    size_t len = strlen(key);
+    size_t val = 0;
+    while(fgets(line, sizeof(line), fp)) {
+        if(strncmp(line, key, len) == 0) {
+            val = strtoul(line + len + 1, nullptr, 10);
+            break;
+        }
+    }
+    fclose(fp);
+    return val;
+}
+
+// 模拟一个处理连接的协程: 用掉一点栈，然后挂起等待
+static void Handler() {
+    volatile char buf[512];
+    memset((char*)buf, 1, sizeof(buf));
+    ZnetServer::Fiber::Yield();
+}
+
+static void RunOne(bool shared, long n) {
+    ZnetServer::Fiber::GetThis();
+    size_t vm0 = ReadStatusKB("VmSize:");
+    size_t rss0 = ReadStatusKB("VmRSS:");
+    std::vector<ZnetServer::Fiber::ptr> fibers;
+    fibers.reserve(n);
+    long created = 0;
+    try {
+        for(; created < n; ++created) {
+            ZnetServer::Fiber::ptr f(new ZnetServer::Fiber(&Handler, 0, false, shared));
+            f->swapIn();
+            fibers.push_back(f);
+        }
+    } catch(const std::exception& e) {
+        fprintf(stderr, "%s: failed after %ld fibers: %s\n",
+                shared ? "shared" : "private", created, e.what());
+    }
+    size_t vm = ReadStatusKB("VmSize:") - vm0;
+    size_t rss = ReadStatusKB("VmRSS:") - rss0;
+    printf("%-8s %10ld %10ld %12.1f %12.1f %12.0f\n", shared ? "shared" : "private",
+           n, created, vm / 1024.0, rss / 1024.0,
+           created ? rss * 1024.0 / created : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    std::vector<long> counts;
+    for(int i = 1; i < argc; ++i) {
+        counts.push_back(atol(argv[i]));
+    }
+    if(counts.empty()) {
+        counts.push_back(100000);
+        counts.push_back(1000000);
+    }
+    printf("%-8s %10s %10s %12s %12s %12s\n", "mode", "fibers", "created", "VM(MB)", "RSS(MB)", "RSS/fiber(B)");
+    fflush(stdout);
+    for(long n : counts) {
+        for(int shared = 0; shared < 2; ++shared) {
+            pid_t pid = fork();
+            if(pid == 0) {
+                RunOne(shared, n);
+                _exit(0);
+            }
+            int status = 0;
+            waitpid(pid, &status, 0);
+            if(!WIFEXITED(status)) {
+                printf("%-8s %10ld  crashed, signal=%d\n", shared ? "shared" : "private", n,
+                       WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+            }
+        }
+    }
+    return 0;
+}
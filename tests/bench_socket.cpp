@@ -0,0 +1,335 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../server/socket.h"
+#include "../server/iomanager.h"
+#include "../server/histogram.h"
+#include "../server/util.h"
+#include "../server/log.h"
+
+// Socket类在回环上的echo
+// 用法: bench_socket [-f tcp4|tcp6|unix] [-t 线程数] [-c 并发连接数] [-d 每项秒数]
+//                    [-s 消息字节数] [-j 输出JSON的文件, -表示标准输出]
+// 服务端和客户端都用Socket，各自在一个IOManager上每个连接一个协程。客户端在fork出的子进程里。
+//   conn_rate  -c个协程循环 建连-发一条消息-收回显-关闭，每秒完成的连接数
+//              (IP连接用SO_LINGER{1,0}关闭，不留TIME_WAIT耗尽端口)
+//   msg_rate   -c条长连接各自一问一答，每秒完成的消息数
+//   lat        消息往返延迟
+
+using ZnetServer::Address;
+using ZnetServer::IPv4Address;
+using ZnetServer::IPv6Address;
+using ZnetServer::UnixAddress;
+using ZnetServer::Socket;
+
+struct Result {
+    std::string name;
+    int threads;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+// 子进程通过管道交回的结果
+struct ClientReport {
+    long conns;
+    double conn_seconds;
+    long conn_errors;
+    long msgs;
+    double msg_seconds;
+    double lat_avg;
+    double lat_p50;
+    double lat_p99;
+};
+
+static std::vector<Result> s_results;
+static std::string s_family = "tcp4";
+static int s_threads = 2;
+static int s_conns = 64;
+static int s_seconds = 2;
+static int s_msgSize = 64;
+static std::atomic<long> s_accepted {0};
+
+static void Add(const std::string& name, long n, double value, const char* unit) {
+    std::string full = s_family + "_" + name;
+    Result r = {full, s_threads, n, value, unit};
+    s_results.push_back(r);
+    printf("%-22s %8d %10ld %14.1f %s\n", full.c_str(), s_threads, n, value, unit);
+    fflush(stdout);
+}
+
+static void wait_done(std::atomic<int>& done, int n) {
+    while(done < n) {
+        usleep(1000);
+    }
+}
+
+static bool SendAll(Socket::ptr sock, const char* buf, size_t len) {
+    while(len) {
+        ssize_t n = sock->send(buf, len);
+        if(n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool RecvAll(Socket::ptr sock, char* buf, size_t len) {
+    while(len) {
+        ssize_t n = sock->recv(buf, len);
+        if(n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void HandleConn(Socket::ptr conn) {
+    std::vector<char> buf(4096);
+    while(true) {
+        ssize_t n = conn->recv(&buf[0], buf.size());
+        if(n <= 0 || !SendAll(conn, &buf[0], n)) {
+            break;
+        }
+    }
+}
+
+static void AcceptLoop(Socket::ptr server) {
+    ZnetServer::IOManager* iom = ZnetServer::IOManager::GetThis();
+    while(true) {
+        Socket::ptr conn = server->accept();
+        if(conn) {
+            ++s_accepted;
+            iom->schedule([conn]() { HandleConn(conn); });
+        } else if(ZnetServer::GetErrno() != EINTR && ZnetServer::GetErrno() != ECONNABORTED) {
+            // 主进程close时以ECANCELED或EBADF退出
+            break;
+        }
+    }
+}
+
+static Socket::ptr Connect(Address::ptr addr) {
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if(!sock->connect(addr, 3000)) {
+        return nullptr;
+    }
+    return sock;
+}
+
+// 子进程: 先测短连接，再测长连接
+static int RunClients(Address::ptr addr, int out) {
+    ClientReport rep;
+    memset(&rep, 0, sizeof(rep));
+    ZnetServer::IOManager iom(s_threads, false, "client");
+    iom.start();
+    std::vector<char> msg(s_msgSize, 'x');
+
+    std::atomic<int> done {0};
+    std::atomic<long> conns {0};
+    std::atomic<long> errors {0};
+    bool ip = addr->getFamily() != AF_UNIX;
+    uint64_t begin = ZnetServer::GetCurrentNS();
+    uint64_t end = begin + s_seconds * 1000000000ull;
+    for(int i = 0; i < s_conns; ++i) {
+        iom.schedule([&]() {
+            std::vector<char> buf(s_msgSize);
+            while(ZnetServer::GetCurrentNS() < end) {
+                Socket::ptr sock = Connect(addr);
+                if(!sock || !SendAll(sock, &msg[0], msg.size())
+                        || !RecvAll(sock, &buf[0], buf.size())) {
+                    ++errors;
+                    continue;
+                }
+                if(ip) {
+                    linger lg = {1, 0};
+                    sock->setOption(SOL_SOCKET, SO_LINGER, lg);
+                }
+                sock->close();
+                ++conns;
+            }
+            ++done;
+        });
+    }
+    wait_done(done, s_conns);
+    rep.conns = conns;
+    rep.conn_errors = errors;
+    rep.conn_seconds = (ZnetServer::GetCurrentNS() - begin) / 1e9;
+
+    done = 0;
+    std::vector<std::unique_ptr<ZnetServer::Histogram> > hists;
+    for(int i = 0; i < s_conns; ++i) {
+        hists.emplace_back(new ZnetServer::Histogram);
+    }
+    std::atomic<long> msgs {0};
+    begin = ZnetServer::GetCurrentNS();
+    end = begin + s_seconds * 1000000000ull;
+    for(int i = 0; i < s_conns; ++i) {
+        ZnetServer::Histogram* hist = hists[i].get();
+        iom.schedule([&, hist]() {
+            std::vector<char> buf(s_msgSize);
+            Socket::ptr sock = Connect(addr);
+            long n = 0;
+            uint64_t now = ZnetServer::GetCurrentNS();
+            while(sock && now < end) {
+                uint64_t sent = now;
+                if(!SendAll(sock, &msg[0], msg.size()) || !RecvAll(sock, &buf[0], buf.size())) {
+                    break;
+                }
+                now = ZnetServer::GetCurrentNS();
+                hist->record(now - sent);
+                ++n;
+            }
+            msgs += n;
+            ++done;
+        });
+    }
+    wait_done(done, s_conns);
+    rep.msgs = msgs;
+    rep.msg_seconds = (ZnetServer::GetCurrentNS() - begin) / 1e9;
+    iom.stop();
+
+    std::vector<const ZnetServer::Histogram*> hs;
+    for(auto& h : hists) {
+        hs.push_back(h.get());
+    }
+    ZnetServer::HistogramStats st = ZnetServer::Histogram::Summarize(hs);
+    rep.lat_avg = st.mean / 1000;
+    rep.lat_p50 = st.p50 / 1000.0;
+    rep.lat_p99 = st.p99 / 1000.0;
+    ssize_t rt = write(out, &rep, sizeof(rep));
+    (void)rt;
+    return 0;
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %ld, "
+                "\"value\": %.2f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.threads, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "f:t:c:d:s:j:")) != -1) {
+        switch(opt) {
+        case 'f': s_family = optarg; break;
+        case 't': s_threads = std::max(1, atoi(optarg)); break;
+        case 'c': s_conns = std::max(1, atoi(optarg)); break;
+        case 'd': s_seconds = std::max(1, atoi(optarg)); break;
+        case 's': s_msgSize = std::max(1, atoi(optarg)); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-f tcp4|tcp6|unix] [-t threads] [-c conns] [-d seconds] "
+                    "[-s bytes] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 服务端和客户端各需要一个连接一个fd
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_cur != RLIM_INFINITY && (rlim_t)s_conns * 2 + 64 > rl.rlim_cur) {
+        s_conns = (rl.rlim_cur - 64) / 2;
+        fprintf(stderr, "RLIMIT_NOFILE=%ld, connections reduced to %d\n", (long)rl.rlim_cur, s_conns);
+    }
+
+    Address::ptr bind_addr;
+    if(s_family == "tcp6") {
+        bind_addr = IPv6Address::Create("::1", 0);
+    } else if(s_family == "unix") {
+        // 抽象命名空间，带上pid避免同时运行的实例冲突
+        bind_addr = std::make_shared<UnixAddress>(std::string(1, '\0')
+                                                  + "zns_bench_socket_" + std::to_string(getpid()));
+    } else {
+        s_family = "tcp4";
+        bind_addr = IPv4Address::Create("127.0.0.1", 0);
+    }
+    Socket::ptr server = Socket::CreateTCP(bind_addr);
+    if(!server->bind(bind_addr) || !server->listen(65535)) {
+        perror("listen");
+        return 1;
+    }
+    Address::ptr addr = server->getLocalAddress();
+
+    // 在创建任何线程之前fork
+    int pipefd[2];
+    if(pipe(pipefd)) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t pid = fork();
+    if(pid == 0) {
+        server->close();
+        close(pipefd[0]);
+        _exit(RunClients(addr, pipefd[1]));
+    }
+    close(pipefd[1]);
+
+    ZnetServer::IOManager iom(s_threads, false, "server");
+    iom.start();
+    iom.schedule([server]() { AcceptLoop(server); });
+
+    ClientReport rep;
+    memset(&rep, 0, sizeof(rep));
+    ssize_t n = read(pipefd[0], &rep, sizeof(rep));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    close(pipefd[0]);
+
+    // 取消accept的等待，客户端退出后所有连接读到EOF
+    iom.cancelAll(server->getSocket());
+    iom.stop();
+    server->close();
+    if(n != (ssize_t)sizeof(rep) || status != 0) {
+        fprintf(stderr, "client failed, accepted=%ld\n", s_accepted.load());
+        return 1;
+    }
+
+    printf("cpus: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-22s %8s %10s %14s\n", "bench", "threads", "iters", "result");
+    Add("conn_rate", rep.conns, rep.conns / rep.conn_seconds, "conns/s");
+    Add("conn_errors", rep.conns, rep.conn_errors, "errors");
+    Add("msg_rate", rep.msgs, rep.msgs / rep.msg_seconds, "msgs/s");
+    Add("lat_avg", rep.msgs, rep.lat_avg, "us");
+    Add("lat_p50", rep.msgs, rep.lat_p50, "us");
+    Add("lat_p99", rep.msgs, rep.lat_p99, "us");
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
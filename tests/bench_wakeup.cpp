@@ -0,0 +1,249 @@
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../server/scheduler.h"
+#include "../server/log.h"
+
+// 空闲工作线程的唤醒延迟和空闲开销
+// 用法: bench_wakeup [-t 线程数] [-n 采样次数] [-j 输出JSON的文件, -表示标准输出]
+//   wakeup     所有工作线程都睡着时，外部线程提交一个任务到它开始执行的时间
+//   handoff    固定线程的任务在工作线程间接力，每一跳都要叫醒目标线程
+//   trickle    每1ms提交一个任务，平均每个任务消耗的CPU(包括空转和唤醒)
+//   timer      所有工作线程都睡着时定时器触发比预定时间晚多少
+//   idle       没有任务时1秒内整个进程的CPU占用和上下文切换次数，
+//              idle_timer 同时有一个100ms的循环定时器
+
+struct Result {
+    std::string name;
+    int threads;
+    long iterations;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Result> s_results;
+static int s_threads = 4;
+static long s_samples = 2000;
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpu_us() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec
+         + ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+}
+
+static long ctx_switches() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+static void Add(const std::string& name, long n, double value, const char* unit) {
+    Result r = {name, s_threads, n, value, unit};
+    s_results.push_back(r);
+    printf("%-18s %8d %10ld %14.1f %s\n", name.c_str(), s_threads, n, value, unit);
+    fflush(stdout);
+}
+
+static void AddLatency(const std::string& name, std::vector<double>& lat) {
+    std::sort(lat.begin(), lat.end());
+    double sum = 0;
+    for(double v : lat) {
+        sum += v;
+    }
+    long n = lat.size();
+    Add(name + "_avg", n, sum / n / 1000, "us");
+    Add(name + "_p50", n, lat[n / 2] / 1000, "us");
+    Add(name + "_p99", n, lat[n * 99 / 100] / 1000, "us");
+}
+
+static void bench_wakeup() {
+    ZnetServer::Scheduler sc(s_threads, false, "wakeup");
+    sc.start();
+    std::vector<double> lat;
+    lat.reserve(s_samples);
+    for(long i = 0; i < s_samples; ++i) {
+        // 等工作线程自旋结束睡下
+        usleep(500);
+        std::atomic<double> end {0};
+        double begin = now_ns();
+        sc.schedule([&end]() { end = now_ns(); });
+        while(end.load() == 0) {
+            std::this_thread::yield();
+        }
+        lat.push_back(end - begin);
+    }
+    sc.stop();
+    AddLatency("wakeup", lat);
+}
+
+struct Relay {
+    ZnetServer::Scheduler* sc;
+    long left;
+    std::atomic<bool> done {false};
+};
+
+static void Hop(Relay* r) {
+    if(--r->left <= 0) {
+        r->done = true;
+        return;
+    }
+    int next = (ZnetServer::Scheduler::GetWorkerIndex() + 1) % r->sc->getWorkerCount();
+    r->sc->schedule([r]() { Hop(r); }, next);
+}
+
+static void bench_handoff() {
+    if(s_threads < 2) {
+        return;
+    }
+    ZnetServer::Scheduler sc(s_threads, false, "handoff");
+    sc.start();
+    usleep(10000);
+    Relay r;
+    r.sc = &sc;
+    r.left = s_samples * 10;
+    long n = r.left;
+    double begin = now_ns();
+    sc.schedule([&r]() { Hop(&r); }, 0);
+    while(!r.done) {
+        usleep(100);
+    }
+    double ns = now_ns() - begin;
+    sc.stop();
+    Add("handoff", n, ns / n, "ns/hop");
+}
+
+static void bench_trickle() {
+    ZnetServer::Scheduler sc(s_threads, false, "trickle");
+    sc.start();
+    usleep(10000);
+    long n = std::min(s_samples, 1000L);
+    std::atomic<long> done {0};
+    double cpu0 = cpu_us();
+    for(long i = 0; i < n; ++i) {
+        sc.schedule([&done]() { ++done; });
+        usleep(1000);
+    }
+    while(done < n) {
+        usleep(100);
+    }
+    double cpu = cpu_us() - cpu0;
+    sc.stop();
+    Add("trickle", n, cpu / n, "cpu_us/task");
+}
+
+static void bench_timer() {
+    ZnetServer::Scheduler sc(s_threads, false, "timer");
+    sc.start();
+    long n = std::min(s_samples / 10, 200L);
+    std::vector<double> lat;
+    lat.reserve(n);
+    for(long i = 0; i < n; ++i) {
+        usleep(500);
+        int ms = 1 + i % 20;
+        std::atomic<double> end {0};
+        double expect = now_ns() + ms * 1e6;
+        sc.addTimer(ms, [&end]() { end = now_ns(); });
+        while(end.load() == 0) {
+            usleep(100);
+        }
+        lat.push_back(end - expect);
+    }
+    sc.stop();
+    AddLatency("timer_late", lat);
+}
+
+static void bench_idle_cpu(bool with_timer) {
+    ZnetServer::Scheduler sc(s_threads, false, "idle");
+    sc.start();
+    if(with_timer) {
+        sc.addTimer(100, []() {}, true);
+    }
+    // 先跑一批任务，让线程都经历过自旋再睡下
+    std::atomic<long> done {0};
+    for(int i = 0; i < 1000; ++i) {
+        sc.schedule([&done]() { ++done; });
+    }
+    while(done < 1000) {
+        usleep(100);
+    }
+    usleep(10000);
+    double cpu0 = cpu_us();
+    long cs0 = ctx_switches();
+    double begin = now_ns();
+    sleep(1);
+    double wall = (now_ns() - begin) / 1000;
+    double cpu = cpu_us() - cpu0;
+    long cs = ctx_switches() - cs0;
+    sc.stop();
+    std::string name = with_timer ? "idle_timer" : "idle";
+    Add(name + "_cpu", 1, cpu * 100 / wall, "%");
+    Add(name + "_ctxsw", 1, cs, "/s");
+}
+
+static void WriteJson(FILE* fp) {
+    fprintf(fp, "{\n  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for(size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"threads\": %d, \"iterations\": %ld, "
+                "\"value\": %.2f, \"unit\": \"%s\"}%s\n",
+                r.name.c_str(), r.threads, r.iterations, r.value, r.unit,
+                i + 1 < s_results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::WARN);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::WARN);
+    const char* json = nullptr;
+    int opt;
+    while((opt = getopt(argc, argv, "t:n:j:")) != -1) {
+        switch(opt) {
+        case 't': s_threads = atoi(optarg); break;
+        case 'n': s_samples = atol(optarg); break;
+        case 'j': json = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n samples] [-j file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("cpus: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-18s %8s %10s %14s\n", "bench", "threads", "iters", "result");
+    bench_wakeup();
+    bench_handoff();
+    bench_trickle();
+    bench_timer();
+    bench_idle_cpu(false);
+    bench_idle_cpu(true);
+
+    if(json) {
+        if(strcmp(json, "-") == 0) {
+            WriteJson(stdout);
+        } else {
+            FILE* fp = fopen(json, "w");
+            if(!fp) {
+                perror(json);
+                return 1;
+            }
+            WriteJson(fp);
+            fclose(fp);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "../server/future.h"
+#include "../server/blocking_pool.h"
+#include "../server/util.h"
+#include "../server/log.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+void test_offload(ZnetServer::Scheduler& sc) {
+    // 单个工作线程上8个协程各做一次100ms的阻塞调用，同时另一个协程每10ms打一次点
+    std::atomic<int> done {0};
+    std::atomic<bool> stop {false};
+    std::atomic<uint64_t> max_gap {0};
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    sc.schedule([&](){
+        uint64_t last = ZnetServer::GetCurrentMS();
+        while(!stop) {
+            // 没有hook，借Offload做非阻塞的睡眠
+            ZnetServer::Scheduler::Offload([](){ usleep(10 * 1000); });
+            uint64_t now = ZnetServer::GetCurrentMS();
+            if(now - last > max_gap) {
+                max_gap = now - last;
+            }
+            last = now;
+        }
+    });
+    for(int i = 0; i < 8; ++i) {
+        sc.schedule([&done, i](){
+            int r = ZnetServer::Scheduler::Offload([i](){
+                usleep(100 * 1000);
+                return i * 10;
+            });
+            if(r == i * 10) {
+                ++done;
+            }
+        });
+    }
+    while(done < 8) {
+        usleep(1000);
+    }
+    stop = true;
+    ZNS_LOG_INFO(g_logger) << "offload: 8 x 100ms blocking calls took " << ZnetServer::GetCurrentMS() - begin
+        << "ms, ticker max gap " << max_gap << "ms, pool threads="
+        << ZnetServer::BlockingPool::GetInstance()->getThreadCount();
+
+    ZnetServer::Future<void> f = sc.async([](){
+        try {
+            ZnetServer::Scheduler::Offload([](){ throw std::runtime_error("disk full"); });
+        } catch(const std::exception& e) {
+            ZNS_LOG_INFO(g_logger) << "offload exception: " << e.what();
+        }
+    });
+    f.get();
+    // 不在协程里直接执行
+    std::string s = ZnetServer::Scheduler::Offload([](){ return std::string("inline"); });
+    ZNS_LOG_INFO(g_logger) << "offload outside fiber: " << s;
+}
+
+void test_elastic(ZnetServer::Scheduler& sc) {
+    // 最多2个线程、队列4个: 20个任务提交时要等位置，空闲100ms后回到min_threads
+    ZnetServer::BlockingPool pool("elastic", 1, 2, 4, 100);
+    std::atomic<int> done {0};
+    std::atomic<int> submitted {0};
+    std::atomic<size_t> max_threads {0};
+    sc.schedule([&](){
+        for(int i = 0; i < 20; ++i) {
+            pool.submit([&](){
+                usleep(5 * 1000);
+                size_t n = pool.getThreadCount();
+                if(n > max_threads) {
+                    max_threads = n;
+                }
+                ++done;
+            });
+            ++submitted;
+        }
+    });
+    while(done < 20) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "elastic: submitted=" << submitted << " done=" << done
+        << " max threads=" << max_threads << " full waits=" << pool.getFullWaits();
+    usleep(300 * 1000);
+    ZNS_LOG_INFO(g_logger) << "elastic: threads after idle=" << pool.getThreadCount()
+        << " idle=" << pool.getIdleCount();
+}
+
+// 析构时还在等位置的提交方被唤醒后抛异常，析构等它们都离开submit才返回
+void test_destroy() {
+    ZnetServer::BlockingPool* pool = new ZnetServer::BlockingPool("destroy", 1, 1, 1, 100);
+    pool->submit([](){ usleep(100 * 1000); });
+    pool->submit([](){});
+    std::atomic<int> rejected {0};
+    std::vector<std::thread> submitters;
+    for(int i = 0; i < 3; ++i) {
+        submitters.emplace_back([pool, &rejected](){
+            try {
+                pool->submit([](){});
+            } catch(const std::logic_error&) {
+                ++rejected;
+            }
+        });
+    }
+    while(pool->getFullWaits() < 3) {
+        usleep(1000);
+    }
+    delete pool;
+    for(auto& t : submitters) {
+        t.join();
+    }
+    ZNS_LOG_INFO(g_logger) << "destroy: rejected submitters=" << rejected;
+}
+
+// 共享栈协程: 队列满时挂起等位置，Offload直接在工作线程上执行
+void test_shared_stack(ZnetServer::Scheduler& sc) {
+    ZnetServer::BlockingPool pool("shared", 1, 1, 1, 100);
+    std::atomic<int> ran {0};
+    std::atomic<int> done {0};
+    std::string offload;
+    sc.schedule([&](){
+        int thread = ZnetServer::Scheduler::GetWorkerIndex();
+        for(int i = 0; i < 4; ++i) {
+            ZnetServer::Scheduler::GetThis()->schedule(std::make_shared<ZnetServer::Fiber>([&](){
+                for(int j = 0; j < 5; ++j) {
+                    pool.submit([&ran](){
+                        usleep(2 * 1000);
+                        ++ran;
+                    });
+                }
+                ++done;
+            }, 0, false, true), thread);
+        }
+        ZnetServer::Scheduler::GetThis()->schedule(std::make_shared<ZnetServer::Fiber>([&](){
+            std::string local = "inline";
+            offload = ZnetServer::Scheduler::Offload([&local](){ return local; });
+            ++done;
+        }, 0, false, true), thread);
+    });
+    while(done < 5 || ran < 20) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "shared stack: ran=" << ran << " full waits=" << pool.getFullWaits()
+        << " offload=" << offload;
+}
+
+int main() {
+    ZnetServer::Scheduler sc(1, false, "offload");
+    sc.start();
+    test_offload(sc);
+    test_elastic(sc);
+    test_destroy();
+    test_shared_stack(sc);
+    sc.stop();
+    return 0;
+}
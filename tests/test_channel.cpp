@@ -0,0 +1,231 @@
+#include "../server/channel.h"
+#include "../server/scheduler.h"
+#include "../server/util.h"
+#include "../server/log.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+void test_pipeline(ZnetServer::Scheduler& sc) {
+    // parse -> process -> write，每一级2个协程，级间用小缓冲通道，上游关闭后下游依次退出
+    typedef ZnetServer::Channel<std::string> Chan;
+    Chan::ptr lines = std::make_shared<Chan>(4);
+    ZnetServer::Channel<long>::ptr nums = std::make_shared<ZnetServer::Channel<long> >(4);
+    ZnetServer::Channel<long>::ptr out = std::make_shared<ZnetServer::Channel<long> >(0);
+    const int N = 10000;
+    sc.schedule([lines](){
+        for(int i = 1; i <= N; ++i) {
+            lines->send(std::to_string(i));
+        }
+        lines->close();
+    });
+    std::atomic<int> parsers {2};
+    for(int i = 0; i < 2; ++i) {
+        sc.schedule([lines, nums, &parsers](){
+            std::string s;
+            while(lines->recv(s)) {
+                nums->send(atol(s.c_str()));
+            }
+            if(--parsers == 0) {
+                nums->close();
+            }
+        });
+    }
+    std::atomic<int> workers {2};
+    for(int i = 0; i < 2; ++i) {
+        sc.schedule([nums, out, &workers](){
+            long v;
+            while(nums->recv(v)) {
+                out->send(v * 2);
+            }
+            if(--workers == 0) {
+                out->close();
+            }
+        });
+    }
+    // 普通线程上接收，阻塞的是线程
+    long sum = 0, n = 0, v;
+    while(out->recv(v)) {
+        sum += v;
+        ++n;
+    }
+    ZNS_LOG_INFO(g_logger) << "pipeline: n=" << n << " sum=" << sum << " expect=" << (long)N * (N + 1);
+}
+
+void test_unbuffered(ZnetServer::Scheduler& sc) {
+    // 不带缓冲: send等到对方接手才返回
+    ZnetServer::Channel<int> ch;
+    std::atomic<bool> sent {false};
+    sc.schedule([&](){
+        ch.send(42);
+        sent = true;
+    });
+    usleep(50 * 1000);
+    bool early = sent;
+    int v = 0;
+    ch.recv(v);
+    while(!sent) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "unbuffered: sent before recv=" << early << " value=" << v;
+
+    // 两个协程乒乓
+    ZnetServer::Channel<int> ping, pong;
+    std::atomic<int> rounds {0};
+    sc.schedule([&](){
+        int x;
+        while(ping.recv(x)) {
+            pong.send(x + 1);
+        }
+        pong.close();
+    });
+    int x = 0;
+    for(int i = 0; i < 1000; ++i) {
+        ping.send(x);
+        pong.recv(x);
+        ++rounds;
+    }
+    ping.close();
+    ZNS_LOG_INFO(g_logger) << "ping-pong: rounds=" << rounds << " x=" << x << " closed recv=" << pong.recv(x);
+}
+
+void test_select(ZnetServer::Scheduler& sc) {
+    ZnetServer::Channel<int> a(1), b(0), quit(0);
+    std::atomic<int> got_a {0}, got_b {0};
+    std::atomic<bool> done {false};
+    sc.schedule([&](){
+        int va, vb, q;
+        while(true) {
+            ZnetServer::Select sel;
+            int ia = sel.addRecv(a, va);
+            int ib = sel.addRecv(b, vb);
+            int iq = sel.addRecv(quit, q);
+            int i = sel.wait();
+            if(i == ia) {
+                ++got_a;
+            } else if(i == ib) {
+                ++got_b;
+            } else if(i == iq) {
+                break;
+            }
+        }
+        done = true;
+    });
+    std::thread t([&](){
+        for(int i = 0; i < 500; ++i) {
+            b.send(i);
+        }
+    });
+    for(int i = 0; i < 500; ++i) {
+        a.send(i);
+    }
+    t.join();
+    // 等协程收完a里最后一个缓冲的元素再退出
+    while(a.size()) {
+        usleep(1000);
+    }
+    quit.close();
+    while(!done) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "select: a=" << got_a << " b=" << got_b;
+
+    // 发送分支和default
+    ZnetServer::Channel<int> full(1);
+    int v = 1, w = 2;
+    full.send(0);
+    ZnetServer::Select s2;
+    s2.addSend(full, v);
+    ZNS_LOG_INFO(g_logger) << "select on full channel: tryWait=" << s2.tryWait();
+    int r;
+    full.recv(r);
+    ZnetServer::Select s3;
+    int is = s3.addSend(full, w);
+    ZNS_LOG_INFO(g_logger) << "select send: index=" << s3.wait() << "/" << is << " ok=" << s3.ok()
+        << " size=" << full.size();
+}
+
+void test_close(ZnetServer::Scheduler& sc) {
+    // 关闭唤醒所有等待的接收方，已缓冲的元素照常取出
+    ZnetServer::Channel<int> ch(8);
+    std::atomic<int> woken {0};
+    for(int i = 0; i < 4; ++i) {
+        sc.schedule([&](){
+            int v;
+            while(ch.recv(v)) {
+            }
+            ++woken;
+        });
+    }
+    usleep(20 * 1000);
+    ch.send(1);
+    ch.send(2);
+    ch.close();
+    while(woken < 4) {
+        usleep(1000);
+    }
+    int v = 0;
+    ZNS_LOG_INFO(g_logger) << "close: woken=" << woken << " send after close=" << ch.send(3)
+        << " tryRecv closed=" << (ch.tryRecv(v) == ZnetServer::Channel<int>::CLOSED);
+    try {
+        ch.close();
+    } catch(const std::exception& e) {
+        ZNS_LOG_INFO(g_logger) << "double close: " << e.what();
+    }
+
+    // 等待中的不带缓冲的发送方被关闭唤醒
+    ZnetServer::Channel<int> u;
+    std::atomic<int> result {-1};
+    sc.schedule([&](){ result = u.send(7); });
+    usleep(20 * 1000);
+    u.close();
+    while(result < 0) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "unbuffered send woken by close: " << result;
+}
+
+// 共享栈协程: 能立即完成的收发照常，需要等待时抛出logic_error
+void test_shared_stack(ZnetServer::Scheduler& sc) {
+    ZnetServer::Channel<int> ch(1);
+    std::atomic<bool> done {false};
+    std::string result;
+    sc.schedule([&](){
+        int thread = ZnetServer::Scheduler::GetWorkerIndex();
+        ZnetServer::Scheduler::GetThis()->schedule(std::make_shared<ZnetServer::Fiber>([&](){
+            int v = 0;
+            bool sent = ch.send(5);
+            bool got = ch.recv(v);
+            result = "immediate=" + std::to_string(sent && got && v == 5);
+            try {
+                ch.recv(v);
+                result += " blocked";
+            } catch(const std::logic_error& e) {
+                result += std::string(" rejected: ") + e.what();
+            }
+            done = true;
+        }, 0, false, true), thread);
+    });
+    while(!done) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "shared stack " << result;
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::INFO);
+    ZnetServer::Scheduler sc(4, false, "channel");
+    sc.start();
+    test_pipeline(sc);
+    test_unbuffered(sc);
+    test_select(sc);
+    test_close(sc);
+    test_shared_stack(sc);
+    sc.stop();
+    return 0;
+}
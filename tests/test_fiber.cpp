@@ -1,5 +1,39 @@
 #include "../server/fiber.h"
 #include "../server/log.h"
+#include <vector>
+
+// 共享栈协程交替运行，栈上的局部变量在换出换入之后要保持不变
+void test_shared_stack() {
+    const int N = 16;
+    static int s_results[N];
+    std::vector<ZnetServer::Fiber::ptr> fibers;
+    for(int i = 0; i < N; ++i) {
+        fibers.push_back(std::make_shared<ZnetServer::Fiber>([i](){
+            char buf[1024];
+            int sum = 0;
+            for(int j = 0; j < 5; ++j) {
+                buf[j * 100] = (char)(i + j);
+                sum += i;
+                ZnetServer::Fiber::Yield();
+            }
+            for(int j = 0; j < 5; ++j) {
+                sum += buf[j * 100];
+            }
+            s_results[i] = sum;
+        }, 0, false, true));
+    }
+    for(int round = 0; round < 6; ++round) {
+        for(auto& f : fibers) {
+            f->swapIn();
+        }
+    }
+    bool ok = true;
+    for(int i = 0; i < N; ++i) {
+        ok = ok && s_results[i] == 5 * i + (5 * i + 10);
+    }
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "shared stack fibers ok=" << ok
+        << " saved=" << fibers[0]->getSavedStackSize();
+}
 
 int main() {
     ZnetServer::Fiber::ptr main_fiber = ZnetServer::Fiber::GetThis();
@@ -7,6 +41,8 @@ int main() {
         ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "hello fiber";
     }, 1024 * 128));
     f->swapIn();
-    
+
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    test_shared_stack();
     return 0;
-}
\ No newline at end of file
+}
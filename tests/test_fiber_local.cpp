@@ -0,0 +1,59 @@
+#include "../server/fiber_local.h"
+#include "../server/thread.h"
+#include "../server/log.h"
+#include <atomic>
+#include <string>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+static std::atomic<int> s_destroyed {0};
+
+struct Arena {
+    int bytes = 0;
+    ~Arena() { ++s_destroyed; }
+};
+
+static ZnetServer::FiberLocal<std::string> s_trace_id;
+static ZnetServer::FiberLocal<Arena> s_arena;
+// 下标超出内联槽位的变量
+static ZnetServer::FiberLocal<int> s_extra[10];
+static thread_local std::string t_trace_id;
+
+int main() {
+    ZnetServer::Fiber::GetThis();
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+
+    // 协程里设置的值在迁移到另一个线程后仍然可见，thread_local则不行
+    ZnetServer::Fiber::ptr f(new ZnetServer::Fiber([](){
+        *s_trace_id = "trace-1";
+        t_trace_id = "trace-1";
+        s_arena->bytes = 128;
+        ZnetServer::Fiber::Yield();
+        ZNS_LOG_INFO(g_logger) << "after migrate fiber_local=" << *s_trace_id
+            << " thread_local=" << t_trace_id << " arena=" << s_arena->bytes;
+    }));
+    f->swapIn();
+    ZNS_LOG_INFO(g_logger) << "main fiber has trace id=" << s_trace_id.has();
+
+    ZnetServer::Thread t("fl", [f](){
+        ZnetServer::Fiber::GetThis();
+        f->swapIn();
+    });
+    t.join();
+    ZNS_LOG_INFO(g_logger) << "destroyed on terminate=" << s_destroyed;
+
+    // reset之后值重新构造
+    f->reset([](){
+        ZNS_LOG_INFO(g_logger) << "after reset has trace id=" << s_trace_id.has()
+            << " arena=" << s_arena->bytes;
+    });
+    f->swapIn();
+    ZNS_LOG_INFO(g_logger) << "destroyed total=" << s_destroyed;
+
+    // has/reset不会为没用过的槽位分配空间
+    s_extra[9].reset();
+    ZNS_LOG_INFO(g_logger) << "extra has=" << s_extra[9].has();
+    *s_extra[9] = 7;
+    ZNS_LOG_INFO(g_logger) << "extra has=" << s_extra[9].has() << " value=" << *s_extra[9];
+    return 0;
+}
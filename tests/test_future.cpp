@@ -0,0 +1,131 @@
+#include "../server/future.h"
+#include "../server/log.h"
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+// 模拟一次后端调用: 中途挂起，让出工作线程
+static int backend(ZnetServer::Scheduler* sc, int v) {
+    ZnetServer::Promise<int> p;
+    ZnetServer::Future<int> f = p.getFuture();
+    sc->schedule([v, &p]() { p.setValue(v * 10); });
+    return f.get();
+}
+
+void test_fan_out(ZnetServer::Scheduler& sc) {
+    // 一个请求协程并发调用多个后端，再汇总
+    ZnetServer::Future<int> total = sc.async([&sc]() {
+        std::vector<ZnetServer::Future<int> > calls;
+        for(int i = 1; i <= 8; ++i) {
+            calls.push_back(sc.async([&sc, i]() { return backend(&sc, i); }));
+        }
+        ZnetServer::WhenAll(calls).get();
+        int sum = 0;
+        for(auto& c : calls) {
+            sum += c.get();
+        }
+        return sum;
+    });
+    ZNS_LOG_INFO(g_logger) << "fan out total=" << total.get();
+}
+
+void test_when_any(ZnetServer::Scheduler& sc) {
+    ZnetServer::Promise<std::string> slow;
+    std::vector<ZnetServer::Future<std::string> > fs;
+    fs.push_back(slow.getFuture());
+    fs.push_back(sc.async([]() { return std::string("fast"); }));
+    size_t idx = ZnetServer::WhenAny(fs).get();
+    ZNS_LOG_INFO(g_logger) << "when_any index=" << idx << " value=" << fs[idx].get();
+    slow.setValue("late");
+    ZNS_LOG_INFO(g_logger) << "slow value=" << fs[0].get();
+}
+
+void test_exception(ZnetServer::Scheduler& sc) {
+    ZnetServer::Future<void> f = sc.async([]() { throw std::runtime_error("backend down"); });
+    try {
+        f.get();
+    } catch(const std::exception& e) {
+        ZNS_LOG_INFO(g_logger) << "async exception: " << e.what();
+    }
+    ZnetServer::Future<int> broken;
+    {
+        ZnetServer::Promise<int> p;
+        broken = p.getFuture();
+    }
+    try {
+        broken.get();
+    } catch(const std::exception& e) {
+        ZNS_LOG_INFO(g_logger) << "dropped promise: " << e.what();
+    }
+}
+
+void test_many(ZnetServer::Scheduler& sc) {
+    // 大量Future在协程里等待，不占用工作线程
+    std::atomic<int> done {0};
+    std::vector<ZnetServer::Future<void> > waiters;
+    std::vector<ZnetServer::Promise<int> > promises(1000);
+    for(size_t i = 0; i < promises.size(); ++i) {
+        ZnetServer::Future<int> f = promises[i].getFuture();
+        waiters.push_back(sc.async([f, &done]() mutable {
+            if(f.get() >= 0) {
+                ++done;
+            }
+        }));
+    }
+    for(size_t i = 0; i < promises.size(); ++i) {
+        promises[i].setValue((int)i);
+    }
+    ZnetServer::WhenAll(waiters).wait();
+    ZNS_LOG_INFO(g_logger) << "waiters done=" << done;
+}
+
+// 共享栈协程等待Future，挂起期间栈被别的协程占用
+void test_shared_stack(ZnetServer::Scheduler& sc) {
+    const int per_worker = 100;
+    std::atomic<int> started {0};
+    std::atomic<int> done {0};
+    std::vector<ZnetServer::Promise<int> > promises(per_worker * 2);
+    for(int w = 0; w < 2; ++w) {
+        sc.schedule([&, w]() {
+            int thread = ZnetServer::Scheduler::GetWorkerIndex();
+            for(int i = 0; i < per_worker; ++i) {
+                ZnetServer::Future<int> f = promises[w * per_worker + i].getFuture();
+                ZnetServer::Scheduler::GetThis()->schedule(std::make_shared<ZnetServer::Fiber>(
+                    [f, &started, &done]() mutable {
+                        ++started;
+                        if(f.get() >= 0) {
+                            ++done;
+                        }
+                    }, 0, false, true), thread);
+            }
+        }, w);
+    }
+    while(started < per_worker * 2) {
+        usleep(1000);
+    }
+    usleep(5000);
+    for(size_t i = 0; i < promises.size(); ++i) {
+        promises[i].setValue((int)i);
+    }
+    while(done < per_worker * 2) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "shared stack waiters done=" << done;
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::INFO);
+    ZnetServer::Scheduler sc(2, false, "future");
+    sc.start();
+    test_fan_out(sc);
+    test_when_any(sc);
+    test_exception(sc);
+    test_many(sc);
+    test_shared_stack(sc);
+    sc.stop();
+    return 0;
+}
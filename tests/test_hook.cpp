@@ -0,0 +1,160 @@
+#include "../server/hook.h"
+#include "../server/iomanager.h"
+#include "../server/config.h"
+#include "../server/util.h"
+#include "../server/log.h"
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+static void wait_done(std::atomic<int>& done, int n) {
+    while(done < n) {
+        usleep(1000);
+    }
+}
+
+// 监听回环地址的随机端口
+static int listen_any(sockaddr_in& addr) {
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(lfd, (sockaddr*)&addr, len);
+    listen(lfd, 16);
+    getsockname(lfd, (sockaddr*)&addr, &len);
+    return lfd;
+}
+
+// 一个工作线程上的协程各自睡眠，总耗时接近最长的那次而不是总和
+void test_sleep(ZnetServer::IOManager& iom) {
+    std::atomic<int> done {0};
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    for(int i = 0; i < 6; ++i) {
+        iom.schedule([i, &done]() {
+            if(i % 3 == 0) {
+                sleep(1);
+            } else if(i % 3 == 1) {
+                usleep(300 * 1000);
+            } else {
+                struct timespec ts = {0, 300 * 1000 * 1000};
+                nanosleep(&ts, nullptr);
+            }
+            ++done;
+        });
+    }
+    wait_done(done, 6);
+    ZNS_LOG_INFO(g_logger) << "sleep x6 elapsed(ms)=" << ZnetServer::GetCurrentMS() - begin;
+}
+
+// 阻塞写法的accept/connect/read/write在同一个工作线程上互相等待，不会卡死线程
+void test_socket(ZnetServer::IOManager& iom) {
+    sockaddr_in addr;
+    std::atomic<int> done {0};
+    std::atomic<int> ticks {0};
+    std::string got;
+    bool blocking_view = false;
+    iom.schedule([&]() {
+        int lfd = listen_any(addr);
+        ++done;
+        int fd = accept(lfd, nullptr, nullptr);
+        char buf[64];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n > 0) {
+            ssize_t rt = write(fd, buf, n);
+            (void)rt;
+        }
+        close(fd);
+        close(lfd);
+        ++done;
+    });
+    wait_done(done, 1);
+    iom.schedule([&]() {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        // 用户看到的仍然是阻塞socket
+        blocking_view = !(fcntl(fd, F_GETFL, 0) & O_NONBLOCK);
+        if(connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+            usleep(50 * 1000);
+            send(fd, "ping", 4, 0);
+            char buf[64];
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            got.assign(buf, n > 0 ? n : 0);
+        }
+        close(fd);
+        ++done;
+    });
+    // 等待期间同一线程上的其他协程照常运行
+    iom.schedule([&]() {
+        while(done < 3) {
+            ++ticks;
+            usleep(5 * 1000);
+        }
+        ++done;
+    });
+    wait_done(done, 4);
+    ZNS_LOG_INFO(g_logger) << "socket echo=" << got << " blocking view=" << blocking_view
+        << " ticks while blocked=" << ticks;
+}
+
+// SO_RCVTIMEO超时返回EAGAIN；用户设了非阻塞之后不再等待
+void test_timeout(ZnetServer::IOManager& iom) {
+    std::atomic<int> done {0};
+    int timeout_err = 0;
+    uint64_t timeout_ms = 0;
+    int nonblock_err = 0;
+    iom.schedule([&]() {
+        sockaddr_in addr;
+        int lfd = listen_any(addr);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        connect(fd, (sockaddr*)&addr, sizeof(addr));
+        int peer = accept(lfd, nullptr, nullptr);
+        struct timeval tv = {0, 100 * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char buf[8];
+        uint64_t begin = ZnetServer::GetCurrentMS();
+        if(read(fd, buf, sizeof(buf)) < 0) {
+            timeout_err = errno;
+        }
+        timeout_ms = ZnetServer::GetCurrentMS() - begin;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        if(read(fd, buf, sizeof(buf)) < 0) {
+            nonblock_err = errno;
+        }
+        close(peer);
+        close(fd);
+        close(lfd);
+        ++done;
+    });
+    wait_done(done, 1);
+    ZNS_LOG_INFO(g_logger) << "rcvtimeo read=" << strerror(timeout_err) << " after(ms)=" << timeout_ms
+        << " nonblock read=" << strerror(nonblock_err);
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::INFO);
+    ZnetServer::Config::Lookup<bool>("iomanager.hook")->setValue(true);
+    ZnetServer::IOManager iom(1, false, "hook");
+    iom.start();
+    test_sleep(iom);
+    test_socket(iom);
+    test_timeout(iom);
+    iom.stop();
+
+    // 主线程没有开启hook，usleep照常阻塞
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    usleep(50 * 1000);
+    ZNS_LOG_INFO(g_logger) << "main hook=" << ZnetServer::IsHookEnable()
+        << " usleep(ms)=" << ZnetServer::GetCurrentMS() - begin
+        << " pending=" << iom.getPendingEventCount();
+    return 0;
+}
@@ -0,0 +1,323 @@
+#include "../server/iomanager.h"
+#include "../server/util.h"
+#include "../server/log.h"
+#include "../server/config.h"
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+static void make_pair(int fds[2]) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+}
+
+// 读不到数据时挂起协程，可读时被唤醒
+static ssize_t fiber_read(int fd, char* buf, size_t len) {
+    while(true) {
+        ssize_t n = read(fd, buf, len);
+        if(n >= 0 || errno != EAGAIN) {
+            return n;
+        }
+        if(ZnetServer::IOManager::GetThis()->addEvent(fd, ZnetServer::IOManager::READ)) {
+            return -1;
+        }
+        ZnetServer::Scheduler::Park();
+    }
+}
+
+// 协程等待可读
+void test_fiber_read(ZnetServer::IOManager& iom) {
+    int fds[2];
+    make_pair(fds);
+    std::atomic<bool> done {false};
+    std::string got;
+    iom.schedule([&]() {
+        char buf[64];
+        ssize_t n = fiber_read(fds[0], buf, sizeof(buf));
+        got.assign(buf, n > 0 ? n : 0);
+        done = true;
+    });
+    usleep(50 * 1000);
+    bool early = done;
+    ssize_t rt = write(fds[1], "hello", 5);
+    (void)rt;
+    while(!done) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "fiber read early=" << early << " got=" << got
+        << " pending=" << iom.getPendingEventCount();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 回调事件，从外部线程注册
+void test_callback(ZnetServer::IOManager& iom) {
+    int fds[2];
+    make_pair(fds);
+    std::atomic<int> fired {0};
+    iom.addEvent(fds[0], ZnetServer::IOManager::WRITE, [&fired]() { ++fired; });
+    // 同一个事件重复注册失败
+    int again = iom.addEvent(fds[0], ZnetServer::IOManager::WRITE, [&fired]() { ++fired; });
+    while(fired == 0) {
+        usleep(1000);
+    }
+    usleep(10 * 1000);
+    ZNS_LOG_INFO(g_logger) << "callback fired=" << fired << " add again=" << again;
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// cancelEvent立即唤醒等待的协程，delEvent不触发
+void test_cancel(ZnetServer::IOManager& iom) {
+    int fds[2];
+    make_pair(fds);
+    std::atomic<int> result {1};
+    iom.schedule([&]() {
+        char buf[8];
+        iom.addEvent(fds[0], ZnetServer::IOManager::READ);
+        ZnetServer::Scheduler::Park();
+        result = (int)read(fds[0], buf, sizeof(buf));
+    });
+    usleep(20 * 1000);
+    bool cancelled = iom.cancelEvent(fds[0], ZnetServer::IOManager::READ);
+    while(result == 1) {
+        usleep(1000);
+    }
+    std::atomic<int> fired {0};
+    iom.addEvent(fds[1], ZnetServer::IOManager::READ, [&fired]() { ++fired; });
+    bool deleted = iom.delEvent(fds[1], ZnetServer::IOManager::READ);
+    ssize_t rt = write(fds[0], "x", 1);
+    (void)rt;
+    usleep(20 * 1000);
+    ZNS_LOG_INFO(g_logger) << "cancel=" << cancelled << " read after cancel=" << result
+        << " del=" << deleted << " fired after del=" << fired
+        << " pending=" << iom.getPendingEventCount();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 大量fd同时等待，fd表按下标扩容
+void test_many(ZnetServer::IOManager& iom) {
+    const int n = 300;
+    std::vector<int> fds(n * 2);
+    for(int i = 0; i < n; ++i) {
+        make_pair(&fds[i * 2]);
+    }
+    std::atomic<int> done {0};
+    for(int i = 0; i < n; ++i) {
+        int fd = fds[i * 2];
+        iom.schedule([fd, &done]() {
+            char buf[8];
+            if(fiber_read(fd, buf, sizeof(buf)) == 1) {
+                ++done;
+            }
+        });
+    }
+    usleep(50 * 1000);
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    for(int i = 0; i < n; ++i) {
+        ssize_t rt = write(fds[i * 2 + 1], "x", 1);
+        (void)rt;
+    }
+    while(done < n) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "many fds=" << n << " done=" << done
+        << " elapsed(ms)=" << ZnetServer::GetCurrentMS() - begin;
+    for(int fd : fds) {
+        close(fd);
+    }
+}
+
+// 定时器: poller在epoll_wait里等到最近的定时器
+void test_timer(ZnetServer::IOManager& iom) {
+    const int n = 20;
+    std::atomic<int> fired {0};
+    std::atomic<int> early {0};
+    std::atomic<uint64_t> max_late {0};
+    for(int i = 0; i < n; ++i) {
+        usleep(2000);
+        uint64_t expect = ZnetServer::GetCurrentMS() + 5 + i;
+        iom.addTimer(5 + i, [&, expect]() {
+            uint64_t now = ZnetServer::GetCurrentMS();
+            if(now < expect) {
+                ++early;
+            } else if(now - expect > max_late) {
+                max_late = now - expect;
+            }
+            ++fired;
+        });
+    }
+    while(fired < n) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "timer fired=" << fired << " early=" << early
+        << " max late(ms)=" << max_late;
+}
+
+// 协程版accept/connect/read/write在回环地址上收发，cancelAll唤醒阻塞的read
+void test_io(ZnetServer::IOManager& iom) {
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(lfd, (sockaddr*)&addr, len);
+    listen(lfd, 16);
+    getsockname(lfd, (sockaddr*)&addr, &len);
+
+    const int n = 20;
+    std::atomic<int> echoed {0};
+    std::atomic<int> done {0};
+    iom.schedule([&]() {
+        for(int i = 0; i < n; ++i) {
+            int fd = iom.accept(lfd, nullptr, nullptr);
+            if(fd < 0) {
+                break;
+            }
+            iom.schedule([&iom, fd]() {
+                char buf[64];
+                ssize_t r;
+                while((r = iom.read(fd, buf, sizeof(buf))) > 0) {
+                    iom.write(fd, buf, r);
+                }
+                close(fd);
+            });
+        }
+        ++done;
+    });
+    for(int i = 0; i < n; ++i) {
+        iom.schedule([&, i]() {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if(iom.connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+                std::string msg = "ping " + std::to_string(i);
+                char buf[64];
+                iom.write(fd, msg.data(), msg.size());
+                ssize_t r = iom.read(fd, buf, sizeof(buf));
+                if(r > 0 && std::string(buf, r) == msg) {
+                    ++echoed;
+                }
+            }
+            close(fd);
+            ++done;
+        });
+    }
+    while(done < n + 1) {
+        usleep(1000);
+    }
+
+    int fds[2];
+    make_pair(fds);
+    std::atomic<int> err {0};
+    iom.schedule([&]() {
+        char buf[8];
+        if(iom.read(fds[0], buf, sizeof(buf)) < 0) {
+            err = errno;
+        } else {
+            err = -1;
+        }
+    });
+    usleep(20 * 1000);
+    iom.cancelAll(fds[0]);
+    while(err == 0) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "io backend=" << iom.getBackend() << " echoed=" << echoed
+        << "/" << n << " read after cancelAll=" << strerror(err)
+        << " pending=" << iom.getPendingEventCount();
+    close(fds[0]);
+    close(fds[1]);
+    close(lfd);
+}
+
+// 共享栈协程挂在协程版IO上，等待和读缓冲区都在各自的栈上，互相不覆盖
+void test_shared_stack_io(ZnetServer::IOManager& iom) {
+    const int n = 8;
+    std::vector<int> pairs(n * 2);
+    for(int i = 0; i < n; ++i) {
+        make_pair(&pairs[i * 2]);
+    }
+    std::atomic<int> ok {0};
+    std::atomic<int> done {0};
+    iom.schedule([&]() {
+        int thread = ZnetServer::Scheduler::GetWorkerIndex();
+        for(int i = 0; i < n; ++i) {
+            int fd = pairs[i * 2];
+            iom.schedule(std::make_shared<ZnetServer::Fiber>([&, i, fd]() {
+                char buf[64];
+                memset(buf, 0, sizeof(buf));
+                ssize_t r = iom.read(fd, buf, sizeof(buf));
+                if(r > 0 && std::string(buf, r) == "shared " + std::to_string(i)) {
+                    ++ok;
+                }
+                ++done;
+            }, 0, false, true), thread);
+        }
+    });
+    usleep(50 * 1000);
+    for(int i = 0; i < n; ++i) {
+        std::string msg = "shared " + std::to_string(i);
+        ssize_t rt = write(pairs[i * 2 + 1], msg.data(), msg.size());
+        (void)rt;
+    }
+    while(done < n) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "shared stack io ok=" << ok << "/" << n;
+    for(int fd : pairs) {
+        close(fd);
+    }
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::INFO);
+    ZnetServer::IOManager iom(2, false, "io");
+    iom.start();
+    test_fiber_read(iom);
+    test_callback(iom);
+    test_cancel(iom);
+    test_many(iom);
+    test_timer(iom);
+    test_io(iom);
+    test_shared_stack_io(iom);
+
+    // stop等到已注册的事件触发之后才返回
+    int fds[2];
+    make_pair(fds);
+    std::atomic<bool> fired {false};
+    iom.addEvent(fds[0], ZnetServer::IOManager::READ, [&fired]() { fired = true; });
+    std::thread writer([&fds]() {
+        usleep(100 * 1000);
+        ssize_t rt = write(fds[1], "x", 1);
+        (void)rt;
+    });
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    iom.stop();
+    ZNS_LOG_INFO(g_logger) << "stop waited(ms)=" << ZnetServer::GetCurrentMS() - begin
+        << " event fired=" << fired;
+    writer.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    // 同样的协程IO走io_uring，内核不支持时退回epoll
+    ZnetServer::Config::Lookup<std::string>("iomanager.backend")->setValue("io_uring");
+    ZnetServer::IOManager uring(2, false, "uring");
+    uring.start();
+    test_io(uring);
+    test_shared_stack_io(uring);
+    uring.stop();
+    return 0;
+}
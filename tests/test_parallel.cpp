@@ -0,0 +1,144 @@
+#include "../server/parallel.h"
+#include "../server/future.h"
+#include "../server/log.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+void test_for(ZnetServer::Scheduler& sc) {
+    // 每个下标恰好执行一次，记录参与的线程；每段睡一会儿，让空闲的工作线程来得及取走子区间
+    std::vector<int> hits(100000, 0);
+    std::mutex mutex;
+    std::set<int> workers;
+    ZnetServer::ParallelFor(&sc, 0, hits.size(), 1000, [&](size_t b, size_t e){
+        for(size_t i = b; i < e; ++i) {
+            ++hits[i];
+        }
+        usleep(200);
+        std::lock_guard<std::mutex> lock(mutex);
+        workers.insert(ZnetServer::Scheduler::GetWorkerIndex());
+    });
+    size_t bad = 0;
+    for(int h : hits) {
+        bad += h != 1;
+    }
+    ZNS_LOG_INFO(g_logger) << "parallel_for: bad=" << bad << " workers=" << workers.size()
+        << " (-1 is the calling thread)";
+}
+
+void test_reduce(ZnetServer::Scheduler& sc) {
+    // 在工作协程里调用，wait()参与执行
+    ZnetServer::Future<uint64_t> sum = sc.async([](){
+        return ZnetServer::ParallelReduce<uint64_t>(1, 1000001, 0, 0,
+            [](size_t b, size_t e){
+                uint64_t s = 0;
+                for(size_t i = b; i < e; ++i) {
+                    s += i;
+                }
+                return s;
+            },
+            [](uint64_t a, uint64_t b){ return a + b; });
+    });
+    ZNS_LOG_INFO(g_logger) << "parallel_reduce: sum=" << sum.get() << " expect=" << 500000500000ull;
+
+    // 不满足交换律的归约按段的顺序合并
+    std::string s = ZnetServer::ParallelReduce(&sc, 0, 26, 3, std::string(),
+        [](size_t b, size_t e){
+            std::string r;
+            for(size_t i = b; i < e; ++i) {
+                r += (char)('a' + i);
+            }
+            return r;
+        },
+        [](std::string a, std::string b){ return a + b; });
+    ZNS_LOG_INFO(g_logger) << "parallel_reduce: concat=" << s;
+}
+
+void test_group(ZnetServer::Scheduler& sc) {
+    // 递归fork-join: 任务里再建任务组
+    struct Fib {
+        static long Run(int n) {
+            if(n < 15) {
+                return n < 2 ? n : Run(n - 1) + Run(n - 2);
+            }
+            long a = 0, b = 0;
+            ZnetServer::TaskGroup g;
+            g.run([&a, n](){ a = Run(n - 1); });
+            g.run([&b, n](){ b = Run(n - 2); });
+            g.wait();
+            return a + b;
+        }
+    };
+    ZnetServer::Future<long> fib = sc.async([](){ return Fib::Run(25); });
+    ZNS_LOG_INFO(g_logger) << "task_group: fib(25)=" << fib.get();
+
+    // 第一个异常在wait()抛出，之后没开始的任务被跳过
+    std::atomic<int> ran {0};
+    ZnetServer::TaskGroup g(&sc);
+    for(int i = 0; i < 100; ++i) {
+        g.run([&ran, i](){
+            ++ran;
+            if(i == 10) {
+                throw std::runtime_error("encode failed");
+            }
+        });
+    }
+    try {
+        g.wait();
+    } catch(const std::exception& e) {
+        ZNS_LOG_INFO(g_logger) << "task_group exception: " << e.what() << " ran=" << ran;
+    }
+    // 异常取出后可以继续使用
+    g.run([&ran](){ ran = -1; });
+    g.wait();
+    ZNS_LOG_INFO(g_logger) << "task_group reuse: ran=" << ran;
+
+    // 没有调度器时在wait()里依次执行
+    int n = 0;
+    ZnetServer::TaskGroup serial;
+    for(int i = 0; i < 10; ++i) {
+        serial.run([&n](){ ++n; });
+    }
+    serial.wait();
+    ZNS_LOG_INFO(g_logger) << "task_group without scheduler: n=" << n;
+}
+
+// 共享栈协程里不能用任务组，空区间直接返回
+void test_shared_stack(ZnetServer::Scheduler& sc) {
+    std::atomic<bool> done {false};
+    std::string result;
+    sc.schedule([&](){
+        int thread = ZnetServer::Scheduler::GetWorkerIndex();
+        ZnetServer::Scheduler::GetThis()->schedule(std::make_shared<ZnetServer::Fiber>([&](){
+            ZnetServer::ParallelFor(0, 0, 1, [](size_t, size_t){});
+            result = "empty ok";
+            try {
+                ZnetServer::ParallelFor(0, 100, 10, [](size_t, size_t){});
+                result += ", ran";
+            } catch(const std::logic_error& e) {
+                result += std::string(", rejected: ") + e.what();
+            }
+            done = true;
+        }, 0, false, true), thread);
+    });
+    while(!done) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "shared stack " << result;
+}
+
+int main() {
+    ZnetServer::Scheduler sc(4, false, "parallel");
+    sc.start();
+    test_for(sc);
+    test_reduce(sc);
+    test_group(sc);
+    test_shared_stack(sc);
+    sc.stop();
+    return 0;
+}
@@ -1,20 +1,356 @@
 #include "../server/scheduler.h"
+#include "../server/stack_allocator.h"
+#include "../server/util.h"
+#include "../server/config.h"
+#include "../server/histogram.h"
+#include "../server/log.h"
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unistd.h>
 
+static std::atomic<int> s_count {0};
+
+// 只可移动的回调
+struct MoveOnlyTask {
+    std::unique_ptr<int> value;
+    void operator()() {
+        s_count += *value;
+    }
+};
+
+static std::atomic<int> s_wrong_thread {0};
+static std::atomic<int> s_pinned {0};
+
+// 固定到线程1的回调，Park之后由主线程Unpark，恢复时仍然在线程1上
+void test_affinity(ZnetServer::Scheduler& sc) {
+    std::atomic<ZnetServer::Fiber*> parked {nullptr};
+    ZnetServer::Fiber::ptr holder;
+    std::mutex mutex;
+    for(int i = 0; i < 1000; ++i) {
+        sc.schedule([&](){
+            if(ZnetServer::Scheduler::GetWorkerIndex() != 1) {
+                ++s_wrong_thread;
+            }
+            ++s_pinned;
+        }, 1);
+    }
+    sc.schedule([&](){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            holder = ZnetServer::Fiber::GetThis();
+        }
+        ZnetServer::Scheduler::Park();
+        if(ZnetServer::Scheduler::GetWorkerIndex() != 1) {
+            ++s_wrong_thread;
+        }
+        ++s_pinned;
+    }, 1);
+    while(true) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(holder) {
+            break;
+        }
+    }
+    ZnetServer::Scheduler::Unpark(holder);
+}
+
+// 批量提交的协程同样遵守固定线程: 自己带affinity的，和整批指定线程的(之后affinity也是它)
+void test_batch(ZnetServer::Scheduler& sc) {
+    std::vector<std::function<void()> > batch(10000, [](){ ++s_count; });
+    sc.schedule(batch.begin(), batch.end());
+
+    auto check = [](){
+        if(ZnetServer::Scheduler::GetWorkerIndex() != 1
+                || ZnetServer::Fiber::GetThis()->getAffinity() != 1) {
+            ++s_wrong_thread;
+        }
+        ++s_pinned;
+    };
+    std::vector<ZnetServer::Fiber::ptr> own;
+    std::vector<ZnetServer::Fiber::ptr> whole;
+    for(int i = 0; i < 100; ++i) {
+        own.push_back(std::make_shared<ZnetServer::Fiber>(check));
+        own.back()->setAffinity(1);
+        whole.push_back(std::make_shared<ZnetServer::Fiber>(check));
+    }
+    sc.schedule(own.begin(), own.end());
+    sc.schedule(whole.begin(), whole.end(), 1);
+}
+
+// 空协程忽略；越界的线程下标抛异常，协程的affinity不变
+void test_invalid(ZnetServer::Scheduler& sc) {
+    sc.schedule(ZnetServer::Fiber::ptr());
+    sc.schedule(ZnetServer::Fiber::ptr(), ZnetServer::Scheduler::HIGH);
+    ZnetServer::Fiber::ptr fiber = std::make_shared<ZnetServer::Fiber>([](){ ++s_count; });
+    bool thrown = false;
+    try {
+        sc.schedule(fiber, sc.getWorkerCount());
+    } catch(const std::logic_error&) {
+        thrown = true;
+    }
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "invalid thread thrown=" << thrown
+        << " affinity=" << fiber->getAffinity();
+
+    // 不在工作线程上创建的共享栈协程没有所属线程，单个和批量调度都拒绝，批里的其他协程不留在队列上
+    ZnetServer::Fiber::ptr shared = std::make_shared<ZnetServer::Fiber>([](){ ++s_count; }, 0, false, true);
+    int rejected = 0;
+    try {
+        sc.schedule(shared);
+    } catch(const std::logic_error&) {
+        ++rejected;
+    }
+    try {
+        sc.schedule(shared, ZnetServer::Scheduler::HIGH);
+    } catch(const std::logic_error&) {
+        ++rejected;
+    }
+    std::vector<ZnetServer::Fiber::ptr> batch;
+    batch.push_back(fiber);
+    batch.push_back(shared);
+    try {
+        sc.schedule(batch.begin(), batch.end());
+    } catch(const std::logic_error&) {
+        ++rejected;
+    }
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "shared stack off worker rejected=" << rejected
+        << " affinity=" << shared->getAffinity();
+    sc.schedule(fiber);
+}
+
+// 单个工作线程被占住时提交的任务按优先级和截止时间出队；
+// 高优先级任务一直占满线程时，低优先级任务在饥饿保护时限后仍然能执行
+void test_priority() {
+    ZnetServer::Scheduler sc(1, false, "priority");
+    sc.start();
+    std::atomic<bool> release {false};
+    std::atomic<int> done {0};
+    std::vector<std::string> order;
+    sc.schedule([&](){
+        while(!release) {
+            usleep(1000);
+        }
+    });
+    usleep(10 * 1000);
+    auto record = [&](const char* name) {
+        return [&order, &done, name](){
+            order.push_back(name);
+            ++done;
+        };
+    };
+    sc.schedule(record("low"), ZnetServer::Scheduler::LOW);
+    sc.schedule(record("normal"));
+    sc.schedule(record("high"), ZnetServer::Scheduler::HIGH);
+    sc.schedule(record("high_d50"), ZnetServer::Scheduler::HIGH, 50);
+    sc.schedule(record("normal_d50"), ZnetServer::Scheduler::NORMAL, 50);
+    sc.schedule(record("high_d10"), ZnetServer::Scheduler::HIGH, 10);
+    release = true;
+    while(done < 6) {
+        usleep(1000);
+    }
+    std::string seq;
+    for(auto& name : order) {
+        seq += name + " ";
+    }
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "priority order: " << seq;
+
+    // 高优先级任务不断重新提交自己，占满300ms
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    std::atomic<bool> flooding {true};
+    std::function<void()> flood = [&](){
+        if(ZnetServer::GetCurrentMS() - begin < 300) {
+            sc.schedule(flood, ZnetServer::Scheduler::HIGH);
+        } else {
+            flooding = false;
+        }
+    };
+    sc.schedule(flood, ZnetServer::Scheduler::HIGH);
+    uint64_t low_wait = 0;
+    bool low_during_flood = false;
+    std::atomic<bool> low_done {false};
+    sc.schedule([&](){
+        low_wait = ZnetServer::GetCurrentMS() - begin;
+        low_during_flood = flooding;
+        low_done = true;
+    }, ZnetServer::Scheduler::LOW);
+    while(!low_done || flooding) {
+        usleep(1000);
+    }
+    sc.stop();
+    ZnetServer::Scheduler::QueueWaitStats high = sc.getQueueWaitStats(ZnetServer::Scheduler::HIGH);
+    ZnetServer::Scheduler::QueueWaitStats low = sc.getQueueWaitStats(ZnetServer::Scheduler::LOW);
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "low under high flood: started after(ms)=" << low_wait
+        << " during flood=" << low_during_flood;
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "queue wait high: count=" << high.count << " p99(us)<=" << high.p99_us
+        << " missed=" << high.missed << "; low: count=" << low.count << " max(us)=" << low.max_us;
+}
+
+// 直方图分位数的相对误差在1/16以内；调度器统计抽样每个任务，并按间隔打日志
+void test_stats() {
+    ZnetServer::Histogram hist;
+    for(uint64_t v = 1; v <= 10000; ++v) {
+        hist.record(v);
+    }
+    ZnetServer::HistogramStats h = ZnetServer::Histogram::Summarize({&hist});
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "histogram 1..10000: p50=" << h.p50 << " p99=" << h.p99
+        << " mean=" << h.mean << " min=" << h.min << " max=" << h.max;
+
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.stats_sample")->setValue(1);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.stats_interval_ms")->setValue(200);
+    ZnetServer::Scheduler sc(2, false, "stats");
+    sc.start();
+    std::atomic<int> done {0};
+    for(int i = 0; i < 2000; ++i) {
+        sc.schedule([&done](){
+            uint64_t end = ZnetServer::GetCurrentUS() + 100;
+            while(ZnetServer::GetCurrentUS() < end) {
+            }
+            ++done;
+        });
+    }
+    while(done < 2000) {
+        usleep(1000);
+    }
+    // 空闲一段时间，利用率下降
+    usleep(300 * 1000);
+    sc.stop();
+    ZnetServer::Scheduler::Stats st = sc.getStats();
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << st.toString();
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.stats_sample")->setValue(16);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.stats_interval_ms")->setValue(0);
+}
+
+void test_watchdog() {
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.watchdog_slice_ms")->setValue(50);
+    ZnetServer::Config::Lookup<bool>("scheduler.preempt")->setValue(true);
+    ZnetServer::Scheduler sc(1, false, "watchdog");
+    sc.start();
+    // 单线程上一个忙等500ms的回调，带抢占点时后提交的短任务不用等它跑完
+    std::atomic<uint64_t> busy_end {0};
+    std::atomic<uint64_t> short_run {0};
+    std::atomic<int> yields {0};
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    sc.schedule([&](){
+        uint64_t end = ZnetServer::GetCurrentMS() + 500;
+        while(ZnetServer::GetCurrentMS() < end) {
+            if(ZnetServer::Scheduler::PreemptRequested()) {
+                ++yields;
+            }
+            ZNS_PREEMPT_POINT();
+        }
+        busy_end = ZnetServer::GetCurrentMS();
+    });
+    usleep(10 * 1000);
+    sc.schedule([&](){ short_run = ZnetServer::GetCurrentMS(); });
+    while(!busy_end) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "preempt: short task ran after " << short_run - begin
+        << "ms, busy loop finished after " << busy_end - begin << "ms, yields=" << yields;
+
+    // 没有抢占点的循环只能被发现，watchdog打一条警告
+    busy_end = 0;
+    sc.schedule([&](){
+        uint64_t end = ZnetServer::GetCurrentMS() + 200;
+        while(ZnetServer::GetCurrentMS() < end) {
+        }
+        busy_end = ZnetServer::GetCurrentMS();
+    });
+    while(!busy_end) {
+        usleep(1000);
+    }
+    sc.stop();
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.watchdog_slice_ms")->setValue(0);
+    ZnetServer::Config::Lookup<bool>("scheduler.preempt")->setValue(false);
+}
+void test_elastic() {
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.max_threads")->setValue(4);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.scale_up_wait_us")->setValue(200);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.scale_up_sustain_ms")->setValue(20);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.scale_down_idle_ms")->setValue(200);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.stats_sample")->setValue(1);
+    ZnetServer::Scheduler sc(1, false, "elastic");
+    sc.start();
+    // 一波忙等1ms的任务积压在队列里，排队时间持续超标，线程数涨上去
+    std::atomic<int> done {0};
+    int max_running = 1;
+    for(int i = 0; i < 500; ++i) {
+        sc.schedule([&done](){
+            uint64_t end = ZnetServer::GetCurrentUS() + 1000;
+            while(ZnetServer::GetCurrentUS() < end) {
+            }
+            ++done;
+        });
+    }
+    while(done < 500) {
+        max_running = std::max(max_running, sc.getRunningCount());
+        usleep(1000);
+    }
+    // 空闲超过200ms之后退回到1个
+    usleep(500 * 1000);
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "elastic: slots=" << sc.getWorkerCount() << " max running="
+        << max_running << " running after idle=" << sc.getRunningCount();
+
+    // 固定到已经退出的槽位，线程重新启动
+    std::atomic<int> pinned {-1};
+    sc.schedule([&pinned](){ pinned = ZnetServer::Scheduler::GetWorkerIndex(); }, 3);
+    while(pinned < 0) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "elastic: pinned task ran on worker " << pinned;
+
+    // 热更新下限，monitor补够线程
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.min_threads")->setValue(3);
+    usleep(100 * 1000);
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "elastic: running with min_threads=3: " << sc.getRunningCount();
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.min_threads")->setValue(0);
+    usleep(500 * 1000);
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "elastic: running after min_threads reset: " << sc.getRunningCount();
+    sc.stop();
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << sc.getStats().toString();
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.max_threads")->setValue(0);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.scale_up_wait_us")->setValue(1000);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.scale_up_sustain_ms")->setValue(50);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.scale_down_idle_ms")->setValue(10000);
+    ZnetServer::Config::Lookup<uint32_t>("scheduler.stats_sample")->setValue(16);
+}
 int main() {
     // 1. 创建一个调度器，内含2个工作线程
-    ZnetServer::Scheduler sc(2, false); 
+    ZnetServer::Scheduler sc(2, false);
 
     // 2. 启动调度器，后台线程开始 run() 循环
-    sc.start(); 
+    sc.start();
 
     // 3. 向调度器投递一个打印任务
     ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "schedule";
     sc.schedule(std::make_shared<ZnetServer::Fiber>([](){
         ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "Hello, Scheduler!";
-    }, 1024 * 128));
+    }));
+
+    // 4. 直接投递回调，在池化协程上执行
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::INFO);
+    std::function<void()> fn = [](){ ++s_count; };
+    for(int i = 0; i < 10000; ++i) {
+        sc.schedule(fn);
+        sc.schedule(MoveOnlyTask{std::unique_ptr<int>(new int(1))});
+    }
+
+    // 5. 固定线程和批量提交
+    test_affinity(sc);
+    test_batch(sc);
+    test_invalid(sc);
+    test_priority();
+    test_stats();
+    test_watchdog();
+    test_elastic();
 
-    // 4. 停止调度器（等待所有任务执行完毕）
+    // 6. 停止调度器（等待所有任务执行完毕）
     sleep(2);
-    sc.stop(); 
+    sc.stop();
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "callbacks done=" << s_count
+        << " mapped stacks=" << ZnetServer::StackAllocator::GetMappedCount();
+    ZNS_LOG_INFO(ZNS_LOG_ROOT()) << "pinned done=" << s_pinned << " on wrong thread=" << s_wrong_thread;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,191 @@
+#include "../server/socket.h"
+#include "../server/iomanager.h"
+#include "../server/util.h"
+#include "../server/log.h"
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+using ZnetServer::Address;
+using ZnetServer::IPAddress;
+using ZnetServer::IPv4Address;
+using ZnetServer::IPv6Address;
+using ZnetServer::UnixAddress;
+using ZnetServer::Socket;
+
+static void wait_done(std::atomic<int>& done, int n) {
+    while(done < n) {
+        usleep(1000);
+    }
+}
+
+// 数字地址的解析和打印，主机名查询
+void test_address() {
+    IPAddress::ptr v4 = IPAddress::Create("127.0.0.1", 8080);
+    IPAddress::ptr v6 = IPAddress::Create("::1", 8080);
+    IPAddress::ptr bad = IPAddress::Create("not an address");
+    ZNS_LOG_INFO(g_logger) << "v4=" << *v4 << " v6=" << *v6 << " bad=" << (bad ? "parsed" : "null");
+
+    UnixAddress::ptr un = std::make_shared<UnixAddress>("/tmp/zns_test.sock");
+    UnixAddress::ptr abstract = std::make_shared<UnixAddress>(std::string("\0zns_test", 9));
+    ZNS_LOG_INFO(g_logger) << "unix=" << *un << " abstract=" << *abstract;
+
+    IPv4Address::ptr a = IPv4Address::Create("127.0.0.1", 80);
+    IPv4Address::ptr b = IPv4Address::Create("127.0.0.1", 80);
+    IPv4Address::ptr c = IPv4Address::Create("127.0.0.2", 80);
+    ZNS_LOG_INFO(g_logger) << "a==b " << (*a == *b) << " a<c " << (*a < *c)
+        << " a!=c " << (*a != *c);
+
+    for(auto& addr : Address::Lookup("localhost:80", AF_UNSPEC, SOCK_STREAM)) {
+        ZNS_LOG_INFO(g_logger) << "lookup localhost:80 -> " << *addr;
+    }
+    Address::ptr any = Address::LookupAny("[::1]:443", AF_INET6);
+    ZNS_LOG_INFO(g_logger) << "lookup [::1]:443 -> " << (any ? any->toString() : "null");
+}
+
+// 同一个工作线程上的服务端和客户端收发，互相等待时只挂起协程
+void test_tcp(ZnetServer::IOManager& iom, Address::ptr bind_addr) {
+    std::atomic<int> done {0};
+    Socket::ptr server = Socket::CreateTCP(bind_addr);
+    if(!server->bind(bind_addr) || !server->listen()) {
+        ZNS_LOG_INFO(g_logger) << "tcp bind " << *bind_addr << " failed errno=" << errno;
+        return;
+    }
+    Address::ptr addr = server->getLocalAddress();
+    iom.schedule([server, &done]() {
+        Socket::ptr conn = server->accept();
+        if(!conn) {
+            ZNS_LOG_INFO(g_logger) << "accept failed errno=" << ZnetServer::GetErrno();
+            ++done;
+            return;
+        }
+        char buf[64];
+        ssize_t n;
+        while((n = conn->recv(buf, sizeof(buf))) > 0) {
+            conn->send(buf, n);
+        }
+        ++done;
+    });
+    iom.schedule([addr, &done]() {
+        Socket::ptr sock = Socket::CreateTCP(addr);
+        if(!sock->connect(addr, 1000)) {
+            ZNS_LOG_INFO(g_logger) << "connect failed errno=" << ZnetServer::GetErrno();
+            ++done;
+            return;
+        }
+        int nodelay = 0;
+        sock->getOption(IPPROTO_TCP, TCP_NODELAY, nodelay);
+        std::string echo;
+        const char* parts[] = {"hello ", "socket ", "world"};
+        for(const char* p : parts) {
+            sock->send(p, strlen(p));
+            char buf[64];
+            ssize_t n = sock->recv(buf, sizeof(buf));
+            if(n > 0) {
+                echo.append(buf, n);
+            }
+        }
+        ZNS_LOG_INFO(g_logger) << *sock << " nodelay=" << nodelay << " echo=" << echo;
+        sock->close();
+        ++done;
+    });
+    wait_done(done, 2);
+}
+
+void test_unix(ZnetServer::IOManager& iom) {
+    // 抽象命名空间，不用清理文件
+    Address::ptr addr = std::make_shared<UnixAddress>(std::string("\0zns_test_socket", 16));
+    test_tcp(iom, addr);
+}
+
+// 没人发数据的recv和连不上的connect按超时返回
+void test_timeout(ZnetServer::IOManager& iom) {
+    std::atomic<int> done {0};
+    Address::ptr bind_addr = IPv4Address::Create("127.0.0.1", 0);
+    Socket::ptr server = Socket::CreateTCP(bind_addr);
+    server->bind(bind_addr);
+    server->listen();
+    Address::ptr addr = server->getLocalAddress();
+    iom.schedule([addr, &done]() {
+        Socket::ptr sock = Socket::CreateTCP(addr);
+        sock->connect(addr);
+        sock->setRecvTimeout(200);
+        char buf[16];
+        uint64_t begin = ZnetServer::GetCurrentMS();
+        ssize_t n = sock->recv(buf, sizeof(buf));
+        int err = ZnetServer::GetErrno();
+        ZNS_LOG_INFO(g_logger) << "recv timeout n=" << n << " eagain=" << (err == EAGAIN)
+            << " elapsed(ms)=" << ZnetServer::GetCurrentMS() - begin;
+        ++done;
+    });
+    iom.schedule([&done]() {
+        // 不可路由的地址，SYN没有回应
+        Address::ptr blackhole = IPv4Address::Create("10.255.255.1", 80);
+        Socket::ptr sock = Socket::CreateTCP(blackhole);
+        uint64_t begin = ZnetServer::GetCurrentMS();
+        bool ok = sock->connect(blackhole, 200);
+        int err = ZnetServer::GetErrno();
+        ZNS_LOG_INFO(g_logger) << "connect timeout ok=" << ok << " errno=" << err
+            << " (" << strerror(err) << ") elapsed(ms)=" << ZnetServer::GetCurrentMS() - begin;
+        ++done;
+    });
+    wait_done(done, 2);
+    // 调度协程之外(这里是主线程)用poll等待
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    bool ok = sock->connect(addr, 1000);
+    sock->setRecvTimeout(100);
+    char buf[16];
+    ssize_t n = sock->recv(buf, sizeof(buf));
+    ZNS_LOG_INFO(g_logger) << "thread connect ok=" << ok << " recv n=" << n
+        << " eagain=" << (errno == EAGAIN);
+}
+
+// UDP收发，recvFrom带回对方地址
+void test_udp(ZnetServer::IOManager& iom) {
+    std::atomic<int> done {0};
+    Address::ptr bind_addr = IPv4Address::Create("127.0.0.1", 0);
+    Socket::ptr server = Socket::CreateUDP(bind_addr);
+    server->bind(bind_addr);
+    Address::ptr addr = server->getLocalAddress();
+    iom.schedule([server, &done]() {
+        char buf[64];
+        Address::ptr from = std::make_shared<IPv4Address>();
+        ssize_t n = server->recvFrom(buf, sizeof(buf), from);
+        if(n > 0) {
+            server->sendTo(buf, n, from);
+        }
+        ++done;
+    });
+    iom.schedule([addr, &done]() {
+        Socket::ptr sock = Socket::CreateUDP(addr);
+        sock->sendTo("ping", 4, addr);
+        char buf[64];
+        Address::ptr from = std::make_shared<IPv4Address>();
+        ssize_t n = sock->recvFrom(buf, sizeof(buf), from);
+        ZNS_LOG_INFO(g_logger) << "udp reply=" << std::string(buf, n > 0 ? n : 0)
+            << " from=" << *from;
+        ++done;
+    });
+    wait_done(done, 2);
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::INFO);
+    test_address();
+    ZnetServer::IOManager iom(1, false, "socket");
+    iom.start();
+    test_tcp(iom, IPv4Address::Create("127.0.0.1", 0));
+    IPAddress::ptr v6 = IPv6Address::Create("::1", 0);
+    test_tcp(iom, v6);
+    test_unix(iom);
+    test_timeout(iom);
+    test_udp(iom);
+    iom.stop();
+    return 0;
+}
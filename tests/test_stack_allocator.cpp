@@ -0,0 +1,64 @@
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "../server/fiber.h"
+#include "../server/log.h"
+#include "../server/stack_allocator.h"
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+void test_reuse() {
+    size_t size = 100 * 1024;
+    void* a = ZnetServer::StackAllocator::Alloc(size);
+    ZNS_LOG_INFO(g_logger) << "alloc 100KB -> class size=" << size;
+    ZnetServer::StackAllocator::Dealloc(a, size);
+    size_t size2 = 128 * 1024;
+    void* b = ZnetServer::StackAllocator::Alloc(size2);
+    ZNS_LOG_INFO(g_logger) << "reused=" << (a == b) << " cached=" << ZnetServer::StackAllocator::GetCachedCount();
+    ZnetServer::StackAllocator::Dealloc(b, size2);
+}
+
+void test_fiber_steady_state() {
+    ZnetServer::Fiber::GetThis();
+    uint64_t before = ZnetServer::StackAllocator::GetMappedCount();
+    for(int i = 0; i < 1000; ++i) {
+        ZnetServer::Fiber::ptr f(new ZnetServer::Fiber([](){}));
+        f->swapIn();
+    }
+    ZNS_LOG_INFO(g_logger) << "1000 fibers, new mmap=" << ZnetServer::StackAllocator::GetMappedCount() - before;
+}
+
+static int recurse(int n) {
+    volatile char buf[1024];
+    buf[0] = (char)n;
+    if(n > (1 << 20)) {
+        return 0;
+    }
+    return recurse(n + 1) + buf[0];
+}
+
+void test_overflow() {
+    pid_t pid = fork();
+    if(pid == 0) {
+        ZnetServer::Fiber::GetThis();
+        ZnetServer::Fiber::ptr f(new ZnetServer::Fiber([](){
+            recurse(0);
+        }, 16 * 1024));
+        f->swapIn();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ZNS_LOG_INFO(g_logger) << "overflow child killed by SIGSEGV="
+        << (WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+}
+
+int main() {
+    g_logger->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    test_reuse();
+    test_fiber_steady_state();
+    test_overflow();
+    return 0;
+}
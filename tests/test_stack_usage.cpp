@@ -0,0 +1,54 @@
+#include "../server/fiber.h"
+#include "../server/scheduler.h"
+#include "../server/config.h"
+#include "../server/log.h"
+#include "../server/stack_usage.h"
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+static int recurse(int depth) {
+    volatile char buf[1024];
+    buf[0] = (char)depth;
+    if(depth <= 0) {
+        return buf[0];
+    }
+    return recurse(depth - 1) + buf[0];
+}
+
+static void deep_entry() {
+    recurse(24);
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZnetServer::Config::Lookup<bool>("fiber.stack_watermark")->setValue(true);
+    ZnetServer::Fiber::GetThis();
+
+    // 不同入口分开统计
+    ZnetServer::Fiber::ptr shallow(new ZnetServer::Fiber([](){ recurse(2); }));
+    shallow->swapIn();
+    ZNS_LOG_INFO(g_logger) << "shallow used=" << shallow->getStackHighWatermark();
+
+    // 32KB的栈用掉超过75%，会打一条警告
+    ZnetServer::Fiber::ptr deep(new ZnetServer::Fiber(std::function<void()>(&deep_entry), 32 * 1024));
+    deep->swapIn();
+    ZNS_LOG_INFO(g_logger) << "deep used=" << deep->getStackHighWatermark();
+
+    // reset之后只重涂用过的部分，测量结果仍然准确
+    deep->reset([](){ recurse(4); });
+    deep->swapIn();
+    ZNS_LOG_INFO(g_logger) << "deep after reset used=" << deep->getStackHighWatermark();
+
+    // 调度器池化协程每次复用都会测量
+    {
+        ZnetServer::Scheduler sc(2, false, "su");
+        sc.start();
+        for(int i = 0; i < 1000; ++i) {
+            sc.schedule([i](){ recurse(i % 8); });
+        }
+        sleep(1);
+        sc.stop();
+    }
+    ZNS_LOG_INFO(g_logger) << "stack usage:" << std::endl << ZnetServer::StackUsage::ToString();
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "../server/task.h"
+#include "../server/log.h"
+#include <atomic>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+static ZnetServer::Task<int> Add(ZnetServer::Scheduler& sc, int a, int b) {
+    co_await ZnetServer::ScheduleOn(sc);
+    co_return a + b;
+}
+
+// Task等待Fiber: 在协程里做可以挂起的阻塞式工作
+static ZnetServer::Task<int> Compute(ZnetServer::Scheduler& sc) {
+    int x = co_await Add(sc, 1, 2);
+    int y = co_await ZnetServer::RunInFiber(sc, [&sc]() {
+        // 协程里阻塞式等待另一个Task，只Park当前协程
+        return ZnetServer::Await(Add(sc, 19, 20));
+    });
+    co_return x + y;
+}
+
+static std::atomic<int> s_done {0};
+
+static ZnetServer::Task<> Worker(ZnetServer::Scheduler& sc, int i) {
+    int v = co_await Add(sc, i, i);
+    if (v == 2 * i) {
+        ++s_done;
+    }
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZnetServer::Scheduler sc(2, false, "task");
+    sc.start();
+
+    // 普通线程等待Task
+    ZNS_LOG_INFO(g_logger) << "Compute=" << ZnetServer::Await(Compute(sc));
+
+    // Fiber等待Task，只挂起协程
+    std::atomic<int> fiber_result {0};
+    sc.schedule([&sc, &fiber_result]() {
+        fiber_result = ZnetServer::Await(Add(sc, 20, 22));
+    });
+
+    for (int i = 0; i < 10000; ++i) {
+        ZnetServer::Spawn(sc, Worker(sc, i));
+    }
+    sleep(1);
+    sc.stop();
+    ZNS_LOG_INFO(g_logger) << "fiber await=" << fiber_result << " spawned done=" << s_done;
+    return 0;
+}
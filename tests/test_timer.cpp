@@ -0,0 +1,157 @@
+#include "../server/scheduler.h"
+#include "../server/util.h"
+#include "../server/log.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+static ZnetServer::Logger::ptr g_logger = ZNS_LOG_ROOT();
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 跨越各层时间轮的单次定时器，统计触发的迟到时间
+void test_oneshot(ZnetServer::Scheduler& sc) {
+    const uint64_t delays[] = {0, 1, 5, 50, 255, 256, 300, 1000, 2500};
+    const int n = sizeof(delays) / sizeof(delays[0]);
+    std::atomic<int> fired {0};
+    std::atomic<int> early {0};
+    std::atomic<uint64_t> max_late {0};
+    for(int i = 0; i < n; ++i) {
+        uint64_t expect = ZnetServer::GetCurrentMS() + delays[i];
+        sc.addTimer(delays[i], [&, expect]() {
+            uint64_t now = ZnetServer::GetCurrentMS();
+            if(now < expect) {
+                ++early;
+            } else if(now - expect > max_late) {
+                max_late = now - expect;
+            }
+            ++fired;
+        });
+    }
+    while(fired < n) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "oneshot fired=" << fired << " early=" << early
+        << " max late(ms)=" << max_late;
+}
+
+// 循环定时器在回调里取消自己
+void test_recurring(ZnetServer::Scheduler& sc) {
+    std::atomic<int> count {0};
+    std::mutex mutex;
+    ZnetServer::Timer::ptr timer;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timer = sc.addTimer(10, [&]() {
+            if(++count == 5) {
+                std::lock_guard<std::mutex> lock(mutex);
+                timer->cancel();
+            }
+        }, true);
+    }
+    usleep(200 * 1000);
+    ZNS_LOG_INFO(g_logger) << "recurring count=" << count << " cancel again=" << timer->cancel();
+}
+
+// 条件对象释放后循环定时器自动失效
+void test_condition(ZnetServer::Scheduler& sc) {
+    std::atomic<int> count {0};
+    std::shared_ptr<int> cond = std::make_shared<int>(0);
+    ZnetServer::Timer::ptr timer = sc.addConditionTimer(5, [&count]() { ++count; }, cond, true);
+    usleep(50 * 1000);
+    cond.reset();
+    usleep(20 * 1000);
+    int after_release = count;
+    usleep(50 * 1000);
+    ZNS_LOG_INFO(g_logger) << "condition fired=" << (after_release > 0)
+        << " stopped=" << (count == after_release) << " cancel=" << timer->cancel();
+}
+
+// reset改短周期，refresh推迟
+void test_reset(ZnetServer::Scheduler& sc) {
+    std::atomic<uint64_t> fired_at {0};
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    ZnetServer::Timer::ptr a = sc.addTimer(5000, [&fired_at]() {
+        fired_at = ZnetServer::GetCurrentMS();
+    });
+    a->reset(20, true);
+    std::atomic<bool> b_fired {false};
+    ZnetServer::Timer::ptr b = sc.addTimer(30, [&b_fired]() { b_fired = true; });
+    usleep(20 * 1000);
+    b->refresh();
+    usleep(20 * 1000);
+    bool b_early = b_fired;
+    while(fired_at == 0 || !b_fired) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "reset fired after(ms)=" << fired_at - begin
+        << " refreshed fired early=" << b_early;
+}
+
+// 协程睡眠: 定时器到期时Unpark，等待期间不占用工作线程
+void test_fiber_sleep(ZnetServer::Scheduler& sc) {
+    const int n = 100;
+    std::atomic<int> done {0};
+    uint64_t begin = ZnetServer::GetCurrentMS();
+    for(int i = 0; i < n; ++i) {
+        sc.schedule([&sc, &done]() {
+            ZnetServer::Fiber::ptr self = ZnetServer::Fiber::GetThis();
+            std::atomic<bool> woke {false};
+            sc.addTimer(50, [self, &woke]() {
+                woke = true;
+                ZnetServer::Scheduler::Unpark(self);
+            });
+            while(!woke) {
+                ZnetServer::Scheduler::Park();
+            }
+            ++done;
+        });
+    }
+    while(done < n) {
+        usleep(1000);
+    }
+    ZNS_LOG_INFO(g_logger) << "fiber sleep done=" << done
+        << " elapsed(ms)=" << ZnetServer::GetCurrentMS() - begin;
+}
+
+// 大量连接超时: 添加、取消都是O(1)
+void test_many(ZnetServer::Scheduler& sc) {
+    const int n = 1000000;
+    std::atomic<int> fired {0};
+    std::vector<ZnetServer::Timer::ptr> timers;
+    timers.reserve(n);
+    double t0 = now_ns();
+    for(int i = 0; i < n; ++i) {
+        timers.push_back(sc.addTimer(1000 + rand() % 60000, [&fired]() { ++fired; }));
+    }
+    double t1 = now_ns();
+    int cancelled = 0;
+    for(auto& t : timers) {
+        cancelled += t->cancel();
+    }
+    double t2 = now_ns();
+    ZNS_LOG_INFO(g_logger) << "many timers=" << n << " add(ns)=" << (t1 - t0) / n
+        << " cancel(ns)=" << (t2 - t1) / n << " cancelled=" << cancelled
+        << " fired=" << fired << " has timer=" << sc.hasTimer();
+}
+
+int main() {
+    ZNS_LOG_NAME("system")->setLevel(ZnetServer::LogLevel::INFO);
+    ZNS_LOG_ROOT()->setLevel(ZnetServer::LogLevel::INFO);
+    ZnetServer::Scheduler sc(2, false, "timer");
+    sc.start();
+    test_oneshot(sc);
+    test_recurring(sc);
+    test_condition(sc);
+    test_reset(sc);
+    test_fiber_sleep(sc);
+    test_many(sc);
+    sc.stop();
+    return 0;
+}